@@ -0,0 +1,183 @@
+////////////////////////////////////////////////////////////////////////////////
+//  AccountManager.hpp
+//
+//
+//  Bitfinex REST API C++ client - several accounts, one client context
+//
+//
+//  AccountManager holds a BitfinexAPI client for every account (key pair).
+//  Clients are built from one ClientContext, so symbols and schemas are
+//  fetched and compiled once, and send requests through one transport
+//  (one set of connections) instead of a transport per account. Every
+//  account keeps its own keyed signer and nonce sequence, switching
+//  accounts has no setup cost.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// internal BitfinexAPI
+#include "BitfinexAPI.hpp"
+
+// namespaces
+using std::string;
+
+
+namespace BfxAPI
+{
+
+    class AccountManager
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        // transport is shared by all accounts, default is libcurl transport
+        // using context curl share
+        explicit AccountManager(const std::shared_ptr<const ClientContext>
+                                &context = BitfinexAPI::createContext(),
+                                const std::shared_ptr<Transport> &transport =
+                                nullptr):
+        context_(context),
+        transport_(transport ? transport : context->newTransport()),
+        connections_([context]
+        {
+            return std::unique_ptr<Connection>(
+                new Connection{context->newTransport()});
+        })
+        {}
+
+        AccountManager(const AccountManager&) = delete;
+        AccountManager& operator = (const AccountManager&) = delete;
+
+        ~AccountManager() { unregisterMetrics(); }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Accessors
+        ////////////////////////////////////////////////////////////////////////
+
+        const std::shared_ptr<const ClientContext>& getContext() const noexcept
+        { return context_; }
+
+        size_t size() const noexcept
+        { return accounts_.size(); }
+
+        bool isThreadSafe() const noexcept
+        { return threadSafe_; }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // Adds account, or replaces keys of existing one. Returned client
+        // stays valid until the account is removed.
+        BitfinexAPI& add(const string &name,
+                         const string &accessKey,
+                         const string &secretKey)
+        {
+            auto it = accounts_.find(name);
+            if (it != accounts_.end())
+            {
+                it->second.setKeys(accessKey, secretKey);
+                return it->second;
+            }
+
+            BitfinexAPI &api = accounts_.emplace(
+                std::piecewise_construct,
+                std::forward_as_tuple(name),
+                std::forward_as_tuple(context_, accessKey, secretKey,
+                                      transport_)).first->second;
+            if (threadSafe_)
+                api.setThreadSafe(true, threadTransport());
+            if (metricsRegistry_)
+                api.registerMetrics(*metricsRegistry_, name);
+            return api;
+        }
+
+        // Client of account, nullptr if there is no such account
+        BitfinexAPI* find(const string &name) noexcept
+        {
+            auto it = accounts_.find(name);
+            return it != accounts_.end() ? &it->second : nullptr;
+        }
+
+        bool remove(const string &name)
+        { return accounts_.erase(name) != 0; }
+
+        // Calls f(name, client) for every account
+        template <typename F>
+        void forEach(const F &f)
+        {
+            for (auto &account : accounts_)
+                f(account.first, account.second);
+        }
+
+        // Thread-safe mode of all accounts (see BitfinexAPI::setThreadSafe()).
+        // Every calling thread gets one transport shared by all accounts
+        // called from the thread. Accounts must not be added or removed
+        // while calls are in flight.
+        void setThreadSafe(bool enabled)
+        {
+            threadSafe_ = enabled;
+            for (auto &account : accounts_)
+                account.second.setThreadSafe(enabled, threadTransport());
+        }
+
+        // Registers all accounts, account name is the client label
+        void registerMetrics(MetricsRegistry &registry)
+        {
+            metricsRegistry_ = &registry;
+            for (auto &account : accounts_)
+                account.second.registerMetrics(registry, account.first);
+        }
+
+        void unregisterMetrics()
+        {
+            metricsRegistry_ = nullptr;
+            for (auto &account : accounts_)
+                account.second.unregisterMetrics();
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        struct Connection
+        {
+            std::shared_ptr<Transport> transport;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        std::shared_ptr<const ClientContext> context_;
+        // transport of all accounts
+        std::shared_ptr<Transport> transport_;
+        // per thread transports of all accounts in thread-safe mode
+        ContextPool<Connection> connections_;
+        bool threadSafe_ = false;
+        MetricsRegistry *metricsRegistry_ = nullptr;
+        // node based map, clients don't move when accounts are added
+        std::unordered_map<string, BitfinexAPI> accounts_;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        BitfinexAPI::TransportFactory threadTransport()
+        {
+            return [this] { return connections_.local().transport; };
+        }
+    };
+}
@@ -0,0 +1,57 @@
+////////////////////////////////////////////////////////////////////////////////
+//  Aligned.hpp
+//
+//
+//  Bitfinex REST API C++ client - over-aligned heap objects
+//
+//
+//  C++14 operator new doesn't honour alignment above alignof(max_align_t),
+//  so cache line aligned types (sharded counters, rate limiter buckets) are
+//  allocated with posix_memalign() when they have to live on heap.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <utility>
+
+
+namespace BfxAPI
+{
+
+    template <typename T>
+    struct AlignedDelete
+    {
+        void operator()(T *object) const noexcept
+        {
+            object->~T();
+            free(object);
+        }
+    };
+
+    template <typename T>
+    using AlignedPtr = std::unique_ptr<T, AlignedDelete<T>>;
+
+    template <typename T, typename... Args>
+    AlignedPtr<T> makeAligned(Args&&... args)
+    {
+        void *memory = nullptr;
+        const size_t alignment =
+        alignof(T) < sizeof(void*) ? sizeof(void*) : alignof(T);
+        if (posix_memalign(&memory, alignment, sizeof(T)))
+            throw std::bad_alloc();
+        try
+        {
+            return AlignedPtr<T>(new (memory) T(std::forward<Args>(args)...));
+        }
+        catch (...)
+        {
+            free(memory);
+            throw;
+        }
+    }
+}
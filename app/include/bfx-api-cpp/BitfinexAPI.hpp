@@ -25,11 +25,15 @@
 #pragma once
 
 // std
+#include <atomic>
 #include <chrono>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <regex>
 #include <unordered_set>
 #include <utility>
@@ -38,12 +42,51 @@
 // internal jsonutils
 #include "jsonutils.hpp"
 
+// internal Aligned
+#include "Aligned.hpp"
+
+// internal ClientContext
+#include "ClientContext.hpp"
+
+// internal ContextPool
+#include "ContextPool.hpp"
+
+// internal Executor
+#include "Executor.hpp"
+
+// internal Credentials
+#include "Credentials.hpp"
+
 // internal error
 #include "error.hpp"
 
 // internal HTTPRequest
 #include "HTTPRequest.hpp"
 
+// internal LatencyHistogram
+#include "LatencyHistogram.hpp"
+
+// internal Metrics
+#include "Metrics.hpp"
+
+// internal RateLimiter
+#include "RateLimiter.hpp"
+
+// internal ResponseCache
+#include "ResponseCache.hpp"
+
+// internal RetryPolicy
+#include "RetryPolicy.hpp"
+
+// internal Trace
+#include "Trace.hpp"
+
+// internal SingleFlight
+#include "SingleFlight.hpp"
+
+// internal SessionLog
+#include "SessionLog.hpp"
+
 // namespaces
 using std::cerr;
 using std::cout;
@@ -68,6 +111,13 @@ namespace BfxAPI
         static constexpr auto WITHDRAWAL_CONF_FILE_PATH = "withdraw.conf";
         #endif
 
+    public:
+
+        // Orders accepted by one /order/new/multi/ request
+        static constexpr size_t MAX_MULTI_ORDERS = 10;
+        // Resends of asynchronous request refused for nonce out of order
+        static constexpr unsigned NONCE_RETRIES = 3;
+
         ////////////////////////////////////////////////////////////////////////
         // Typedefs
         ////////////////////////////////////////////////////////////////////////
@@ -84,7 +134,63 @@ namespace BfxAPI
         using vOrders = vector<sOrder>;
         using vIds = vector<long long>;
 
-    public:
+        // Public endpoint response shared by coalesced requests
+        struct PublicResult
+        {
+            string response;
+            CURLcode curlStatusCode;
+            long httpStatusCode;
+            BfxClientErrors bfxApiStatusCode;
+        };
+        using PublicCoalescer = SingleFlight<PublicResult>;
+        using TransportFactory = std::function<std::shared_ptr<Transport>()>;
+
+        // Request built by endpoint method, see prepare()
+        struct PreparedRequest
+        {
+            bool post;
+            string path;
+            map<string, string> params; // GET query parameters
+            string payload;             // POST JSON payload
+            std::shared_ptr<NonceSequence> nonces; // POST nonces of API key
+
+            // Fresh nonce before repeating authenticated request
+            void renewNonce()
+            {
+                if (nonces)
+                    BitfinexAPI::renewNonce(payload, nonces->next());
+            }
+        };
+
+        // Authenticated request signed by caller, see OrderTemplate.hpp
+        struct SignedRequest
+        {
+            string path;
+            string payload;             // JSON payload
+            Transport::Header header;   // X-BFX-APIKEY, -PAYLOAD, -SIGNATURE
+            int64_t signing;            // payload building and signing [ns]
+        };
+
+        // Outcome of request sent by submit()
+        struct AsyncResult
+        {
+            string response;
+            CURLcode curlStatusCode;
+            long httpStatusCode;
+            BfxClientErrors bfxApiStatusCode;
+
+            bool hasApiError() const noexcept
+            { return bfxApiStatusCode != noError || curlStatusCode != CURLE_OK; }
+
+            // Bitfinex refuses nonce not greater than the last one of the
+            // key before executing the request, concurrent requests may
+            // arrive out of nonce order
+            bool nonceRejected() const noexcept
+            {
+                return curlStatusCode == CURLE_OK && httpStatusCode == 400 &&
+                       response.find("Nonce is too small") != string::npos;
+            }
+        };
 
         ////////////////////////////////////////////////////////////////////////
         // Constructor - Destructor
@@ -92,86 +198,105 @@ namespace BfxAPI
 
         explicit BitfinexAPI():BitfinexAPI("", "") {}
 
-        explicit BitfinexAPI(const string &accessKey, const string &secretKey):
+        // apiUrl allows to target local mock server or proxy, transport
+        // replaces default libcurl transport (e.g. FakeTransport or
+        // SessionReplayer) and is already used to fetch symbols
+        explicit BitfinexAPI(const string &accessKey,
+                             const string &secretKey,
+                             const string &apiUrl = API_URL,
+                             const std::shared_ptr<Transport> &transport =
+                             nullptr):
+        BitfinexAPI(createContext(apiUrl, transport), accessKey, secretKey,
+                    transport)
+        {}
+
+        // Cheap construction from context shared with other clients, no I/O
+        // and no schema setup
+        explicit BitfinexAPI(const std::shared_ptr<const ClientContext> &shared,
+                             const string &accessKey = "",
+                             const string &secretKey = "",
+                             const std::shared_ptr<Transport> &transport =
+                             nullptr):
         WDconfFilePath_(WITHDRAWAL_CONF_FILE_PATH),
-        Request(API_URL),
-        bfxApiStatusCode_(noError)
+        shared_(shared),
+        context_(shared->getApiUrl(),
+                 transport ? transport : shared->newTransport())
         {
             // Internal HTTPRequest set Keys
-            Request.setAccessKey(accessKey);
-            Request.setSecretKey(secretKey);
-
-            // populate _symbols directly from Bitfinex getSymbols endpoint
-            jsonutils::jsonStrToUset(symbols_, getSymbols().strResponse());
-
-            currencies_ =
-            {
-                "BTG",
-                "DSH",
-                "ETC",
-                "ETP",
-                "EUR",
-                "GBP",
-                "IOT",
-                "JPY",
-                "LTC",
-                "NEO",
-                "OMG",
-                "SAN",
-                "USD",
-                "XMR",
-                "XRP",
-                "ZEC"
-            };
-
-            schemaValidator_ = jsonutils::BfxSchemaValidator(symbols_, currencies_);
-
-            // As found on
-            // https://bitfinex.readme.io/v1/reference#rest-auth-deposit
-            methods_ =
-            {
-                "bcash"
-                "bitcoin",
-                "ethereum",
-                "ethereumc",
-                "ethereumc",
-                "litecoin",
-                "mastercoin",
-                "monero",
-                "tetheruso",
-                "zcash",
-            };
-
-            walletNames_ =
-            {
-                "trading", "exchange", "deposit"
-            };
-
-            // New order endpoint "type" parameter
-            types_ =
-            {
-                "market",
-                "limit",
-                "stop",
-                "trailing-stop",
-                "fill-or-kill",
-                "exchange market",
-                "exchange limit",
-                "exchange stop",
-                "exchange trailing-stop",
-                "exchange fill-or-kill"
-            };
+            setCredentials(accessKey, secretKey);
+            applyCredentials(context_);
+            observe(context_);
         }
 
         // BitfinexAPI object cannot be
         // copied
         BitfinexAPI(const BitfinexAPI&) = delete;
         BitfinexAPI& operator = (const BitfinexAPI&) = delete;
-        // moved
-        BitfinexAPI(BitfinexAPI&&) = delete;
-        BitfinexAPI& operator = (BitfinexAPI&&) = delete;
 
-        ~BitfinexAPI() { }
+        // Moved-from client can only be destroyed or assigned to. Per thread
+        // contexts of thread-safe client aren't moved, they are created
+        // again on first use. Pending asynchronous requests move with the
+        // client, their callbacks complete on the new one. Allocation
+        // failure while taking over thread-safe mode or metrics
+        // registration terminates.
+        BitfinexAPI(BitfinexAPI &&other) noexcept:
+        WDconfFilePath_(std::move(other.WDconfFilePath_)),
+        accessKey_(std::move(other.accessKey_)),
+        signer_(std::move(other.signer_)),
+        nonces_(std::move(other.nonces_)),
+        shared_(std::move(other.shared_)),
+        context_(std::move(other.context_)),
+        transportFactory_(std::move(other.transportFactory_)),
+        rateLimiter_(std::move(other.rateLimiter_)),
+        retrier_(std::move(other.retrier_)),
+        latencies_(std::move(other.latencies_)),
+        requestCounters_(std::move(other.requestCounters_)),
+        clientErrorCounters_(std::move(other.clientErrorCounters_)),
+        curlErrorCounters_(std::move(other.curlErrorCounters_)),
+        cache_(std::move(other.cache_)),
+        coalescer_(std::move(other.coalescer_)),
+        replayer_(std::move(other.replayer_)),
+        observers_(std::move(other.observers_)),
+        self_(std::move(other.self_))
+        { adopt(other); }
+
+        BitfinexAPI& operator = (BitfinexAPI &&other) noexcept
+        {
+            if (this == &other)
+                return *this;
+
+            unregisterMetrics();
+            WDconfFilePath_ = std::move(other.WDconfFilePath_);
+            accessKey_ = std::move(other.accessKey_);
+            signer_ = std::move(other.signer_);
+            nonces_ = std::move(other.nonces_);
+            shared_ = std::move(other.shared_);
+            context_ = std::move(other.context_);
+            pool_ = nullptr;
+            transportFactory_ = std::move(other.transportFactory_);
+            rateLimiter_ = std::move(other.rateLimiter_);
+            retrier_ = std::move(other.retrier_);
+            latencies_ = std::move(other.latencies_);
+            requestCounters_ = std::move(other.requestCounters_);
+            clientErrorCounters_ = std::move(other.clientErrorCounters_);
+            curlErrorCounters_ = std::move(other.curlErrorCounters_);
+            cache_ = std::move(other.cache_);
+            coalescer_ = std::move(other.coalescer_);
+            replayer_ = std::move(other.replayer_);
+            observers_ = std::move(other.observers_);
+            // requests of replaced context were dropped with it
+            self_->store(nullptr, std::memory_order_release);
+            self_ = std::move(other.self_);
+            adopt(other);
+            return *this;
+        }
+
+        ~BitfinexAPI()
+        {
+            unregisterMetrics();
+            if (self_)
+                self_->store(nullptr, std::memory_order_release);
+        }
 
         ////////////////////////////////////////////////////////////////////////
         // Accessors
@@ -182,27 +307,415 @@ namespace BfxAPI
         { return WDconfFilePath_; }
 
         const BfxClientErrors& getBfxApiStatusCode() const noexcept
-        { return bfxApiStatusCode_; }
+        { return context().bfxApiStatusCode; }
 
         const CURLcode getCurlStatusCode() const noexcept
-        { return Request.getLastStatusCode(); }
+        { return context().request.getLastStatusCode(); }
+
+        // HTTP status of the last response, 0 if none was received
+        long getHttpStatusCode() const noexcept
+        { return context().request.getLastHttpCode(); }
 
         const string strResponse() const noexcept
-        { return Request.getLastResponse(); }
+        { return context().request.getLastResponse(); }
 
         bool hasApiError()
         {
-            return (checkErrors() != noError || Request.hasError());
+            return (checkErrors() != noError || context().request.hasError());
         }
 
+        const ResponseCache& getCache() const noexcept
+        { return *cache_; }
+
+        RateLimiter& getRateLimiter() noexcept
+        { return *rateLimiter_; }
+
+        Retrier& getRetrier() noexcept
+        { return *retrier_; }
+
+        // Shared state, pass it to constructor of further clients
+        const std::shared_ptr<const ClientContext>& getContext() const noexcept
+        { return shared_; }
+
+        const EndpointLatencies& getLatencies() const noexcept
+        { return *latencies_; }
+
+        // Credentials for requests signed outside of client (OrderTemplate)
+        const string& getAccessKey() const noexcept
+        { return accessKey_; }
+
+        const std::shared_ptr<const HmacSigner>& getSigner() const noexcept
+        { return signer_; }
+
+        const std::shared_ptr<NonceSequence>& getNonces() const noexcept
+        { return nonces_; }
+
         // Setters
         void setWDconfFilePath(const string &path) noexcept
         { WDconfFilePath_ = path; }
 
-        void setKeys(const string &accessKey, const string &secretKey) noexcept
+        // Secret key is kept only as keyed HMAC signer. Nonces are shared
+        // with other clients using the same access key.
+        void setKeys(const string &accessKey, const string &secretKey)
+        {
+            setCredentials(accessKey, secretKey);
+            forEachContext([this](CallContext &ctx) { applyCredentials(ctx); });
+            // Cached authenticated responses belong to previous keys
+            cache_->invalidateAll();
+        }
+
+        // Replaces symbols fetched by constructor, e.g. with symbols parsed
+        // from recorded "/symbols/" response. Client gets its own copy of
+        // shared context, other clients of the context are not affected.
+        void setSymbols(const unordered_set<string> &symbols)
+        { shared_ = shared_->withSymbols(symbols); }
+
+        // Enables caching of slow changing endpoint responses
+        // ("/symbols_details/", "/account_fees/", "/key_info/", "/summary/").
+        // Zero ttl disables caching.
+        void setCacheTTL(const string &path,
+                         const std::chrono::milliseconds &ttl)
+        { cache_->setTTL(path, ttl); }
+
+        void invalidateCache(const string &path)
+        { cache_->invalidate(path); }
+
+        void invalidateCache()
+        { cache_->invalidateAll(); }
+
+        // Latencies can be shared by several BitfinexAPI instances to get
+        // aggregated histograms
+        void setLatencies(const std::shared_ptr<EndpointLatencies> &latencies)
+        noexcept
+        { if (latencies) latencies_ = latencies; }
+
+        // Adds collector of this client metrics to registry, client is used
+        // as label value to distinguish several clients in one registry.
+        // Client must be unregistered (or destroyed) before the registry.
+        void registerMetrics(MetricsRegistry &registry,
+                             const string &client = "default")
+        {
+            unregisterMetrics();
+            metricsRegistry_ = &registry;
+            metricsClient_ = client;
+            metricsId_ = registry.add([this, client](MetricsWriter &writer)
+            { collectMetrics(writer, client); });
+        }
+
+        void unregisterMetrics()
+        {
+            if (metricsRegistry_)
+                metricsRegistry_->remove(metricsId_);
+            metricsRegistry_ = nullptr;
+        }
+
+        // Coalescer can be shared by BitfinexAPI instances running in
+        // different threads. Identical concurrent public requests are then
+        // sent only once.
+        void setCoalescer(const std::shared_ptr<PublicCoalescer> &coalescer)
+        noexcept
+        { coalescer_ = coalescer; }
+
+        // Appends every subsequent HTTP exchange to session log, nullptr
+        // stops recording
+        void setRecorder(const std::shared_ptr<SessionRecorder> &recorder)
+        {
+            observers_->update([&recorder](ObserverSet &set)
+                               { set.recorder = recorder; });
+        }
+
+        // Calls observer after every HTTP exchange of every context, next
+        // to recorder and other observers (e.g. OrderCache). In thread-safe
+        // mode and with executor it is called from several threads. Can be
+        // called while requests run. Returns id for removeExchangeObserver().
+        uint64_t addExchangeObserver(const ExchangeObserver &observer)
+        {
+            uint64_t id = 0;
+            observers_->update([&](ObserverSet &set)
+            {
+                id = ++set.lastId;
+                set.observers[id] = observer;
+            });
+            return id;
+        }
+
+        // Exchanges completing after the call don't reach the observer,
+        // the ones already notifying other threads may still be calling it
+        void removeExchangeObserver(const uint64_t &id)
+        {
+            observers_->update([&id](ObserverSet &set)
+                               { set.observers.erase(id); });
+        }
+
+        // Transport must not be shared with clients running in other
+        // threads unless it is thread safe (CurlTransport is not). In
+        // thread-safe mode sets transport of calling thread context only.
+        void setTransport(const std::shared_ptr<Transport> &transport)
+        { context().request.setTransport(transport); }
+
+        const std::shared_ptr<Transport>& getTransport() const noexcept
+        { return context().request.getTransport(); }
+
+        // Serves requests from recorded session instead of network, nullptr
+        // restores previous transport. Symbols are reloaded from recorded
+        // "/symbols/" response if there is one.
+        void setReplayer(const std::shared_ptr<SessionReplayer> &replayer)
+        {
+            if (!replayer)
+            {
+                if (replayer_)
+                    forEachContext([this](CallContext &ctx)
+                    {
+                        ctx.request.setTransport(ctx.liveTransport
+                                                 ? ctx.liveTransport
+                                                 : newTransport());
+                        ctx.liveTransport = nullptr;
+                    });
+                replayer_ = nullptr;
+                return;
+            }
+            forEachContext([this, &replayer](CallContext &ctx)
+            {
+                if (!replayer_)
+                    ctx.liveTransport = ctx.request.getTransport();
+                ctx.request.setTransport(replayer);
+            });
+            replayer_ = replayer;
+
+            const string symbols = replayer->peek("/symbols/");
+            unordered_set<string> recorded;
+            if (!symbols.empty() &&
+                jsonutils::jsonStrToUset(recorded, symbols) == noError)
+                setSymbols(recorded);
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Thread safety
+        ////////////////////////////////////////////////////////////////////////
+
+        // In thread-safe mode every calling thread uses its own context
+        // (HTTPRequest with own transport, last response and status) leased
+        // from a pool, while symbols, schemas, keys, cache, rate limiter and
+        // metrics are shared. Results are read by the calling thread
+        // (strResponse(), hasApiError(), ...) as usual. Settings (keys,
+        // symbols, replayer) must not change while calls are in flight,
+        // recorder and observers can. transportFactory creates transport of
+        // every context, default is CurlTransport.
+        void setThreadSafe(bool enabled,
+                           const TransportFactory &transportFactory = nullptr)
+        {
+            transportFactory_ = transportFactory;
+            if (!enabled)
+            {
+                pool_ = nullptr;
+                return;
+            }
+            pool_.reset(new ContextPool<CallContext>([this]
+            {
+                std::unique_ptr<CallContext> ctx(
+                    new CallContext(shared_->getApiUrl(), replayer_ ? replayer_
+                                                       : newTransport()));
+                applyCredentials(*ctx);
+                observe(*ctx);
+                return ctx;
+            }));
+        }
+
+        bool isThreadSafe() const noexcept
+        { return pool_ != nullptr; }
+
+        // Returns context of calling thread to the pool, e.g. before worker
+        // thread exits
+        void releaseContext()
+        {
+            if (pool_)
+                pool_->release();
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Asynchronous requests
+        ////////////////////////////////////////////////////////////////////////
+
+        // Runs endpoint method, e.g.
+        // [](BitfinexAPI &api) { api.getTicker("btcusd"); },
+        // but captures its request instead of sending it. Returns false if
+        // there is nothing to send because the endpoint failed client-side
+        // validation or was served from cache, result then holds the final
+        // outcome.
+        template <typename Endpoint>
+        bool prepare(const Endpoint &endpoint,
+                     PreparedRequest &request,
+                     AsyncResult &result)
+        {
+            CallContext &ctx = context();
+            const auto requestId = ctx.request.getLastRequestId();
+            ctx.bfxApiStatusCode = noError;
+            ctx.checkedRequestId = requestId;
+            ctx.captured = false;
+            ctx.capture = &request;
+            try
+            {
+                endpoint(*this);
+            }
+            catch (...)
+            {
+                ctx.capture = nullptr;
+                throw;
+            }
+            ctx.capture = nullptr;
+            if (ctx.captured)
+                return true;
+
+            const bool cached = ctx.request.getLastRequestId() != requestId;
+            result = AsyncResult{cached ? strResponse() : string(), CURLE_OK,
+                                 cached ? getHttpStatusCode() : 0,
+                                 ctx.bfxApiStatusCode};
+            return false;
+        }
+
+        // Sends prepared request through transport asynchronous interface,
+        // callback is invoked from poll(). Rate limiting and retries are up
+        // to the caller (see RateLimiter::reserve(), Retrier::shouldRetry()).
+        // Client must outlive pending requests, it may be moved meanwhile.
+        void submit(const PreparedRequest &request,
+                    const std::function<void(AsyncResult&)> &callback)
+        {
+            auto done = [self = self_, callback](HttpExchange &exchange)
+            {
+                BitfinexAPI *api = self->load(std::memory_order_acquire);
+                if (!api)
+                    return;
+                AsyncResult result = api->finishAsync(exchange);
+                callback(result);
+            };
+            HTTPRequest &http = context().request;
+            if (request.post)
+                http.submitPost(request.path, request.payload, done);
+            else
+                http.submitGet(request.path, request.params, done);
+        }
+
+        // As above, but response validation and callback run on executor
+        // worker, poll() only hands completed responses over. Callbacks of
+        // different requests may run concurrently.
+        void submit(const PreparedRequest &request,
+                    const std::function<void(AsyncResult&)> &callback,
+                    Executor &executor)
+        {
+            auto done = [self = self_, callback, &executor]
+                        (HttpExchange &exchange)
+            {
+                auto completed =
+                std::make_shared<HttpExchange>(std::move(exchange));
+                executor.post([self, callback, completed]
+                {
+                    BitfinexAPI *api = self->load(std::memory_order_acquire);
+                    if (!api)
+                        return;
+                    AsyncResult result = api->finishAsync(*completed);
+                    callback(result);
+                });
+            };
+            HTTPRequest &http = context().request;
+            if (request.post)
+                http.submitPost(request.path, request.payload, done);
+            else
+                http.submitGet(request.path, request.params, done);
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Pre-signed requests
+        ////////////////////////////////////////////////////////////////////////
+
+        // Sends request signed by caller, result is read as after endpoint
+        // method. Returns false if request was not sent due to rate
+        // limiting. Not retried, repeated request needs fresh nonce and
+        // signature (see OrderTemplate::send()).
+        bool post(const SignedRequest &request)
+        {
+            if (!rateLimiter_->acquire(request.path))
+            {
+                setClientError(rateLimited);
+                return false;
+            }
+
+            HTTPRequest &http = context().request;
+            http.postSigned(request.path, request.payload, request.header,
+                            request.signing);
+            latencies_->record(request.path, http.getLastTimings());
+            countRequest(request.path, http.getLastStatusCode());
+            return true;
+        }
+
+        // Asynchronous variant of post(), see submit() above
+        void submit(const SignedRequest &request,
+                    const std::function<void(AsyncResult&)> &callback)
+        {
+            context().request.submitSigned(request.path, request.payload,
+                                           request.header,
+                                           [self = self_, callback]
+                                           (HttpExchange &exchange)
+            {
+                BitfinexAPI *api = self->load(std::memory_order_acquire);
+                if (!api)
+                    return;
+                AsyncResult result = api->finishAsync(exchange);
+                callback(result);
+            }, request.signing);
+        }
+
+        // Connects blocking POST requests of calling thread context ahead of
+        // time with a "/symbols/" request, so that first order doesn't pay
+        // for TCP and TLS handshakes
+        void warmUp()
+        {
+            if (rateLimiter_->acquire("/symbols/"))
+                context().request.warmUp("/symbols/");
+        }
+
+        // Drives submitted requests, waits up to timeout for progress.
+        // Returns number of completed requests.
+        size_t poll(const std::chrono::milliseconds &timeout =
+                    std::chrono::milliseconds(0))
+        { return context().request.poll(timeout); }
+
+        size_t pending() const
+        { return context().request.pending(); }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // Fetches symbols and compiles schemas once, the context can then
+        // be shared by any number of clients
+        static std::shared_ptr<const ClientContext>
+        createContext(const string &apiUrl = API_URL,
+                      const std::shared_ptr<Transport> &transport = nullptr)
+        {
+            auto curlShare = std::make_shared<CurlShare>();
+            HTTPRequest request(apiUrl,
+                                transport ? transport
+                                          : std::make_shared<CurlTransport>(
+                                                curlShare));
+            unordered_set<string> symbols;
+            const string response = request.get("/symbols/");
+            if (!request.hasError())
+                jsonutils::jsonStrToUset(symbols, response);
+            return std::make_shared<ClientContext>(apiUrl, symbols, curlShare);
+        }
+
+        static bool inArray(const string &value,
+                            const unordered_set<string> &inputSet) noexcept
+        { return (inputSet.find(value) != inputSet.cend()); };
+
+        // Same symbol and type checks as newOrder() does
+        BfxClientErrors checkOrder(const sOrder &order) const noexcept
         {
-            Request.setAccessKey(accessKey);
-            Request.setSecretKey(secretKey);
+            if (!inArray(order.symbol, shared_->getSymbols()))
+                return badSymbol;
+            if (!inArray(order.type, shared_->getTypes()))
+                return badOrderType;
+            return noError;
         }
 
         ////////////////////////////////////////////////////////////////////////
@@ -211,20 +724,20 @@ namespace BfxAPI
 
         BitfinexAPI& getTicker(const string &symbol)
         {
-            if (!inArray(symbol, symbols_))
-                bfxApiStatusCode_ = badSymbol;
+            if (!inArray(symbol, shared_->getSymbols()))
+                setClientError(badSymbol);
             else
-                Request.get("/pubticker/" + symbol);
+                publicGet("/pubticker/" + symbol);
 
             return *this;
         };
 
         BitfinexAPI& getStats(const string &symbol)
         {
-            if (!inArray(symbol, symbols_))
-                bfxApiStatusCode_ = badSymbol;
+            if (!inArray(symbol, shared_->getSymbols()))
+                setClientError(badSymbol);
             else
-                Request.get("/stats/" + symbol);
+                publicGet("/stats/" + symbol);
 
             return *this;
         };
@@ -233,14 +746,14 @@ namespace BfxAPI
                                     const unsigned &limit_bids = 50,
                                     const unsigned &limit_asks = 50)
         {
-            if (!inArray(currency, currencies_))
-                bfxApiStatusCode_ = badCurrency;
+            if (!inArray(currency, shared_->getCurrencies()))
+                setClientError(badCurrency);
             else
             {
                 map<string, string> params;
                 params["limit_bids"] = to_string(limit_bids);
                 params["limit_asks"] = to_string(limit_asks);
-                Request.get("/lendbook/" + currency, params);
+                publicGet("/lendbook/" + currency, params);
             }
 
             return *this;
@@ -251,15 +764,15 @@ namespace BfxAPI
                                   const unsigned &limit_asks = 50,
                                   const bool &group = true)
         {
-            if (!inArray(symbol, symbols_))
-                bfxApiStatusCode_ = badSymbol;
+            if (!inArray(symbol, shared_->getSymbols()))
+                setClientError(badSymbol);
             else
             {
                 map<string, string> params;
                 params["limit_bids"] = to_string(limit_bids);
                 params["limit_asks"] = to_string(limit_asks);
                 params["group"]      = to_string(group);
-                Request.get("/book/" + symbol, params);
+                publicGet("/book/" + symbol, params);
             }
 
             return *this;
@@ -269,14 +782,14 @@ namespace BfxAPI
                                const time_t &since = 0,
                                const unsigned &limit_trades = 50)
         {
-            if (!inArray(symbol, symbols_))
-                bfxApiStatusCode_ = badSymbol;
+            if (!inArray(symbol, shared_->getSymbols()))
+                setClientError(badSymbol);
             else
             {
                 map<string, string> params;
                 params["timestamp"]    = to_string(since);
                 params["limit_trades"] = to_string(limit_trades);
-                Request.get("/trades/" + symbol, params);
+                publicGet("/trades/" + symbol, params);
             }
 
             return *this;
@@ -286,14 +799,14 @@ namespace BfxAPI
                               const time_t &since = 0,
                               const unsigned &limit_lends = 50)
         {
-            if (!inArray(currency, currencies_))
-                bfxApiStatusCode_ = badCurrency;
+            if (!inArray(currency, shared_->getCurrencies()))
+                setClientError(badCurrency);
             else
             {
                 map<string, string> params;
                 params["timestamp"]   = to_string(since);
                 params["limit_lends"] = to_string(limit_lends);
-                Request.get("/lends/" + currency, params);
+                publicGet("/lends/" + currency, params);
             }
 
             return *this;
@@ -301,14 +814,18 @@ namespace BfxAPI
 
         BitfinexAPI& getSymbols()
         {
-            Request.get("/symbols/");
+            publicGet("/symbols/");
 
             return *this;
         };
 
         BitfinexAPI& getSymbolsDetails()
         {
-            Request.get("/symbols_details/");
+            if (fromCache("/symbols_details/"))
+                return *this;
+
+            publicGet("/symbols_details/");
+            toCache("/symbols_details/");
 
             return *this;
         };
@@ -321,29 +838,37 @@ namespace BfxAPI
         BitfinexAPI& getAccountInfo()
         {
             string params = "{\"request\":\"/v1/account_infos\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += "}";
-            Request.post("/account_infos/", params);
+            authPost("/account_infos/", params);
 
             return *this;
         };
 
         BitfinexAPI& getAccountFees()
         {
+            if (fromCache("/account_fees/"))
+                return *this;
+
             string params = "{\"request\":\"/v1/account_fees\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += "}";
-            Request.post("/account_fees/", params);
+            authPost("/account_fees/", params);
+            toCache("/account_fees/");
 
             return *this;
         };
 
         BitfinexAPI& getSummary()
         {
+            if (fromCache("/summary/"))
+                return *this;
+
             string params = "{\"request\":\"/v1/summary\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += "}";
-            Request.post("/summary/", params);
+            authPost("/summary/", params);
+            toCache("/summary/");
 
             return *this;
         };
@@ -352,29 +877,33 @@ namespace BfxAPI
                              const string &walletName,
                              const bool &renew = false)
         {
-            if (!inArray(method, methods_))
-            { bfxApiStatusCode_ = badDepositMethod; return *this; }
+            if (!inArray(method, shared_->getMethods()))
+            { setClientError(badDepositMethod); return *this; }
 
-            if (!inArray(walletName, walletNames_))
-            { bfxApiStatusCode_ = badWalletType; return *this; }
+            if (!inArray(walletName, shared_->getWalletNames()))
+            { setClientError(badWalletType); return *this; }
 
             string params = "{\"request\":\"/v1/deposit/new\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += ",\"method\":\"" + method + "\"";
             params += ",\"wallet_name\":\"" + walletName + "\"";
             params += ",\"renew\":" + to_string(renew);
             params += "}";
-            Request.post("/deposit/new/", params);
+            authPost("/deposit/new/", params);
 
             return *this;
         };
 
         BitfinexAPI& getKeyPermissions()
         {
+            if (fromCache("/key_info/"))
+                return *this;
+
             string params = "{\"request\":\"/v1/key_info\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += "}";
-            Request.post("/key_info/", params);
+            authPost("/key_info/", params);
+            toCache("/key_info/");
 
             return *this;
         };
@@ -382,9 +911,9 @@ namespace BfxAPI
         BitfinexAPI& getMarginInfos()
         {
             string params = "{\"request\":\"/v1/margin_infos\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += "}";
-            Request.post("/margin_infos/", params);
+            authPost("/margin_infos/", params);
 
             return *this;
         };
@@ -392,9 +921,9 @@ namespace BfxAPI
         BitfinexAPI& getBalances()
         {
             string params = "{\"request\":\"/v1/balances\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += "}";
-            Request.post("/balances/", params);
+            authPost("/balances/", params);
 
             return *this;
         };
@@ -404,21 +933,21 @@ namespace BfxAPI
                               const string &walletfrom,
                               const string &walletto)
         {
-            if (!inArray(currency, currencies_))
-            { bfxApiStatusCode_ = badCurrency; return *this; }
+            if (!inArray(currency, shared_->getCurrencies()))
+            { setClientError(badCurrency); return *this; }
 
-            if (!inArray(walletfrom, walletNames_) ||
-                !inArray(walletto, walletNames_))
-            { bfxApiStatusCode_ = badWalletType; return *this; }
+            if (!inArray(walletfrom, shared_->getWalletNames()) ||
+                !inArray(walletto, shared_->getWalletNames()))
+            { setClientError(badWalletType); return *this; }
 
             string params = "{\"request\":\"/v1/transfer\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += ",\"amount\":\"" + to_string(amount) + "\"";
             params += ",\"currency\":\"" + currency + "\"";
             params += ",\"walletfrom\":\"" + walletfrom + "\"";
             params += ",\"walletto\":\"" + walletto + "\"";
             params += "}";
-            Request.post("/transfer/", params);
+            authPost("/transfer/", params);
 
             return *this;
         };
@@ -427,16 +956,16 @@ namespace BfxAPI
         BitfinexAPI& withdraw()
         {
             string params = "{\"request\":\"/v1/withdraw\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
 
             // Add params from withdraw.conf
             BfxClientErrors code(parseWDconfParams(params));
             if (code != noError)
-                bfxApiStatusCode_ = code;
+                setClientError(code);
             else
             {
                 params += "}";
-                Request.post("/withdraw/", params);
+                authPost("/withdraw/", params);
             }
 
             return *this;
@@ -454,14 +983,14 @@ namespace BfxAPI
                               const bool &ocoorder = false,
                               const double &buy_price_oco = 0)
         {
-            if (!inArray(symbol, symbols_))
-            { bfxApiStatusCode_ = badSymbol; return *this; };
+            if (!inArray(symbol, shared_->getSymbols()))
+            { setClientError(badSymbol); return *this; };
 
-            if (!inArray(type, types_))
-            { bfxApiStatusCode_ = badOrderType; return *this; };
+            if (!inArray(type, shared_->getTypes()))
+            { setClientError(badOrderType); return *this; };
 
             string params = "{\"request\":\"/v1/order/new\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += ",\"symbol\":\"" + symbol + "\"";
             params += ",\"amount\":\"" + to_string(amount) + "\"";
             params += ",\"price\":\"" + to_string(price) + "\"";
@@ -474,32 +1003,42 @@ namespace BfxAPI
             params += ",\"buy_price_oco\":" + bool2string(buy_price_oco);
             params += "}";
 
-            Request.post("/order/new/", params);
+            authPost("/order/new/", params);
             return *this;
         };
 
+        // At most MAX_MULTI_ORDERS orders, see OrderBatch.hpp for more
         BitfinexAPI& newOrders(const vOrders &orders)
         {
-            string params = "{\"request\":\"/v1/order/new/multi\",\"nonce\":\""
-            + getTonce() + "\"";
+            if (orders.empty())
+            { setClientError(requiredParamsMissing); return *this; };
+
+            if (orders.size() > MAX_MULTI_ORDERS)
+            { setClientError(tooManyOrders); return *this; };
 
-            // Get pointer to last element in orders. We will not place
-            // ',' character at the end of the last loop.
-            auto &last = *(--orders.cend());
+            for (const auto &order : orders)
+            {
+                const BfxClientErrors code = checkOrder(order);
+                if (code != noError)
+                { setClientError(code); return *this; };
+            }
+
+            string params = "{\"request\":\"/v1/order/new/multi\",\"nonce\":\""
+            + nonce() + "\"";
 
             params += ",\"payload\":[";
             for (const auto &order : orders)
             {
+                if (&order != &orders.front())
+                    params += ",";
                 params += "{\"symbol\":\"" + order.symbol + "\"";
                 params += ",\"amount\":\"" + to_string(order.amount) + "\"";
                 params += ",\"price\":\"" + to_string(order.price) + "\"";
                 params += ",\"side\":\"" + order.side + "\"";
                 params += ",\"type\":\"" + order.type + "\"}";
-                if (&order != &last)
-                    params += ",";
             }
             params += "]}";
-            Request.post("/order/new/multi/", params);
+            authPost("/order/new/multi/", params);
 
             return *this;
         };
@@ -507,32 +1046,32 @@ namespace BfxAPI
         BitfinexAPI& cancelOrder(const long long &order_id)
         {
             string params = "{\"request\":\"/v1/order/cancel\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += ",\"order_id\":" + to_string(order_id);
             params += "}";
-            Request.post("/order/cancel/", params);
+            authPost("/order/cancel/", params);
 
             return *this;
         };
 
+        // See OrderBatch.hpp for cancelling many orders concurrently
         BitfinexAPI& cancelOrders(const vIds &vOrderIds)
         {
-            string params = "{\"request\":\"/v1/order/cancel/multi\",\"nonce\":\""
-            + getTonce() + "\"";
+            if (vOrderIds.empty())
+            { setClientError(requiredParamsMissing); return *this; };
 
-            // Get pointer to last element in vOrders. We will not place
-            // ',' character at the end of the last loop.
-            auto &last = *(--vOrderIds.cend());
+            string params = "{\"request\":\"/v1/order/cancel/multi\",\"nonce\":\""
+            + nonce() + "\"";
 
             params += ", \"order_ids\":[";
             for (const auto &order_id : vOrderIds)
             {
-                params += to_string(order_id);
-                if (&order_id != &last)
+                if (&order_id != &vOrderIds.front())
                     params += ",";
+                params += to_string(order_id);
             }
             params += "]}";
-            Request.post("/order/cancel/multi/", params);
+            authPost("/order/cancel/multi/", params);
 
             return *this;
         };
@@ -540,9 +1079,9 @@ namespace BfxAPI
         BitfinexAPI& cancelAllOrders()
         {
             string params = "{\"request\":\"/v1/order/cancel/all\",\"nonce\":\""
-            + getTonce() + "\"";
+            + nonce() + "\"";
             params += "}";
-            Request.post("/order/cancel/all/", params);
+            authPost("/order/cancel/all/", params);
 
             return *this;
         };
@@ -556,14 +1095,14 @@ namespace BfxAPI
                                   const bool &is_hidden = false,
                                   const bool &use_remaining = false)
         {
-            if (!inArray(symbol, symbols_))
-            { bfxApiStatusCode_ = badSymbol; return *this; };
+            if (!inArray(symbol, shared_->getSymbols()))
+            { setClientError(badSymbol); return *this; };
 
-            if (!inArray(type, types_))
-            { bfxApiStatusCode_ = badOrderType; return *this; };
+            if (!inArray(type, shared_->getTypes()))
+            { setClientError(badOrderType); return *this; };
 
             string params = "{\"request\":\"/v1/order/cancel/replace\",\"nonce\":\""
-            + getTonce() + "\"";
+            + nonce() + "\"";
             params += ",\"order_id\":" + to_string(order_id);
             params += ",\"symbol\":\"" + symbol + "\"";
             params += ",\"amount\":\"" + to_string(amount) + "\"";
@@ -573,7 +1112,7 @@ namespace BfxAPI
             params += ",\"is_hidden\":" + bool2string(is_hidden);
             params += ",\"use_all_available\":" + bool2string(use_remaining);
             params += "}";
-            Request.post("/order/cancel/replace/", params);
+            authPost("/order/cancel/replace/", params);
 
             return *this;
         };
@@ -581,10 +1120,10 @@ namespace BfxAPI
         BitfinexAPI& getOrderStatus(const long long &order_id)
         {
             string params = "{\"request\":\"/v1/order/status\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += ",\"order_id\":" + to_string(order_id);
             params += "}";
-            Request.post("/order/status/", params);
+            authPost("/order/status/", params);
 
             return *this;
         };
@@ -592,9 +1131,9 @@ namespace BfxAPI
         BitfinexAPI& getActiveOrders()
         {
             string params = "{\"request\":\"/v1/orders\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += "}";
-            Request.post("/orders/", params);
+            authPost("/orders/", params);
 
             return *this;
         };
@@ -602,10 +1141,10 @@ namespace BfxAPI
         BitfinexAPI& getOrdersHistory(const unsigned &limit = 50)
         {
             string params = "{\"request\":\"/v1/orders/hist\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += ",\"limit\":" + to_string(limit);
             params += "}";
-            Request.post("/orders/hist/", params);
+            authPost("/orders/hist/", params);
 
             return *this;
         };
@@ -615,9 +1154,9 @@ namespace BfxAPI
         BitfinexAPI& getActivePositions()
         {
             string params = "{\"request\":\"/v1/positions\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += "}";
-            Request.post("/positions/", params);
+            authPost("/positions/", params);
 
             return *this;
         };
@@ -626,11 +1165,11 @@ namespace BfxAPI
                                    const double &amount)
         {
             string params = "{\"request\":\"/v1/position/claim\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += ",\"position_id\":" + to_string(position_id);
             params += ",\"amount\":\"" + to_string(amount) + "\"";
             params += "}";
-            Request.post("/position/claim/", params);
+            authPost("/position/claim/", params);
 
             return *this;
         };
@@ -644,18 +1183,18 @@ namespace BfxAPI
                                        const string &walletType = "all")
         {
             // Is currency valid ?
-            if (!inArray(currency, currencies_))
-            { bfxApiStatusCode_ = badCurrency; return *this; };
+            if (!inArray(currency, shared_->getCurrencies()))
+            { setClientError(badCurrency); return *this; };
 
             // Is wallet type valid ?
             // Modified condition which accepts "all" value for all wallets
             // balances together.If "all" specified then there is simply no
             // wallet parameter in POST request.
-            if (!inArray(walletType, walletNames_) || walletType != "all")
-            { bfxApiStatusCode_ = badWalletType; return *this; };
+            if (!inArray(walletType, shared_->getWalletNames()) && walletType != "all")
+            { setClientError(badWalletType); return *this; };
 
             string params = "{\"request\":\"/v1/history\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += ",\"currency\":\"" + currency + "\"";
             params += ",\"since\":\"" + to_string(since) + "\"";
             params += ",\"until\":\"" + (!until ? getTonce() : to_string(until))
@@ -664,7 +1203,7 @@ namespace BfxAPI
             if (walletType != "all")
                 params += ",\"wallet\":\"" + walletType + "\"";
             params += "}";
-            Request.post("/history/", params);
+            authPost("/history/", params);
 
             return *this;
         };
@@ -675,14 +1214,14 @@ namespace BfxAPI
                                           const time_t &until = 0,
                                           const unsigned &limit = 500)
         {
-            if (!inArray(currency, currencies_))
-            { bfxApiStatusCode_ = badCurrency; return *this; };
+            if (!inArray(currency, shared_->getCurrencies()))
+            { setClientError(badCurrency); return *this; };
 
-            if (!inArray(method, methods_) && method != "wire" && method != "all")
-            { bfxApiStatusCode_ = badDepositMethod; return *this; };
+            if (!inArray(method, shared_->getMethods()) && method != "wire" && method != "all")
+            { setClientError(badDepositMethod); return *this; };
 
             string params = "{\"request\":\"/v1/history/movements\",\"nonce\":\""
-            + getTonce() + "\"";
+            + nonce() + "\"";
             params += ",\"currency\":\"" + currency + "\"";
             if (method != "all")
                 params += ",\"method\":\"" + method + "\"";
@@ -691,7 +1230,7 @@ namespace BfxAPI
             (!until ? getTonce() : to_string(until)) + "\"";
             params += ",\"limit\":" + to_string(limit);
             params += "}";
-            Request.post("/history/movements/", params);
+            authPost("/history/movements/", params);
 
             return *this;
         };
@@ -702,12 +1241,12 @@ namespace BfxAPI
                                    const unsigned &limit_trades = 500,
                                    const bool reverse = false)
         {
-            if (!inArray(symbol, symbols_))
-                bfxApiStatusCode_ = badSymbol;
+            if (!inArray(symbol, shared_->getSymbols()))
+                setClientError(badSymbol);
             else
             {
                 string params = "{\"request\":\"/v1/mytrades\",\"nonce\":\"" +
-                getTonce() + "\"";
+                nonce() + "\"";
                 params += ",\"symbol\":\"" + symbol + "\"";
                 params += ",\"timestamp\":\"" + to_string(timestamp) + "\"";
                 params += ",\"until\":\"" +
@@ -715,7 +1254,7 @@ namespace BfxAPI
                 params += ",\"limit_trades\":" + to_string(limit_trades);
                 params += ",\"reverse\":" + to_string(reverse);
                 params += "}";
-                Request.post("/mytrades/", params);
+                authPost("/mytrades/", params);
             }
 
             return *this;
@@ -728,19 +1267,19 @@ namespace BfxAPI
                               const unsigned &period,
                               const string &direction)
         {
-            if(!inArray(currency, currencies_))
-                bfxApiStatusCode_ = badCurrency;
+            if(!inArray(currency, shared_->getCurrencies()))
+                setClientError(badCurrency);
             else
             {
                 string params = "{\"request\":\"/v1/offer/new\",\"nonce\":\"" +
-                getTonce() + "\"";
+                nonce() + "\"";
                 params += ",\"currency\":\"" + currency + "\"";
                 params += ",\"amount\":\"" + to_string(amount) + "\"";
                 params += ",\"rate\":\"" + to_string(rate) + "\"";
                 params += ",\"period\":" + to_string(period);
                 params += ",\"direction\":\"" + direction + "\"";
                 params += "}";
-                Request.post("/offer/new/", params);
+                authPost("/offer/new/", params);
             }
 
             return  *this;
@@ -749,10 +1288,10 @@ namespace BfxAPI
         BitfinexAPI& cancelOffer(const long long &offer_id)
         {
             string params = "{\"request\":\"/v1/offer/cancel\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += ",\"offer_id\":" + to_string(offer_id);
             params += "}";
-            Request.post("/offer/cancel/", params);
+            authPost("/offer/cancel/", params);
 
             return *this;
         };
@@ -760,10 +1299,10 @@ namespace BfxAPI
         BitfinexAPI& getOfferStatus(const long long &offer_id)
         {
             string params = "{\"request\":\"/v1/offer/status\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += ",\"offer_id\":" + to_string(offer_id);
             params += "}";
-            Request.post("/offer/status/", params);
+            authPost("/offer/status/", params);
 
             return *this;
         };
@@ -771,9 +1310,9 @@ namespace BfxAPI
         BitfinexAPI& getActiveCredits()
         {
             string params = "{\"request\":\"/v1/credits\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += "}";
-            Request.post("/credits/", params);
+            authPost("/credits/", params);
 
             return *this;
         };
@@ -781,9 +1320,9 @@ namespace BfxAPI
         BitfinexAPI& getOffers()
         {
             string params = "{\"request\":\"/v1/offers\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += "}";
-            Request.post("/offers/", params);
+            authPost("/offers/", params);
 
             return *this;
         };
@@ -791,10 +1330,10 @@ namespace BfxAPI
         BitfinexAPI& getOffersHistory(const unsigned &limit)
         {
             string params = "{\"request\":\"/v1/offers/hist\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += ",\"limit\":" + to_string(limit);
             params += "}";
-            Request.post("/offers/hist/", params);
+            authPost("/offers/hist/", params);
 
             return *this;
         };
@@ -809,18 +1348,18 @@ namespace BfxAPI
                                           const unsigned &limit_trades = 50)
         {
             // Is currency valid ?
-            if(!inArray(currency, currencies_))
-                bfxApiStatusCode_ = badCurrency;
+            if(!inArray(currency, shared_->getCurrencies()))
+                setClientError(badCurrency);
             else
             {
                 string params = "{\"request\":\"/v1/mytrades_funding\",\"nonce\":\""
-                + getTonce() + "\"";
+                + nonce() + "\"";
                 // param inconsistency in BFX API, "symbol" should be currency
                 params += ",\"symbol\":\"" + currency + "\"";
                 params += ",\"until\":" + to_string(until);
                 params += ",\"limit_trades\":" + to_string(limit_trades);
                 params += "}";
-                Request.post("/mytrades_funding/", params);
+                authPost("/mytrades_funding/", params);
             }
 
             return *this;
@@ -829,9 +1368,9 @@ namespace BfxAPI
         BitfinexAPI& getTakenFunds()
         {
             string params = "{\"request\":\"/v1/taken_funds\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += "}";
-            Request.post("/taken_funds/", params);
+            authPost("/taken_funds/", params);
 
             return *this;
         };
@@ -839,9 +1378,9 @@ namespace BfxAPI
         BitfinexAPI& getUnusedTakenFunds()
         {
             string params = "{\"request\":\"/v1/unused_taken_funds\",\"nonce\":\""
-            + getTonce() + "\"";
+            + nonce() + "\"";
             params += "}";
-            Request.post("/unused_taken_funds/", params);
+            authPost("/unused_taken_funds/", params);
 
             return *this;
         };
@@ -849,9 +1388,9 @@ namespace BfxAPI
         BitfinexAPI& getTotalTakenFunds()
         {
             string params = "{\"request\":\"/v1/total_taken_funds\",\"nonce\":\""
-            + getTonce() + "\"";
+            + nonce() + "\"";
             params += "}";
-            Request.post("/total_taken_funds/", params);
+            authPost("/total_taken_funds/", params);
 
             return *this;
         };
@@ -859,10 +1398,10 @@ namespace BfxAPI
         BitfinexAPI& closeLoan(const long long &offer_id)
         {
             string params = "{\"request\":\"/v1/funding/close\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += ",\"swap_id\":" + to_string(offer_id);
             params += "}";
-            Request.post("/funding/close/", params);
+            authPost("/funding/close/", params);
 
             return *this;
         };
@@ -870,39 +1409,202 @@ namespace BfxAPI
         BitfinexAPI& closePosition(const long long &position_id)
         {
             string params = "{\"request\":\"/v1/position/close\",\"nonce\":\"" +
-            getTonce() + "\"";
+            nonce() + "\"";
             params += ",\"position_id\":" + to_string(position_id);
             params += "}";
-            Request.post("/position/close/", params);
+            authPost("/position/close/", params);
 
             return *this;
         };
 
     private:
 
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        // Mutable state of one call: request buffers, transport and status
+        struct CallContext
+        {
+            CallContext(const string &apiUrl,
+                        const std::shared_ptr<Transport> &transport):
+            request(apiUrl, transport)
+            {}
+
+            HTTPRequest request;
+            BfxClientErrors bfxApiStatusCode = noError;
+            unsigned long long checkedRequestId = -1ULL;
+            // payload building start, see nonce()
+            int64_t payloadStart = 0;
+            // endpoint request capture, see prepare()
+            PreparedRequest *capture = nullptr;
+            bool captured = false;
+            // transport replaced by replayer
+            std::shared_ptr<Transport> liveTransport;
+        };
+
+        struct ObserverSet
+        {
+            std::shared_ptr<SessionRecorder> recorder;
+            std::map<uint64_t, ExchangeObserver> observers;
+            uint64_t lastId = 0;
+        };
+
+        // Recorder and observers shared by all contexts. Writers publish a
+        // changed copy of the set, so observers can be added and removed
+        // while other threads notify the current one.
+        class Observers
+        {
+        public:
+
+            void notify(const HttpExchange &exchange) const
+            {
+                if (empty_.load(std::memory_order_acquire))
+                    return;
+
+                const auto set = std::atomic_load(&set_);
+                if (set->recorder)
+                    set->recorder->record(exchange);
+                for (const auto &observer : set->observers)
+                    observer.second(exchange);
+            }
+
+            template <typename F>
+            void update(const F &change)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto set = std::make_shared<ObserverSet>(*set_);
+                change(*set);
+                empty_.store(!set->recorder && set->observers.empty(),
+                             std::memory_order_release);
+                std::atomic_store(&set_,
+                                  std::shared_ptr<const ObserverSet>(
+                                      std::move(set)));
+            }
+
+        private:
+
+            std::mutex mutex_; // of writers
+            std::shared_ptr<const ObserverSet> set_ =
+            std::make_shared<const ObserverSet>();
+            std::atomic<bool> empty_{true};
+        };
+
         ////////////////////////////////////////////////////////////////////////
         // Private attributes
         ////////////////////////////////////////////////////////////////////////
 
-        // containers with supported parameters
-        unordered_set<string> symbols_; // valid symbol pairs
-        unordered_set<string> currencies_; // valid currencies
-        unordered_set<string> methods_; // valid deposit methods
-        unordered_set<string> walletNames_; // valid walletTypes
-        unordered_set<string> types_; // valid Types (see new order endpoint)
         // BitfinexAPI settings
         string WDconfFilePath_;
-        // internal jsonutils instances
-        jsonutils::BfxSchemaValidator schemaValidator_;
-        // internal HTTPRequest instance
-        HTTPRequest Request;
-        // dynamic and status variables
-        BfxClientErrors bfxApiStatusCode_;
+        string accessKey_;
+        std::shared_ptr<const HmacSigner> signer_;
+        std::shared_ptr<NonceSequence> nonces_;
+        // symbols, schemas and curl share of all clients of one context
+        std::shared_ptr<const ClientContext> shared_;
+        // internal HTTPRequest instance and status of the last call
+        CallContext context_;
+        // per thread contexts in thread-safe mode
+        std::unique_ptr<ContextPool<CallContext>> pool_;
+        TransportFactory transportFactory_;
+        // client-side endpoint rate limits
+        AlignedPtr<RateLimiter> rateLimiter_ = makeAligned<RateLimiter>();
+        // failed requests retries
+        std::unique_ptr<Retrier> retrier_{new Retrier()};
+        // per endpoint latency histograms
+        std::shared_ptr<EndpointLatencies> latencies_ =
+        std::make_shared<EndpointLatencies>();
+        // per thread sharded counters
+        static constexpr auto GROUPS = static_cast<size_t>(EndpointGroup::count);
+        AlignedPtr<ShardedCounters<GROUPS>> requestCounters_ =
+        makeAligned<ShardedCounters<GROUPS>>();
+        AlignedPtr<ShardedCounters<32>> clientErrorCounters_ =
+        makeAligned<ShardedCounters<32>>();
+        AlignedPtr<ShardedCounters<128>> curlErrorCounters_ =
+        makeAligned<ShardedCounters<128>>();
+        MetricsRegistry *metricsRegistry_ = nullptr;
+        size_t metricsId_ = 0;
+        string metricsClient_;
+        // slow changing endpoints cache
+        std::unique_ptr<ResponseCache> cache_{new ResponseCache()};
+        // shared public requests coalescer
+        std::shared_ptr<PublicCoalescer> coalescer_;
+        // session replay, recording and other exchange observers
+        std::shared_ptr<SessionReplayer> replayer_;
+        std::shared_ptr<Observers> observers_ = std::make_shared<Observers>();
+        // current address of the client, asynchronous callbacks resolve it
+        // when they complete, nullptr after destruction
+        std::shared_ptr<std::atomic<BitfinexAPI*>> self_ =
+        std::make_shared<std::atomic<BitfinexAPI*>>(this);
 
         ////////////////////////////////////////////////////////////////////////
         // Utility private methods
         ////////////////////////////////////////////////////////////////////////
 
+        // Takes over pending callbacks, thread-safe mode and metrics
+        // registration of moved-from client, all refer to the client by
+        // address
+        void adopt(BitfinexAPI &other)
+        {
+            self_->store(this, std::memory_order_release);
+            if (other.pool_)
+            {
+                other.pool_ = nullptr;
+                setThreadSafe(true, transportFactory_);
+            }
+            if (other.metricsRegistry_)
+            {
+                MetricsRegistry &registry = *other.metricsRegistry_;
+                const string client = other.metricsClient_;
+                other.unregisterMetrics();
+                registerMetrics(registry, client);
+            }
+        }
+
+        void setCredentials(const string &accessKey, const string &secretKey)
+        {
+            accessKey_ = accessKey;
+            signer_ = secretKey.empty()
+                      ? nullptr
+                      : std::make_shared<const HmacSigner>(secretKey);
+            nonces_ = NonceSequence::forKey(accessKey);
+        }
+
+        void applyCredentials(CallContext &ctx) const
+        {
+            ctx.request.setAccessKey(accessKey_);
+            ctx.request.setSigner(signer_);
+        }
+
+        // Context of calling thread in thread-safe mode, context_ otherwise
+        CallContext& context()
+        { return pool_ ? pool_->local() : context_; }
+
+        const CallContext& context() const
+        { return pool_ ? pool_->local() : context_; }
+
+        template <typename F>
+        void forEachContext(const F &f)
+        {
+            f(context_);
+            if (pool_)
+                pool_->forEach(f);
+        }
+
+        std::shared_ptr<Transport> newTransport() const
+        {
+            return transportFactory_ ? transportFactory_()
+                                     : std::make_shared<CurlTransport>();
+        }
+
+        // Attaches observers_ to new context, it stays attached when
+        // observers change
+        void observe(CallContext &ctx) const
+        {
+            const std::shared_ptr<Observers> observers = observers_;
+            ctx.request.setObserver([observers](const HttpExchange &exchange)
+                                    { observers->notify(exchange); });
+        }
+
         BfxClientErrors parseWDconfParams(string &params)
         {
             using std::getline;
@@ -953,7 +1655,7 @@ namespace BfxAPI
                     return wireParamsMissing;
                 }
             }
-            else if (inArray(mParams["withdraw_type"], methods_))
+            else if (inArray(mParams["withdraw_type"], shared_->getMethods()))
             {
                 if(!mParams.count("address"))
                 {
@@ -975,19 +1677,326 @@ namespace BfxAPI
         };
 
         BfxClientErrors checkErrors() {
-            bfxApiStatusCode_ = Request.hasError()
+            CallContext &ctx = context();
+            // Last response was already validated
+            if (ctx.checkedRequestId == ctx.request.getLastRequestId())
+                return ctx.bfxApiStatusCode;
+
+            // span keeps detail pointer until it ends
+            const string &path = ctx.request.getLastPath();
+            BFX_TRACE_SPAN("checkErrors", path.c_str());
+            ctx.bfxApiStatusCode = validate(path,
+                                            ctx.request.getLastResponse(),
+                                            ctx.request.getLastStatusCode());
+            ctx.checkedRequestId = ctx.request.getLastRequestId();
+            return ctx.bfxApiStatusCode;
+        }
+
+        BfxClientErrors validate(const string &path,
+                                 const string &response,
+                                 const CURLcode &curlCode)
+        {
+            jsonutils::SchemaTimings timings = {0, 0};
+            const BfxClientErrors code = curlCode != CURLE_OK
                 ? curlERR
-                : schemaValidator_.validateSchema(
-                    Request.getLastPath(),
-                    Request.getLastResponse()
-                );
-            return bfxApiStatusCode_;
+                : shared_->getSchemaValidator().validateSchema(path, response, &timings);
+            if (code != noError)
+                clientErrorCounters_->add(code);
+            if (curlCode == CURLE_OK)
+            {
+                latencies_->record(path, Phase::parse, timings.parse);
+                latencies_->record(path, Phase::validation, timings.validation);
+            }
+            return code;
+        }
+
+        AsyncResult finishAsync(HttpExchange &exchange)
+        {
+            latencies_->record(exchange.path, exchange.timings);
+            countRequest(exchange.path, exchange.curlCode);
+            AsyncResult result{std::move(exchange.response), exchange.curlCode,
+                               exchange.httpCode, noError};
+            result.bfxApiStatusCode = validate(exchange.path, result.response,
+                                               result.curlStatusCode);
+            return result;
+        }
+
+        // Serves path from cache_ if caching is enabled and response is fresh
+        bool fromCache(const string &path)
+        {
+            string response;
+            if (!cache_->lookup(path, response))
+                return false;
+
+            CallContext &ctx = context();
+            // only 2xx responses are stored, see toCache()
+            ctx.request.adoptResponse(path, response, CURLE_OK, 200);
+            ctx.bfxApiStatusCode = noError;
+            ctx.checkedRequestId = ctx.request.getLastRequestId();
+            return true;
+        }
+
+        // Authenticated cached endpoints have no schema, error body of
+        // failed request would pass validation
+        void toCache(const string &path)
+        {
+            const long httpCode = context().request.getLastHttpCode();
+            if (!context().capture && cache_->isEnabled(path) &&
+                httpCode >= 200 && httpCode < 300 && checkErrors() == noError)
+                cache_->store(path, context().request.getLastResponse());
+        }
+
+        // Records client-side error so that it is not overwritten by
+        // validation of previous response
+        void setClientError(const BfxClientErrors &code) noexcept
+        {
+            CallContext &ctx = context();
+            ctx.bfxApiStatusCode = code;
+            ctx.checkedRequestId = ctx.request.getLastRequestId();
+            clientErrorCounters_->add(code);
+        }
+
+        void countRequest(const string &path, const CURLcode &code) noexcept
+        {
+            requestCounters_->add(
+                static_cast<size_t>(RateLimiter::groupOf(path)));
+            if (code != CURLE_OK)
+                curlErrorCounters_->add(code);
+        }
+
+        void collectMetrics(MetricsWriter &w, const string &client) const
+        {
+            using Labels = MetricsWriter::Labels;
+
+            w.family("bfx_requests", "counter", "HTTP requests sent");
+            w.family("bfx_retries", "counter", "Repeated request attempts");
+            w.family("bfx_retry_failures", "counter",
+                     "Requests failed after last allowed attempt");
+            for (size_t i = 0; i < GROUPS; ++i)
+            {
+                const auto group = static_cast<EndpointGroup>(i);
+                const Labels labels =
+                {{"client", client}, {"group", endpointGroupName(group)}};
+                w.sample("bfx_requests", "_total", labels,
+                         requestCounters_->value(i));
+                w.sample("bfx_retries", "_total", labels,
+                         retrier_->retries(group));
+                w.sample("bfx_retry_failures", "_total", labels,
+                         retrier_->failures(group));
+            }
+
+            w.family("bfx_client_errors", "counter",
+                     "BfxClientErrors status codes");
+            for (size_t i = 1; i < clientErrorCounters_->size(); ++i)
+                if (clientErrorCounters_->value(i))
+                    w.sample("bfx_client_errors", "_total",
+                             {{"client", client},
+                              {"code", bfxClientErrorName(
+                                  static_cast<BfxClientErrors>(i))}},
+                             clientErrorCounters_->value(i));
+
+            w.family("bfx_curl_errors", "counter", "libcurl CURLcode errors");
+            for (size_t i = 1; i < curlErrorCounters_->size(); ++i)
+                if (curlErrorCounters_->value(i))
+                    w.sample("bfx_curl_errors", "_total",
+                             {{"client", client}, {"code", to_string(i)}},
+                             curlErrorCounters_->value(i));
+
+            w.family("bfx_rate_limited", "counter",
+                     "Requests refused by client-side rate limiter");
+            w.sample("bfx_rate_limited", "_total", {{"client", client}},
+                     rateLimiter_->rejected());
+            w.family("bfx_rate_limit_delayed", "counter",
+                     "Requests delayed by client-side rate limiter");
+            w.sample("bfx_rate_limit_delayed", "_total", {{"client", client}},
+                     rateLimiter_->delayed());
+
+            const auto cacheStats = cache_->getStats();
+            w.family("bfx_cache_hits", "counter", "Response cache hits");
+            w.sample("bfx_cache_hits", "_total", {{"client", client}},
+                     cacheStats.hits);
+            w.family("bfx_cache_misses", "counter", "Response cache misses");
+            w.sample("bfx_cache_misses", "_total", {{"client", client}},
+                     cacheStats.misses);
+
+            w.family("bfx_request_latency_seconds", "summary",
+                     "Request phase latency");
+            latencies_->forEach([&](const EndpointLatencies::Endpoint &e)
+            {
+                for (size_t p = 0; p < static_cast<size_t>(Phase::count); ++p)
+                {
+                    const LatencyHistogram &h = e.phases[p];
+                    if (!h.count())
+                        continue;
+                    const Labels labels =
+                    {
+                        {"client", client},
+                        {"endpoint", e.path},
+                        {"phase", phaseName(static_cast<Phase>(p))}
+                    };
+                    for (const char *q : {"0.5", "0.9", "0.99", "0.999"})
+                    {
+                        Labels quantile(labels);
+                        quantile.emplace_back("quantile", q);
+                        w.sample("bfx_request_latency_seconds", "", quantile,
+                                 h.percentile(atof(q)) / 1e9);
+                    }
+                    w.sample("bfx_request_latency_seconds", "_sum", labels,
+                             h.sum() / 1e9);
+                    w.sample("bfx_request_latency_seconds", "_count", labels,
+                             h.count());
+                }
+            });
+        }
+
+        void authPost(const string &path, const string &params)
+        {
+            CallContext &ctx = context();
+            if (ctx.payloadStart)
+            {
+                const int64_t now = steadyNowNs();
+                latencies_->record(path, Phase::payloadBuild,
+                                   now - ctx.payloadStart);
+                Tracer::complete("payload_build", ctx.payloadStart, now,
+                                 path.c_str());
+                ctx.payloadStart = 0;
+            }
+
+            if (ctx.capture)
+            {
+                *ctx.capture = PreparedRequest{true, path, {}, params, nonces_};
+                ctx.captured = true;
+                return;
+            }
+
+            BFX_TRACE_SPAN("authPost", path.c_str());
+
+            string payload(params);
+            for (unsigned attempt = 0; ; ++attempt)
+            {
+                if (!rateLimiter_->acquire(path))
+                {
+                    setClientError(rateLimited);
+                    return;
+                }
+
+                // acquire() may wait while other threads or clients of the
+                // key send later nonces, server rejects smaller ones. Fresh
+                // nonce also replaces reused one of repeated request.
+                renewNonce(payload, nonces_->next());
+                ctx.request.post(path, payload);
+                latencies_->record(path, ctx.request.getLastTimings());
+                countRequest(path, ctx.request.getLastStatusCode());
+                if (!retrier_->retry(path, attempt,
+                                    ctx.request.getLastStatusCode(),
+                                    ctx.request.getLastHttpCode()))
+                    return;
+            }
+        }
+
+        // Returns false if request was not sent due to rate limiting
+        bool getWithRetry(const string &path, const map<string, string> &params)
+        {
+            BFX_TRACE_SPAN("publicGet", path.c_str());
+            HTTPRequest &http = context().request;
+            for (unsigned attempt = 0; ; ++attempt)
+            {
+                if (!rateLimiter_->acquire(path))
+                {
+                    setClientError(rateLimited);
+                    return false;
+                }
+
+                http.get(path, params);
+                latencies_->record(path, http.getLastTimings());
+                countRequest(path, http.getLastStatusCode());
+                if (!retrier_->retry(path, attempt,
+                                    http.getLastStatusCode(),
+                                    http.getLastHttpCode()))
+                    return true;
+            }
+        }
+
+        void publicGet(const string &path, const map<string, string> &params = {})
+        {
+            CallContext &ctx = context();
+            if (ctx.capture)
+            {
+                *ctx.capture = PreparedRequest{false, path, params, "", nullptr};
+                ctx.captured = true;
+                return;
+            }
+
+            if (!coalescer_)
+            {
+                getWithRetry(path, params);
+                return;
+            }
+
+            // Coalescer may be shared by clients of different API urls
+            bool leader = false;
+            auto result = coalescer_->fetch(
+                shared_->getApiUrl() + path + "?" +
+                ctx.request.parseParams(params),
+                [&]
+                {
+                    leader = true;
+                    if (!getWithRetry(path, params))
+                        return PublicResult{string(), CURLE_OK, 0, rateLimited};
+                    return PublicResult{
+                        ctx.request.getLastResponse(),
+                        ctx.request.getLastStatusCode(),
+                        ctx.request.getLastHttpCode(),
+                        checkErrors()
+                    };
+                },
+                [](const PublicResult &result)
+                {
+                    // failures are not served for freshness window
+                    return result.curlStatusCode == CURLE_OK &&
+                           result.httpStatusCode >= 200 &&
+                           result.httpStatusCode < 300 &&
+                           result.bfxApiStatusCode == noError;
+                });
+
+            // Followers take over response, its HTTP status and validation
+            // status
+            if (!leader)
+            {
+                ctx.request.adoptResponse(path, result->response,
+                                          result->curlStatusCode,
+                                          result->httpStatusCode);
+                ctx.bfxApiStatusCode = result->bfxApiStatusCode;
+                ctx.checkedRequestId = ctx.request.getLastRequestId();
+            }
         }
 
         ////////////////////////////////////////////////////////////////////////
         // Utility private static methods
         ////////////////////////////////////////////////////////////////////////
 
+        // Nonce of authenticated request payload, marks start of payload
+        // building
+        string nonce()
+        {
+            BFX_TRACE_SPAN("nonce");
+            context().payloadStart = steadyNowNs();
+            return nonces_->next();
+        }
+
+        // Replaces nonce value in JSON payload with fresh one
+        static void renewNonce(string &payload, const string &nonce)
+        {
+            static const string key = "\"nonce\":\"";
+            const auto begin = payload.find(key);
+            if (begin == string::npos)
+                return;
+
+            const auto valueBegin = begin + key.size();
+            const auto valueEnd = payload.find('"', valueBegin);
+            payload.replace(valueBegin, valueEnd - valueBegin, nonce);
+        }
+
         const static string bool2string(const bool &in) noexcept
         { return in ? "true" : "false"; };
 
@@ -1000,9 +2009,5 @@ namespace BfxAPI
 
             return to_string(ms.count());
         };
-
-        static bool inArray(const string &value,
-                            const unordered_set<string> &inputSet) noexcept
-        { return (inputSet.find(value) != inputSet.cend()); };
     };
 }
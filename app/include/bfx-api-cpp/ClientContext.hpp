@@ -0,0 +1,176 @@
+////////////////////////////////////////////////////////////////////////////////
+//  ClientContext.hpp
+//
+//
+//  Bitfinex REST API C++ client - state shared by clients
+//
+//
+//  ClientContext holds immutable heavyweight state of BitfinexAPI clients:
+//  API url, valid symbols and other parameter sets, compiled JSON schemas
+//  and libcurl share handle. It is built once (see
+//  BitfinexAPI::createContext()) and shared read-only by any number of
+//  clients and threads, constructing a client from existing context does
+//  no I/O and no schema setup.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+// internal jsonutils
+#include "jsonutils.hpp"
+
+// internal Transport
+#include "Transport.hpp"
+
+// namespaces
+using std::string;
+using std::unordered_set;
+
+
+namespace BfxAPI
+{
+
+    class ClientContext
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        ClientContext(const string &apiUrl,
+                      const unordered_set<string> &symbols,
+                      const std::shared_ptr<CurlShare> &curlShare =
+                      std::make_shared<CurlShare>()):
+        apiUrl_(apiUrl),
+        symbols_(symbols),
+        curlShare_(curlShare)
+        {
+            currencies_ =
+            {
+                "BTG",
+                "DSH",
+                "ETC",
+                "ETP",
+                "EUR",
+                "GBP",
+                "IOT",
+                "JPY",
+                "LTC",
+                "NEO",
+                "OMG",
+                "SAN",
+                "USD",
+                "XMR",
+                "XRP",
+                "ZEC"
+            };
+
+            schemaValidator_.reset(
+                new jsonutils::BfxSchemaValidator(symbols_, currencies_));
+
+            // As found on
+            // https://bitfinex.readme.io/v1/reference#rest-auth-deposit
+            methods_ =
+            {
+                "bcash"
+                "bitcoin",
+                "ethereum",
+                "ethereumc",
+                "ethereumc",
+                "litecoin",
+                "mastercoin",
+                "monero",
+                "tetheruso",
+                "zcash",
+            };
+
+            walletNames_ =
+            {
+                "trading", "exchange", "deposit"
+            };
+
+            // New order endpoint "type" parameter
+            types_ =
+            {
+                "market",
+                "limit",
+                "stop",
+                "trailing-stop",
+                "fill-or-kill",
+                "exchange market",
+                "exchange limit",
+                "exchange stop",
+                "exchange trailing-stop",
+                "exchange fill-or-kill"
+            };
+        }
+
+        ClientContext(const ClientContext&) = delete;
+        ClientContext& operator = (const ClientContext&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Accessors
+        ////////////////////////////////////////////////////////////////////////
+
+        const string& getApiUrl() const noexcept
+        { return apiUrl_; }
+
+        const unordered_set<string>& getSymbols() const noexcept
+        { return symbols_; }
+
+        const unordered_set<string>& getCurrencies() const noexcept
+        { return currencies_; }
+
+        const unordered_set<string>& getMethods() const noexcept
+        { return methods_; }
+
+        const unordered_set<string>& getWalletNames() const noexcept
+        { return walletNames_; }
+
+        const unordered_set<string>& getTypes() const noexcept
+        { return types_; }
+
+        const jsonutils::BfxSchemaValidator& getSchemaValidator() const
+        noexcept
+        { return *schemaValidator_; }
+
+        const std::shared_ptr<CurlShare>& getCurlShare() const noexcept
+        { return curlShare_; }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// libcurl transport using shared DNS cache and TLS sessions
+        std::shared_ptr<Transport> newTransport() const
+        { return std::make_shared<CurlTransport>(curlShare_); }
+
+        /// Copy with different symbols, sharing url and curl share
+        std::shared_ptr<const ClientContext>
+        withSymbols(const unordered_set<string> &symbols) const
+        { return std::make_shared<ClientContext>(apiUrl_, symbols, curlShare_); }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        string apiUrl_;
+        // containers with supported parameters
+        unordered_set<string> symbols_; // valid symbol pairs
+        unordered_set<string> currencies_; // valid currencies
+        unordered_set<string> methods_; // valid deposit methods
+        unordered_set<string> walletNames_; // valid walletTypes
+        unordered_set<string> types_; // valid Types (see new order endpoint)
+        // compiled schemas of all endpoints
+        std::unique_ptr<jsonutils::BfxSchemaValidator> schemaValidator_;
+        std::shared_ptr<CurlShare> curlShare_;
+    };
+}
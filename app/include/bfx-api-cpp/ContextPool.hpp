@@ -0,0 +1,185 @@
+////////////////////////////////////////////////////////////////////////////////
+//  ContextPool.hpp
+//
+//
+//  Bitfinex REST API C++ client - per thread call contexts
+//
+//
+//  ContextPool leases one context to every calling thread. The context stays
+//  bound to the thread, so results of the last call can be read after the
+//  call returns, until the thread releases it back to the pool. Lookup of
+//  the bound context is a thread local cache hit in the common case, the
+//  pool mutex is taken only on the first use by a thread. The cache keeps
+//  contexts of several pools, so threads alternating between clients keep
+//  hitting it.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+namespace BfxAPI
+{
+
+    template <typename Context>
+    class ContextPool
+    {
+    public:
+
+        using Factory = std::function<std::unique_ptr<Context>()>;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        explicit ContextPool(const Factory &factory):
+        factory_(factory),
+        id_(nextId())
+        {}
+
+        ContextPool(const ContextPool&) = delete;
+        ContextPool& operator = (const ContextPool&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Context bound to calling thread, taken from free contexts or
+        /// created on first use
+        Context& local()
+        {
+            Cache &cache = threadCache();
+            for (const auto &entry : cache.entries)
+                if (entry.pool == id_)
+                    return *entry.context;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            Context *&bound = bound_[std::this_thread::get_id()];
+            if (!bound)
+            {
+                if (free_.empty())
+                {
+                    contexts_.push_back(factory_());
+                    bound = contexts_.back().get();
+                }
+                else
+                {
+                    bound = free_.back();
+                    free_.pop_back();
+                }
+            }
+            cache.store(id_, bound);
+            return *bound;
+        }
+
+        /// Returns context of calling thread to the pool, e.g. before the
+        /// thread exits
+        void release()
+        {
+            for (auto &entry : threadCache().entries)
+                if (entry.pool == id_)
+                    entry = CacheEntry();
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = bound_.find(std::this_thread::get_id());
+            if (it == bound_.end())
+                return;
+            free_.push_back(it->second);
+            bound_.erase(it);
+        }
+
+        /// Applies f to every context (bound or free), e.g. to change
+        /// settings. Contexts must not be in use by other threads.
+        template <typename F>
+        void forEach(const F &f)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto &context : contexts_)
+                f(*context);
+        }
+
+        size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return contexts_.size();
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Class constants
+        ////////////////////////////////////////////////////////////////////////
+
+        static constexpr size_t CACHE_SIZE = 8;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        // Context bound to thread by pool, pool ids are never reused so
+        // a stale entry of destroyed pool can't match
+        struct CacheEntry
+        {
+            uint64_t pool = 0;
+            Context *context = nullptr;
+        };
+
+        // Last pools used by thread, shared by all pools of Context type
+        struct Cache
+        {
+            std::array<CacheEntry, CACHE_SIZE> entries;
+            size_t victim = 0;
+
+            // Takes free entry, or evicts entries round-robin
+            void store(const uint64_t &pool, Context *context) noexcept
+            {
+                for (auto &entry : entries)
+                    if (!entry.pool)
+                    {
+                        entry = CacheEntry{pool, context};
+                        return;
+                    }
+                entries[victim] = CacheEntry{pool, context};
+                victim = (victim + 1) % CACHE_SIZE;
+            }
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        Factory factory_;
+        const uint64_t id_;
+        mutable std::mutex mutex_;
+        std::vector<std::unique_ptr<Context>> contexts_;
+        std::vector<Context*> free_;
+        std::unordered_map<std::thread::id, Context*> bound_;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static Cache& threadCache()
+        {
+            static thread_local Cache cache;
+            return cache;
+        }
+
+        static uint64_t nextId() noexcept
+        {
+            static std::atomic<uint64_t> id{0};
+            return ++id;
+        }
+    };
+}
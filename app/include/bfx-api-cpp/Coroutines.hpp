@@ -0,0 +1,643 @@
+////////////////////////////////////////////////////////////////////////////////
+//  Coroutines.hpp
+//
+//
+//  Bitfinex REST API C++ client - C++20 coroutine interface
+//
+//
+//  AsyncBitfinexAPI offers awaitable variant of every BitfinexAPI endpoint
+//  (getTickerAsync(), newOrderAsync(), ...). Requests are sent through the
+//  asynchronous interface of client transport (curl multi by default) and
+//  single EventLoop thread drives any number of concurrent request flows.
+//
+//      BfxAPI::EventLoop loop;
+//      BfxAPI::AsyncBitfinexAPI api(client, loop);
+//      loop.spawn([](BfxAPI::AsyncBitfinexAPI &api) -> BfxAPI::Task<>
+//      {
+//          co_await api.cancelAllOrdersAsync();
+//          auto order = co_await api.newOrderAsync("btcusd", 0.01, 983, ...);
+//          if (!order.hasApiError())
+//              ...
+//      }(api));
+//      loop.run();
+//
+//  Compiled only with coroutine support (-std=c++20).
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#if defined(__cpp_impl_coroutine)
+
+// std
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// BitfinexAPI
+#include "BitfinexAPI.hpp"
+
+
+namespace BfxAPI
+{
+
+    template <typename T = void>
+    class Task;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Task
+    ////////////////////////////////////////////////////////////////////////////
+
+    struct TaskPromiseBase
+    {
+        // Resumes awaiting coroutine when the task finishes
+        struct FinalAwaiter
+        {
+            bool await_ready() const noexcept
+            { return false; }
+
+            template <typename Promise>
+            std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<Promise> handle) noexcept
+            {
+                auto continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        std::suspend_always initial_suspend() const noexcept
+        { return {}; }
+
+        FinalAwaiter final_suspend() const noexcept
+        { return {}; }
+
+        void unhandled_exception() noexcept
+        { error = std::current_exception(); }
+
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+    };
+
+    template <typename T>
+    struct TaskPromise: TaskPromiseBase
+    {
+        Task<T> get_return_object() noexcept;
+
+        void return_value(T inValue)
+        { value = std::move(inValue); }
+
+        T result()
+        {
+            if (error)
+                std::rethrow_exception(error);
+            return std::move(*value);
+        }
+
+        std::optional<T> value;
+    };
+
+    template <>
+    struct TaskPromise<void>: TaskPromiseBase
+    {
+        Task<void> get_return_object() noexcept;
+
+        void return_void() const noexcept {}
+
+        void result()
+        {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    };
+
+    /// Lazily started coroutine, runs when awaited (or spawned on EventLoop)
+    template <typename T>
+    class [[nodiscard]] Task
+    {
+    public:
+
+        using promise_type = TaskPromise<T>;
+        using Handle = std::coroutine_handle<promise_type>;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        explicit Task(Handle handle) noexcept:
+        handle_(handle)
+        {}
+
+        Task(Task &&other) noexcept:
+        handle_(std::exchange(other.handle_, {}))
+        {}
+
+        Task& operator = (Task &&other) noexcept
+        {
+            if (this != &other)
+            {
+                if (handle_)
+                    handle_.destroy();
+                handle_ = std::exchange(other.handle_, {});
+            }
+            return *this;
+        }
+
+        Task(const Task&) = delete;
+        Task& operator = (const Task&) = delete;
+
+        ~Task()
+        {
+            if (handle_)
+                handle_.destroy();
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Awaitable
+        ////////////////////////////////////////////////////////////////////////
+
+        bool await_ready() const noexcept
+        { return !handle_ || handle_.done(); }
+
+        std::coroutine_handle<>
+        await_suspend(std::coroutine_handle<> awaiting) noexcept
+        {
+            handle_.promise().continuation = awaiting;
+            return handle_;
+        }
+
+        T await_resume()
+        { return handle_.promise().result(); }
+
+    private:
+
+        Handle handle_;
+    };
+
+    template <typename T>
+    inline Task<T> TaskPromise<T>::get_return_object() noexcept
+    { return Task<T>(Task<T>::Handle::from_promise(*this)); }
+
+    inline Task<void> TaskPromise<void>::get_return_object() noexcept
+    { return Task<void>(Task<void>::Handle::from_promise(*this)); }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Event loop
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Single threaded scheduler of coroutines, timers and transport polling
+    class EventLoop
+    {
+        static constexpr auto MAX_WAIT = std::chrono::milliseconds(100);
+
+    public:
+
+        // I/O source polled by the loop (e.g. client transport)
+        struct Source
+        {
+            std::function<size_t(const std::chrono::milliseconds&)> poll;
+            std::function<size_t()> pending;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        EventLoop() = default;
+        EventLoop(const EventLoop&) = delete;
+        EventLoop& operator = (const EventLoop&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Queues coroutine to be resumed by the next loop iteration
+        void schedule(std::coroutine_handle<> handle)
+        { ready_.push_back(handle); }
+
+        /// Awaitable suspending the coroutine for duration
+        auto sleep(const std::chrono::nanoseconds &duration)
+        {
+            struct Awaiter
+            {
+                EventLoop &loop;
+                int64_t deadline;
+
+                bool await_ready() const noexcept
+                { return deadline <= steadyNowNs(); }
+
+                void await_suspend(std::coroutine_handle<> handle)
+                { loop.timers_.push(Timer{deadline, loop.timerSeq_++, handle}); }
+
+                void await_resume() const noexcept {}
+            };
+            return Awaiter{*this, steadyNowNs() + duration.count()};
+        }
+
+        /// Starts detached task, the loop keeps running until it completes
+        void spawn(Task<void> task)
+        {
+            ++active_;
+            detach(*this, std::move(task));
+        }
+
+        /// Runs the loop until task completes and returns its result
+        template <typename T>
+        T runUntilComplete(Task<T> task)
+        {
+            std::optional<Task<T>> holder(std::move(task));
+            bool done = false;
+            spawn(complete(*holder, done));
+            while (!done && step()) {}
+            return holder->await_resume();
+        }
+
+        /// Runs until all spawned tasks complete. Returns early if remaining
+        /// tasks wait for nothing the loop drives.
+        void run()
+        {
+            while (active_ && step()) {}
+        }
+
+        size_t addSource(const Source &source)
+        {
+            sources_.emplace_back(nextSourceId_, source);
+            return nextSourceId_++;
+        }
+
+        void removeSource(const size_t &id)
+        {
+            for (auto it = sources_.begin(); it != sources_.end(); ++it)
+                if (it->first == id)
+                {
+                    sources_.erase(it);
+                    return;
+                }
+        }
+
+        /// Number of spawned tasks not completed yet
+        size_t active() const noexcept
+        { return active_; }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        struct Timer
+        {
+            int64_t deadline;
+            uint64_t seq;
+            std::coroutine_handle<> handle;
+
+            // Earliest deadline on top of priority queue
+            bool operator < (const Timer &other) const noexcept
+            {
+                return deadline != other.deadline ? deadline > other.deadline
+                                                  : seq > other.seq;
+            }
+        };
+
+        struct Detached
+        {
+            struct promise_type
+            {
+                Detached get_return_object() const noexcept
+                { return {}; }
+
+                std::suspend_never initial_suspend() const noexcept
+                { return {}; }
+
+                std::suspend_never final_suspend() const noexcept
+                { return {}; }
+
+                void return_void() const noexcept {}
+
+                void unhandled_exception() const noexcept {}
+            };
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        std::deque<std::coroutine_handle<>> ready_;
+        std::priority_queue<Timer> timers_;
+        uint64_t timerSeq_ = 0;
+        std::vector<std::pair<size_t, Source>> sources_;
+        size_t nextSourceId_ = 0;
+        size_t active_ = 0;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // One iteration: ready coroutines, expired timers, I/O. Returns
+        // false if there is nothing left that could make progress.
+        bool step()
+        {
+            for (size_t n = ready_.size(); n; --n)
+            {
+                auto handle = ready_.front();
+                ready_.pop_front();
+                handle.resume();
+            }
+
+            const int64_t now = steadyNowNs();
+            while (!timers_.empty() && timers_.top().deadline <= now)
+            {
+                ready_.push_back(timers_.top().handle);
+                timers_.pop();
+            }
+
+            std::chrono::nanoseconds wait(0);
+            if (ready_.empty())
+            {
+                wait = MAX_WAIT;
+                if (!timers_.empty())
+                    wait = std::min(wait, std::chrono::nanoseconds(
+                        timers_.top().deadline - now));
+            }
+
+            size_t busy = 0;
+            for (const auto &source : sources_)
+                if (source.second.pending())
+                    ++busy;
+
+            if (!busy)
+            {
+                if (ready_.empty() && timers_.empty())
+                    return false;
+                if (wait.count() > 0)
+                    std::this_thread::sleep_for(wait);
+                return true;
+            }
+
+            // Block in transport only if it is the single busy source
+            const auto timeout = busy == 1
+                ? std::chrono::ceil<std::chrono::milliseconds>(wait)
+                : std::chrono::milliseconds(0);
+            size_t completed = 0;
+            for (const auto &source : sources_)
+                if (source.second.pending())
+                    completed += source.second.poll(timeout);
+            if (busy > 1 && !completed && ready_.empty())
+                std::this_thread::sleep_for(std::min(
+                    wait, std::chrono::nanoseconds(std::chrono::milliseconds(1))));
+            return true;
+        }
+
+        static Detached detach(EventLoop &loop, Task<void> task)
+        {
+            try
+            {
+                co_await task;
+            }
+            catch (const std::exception &e)
+            {
+                BFX_LOG(LogLevel::error, "Unhandled exception in spawned task",
+                        {{"what", e.what()}});
+            }
+            catch (...)
+            {
+                BFX_LOG(LogLevel::error, "Unhandled exception in spawned task");
+            }
+            --loop.active_;
+        }
+
+        template <typename T>
+        static Task<void> complete(Task<T> &task, bool &done)
+        {
+            // Result (or exception) stays in task, read by runUntilComplete()
+            struct Finished
+            {
+                bool &done;
+                ~Finished() { done = true; }
+            } finished{done};
+            co_await WhenDone<T>{task};
+        }
+
+        // Awaits task without consuming its result
+        template <typename T>
+        struct WhenDone
+        {
+            Task<T> &task;
+
+            bool await_ready() const noexcept
+            { return task.await_ready(); }
+
+            std::coroutine_handle<>
+            await_suspend(std::coroutine_handle<> awaiting) noexcept
+            { return task.await_suspend(awaiting); }
+
+            void await_resume() const noexcept {}
+        };
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Awaitable client
+    ////////////////////////////////////////////////////////////////////////////
+
+    #define BFX_ASYNC_ENDPOINT(name) \
+        template <typename... Args> \
+        Task<Result> name##Async(Args... args) \
+        { return call([=](BitfinexAPI &api) { api.name(args...); }); }
+
+    /// Awaitable endpoints of BitfinexAPI instance. Client and loop must
+    /// outlive the AsyncBitfinexAPI, all of them are used from the loop
+    /// thread only.
+    class AsyncBitfinexAPI
+    {
+    public:
+
+        using Result = BitfinexAPI::AsyncResult;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        AsyncBitfinexAPI(BitfinexAPI &api, EventLoop &loop):
+        api_(api),
+        loop_(loop)
+        {
+            sourceId_ = loop_.addSource(
+                {[this](const std::chrono::milliseconds &timeout)
+                 { return api_.poll(timeout); },
+                 [this] { return api_.pending(); }});
+        }
+
+        AsyncBitfinexAPI(const AsyncBitfinexAPI&) = delete;
+        AsyncBitfinexAPI& operator = (const AsyncBitfinexAPI&) = delete;
+
+        ~AsyncBitfinexAPI()
+        { loop_.removeSource(sourceId_); }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        BitfinexAPI& getClient() noexcept
+        { return api_; }
+
+        EventLoop& getLoop() noexcept
+        { return loop_; }
+
+        /// Awaitable call of any endpoint method, e.g.
+        /// call([](BitfinexAPI &api) { api.getTicker("btcusd"); }).
+        /// Endpoint is stored by value and runs when the task is awaited.
+        /// Rate limiter delays and retry backoffs suspend the coroutine
+        /// instead of blocking the loop. Authenticated request refused for
+        /// nonce out of order is resent with fresh nonce.
+        template <typename Endpoint>
+        Task<Result> call(Endpoint endpoint)
+        {
+            BitfinexAPI::PreparedRequest request;
+            Result result;
+            if (!api_.prepare(endpoint, request, result))
+                co_return result;
+
+            for (unsigned attempt = 0, nonceAttempt = 0; ; )
+            {
+                const int64_t waitNs =
+                api_.getRateLimiter().reserve(request.path);
+                if (waitNs < 0)
+                    co_return Result{string(), CURLE_OK, 0, rateLimited};
+                if (waitNs > 0)
+                    co_await loop_.sleep(std::chrono::nanoseconds(waitNs));
+
+                // Nonce taken right before sending, other flows of the loop
+                // may have sent greater ones while this one was suspended
+                request.renewNonce();
+                co_await Submit{*this, request, result};
+
+                if (result.nonceRejected() &&
+                    nonceAttempt < BitfinexAPI::NONCE_RETRIES)
+                {
+                    ++nonceAttempt;
+                    continue;
+                }
+
+                std::chrono::nanoseconds delay(0);
+                if (!api_.getRetrier().shouldRetry(request.path, attempt++,
+                                                   result.curlStatusCode,
+                                                   result.httpStatusCode,
+                                                   delay))
+                    co_return result;
+                co_await loop_.sleep(delay);
+            }
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public endpoints
+        ////////////////////////////////////////////////////////////////////////
+
+        BFX_ASYNC_ENDPOINT(getTicker)
+        BFX_ASYNC_ENDPOINT(getStats)
+        BFX_ASYNC_ENDPOINT(getFundingBook)
+        BFX_ASYNC_ENDPOINT(getOrderBook)
+        BFX_ASYNC_ENDPOINT(getTrades)
+        BFX_ASYNC_ENDPOINT(getLends)
+        BFX_ASYNC_ENDPOINT(getSymbols)
+        BFX_ASYNC_ENDPOINT(getSymbolsDetails)
+
+        ////////////////////////////////////////////////////////////////////////
+        // Authenticated endpoints
+        ////////////////////////////////////////////////////////////////////////
+
+        //  Account  //
+        BFX_ASYNC_ENDPOINT(getAccountInfo)
+        BFX_ASYNC_ENDPOINT(getAccountFees)
+        BFX_ASYNC_ENDPOINT(getSummary)
+        BFX_ASYNC_ENDPOINT(deposit)
+        BFX_ASYNC_ENDPOINT(getKeyPermissions)
+        BFX_ASYNC_ENDPOINT(getMarginInfos)
+        BFX_ASYNC_ENDPOINT(getBalances)
+        BFX_ASYNC_ENDPOINT(transfer)
+        BFX_ASYNC_ENDPOINT(withdraw)
+
+        //  Orders  //
+        BFX_ASYNC_ENDPOINT(newOrder)
+        BFX_ASYNC_ENDPOINT(newOrders)
+        BFX_ASYNC_ENDPOINT(cancelOrder)
+        BFX_ASYNC_ENDPOINT(cancelOrders)
+        BFX_ASYNC_ENDPOINT(cancelAllOrders)
+        BFX_ASYNC_ENDPOINT(replaceOrder)
+        BFX_ASYNC_ENDPOINT(getOrderStatus)
+        BFX_ASYNC_ENDPOINT(getActiveOrders)
+        BFX_ASYNC_ENDPOINT(getOrdersHistory)
+
+        //  Positions  //
+        BFX_ASYNC_ENDPOINT(getActivePositions)
+        BFX_ASYNC_ENDPOINT(claimPosition)
+
+        //  Historical data  //
+        BFX_ASYNC_ENDPOINT(getBalanceHistory)
+        BFX_ASYNC_ENDPOINT(getWithdrawalHistory)
+        BFX_ASYNC_ENDPOINT(getPastTrades)
+
+        //  Margin funding  //
+        BFX_ASYNC_ENDPOINT(newOffer)
+        BFX_ASYNC_ENDPOINT(cancelOffer)
+        BFX_ASYNC_ENDPOINT(getOfferStatus)
+        BFX_ASYNC_ENDPOINT(getActiveCredits)
+        BFX_ASYNC_ENDPOINT(getOffers)
+        BFX_ASYNC_ENDPOINT(getOffersHistory)
+        BFX_ASYNC_ENDPOINT(getPastFundingTrades)
+        BFX_ASYNC_ENDPOINT(getTakenFunds)
+        BFX_ASYNC_ENDPOINT(getUnusedTakenFunds)
+        BFX_ASYNC_ENDPOINT(getTotalTakenFunds)
+        BFX_ASYNC_ENDPOINT(closeLoan)
+        BFX_ASYNC_ENDPOINT(closePosition)
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        // Submits request and resumes coroutine from the loop once the
+        // response is stored to result
+        struct Submit
+        {
+            AsyncBitfinexAPI &self;
+            const BitfinexAPI::PreparedRequest &request;
+            Result &result;
+
+            bool await_ready() const noexcept
+            { return false; }
+
+            void await_suspend(std::coroutine_handle<> handle)
+            {
+                self.api_.submit(request, [this, handle](Result &done)
+                {
+                    result = std::move(done);
+                    self.loop_.schedule(handle);
+                });
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        BitfinexAPI &api_;
+        EventLoop &loop_;
+        size_t sourceId_;
+    };
+
+    #undef BFX_ASYNC_ENDPOINT
+}
+
+#endif // __cpp_impl_coroutine
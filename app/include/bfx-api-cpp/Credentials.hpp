@@ -0,0 +1,229 @@
+////////////////////////////////////////////////////////////////////////////////
+//  Credentials.hpp
+//
+//
+//  Bitfinex REST API C++ client - request signing and nonces
+//
+//
+//  HmacSigner keeps HMAC-SHA384 keyed by API secret, so signing a payload
+//  doesn't set up the key and filter pipeline again. Every thread signs
+//  with its own keyed copy, threads sharing the signer don't wait for each
+//  other. NonceSequence issues
+//  strictly increasing nonces of one API key, the sequence is shared by all
+//  clients using the key, so concurrent requests never reuse a nonce.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// cryptopp
+#include <cryptopp/hmac.h>
+#include <cryptopp/sha.h>
+
+// internal Trace
+#include "Trace.hpp"
+
+// CRYPTOPP_NO_GLOBAL_BYTE signals byte is at CryptoPP::byte
+#ifdef CRYPTOPP_NO_GLOBAL_BYTE
+using CryptoPP::byte;
+#endif
+
+// namespaces
+using std::string;
+
+
+namespace BfxAPI
+{
+
+    class HmacSigner
+    {
+    public:
+
+        // Length of hex signature
+        static constexpr size_t DIGEST_HEX_SIZE = 96;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        explicit HmacSigner(const string &secretKey):
+        key_(secretKey),
+        id_(nextId())
+        {}
+
+        HmacSigner(const HmacSigner&) = delete;
+        HmacSigner& operator = (const HmacSigner&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // Lowercase hex HMAC-SHA384 of payload, same as
+        // HTTPRequest::getHmacSha384()
+        string sign(const string &payload) const
+        {
+            string digest(DIGEST_HEX_SIZE, '\0');
+            sign(payload.data(), payload.size(), &digest[0]);
+            return digest;
+        }
+
+        // Writes DIGEST_HEX_SIZE characters to hex, doesn't allocate
+        void sign(const char *data, size_t size, char *hex) const
+        {
+            BFX_TRACE_SPAN("sign");
+
+            byte mac[Hmac::DIGESTSIZE];
+            Hmac &hmac = threadHmac();
+            hmac.Update(reinterpret_cast<const byte*>(data), size);
+            hmac.Final(mac);
+
+            static const char digits[] = "0123456789abcdef";
+            for (size_t i = 0; i < sizeof(mac); ++i)
+            {
+                hex[2 * i] = digits[mac[i] >> 4];
+                hex[2 * i + 1] = digits[mac[i] & 0x0f];
+            }
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Class constants
+        ////////////////////////////////////////////////////////////////////////
+
+        static constexpr size_t CACHE_SIZE = 4;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        using Hmac = CryptoPP::HMAC<CryptoPP::SHA384>;
+        static_assert(2 * Hmac::DIGESTSIZE == DIGEST_HEX_SIZE,
+                      "unexpected digest size");
+
+        // Keyed hmac of signer, signer ids are never reused so a stale
+        // entry of destroyed signer can't match
+        struct CacheEntry
+        {
+            uint64_t signer = 0;
+            std::unique_ptr<Hmac> hmac;
+        };
+
+        // Last signers used by thread
+        struct Cache
+        {
+            std::array<CacheEntry, CACHE_SIZE> entries;
+            size_t victim = 0;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        const string key_;
+        const uint64_t id_;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // Hmac of calling thread keyed on first use, Final() restarts it
+        // with the same key
+        Hmac& threadHmac() const
+        {
+            static thread_local Cache cache;
+            CacheEntry *free = nullptr;
+            for (auto &entry : cache.entries)
+            {
+                if (entry.signer == id_)
+                    return *entry.hmac;
+                if (!entry.signer && !free)
+                    free = &entry;
+            }
+            if (!free)
+            {
+                free = &cache.entries[cache.victim];
+                cache.victim = (cache.victim + 1) % CACHE_SIZE;
+            }
+            free->signer = id_;
+            free->hmac.reset(new Hmac(reinterpret_cast<const byte*>(
+                                      key_.data()), key_.size()));
+            return *free->hmac;
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static uint64_t nextId() noexcept
+        {
+            static std::atomic<uint64_t> id{0};
+            return ++id;
+        }
+    };
+
+    class NonceSequence
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // Millisecond timestamp, or previous nonce + 1 if requests come
+        // faster than 1 per millisecond
+        string next() noexcept
+        { return std::to_string(nextValue()); }
+
+        uint64_t nextValue() noexcept
+        {
+            using namespace std::chrono;
+
+            const uint64_t now = duration_cast<milliseconds>(
+                system_clock::now().time_since_epoch()).count();
+            uint64_t last = last_.load(std::memory_order_relaxed);
+            uint64_t nonce;
+            do
+                nonce = now > last ? now : last + 1;
+            while (!last_.compare_exchange_weak(last, nonce,
+                                                std::memory_order_relaxed));
+            return nonce;
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // Sequence of API key, shared by all clients of the process
+        static std::shared_ptr<NonceSequence> forKey(const string &accessKey)
+        {
+            static std::mutex mutex;
+            static std::unordered_map<string, std::shared_ptr<NonceSequence>>
+            sequences;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            auto &sequence = sequences[accessKey];
+            if (!sequence)
+                sequence = std::make_shared<NonceSequence>();
+            return sequence;
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        std::atomic<uint64_t> last_{0};
+    };
+}
@@ -0,0 +1,244 @@
+////////////////////////////////////////////////////////////////////////////////
+//  Executor.hpp
+//
+//
+//  Bitfinex REST API C++ client - work-stealing thread pool
+//
+//
+//  Executor runs posted tasks on a fixed set of worker threads. Every worker
+//  has its own task queue, a worker which runs out of tasks steals from the
+//  others. Tasks posted from a worker go to its own queue, tasks posted from
+//  other threads (e.g. the thread driving poll()) are spread round robin.
+//  Idle workers sleep and posting only touches the wake-up mutex when some
+//  worker sleeps.
+//
+//  Client uses it to parse, validate and decode completed responses off the
+//  thread driving network I/O, see BitfinexAPI::submit() and
+//  FanOut::setExecutor().
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// internal Aligned
+#include "Aligned.hpp"
+
+// internal Logger
+#include "Logger.hpp"
+
+
+namespace BfxAPI
+{
+
+    class Executor
+    {
+    public:
+
+        using Task = std::function<void()>;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        // Default leaves one core to the I/O thread
+        explicit Executor(size_t threads = defaultThreads())
+        {
+            threads = std::max<size_t>(threads, 1);
+            for (size_t i = 0; i < threads; ++i)
+                workers_.push_back(makeAligned<Worker>(*this));
+            for (size_t i = 0; i < threads; ++i)
+                workers_[i]->thread = std::thread(&Executor::run, this, i);
+        }
+
+        // Runs tasks still queued, then joins workers. Posting from other
+        // threads must be over by then.
+        ~Executor()
+        {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex_);
+                stopping_ = true;
+            }
+            wake_.notify_all();
+            for (auto &worker : workers_)
+                worker->thread.join();
+        }
+
+        Executor(const Executor&) = delete;
+        Executor& operator = (const Executor&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Accessors
+        ////////////////////////////////////////////////////////////////////////
+
+        size_t size() const noexcept
+        { return workers_.size(); }
+
+        /// Tasks taken from queue of another worker
+        uint64_t stolen() const noexcept
+        { return stolen_.load(std::memory_order_relaxed); }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Queues task, callable from any thread including workers.
+        /// Exceptions escaping task are logged.
+        void post(Task task)
+        {
+            Worker *self = currentWorker();
+            Worker &worker = self && &self->owner == this
+            ? *self
+            : *workers_[next_.fetch_add(1, std::memory_order_relaxed) %
+                        workers_.size()];
+            {
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                worker.tasks.push_back(std::move(task));
+                queued_.fetch_add(1);
+            }
+            if (sleeping_.load())
+            {
+                { std::lock_guard<std::mutex> lock(sleepMutex_); }
+                wake_.notify_one();
+            }
+        }
+
+        static size_t defaultThreads() noexcept
+        {
+            const size_t cores = std::thread::hardware_concurrency();
+            return cores > 1 ? cores - 1 : 1;
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        // Own line per worker, owner and thieves contend on queue mutex only
+        struct alignas(64) Worker
+        {
+            explicit Worker(Executor &executor): owner(executor) {}
+
+            Executor &owner;
+            std::mutex mutex;
+            std::deque<Task> tasks;
+            std::thread thread;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        std::vector<AlignedPtr<Worker>> workers_;
+        std::atomic<size_t> next_{0};
+        // tasks in all queues, workers sleep while it is 0
+        std::atomic<size_t> queued_{0};
+        std::atomic<size_t> sleeping_{0};
+        std::atomic<uint64_t> stolen_{0};
+        std::mutex sleepMutex_;
+        std::condition_variable wake_;
+        bool stopping_ = false;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        void run(size_t self)
+        {
+            currentWorker() = workers_[self].get();
+            Task task;
+            for (;;)
+            {
+                if (take(self, task))
+                {
+                    execute(task);
+                    task = nullptr;
+                    continue;
+                }
+
+                // queued_ is checked after announcing sleep, post() checks
+                // sleeping_ after queuing, one of them sees the other
+                std::unique_lock<std::mutex> lock(sleepMutex_);
+                sleeping_.fetch_add(1);
+                wake_.wait(lock, [this]
+                           { return stopping_ || queued_.load() > 0; });
+                sleeping_.fetch_sub(1);
+                if (stopping_ && queued_.load() == 0)
+                    break;
+            }
+            currentWorker() = nullptr;
+        }
+
+        // Oldest task of own queue, else newest task of another worker
+        bool take(size_t self, Task &task)
+        {
+            if (pop(*workers_[self], task, true))
+                return true;
+            for (size_t i = 1; i < workers_.size(); ++i)
+                if (pop(*workers_[(self + i) % workers_.size()], task, false))
+                {
+                    stolen_.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            return false;
+        }
+
+        bool pop(Worker &worker, Task &task, bool oldest)
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            if (worker.tasks.empty())
+                return false;
+            if (oldest)
+            {
+                task = std::move(worker.tasks.front());
+                worker.tasks.pop_front();
+            }
+            else
+            {
+                task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+            }
+            queued_.fetch_sub(1);
+            return true;
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static void execute(Task &task) noexcept
+        {
+            try
+            {
+                task();
+            }
+            catch (const std::exception &e)
+            {
+                BFX_LOG(LogLevel::error, "Unhandled exception in executor task",
+                        {{"what", e.what()}});
+            }
+            catch (...)
+            {
+                BFX_LOG(LogLevel::error, "Unhandled exception in executor task");
+            }
+        }
+
+        static Worker*& currentWorker() noexcept
+        {
+            static thread_local Worker *worker = nullptr;
+            return worker;
+        }
+    };
+}
@@ -0,0 +1,221 @@
+////////////////////////////////////////////////////////////////////////////////
+//  FanOut.hpp
+//
+//
+//  Bitfinex REST API C++ client - one public endpoint for many symbols
+//
+//
+//  FanOut sends the same public request (ticker, stats, order book, ...)
+//  for every symbol of a set concurrently through the client asynchronous
+//  interface, with at most maxInFlight requests in flight. Responses are
+//  decoded into typed records indexed by symbol. A failed symbol gets its
+//  own status codes and doesn't stop the others. Requests are sent by
+//  RequestScheduler, client rate limiter and retry policy apply to every
+//  request. With an Executor set, responses are validated and decoded on
+//  its workers while the calling thread keeps driving network I/O.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// internal BitfinexAPI
+#include "BitfinexAPI.hpp"
+
+// internal decoders
+#include "decoders.hpp"
+
+// internal RequestScheduler
+#include "RequestScheduler.hpp"
+
+// namespaces
+using std::string;
+using std::vector;
+
+
+namespace BfxAPI
+{
+
+    // Outcome of request for one symbol, value is valid if ok()
+    template <typename Record>
+    struct SymbolResult
+    {
+        Record value;
+        CURLcode curlStatusCode = CURLE_OK;
+        long httpStatusCode = 0;
+        BfxClientErrors bfxApiStatusCode = noError;
+
+        bool ok() const noexcept
+        { return bfxApiStatusCode == noError && curlStatusCode == CURLE_OK; }
+    };
+
+    template <typename Record>
+    using FanOutResults = std::unordered_map<string, SymbolResult<Record>>;
+
+    class FanOut
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        explicit FanOut(BitfinexAPI &api,
+                        size_t maxInFlight = 8,
+                        Executor *executor = nullptr):
+        scheduler_(api, maxInFlight, executor)
+        {}
+
+        ////////////////////////////////////////////////////////////////////////
+        // Accessors
+        ////////////////////////////////////////////////////////////////////////
+
+        size_t getMaxInFlight() const noexcept
+        { return scheduler_.getMaxInFlight(); }
+
+        void setMaxInFlight(size_t maxInFlight) noexcept
+        { scheduler_.setMaxInFlight(maxInFlight); }
+
+        Executor* getExecutor() const noexcept
+        { return scheduler_.getExecutor(); }
+
+        // Executor must outlive the calls, nullptr handles responses on the
+        // calling thread
+        void setExecutor(Executor *executor) noexcept
+        { scheduler_.setExecutor(executor); }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        template <typename Symbols>
+        FanOutResults<jsonutils::Ticker> tickers(const Symbols &symbols)
+        {
+            return run<jsonutils::Ticker>(symbols,
+                [](BitfinexAPI &api, const string &symbol)
+                { api.getTicker(symbol); },
+                jsonutils::decodeTicker);
+        }
+
+        template <typename Symbols>
+        FanOutResults<vector<jsonutils::VolumeStats>>
+        stats(const Symbols &symbols)
+        {
+            return run<vector<jsonutils::VolumeStats>>(symbols,
+                [](BitfinexAPI &api, const string &symbol)
+                { api.getStats(symbol); },
+                jsonutils::decodeStats);
+        }
+
+        template <typename Symbols>
+        FanOutResults<jsonutils::OrderBook>
+        orderBooks(const Symbols &symbols,
+                   const unsigned &limit_bids = 50,
+                   const unsigned &limit_asks = 50,
+                   const bool &group = true)
+        {
+            return run<jsonutils::OrderBook>(symbols,
+                [&](BitfinexAPI &api, const string &symbol)
+                { api.getOrderBook(symbol, limit_bids, limit_asks, group); },
+                jsonutils::decodeOrderBook);
+        }
+
+        template <typename Symbols>
+        FanOutResults<vector<jsonutils::Trade>>
+        trades(const Symbols &symbols,
+               const time_t &since = 0,
+               const unsigned &limit_trades = 50)
+        {
+            return run<vector<jsonutils::Trade>>(symbols,
+                [&](BitfinexAPI &api, const string &symbol)
+                { api.getTrades(symbol, since, limit_trades); },
+                jsonutils::decodeTrades);
+        }
+
+        // Runs endpoint(api, symbol) for every symbol and decodes responses
+        // with decode(response, record), returns when all symbols are done
+        template <typename Record,
+                  typename Symbols,
+                  typename Endpoint,
+                  typename Decoder>
+        FanOutResults<Record> run(const Symbols &symbols,
+                                  const Endpoint &endpoint,
+                                  const Decoder &decode)
+        {
+            FanOutResults<Record> results;
+            vector<string> unique;
+            for (const string &symbol : symbols)
+                if (results.emplace(symbol, SymbolResult<Record>()).second)
+                    unique.push_back(symbol);
+
+            each(unique, endpoint,
+                [&](const string &symbol, BitfinexAPI::AsyncResult &result)
+                {
+                    SymbolResult<Record> &out = results.find(symbol)->second;
+                    out.curlStatusCode = result.curlStatusCode;
+                    out.httpStatusCode = result.httpStatusCode;
+                    out.bfxApiStatusCode = result.bfxApiStatusCode;
+                    if (out.ok())
+                        out.bfxApiStatusCode = decode(result.response,
+                                                      out.value);
+                });
+            return results;
+        }
+
+        // Runs endpoint(api, symbol) for every symbol (symbols should be
+        // unique) and calls handler(symbol, result) with the final result
+        // of each one, e.g. to decode response in place. Returns when all
+        // symbols are done. With executor, handler runs on its workers,
+        // concurrently for different symbols.
+        template <typename Symbols, typename Endpoint, typename Handler>
+        void each(const Symbols &symbols,
+                  const Endpoint &endpoint,
+                  const Handler &handler)
+        {
+            BitfinexAPI &client = scheduler_.getClient();
+            std::deque<Job> jobs;
+            std::deque<Job*> ready;
+
+            // Symbols are copied, elements of the range may be temporaries
+            for (const auto &symbol : symbols)
+            {
+                jobs.emplace_back();
+                Job &job = jobs.back();
+                job.symbol = symbol;
+                BitfinexAPI::AsyncResult done;
+                if (client.prepare([&](BitfinexAPI &api)
+                                   { endpoint(api, job.symbol); },
+                                   job.request, done))
+                    ready.push_back(&job);
+                else
+                    handler(job.symbol, done);
+            }
+
+            scheduler_.run(std::move(ready),
+                [&](const Job &job, BitfinexAPI::AsyncResult &result)
+                { handler(job.symbol, result); });
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        struct Job: ScheduledRequest
+        {
+            string symbol;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        RequestScheduler scheduler_;
+    };
+}
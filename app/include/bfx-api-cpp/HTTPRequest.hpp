@@ -22,14 +22,32 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+#pragma once
+
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
 
 // curl
 #include <curl/curl.h>
 
+// internal Credentials
+#include "Credentials.hpp"
+
+// internal LatencyHistogram (RequestTimings)
+#include "LatencyHistogram.hpp"
+
+// internal Logger
+#include "Logger.hpp"
+
+// internal Trace
+#include "Trace.hpp"
+
+// internal Transport
+#include "Transport.hpp"
+
 // cryptopp
-#include <cryptopp/base64.h>
 #include <cryptopp/hex.h>
 #include <cryptopp/hmac.h>
 #include <cryptopp/osrng.h>
@@ -44,14 +62,10 @@ using CryptoPP::byte;
 
 namespace BfxAPI {
 
-  class HTTPRequest {
+  // Observer is called after every completed request
+  using ExchangeObserver = std::function<void(const HttpExchange&)>;
 
-    ////////////////////////////////////////////////////////////////////////
-    // Class constants
-    ////////////////////////////////////////////////////////////////////////
-    
-    static constexpr auto CURL_TIMEOUT = 30L;
-    static constexpr auto CURL_DEBUG_VERBOSE = 0L;
+  class HTTPRequest {
 
     public:
       
@@ -59,15 +73,12 @@ namespace BfxAPI {
       // Constructor / Destructor
       ////////////////////////////////////////////////////////////////////////
       
-      HTTPRequest(string inEndpoint) {
+      // Default transport is libcurl
+      HTTPRequest(string inEndpoint,
+                  std::shared_ptr<Transport> inTransport = nullptr) {
         endpoint = inEndpoint;
-        curlGET = curl_easy_init();
-        curlPOST = curl_easy_init();
-      };
-
-      ~HTTPRequest() {
-        curl_easy_cleanup(curlGET);
-        curl_easy_cleanup(curlPOST);
+        transport = inTransport ? inTransport
+                                : std::make_shared<CurlTransport>();
       };
 
       ////////////////////////////////////////////////////////////////////////
@@ -75,75 +86,105 @@ namespace BfxAPI {
       ////////////////////////////////////////////////////////////////////////
 
       string get(string inPath, map<string, string> params = {}) {
-        response = "";
-        if (curlGET) {
-          path = inPath;
-          string url = endpoint + path + "?" + parseParams(params);
-
-          setupHeader();
-          curl_easy_setopt(curlPOST, CURLOPT_HTTPHEADER, curlHeader);
-          curl_easy_setopt(curlGET, CURLOPT_TIMEOUT, CURL_TIMEOUT);
-          curl_easy_setopt(curlGET, CURLOPT_URL, url.c_str());
-          curl_easy_setopt(curlGET, CURLOPT_VERBOSE, CURL_DEBUG_VERBOSE);
-          curl_easy_setopt(curlGET, CURLOPT_WRITEDATA, &response);
-          curl_easy_setopt(curlGET, CURLOPT_WRITEFUNCTION, writeCallback);
-
-          curlStatusCode = curl_easy_perform(curlGET);
-          // libcurl internal error handling
-          if (curlStatusCode != CURLE_OK) {
-            cerr << "libcurl error in Request.get():" << endl;
-            cerr << "CURLcode: " << curlStatusCode << endl;
-          }
-        } else {
-          cerr << "curl not properly initialized curlGET = nullptr";
-        }
+        ++requestId;
+        path = inPath;
+        HttpExchange exchange = makeExchange(false, parseParams(params), "", path);
+        transport->get(endpoint + path + "?" + exchange.params, header,
+                       exchange);
+        finish(exchange);
         return response;
       };
 
       string post(string inPath, string json = "") {
-        response = "";
-        if (curlPOST) {
-          path = inPath;
-          string url = endpoint + path;
-          string payload;
-          getBase64(json, payload);
-
-          if (accessKey != "") {
-            header["X-BFX-APIKEY"] = accessKey;
-          }
-
-          if (secretKey != "") {
-            header["X-BFX-SIGNATURE"] = getSignature(payload);
-          }
-
-          if (payload != "") {
-           header["X-BFX-PAYLOAD"] = payload;
-          }
-
-          setupHeader();
-          curl_easy_setopt(curlPOST, CURLOPT_HTTPHEADER, curlHeader);
-          curl_easy_setopt(curlPOST, CURLOPT_POST, 1);
-          curl_easy_setopt(curlPOST, CURLOPT_POSTFIELDS, "\n");
-          curl_easy_setopt(curlPOST, CURLOPT_TIMEOUT, CURL_TIMEOUT);
-          curl_easy_setopt(curlPOST, CURLOPT_URL, url.c_str());
-          curl_easy_setopt(curlPOST, CURLOPT_VERBOSE, CURL_DEBUG_VERBOSE);
-          curl_easy_setopt(curlPOST, CURLOPT_WRITEDATA, &response);
-          curl_easy_setopt(curlPOST, CURLOPT_WRITEFUNCTION, writeCallback);
-
-          curlStatusCode = curl_easy_perform(curlPOST);
-          clearHeader();
-          // libcurl internal error handling
-          if (curlStatusCode != CURLE_OK) {
-            cerr << "libcurl error in Request.post():" << endl;
-            cerr << "CURLcode: " << curlStatusCode << endl;
-          }
-        } else {
-          cerr << "curl not properly initialized curlPOST = nullptr";
-        }
-
+        ++requestId;
+        path = inPath;
+        HttpExchange exchange = makeExchange(true, "", json, path);
+        map<string, string> postHeader;
+        const int64_t signing = signedHeader(json, postHeader);
+        transport->post(endpoint + path, postHeader, exchange);
+        exchange.timings.signing = signing;
+        finish(exchange);
         return response;
       };
 
+      // Asynchronous requests don't change last response of this instance,
+      // callback gets the whole exchange. Callbacks are invoked from poll().
+      void submitGet(const string &inPath,
+                     const map<string, string> &params,
+                     const Transport::Callback &callback) {
+        HttpExchange exchange = makeExchange(false, parseParams(params), "",
+                                             inPath);
+        const string url = endpoint + inPath + "?" + exchange.params;
+        transport->submit(url, header, std::move(exchange),
+                          observed(callback));
+      }
+
+      void submitPost(const string &inPath,
+                      const string &json,
+                      const Transport::Callback &callback) {
+        HttpExchange exchange = makeExchange(true, "", json, inPath);
+        map<string, string> postHeader;
+        const int64_t signing = signedHeader(json, postHeader);
+        transport->submit(endpoint + inPath, postHeader, std::move(exchange),
+          observed([callback, signing](HttpExchange &done) {
+            done.timings.signing = signing;
+            callback(done);
+          }));
+      }
+
+      // Payload signed by caller (see OrderTemplate), header carries
+      // authentication fields
+      string postSigned(const string &inPath, const string &json,
+                        const map<string, string> &authHeader,
+                        int64_t signing = 0) {
+        ++requestId;
+        path = inPath;
+        HttpExchange exchange = makeExchange(true, "", json, path);
+        transport->post(endpoint + path, authHeader, exchange);
+        exchange.timings.signing = signing;
+        finish(exchange);
+        return response;
+      }
+
+      void submitSigned(const string &inPath, const string &json,
+                        const map<string, string> &authHeader,
+                        const Transport::Callback &callback,
+                        int64_t signing = 0) {
+        HttpExchange exchange = makeExchange(true, "", json, inPath);
+        transport->submit(endpoint + inPath, authHeader, std::move(exchange),
+          observed([callback, signing](HttpExchange &done) {
+            done.timings.signing = signing;
+            callback(done);
+          }));
+      }
+
+      // Opens connection of blocking POST ahead of time with GET of path
+      void warmUp(const string &inPath) {
+        transport->warmUp(endpoint + inPath);
+      }
+
+      // Drives submitted requests, returns number of completed ones
+      size_t poll(const std::chrono::milliseconds &timeout =
+                  std::chrono::milliseconds(0)) {
+        return transport->poll(timeout);
+      }
+
+      size_t pending() const {
+        return transport->pending();
+      }
+
+      // Makes response fetched elsewhere (e.g. by another HTTPRequest
+      // instance) the last response of this instance
+      void adoptResponse(string inPath, string inResponse, CURLcode code,
+                         long httpCode) {
+        ++requestId;
+        path = inPath;
+        response = inResponse;
+        curlStatusCode = code;
+        httpStatusCode = httpCode;
+        timings = RequestTimings();
+      }
+
       string parseParams(map<string, string> params) {
         string pp = "";
         for (auto it = params.begin(); it != params.end(); it++) {
@@ -153,29 +194,49 @@ namespace BfxAPI {
       };
 
       string getSignature(string payload) {
-        string signature;
-        getHmacSha384(secretKey, payload, signature);
-        return signature;
+        return signer ? signer->sign(payload) : string();
       }
 
       const CURLcode getLastStatusCode() const noexcept {
         return curlStatusCode;
       }
 
+      // HTTP response code, 0 if no response was received
+      long getLastHttpCode() const noexcept {
+        return httpStatusCode;
+      }
+
+      // libcurl phase timings and signing time of the last request
+      const RequestTimings& getLastTimings() const noexcept {
+        return timings;
+      }
+
       const string getLastResponse() const noexcept {
         return response;
       }
 
-      const string getLastPath() const noexcept {
+      const string& getLastPath() const noexcept {
         return path;
       }
 
+      // Increments with every request, identifies the last response
+      unsigned long long getLastRequestId() const noexcept {
+        return requestId;
+      }
+
       const bool hasError() const noexcept {
         return curlStatusCode != CURLE_OK;
       }
 
       void setSecretKey(string inSecretKey) {
-        secretKey = inSecretKey;
+        signer = inSecretKey != ""
+                 ? std::make_shared<const HmacSigner>(inSecretKey)
+                 : nullptr;
+      }
+
+      // Signer can be shared by requests using the same secret key
+      void setSigner(std::shared_ptr<const HmacSigner> inSigner) {
+        signer = inSigner;
       }
 
       void setAccessKey(string inAccessKey) {
@@ -186,63 +247,60 @@ namespace BfxAPI {
         header = inHeader;
       }
 
-    private:
-
-      ////////////////////////////////////////////////////////////////////////
-      // Private properties
-      ////////////////////////////////////////////////////////////////////////
-      
-      string endpoint, path, secretKey, accessKey, response;
-      map<string, string> header;
-      struct curl_slist *curlHeader = nullptr;
-
-      // Curl properties
-      CURL *curlGET;
-      CURL *curlPOST;
-      CURLcode curlStatusCode;
+      void setTransport(std::shared_ptr<Transport> inTransport) {
+        if (inTransport) {
+          transport = inTransport;
+        }
+      }
 
-      ////////////////////////////////////////////////////////////////////////
-      // Private methods
-      ////////////////////////////////////////////////////////////////////////
+      const std::shared_ptr<Transport>& getTransport() const noexcept {
+        return transport;
+      }
 
-      // Curl write callback function. Appends fetched *content to *userp
-      // pointer. *userp pointer is set up by
-      // curl_easy_setopt(curl, CURLOPT_WRITEDATA, &result) line.
-      // In this case *userp points to result.
-      static size_t writeCallback(
-        void *data,
-        size_t size,
-        size_t nmemb,
-        void *userp) noexcept
-      {
-        (static_cast <string*>(userp))
-          ->append(static_cast <char*>(data), size * nmemb);
-        return size * nmemb;
-      };
+      void setObserver(ExchangeObserver inObserver) {
+        observer = inObserver;
+      }
 
       static void getBase64(const string &content, string &encoded) {
-        using CryptoPP::Base64Encoder;
-        using CryptoPP::StringSink;
-        using CryptoPP::StringSource;
-
-        byte buffer[1024] = {};
-
-        for (auto i = 0; i < content.length(); ++i)
-            buffer[i] = content[i];
-
-        StringSource ss(
-          buffer,
-          content.length(),
-          true,
-          new Base64Encoder(new StringSink(encoded), false)
-        );
+        BFX_TRACE_SPAN("getBase64");
+        appendBase64(content.data(), content.size(), encoded);
       };
 
+      // Standard alphabet with padding and without line breaks, same as
+      // CryptoPP::Base64Encoder(sink, false). Appends to encoded, reuses
+      // its capacity.
+      static void appendBase64(const char *data, size_t size,
+                               string &encoded) {
+        static const char alphabet[] =
+          "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        const unsigned char *in = reinterpret_cast<const unsigned char*>(data);
+        size_t out = encoded.size();
+        encoded.resize(out + (size + 2) / 3 * 4);
+        size_t i = 0;
+        for (; i + 2 < size; i += 3) {
+          const uint32_t group = in[i] << 16 | in[i + 1] << 8 | in[i + 2];
+          encoded[out++] = alphabet[group >> 18];
+          encoded[out++] = alphabet[group >> 12 & 0x3f];
+          encoded[out++] = alphabet[group >> 6 & 0x3f];
+          encoded[out++] = alphabet[group & 0x3f];
+        }
+        if (i < size) {
+          const uint32_t group = in[i] << 16 |
+                                 (i + 1 < size ? in[i + 1] << 8 : 0);
+          encoded[out++] = alphabet[group >> 18];
+          encoded[out++] = alphabet[group >> 12 & 0x3f];
+          encoded[out++] = i + 1 < size ? alphabet[group >> 6 & 0x3f] : '=';
+          encoded[out++] = '=';
+        }
+      }
+
       static void getHmacSha384(
         const string &key,
         const string &content,
         string &digest)
       {
+          BFX_TRACE_SPAN("getHmacSha384");
+
           using CryptoPP::HashFilter;
           using CryptoPP::HexEncoder;
           using CryptoPP::HMAC;
@@ -265,21 +323,92 @@ namespace BfxAPI {
           transform(digest.cbegin(), digest.cend(), digest.begin(), ::tolower);
       };
 
-      void setupHeader() {
-        curlHeader = nullptr;
-        for (auto it = header.begin(); it != header.end(); it++) {
-          curlHeader = curl_slist_append(
-            curlHeader,
-            (it->first + ": " + it->second).c_str()
-          );
+    private:
+
+      ////////////////////////////////////////////////////////////////////////
+      // Private properties
+      ////////////////////////////////////////////////////////////////////////
+      
+      string endpoint, path, accessKey, response;
+      std::shared_ptr<const HmacSigner> signer;
+      map<string, string> header;
+      std::shared_ptr<Transport> transport;
+
+      // Last request status
+      CURLcode curlStatusCode = CURLE_OK;
+      long httpStatusCode = 0;
+      RequestTimings timings = RequestTimings();
+      unsigned long long requestId = 0;
+
+      // Transport hooks
+      ExchangeObserver observer;
+
+      ////////////////////////////////////////////////////////////////////////
+      // Private methods
+      ////////////////////////////////////////////////////////////////////////
+
+      HttpExchange makeExchange(bool post, const string &params,
+                                const string &json,
+                                const string &inPath) const {
+        return HttpExchange{post, inPath, params, json, "", CURLE_OK, 0,
+                            RequestTimings(), steadyNowNs()};
+      }
+
+      // Adds authentication header fields to copy of common header, returns
+      // signing time
+      int64_t signedHeader(const string &json, map<string, string> &out) {
+        const int64_t signingStart = steadyNowNs();
+        string payload;
+        getBase64(json, payload);
+
+        out = header;
+        if (accessKey != "") {
+          out["X-BFX-APIKEY"] = accessKey;
         }
-      };
 
-      void clearHeader() {
-        curlHeader = nullptr;
-        header.erase("X-BFX-APIKEY");
-        header.erase("X-BFX-SIGNATURE");
-        header.erase("X-BFX-PAYLOAD");
+        if (signer) {
+          out["X-BFX-SIGNATURE"] = getSignature(payload);
+        }
+        const int64_t signing = steadyNowNs() - signingStart;
+
+        if (payload != "") {
+          out["X-BFX-PAYLOAD"] = payload;
+        }
+        return signing;
+      }
+
+      // Makes exchange the last response of this instance
+      void finish(HttpExchange &exchange) {
+        notify(exchange);
+        response = std::move(exchange.response);
+        curlStatusCode = exchange.curlCode;
+        httpStatusCode = exchange.httpCode;
+        timings = exchange.timings;
+        // libcurl internal error handling
+        if (curlStatusCode != CURLE_OK) {
+          BFX_LOG(LogLevel::error, exchange.post
+                                   ? "libcurl error in Request.post()"
+                                   : "libcurl error in Request.get()",
+                  {{"path", path}, {"curl_code", curlStatusCode},
+                   {"error", curl_easy_strerror(curlStatusCode)}});
+        }
+      }
+
+      void notify(const HttpExchange &exchange) const {
+        if (observer) {
+          observer(exchange);
+        }
+      }
+
+      Transport::Callback observed(const Transport::Callback &callback) {
+        ExchangeObserver inObserver = observer;
+        if (!inObserver) {
+          return callback;
+        }
+        return [inObserver, callback](HttpExchange &exchange) {
+          inObserver(exchange);
+          callback(exchange);
+        };
       }
 
   };
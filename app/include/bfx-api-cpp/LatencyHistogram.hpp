@@ -0,0 +1,401 @@
+////////////////////////////////////////////////////////////////////////////////
+//  LatencyHistogram.hpp
+//
+//
+//  Bitfinex REST API C++ client - per endpoint latency histograms
+//
+//
+//  LatencyHistogram is a lock-free log-linear (HDR style) histogram of
+//  nanosecond durations. Every power of two range is split into 16 linear
+//  sub-buckets, so recorded values are kept with ~6% precision from 1ns up
+//  to ~18 minutes.
+//
+//  EndpointLatencies keeps one histogram per request phase for every
+//  endpoint path. Endpoint slots are allocated lazily in a fixed size open
+//  addressing table with compare-and-swap, recording never takes a lock.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+// namespaces
+using std::string;
+using std::vector;
+
+
+namespace BfxAPI
+{
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Request phases
+    ////////////////////////////////////////////////////////////////////////////
+
+    // libcurl phases hold duration of the single phase (not the cumulative
+    // time reported by curl_easy_getinfo) so they can be compared directly.
+    enum class Phase
+    {
+        nameLookup = 0, // DNS resolution
+        connect,        // TCP connect
+        appConnect,     // TLS handshake
+        preTransfer,    // remaining protocol setup
+        startTransfer,  // request sent until first response byte
+        transfer,       // response body transfer
+        total,          // whole libcurl transfer
+        payloadBuild,   // building JSON payload of authenticated request
+        signing,        // base64 payload encoding and HMAC signature
+        parse,          // response JSON parsing
+        validation,     // response JSON schema validation
+        count
+    };
+
+    inline const char* phaseName(const Phase &phase) noexcept
+    {
+        static const char *names[] =
+        {
+            "namelookup", "connect", "appconnect", "pretransfer",
+            "starttransfer", "transfer", "total", "payload_build", "signing",
+            "parse", "validation"
+        };
+        return names[static_cast<size_t>(phase)];
+    }
+
+    /// Cumulative libcurl timings of single transfer as reported by
+    /// curl_easy_getinfo() and local signing time, all in nanoseconds
+    struct RequestTimings
+    {
+        int64_t nameLookup;
+        int64_t connect;
+        int64_t appConnect;
+        int64_t preTransfer;
+        int64_t startTransfer;
+        int64_t total;
+        int64_t signing;
+    };
+
+    inline int64_t steadyNowNs() noexcept
+    {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(
+            steady_clock::now().time_since_epoch()).count();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Histogram
+    ////////////////////////////////////////////////////////////////////////////
+
+    class LatencyHistogram
+    {
+        static constexpr auto SUB_BUCKET_BITS = 4;
+        static constexpr auto SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+        static constexpr auto MAX_MAGNITUDE = 40; // 2^40ns ~ 18 minutes
+
+    public:
+
+        static constexpr size_t BUCKETS =
+        (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        void record(int64_t ns) noexcept
+        {
+            if (ns < 0)
+                ns = 0;
+
+            buckets_[indexOf(ns)].fetch_add(1, std::memory_order_relaxed);
+            count_.fetch_add(1, std::memory_order_relaxed);
+            sum_.fetch_add(ns, std::memory_order_relaxed);
+
+            int64_t max = max_.load(std::memory_order_relaxed);
+            while (ns > max &&
+                   !max_.compare_exchange_weak(max, ns,
+                                               std::memory_order_relaxed)) {}
+        }
+
+        uint64_t count() const noexcept
+        { return count_.load(std::memory_order_relaxed); }
+
+        int64_t sum() const noexcept
+        { return sum_.load(std::memory_order_relaxed); }
+
+        int64_t max() const noexcept
+        { return max_.load(std::memory_order_relaxed); }
+
+        double mean() const noexcept
+        {
+            const uint64_t n = count();
+            return n ? static_cast<double>(sum()) / n : 0.0;
+        }
+
+        /// Upper bound of the bucket holding quantile q (0.0 - 1.0)
+        int64_t percentile(const double &q) const noexcept
+        {
+            const uint64_t n = count();
+            if (!n)
+                return 0;
+
+            const uint64_t rank = q <= 0 ? 1 : static_cast<uint64_t>(q * n + 0.5);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BUCKETS; ++i)
+            {
+                seen += buckets_[i].load(std::memory_order_relaxed);
+                if (seen >= rank && seen)
+                {
+                    const int64_t upper = upperBoundOf(i);
+                    return upper < max() ? upper : max();
+                }
+            }
+            return max();
+        }
+
+        /// Calls f(upperBound, cumulativeCount) for every non-empty bucket
+        template <typename F>
+        void forEachBucket(F &&f) const
+        {
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < BUCKETS; ++i)
+            {
+                const uint64_t n = buckets_[i].load(std::memory_order_relaxed);
+                if (!n)
+                    continue;
+                cumulative += n;
+                f(upperBoundOf(i), cumulative);
+            }
+        }
+
+        void reset() noexcept
+        {
+            for (auto &bucket : buckets_)
+                bucket.store(0, std::memory_order_relaxed);
+            count_.store(0, std::memory_order_relaxed);
+            sum_.store(0, std::memory_order_relaxed);
+            max_.store(0, std::memory_order_relaxed);
+        }
+
+        static size_t indexOf(const int64_t &ns) noexcept
+        {
+            const uint64_t v = static_cast<uint64_t>(ns);
+            if (v < SUB_BUCKETS)
+                return v;
+
+            int magnitude = 63 - __builtin_clzll(v);
+            if (magnitude > MAX_MAGNITUDE)
+                return BUCKETS - 1;
+
+            const size_t sub =
+            (v >> (magnitude - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+            return (magnitude - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+        }
+
+        /// Exclusive upper bound of values falling into bucket
+        static int64_t upperBoundOf(const size_t &index) noexcept
+        {
+            if (index < SUB_BUCKETS)
+                return index + 1;
+
+            const int shift = index / SUB_BUCKETS - 1;
+            const int64_t sub = index % SUB_BUCKETS;
+            return (SUB_BUCKETS + sub + 1) << shift;
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        std::atomic<uint64_t> buckets_[BUCKETS] = {};
+        std::atomic<uint64_t> count_{0};
+        std::atomic<int64_t> sum_{0};
+        std::atomic<int64_t> max_{0};
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Endpoint table
+    ////////////////////////////////////////////////////////////////////////////
+
+    class EndpointLatencies
+    {
+        static constexpr auto PHASES = static_cast<size_t>(Phase::count);
+        static constexpr size_t SLOTS = 256;
+
+    public:
+
+        struct Endpoint
+        {
+            explicit Endpoint(const string &inPath): path(inPath) {}
+            const string path;
+            LatencyHistogram phases[PHASES];
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        EndpointLatencies() {}
+
+        EndpointLatencies(const EndpointLatencies&) = delete;
+        EndpointLatencies& operator = (const EndpointLatencies&) = delete;
+
+        ~EndpointLatencies()
+        {
+            for (auto &slot : slots_)
+                delete slot.load();
+            delete overflow_.load();
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        void record(const string &path, const Phase &phase, const int64_t &ns)
+        { endpoint(path).phases[static_cast<size_t>(phase)].record(ns); }
+
+        /// Records libcurl phases and signing time of single transfer
+        void record(const string &path, const RequestTimings &t)
+        {
+            auto &phases = endpoint(path).phases;
+            auto rec = [&phases](const Phase &phase, const int64_t &ns)
+            { phases[static_cast<size_t>(phase)].record(ns); };
+
+            // appconnect is zero for plain HTTP and reused connections
+            const int64_t connected = t.appConnect ? t.appConnect : t.connect;
+            rec(Phase::nameLookup, t.nameLookup);
+            rec(Phase::connect, t.connect - t.nameLookup);
+            rec(Phase::appConnect, t.appConnect ? t.appConnect - t.connect : 0);
+            rec(Phase::preTransfer, t.preTransfer - connected);
+            rec(Phase::startTransfer, t.startTransfer - t.preTransfer);
+            rec(Phase::transfer, t.total - t.startTransfer);
+            rec(Phase::total, t.total);
+            if (t.signing)
+                rec(Phase::signing, t.signing);
+        }
+
+        /// Histogram of path and phase, nullptr if nothing was recorded yet
+        const LatencyHistogram* find(const string &path,
+                                     const Phase &phase) const
+        {
+            const Endpoint *e = lookup(endpointOf(path));
+            return e ? &e->phases[static_cast<size_t>(phase)] : nullptr;
+        }
+
+        /// Calls f(const Endpoint&) for every endpoint with recorded data
+        template <typename F>
+        void forEach(F &&f) const
+        {
+            for (const auto &slot : slots_)
+            {
+                const Endpoint *e = slot.load(std::memory_order_acquire);
+                if (e)
+                    f(*e);
+            }
+            const Endpoint *e = overflow_.load(std::memory_order_acquire);
+            if (e)
+                f(*e);
+        }
+
+        /// Endpoint paths with symbol or currency suffix share one entry,
+        /// e.g. "/book/btcusd" is recorded as "/book/". Returns static prefix
+        /// or path itself, no allocation on the recording path.
+        static const char* endpointOf(const string &path) noexcept
+        {
+            for (const char *prefix : {"/pubticker/", "/stats/", "/book/",
+                                       "/trades/", "/lendbook/", "/lends/"})
+            {
+                const size_t len = strlen(prefix);
+                if (path.size() > len && path.compare(0, len, prefix) == 0)
+                    return prefix;
+            }
+            return path.c_str();
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        std::atomic<Endpoint*> slots_[SLOTS] = {};
+        std::atomic<Endpoint*> overflow_{nullptr};
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        const Endpoint* lookup(const char *key) const noexcept
+        {
+            size_t i = hashOf(key) % SLOTS;
+            for (size_t probe = 0; probe < SLOTS; ++probe, i = (i + 1) % SLOTS)
+            {
+                const Endpoint *e = slots_[i].load(std::memory_order_acquire);
+                if (!e)
+                    return nullptr;
+                if (e->path == key)
+                    return e;
+            }
+            return nullptr;
+        }
+
+        Endpoint& endpoint(const string &path)
+        {
+            const char *key = endpointOf(path);
+            size_t i = hashOf(key) % SLOTS;
+            Endpoint *created = nullptr;
+            for (size_t probe = 0; probe < SLOTS; ++probe, i = (i + 1) % SLOTS)
+            {
+                Endpoint *e = slots_[i].load(std::memory_order_acquire);
+                if (!e)
+                {
+                    if (!created)
+                        created = new Endpoint(key);
+                    if (slots_[i].compare_exchange_strong(
+                            e, created, std::memory_order_acq_rel))
+                        return *created;
+                    // Slot taken concurrently, e holds the winner
+                }
+                if (e->path == key)
+                {
+                    delete created;
+                    return *e;
+                }
+            }
+
+            // Table full - account to a shared overflow entry
+            delete created;
+            Endpoint *e = overflow_.load(std::memory_order_acquire);
+            if (!e)
+            {
+                Endpoint *other = new Endpoint("other");
+                if (overflow_.compare_exchange_strong(
+                        e, other, std::memory_order_acq_rel))
+                    return *other;
+                delete other;
+            }
+            return *e;
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // FNV-1a of zero terminated key
+        static size_t hashOf(const char *key) noexcept
+        {
+            uint64_t hash = 14695981039346656037ULL;
+            for (; *key; ++key)
+                hash = (hash ^ static_cast<unsigned char>(*key)) *
+                       1099511628211ULL;
+            return static_cast<size_t>(hash);
+        }
+    };
+}
@@ -0,0 +1,405 @@
+////////////////////////////////////////////////////////////////////////////////
+//  Logger.hpp
+//
+//
+//  Bitfinex REST API C++ client - asynchronous diagnostics logger
+//
+//
+//  Log calls copy the message and its key/value fields into a fixed size
+//  record of a bounded lock-free MPSC ring buffer. Records are formatted
+//  (logfmt style) and written to the sink by a background thread, so request
+//  threads never block on terminal or pipe I/O. When the ring is full new
+//  records are dropped and counted.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+// namespaces
+using std::string;
+
+
+namespace BfxAPI
+{
+
+    enum class LogLevel
+    {
+        debug = 0,
+        info,
+        warning,
+        error,
+        off
+    };
+
+    inline const char* logLevelName(const LogLevel &level) noexcept
+    {
+        static const char *names[] = {"DEBUG", "INFO", "WARNING", "ERROR", "OFF"};
+        return names[static_cast<size_t>(level)];
+    }
+
+    /// Key/value pair of log record. Key must be a string literal, string
+    /// values are copied (and possibly truncated) when the record is queued.
+    struct LogField
+    {
+        LogField(const char *inKey, const string &value) noexcept:
+        key(inKey), str(value.data()), len(value.size()), num(0), isNum(false) {}
+
+        LogField(const char *inKey, const char *value) noexcept:
+        key(inKey), str(value), len(strlen(value)), num(0), isNum(false) {}
+
+        template <typename T,
+                  typename = typename std::enable_if<
+                  std::is_integral<T>::value || std::is_enum<T>::value>::type>
+        LogField(const char *inKey, const T &value) noexcept:
+        key(inKey), str(nullptr), len(0), num(static_cast<int64_t>(value)),
+        isNum(true) {}
+
+        const char *key;
+        const char *str;
+        size_t len;
+        int64_t num;
+        bool isNum;
+    };
+
+    class Logger
+    {
+        static constexpr size_t CAPACITY = 1024; // records, power of two
+        static constexpr size_t MAX_FIELDS = 6;
+        static constexpr size_t TEXT_SIZE = 384; // bytes of copied strings
+
+    public:
+
+        using Sink = std::function<void(const LogLevel&, const string&)>;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        Logger():
+        slots_(new Slot[CAPACITY])
+        {
+            for (size_t i = 0; i < CAPACITY; ++i)
+                slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        Logger(const Logger&) = delete;
+        Logger& operator = (const Logger&) = delete;
+
+        ~Logger()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                running_ = false;
+            }
+            wake_.notify_one();
+            if (worker_.joinable())
+                worker_.join();
+            delete[] slots_;
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Process wide logger used by the client
+        static Logger& instance()
+        {
+            static Logger logger;
+            return logger;
+        }
+
+        bool isEnabled(const LogLevel &level) const noexcept
+        { return level >= level_.load(std::memory_order_relaxed); }
+
+        /// Queues record, never blocks. Returns false if level is disabled or
+        /// the record was dropped.
+        bool log(const LogLevel &level,
+                 const char *message,
+                 std::initializer_list<LogField> fields = {}) noexcept
+        {
+            if (!isEnabled(level) || level == LogLevel::off)
+                return false;
+
+            // Claim slot (Vyukov bounded MPMC queue, single consumer)
+            uint64_t pos = tail_.load(std::memory_order_relaxed);
+            Slot *slot;
+            for (;;)
+            {
+                slot = &slots_[pos & (CAPACITY - 1)];
+                const uint64_t seq = slot->seq.load(std::memory_order_acquire);
+                const int64_t diff = static_cast<int64_t>(seq - pos);
+                if (diff == 0)
+                {
+                    if (tail_.compare_exchange_weak(pos, pos + 1,
+                                                    std::memory_order_relaxed))
+                        break;
+                }
+                else if (diff < 0)
+                {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                    pos = tail_.load(std::memory_order_relaxed);
+            }
+
+            Record &r = slot->record;
+            r.level = level;
+            r.time = std::chrono::system_clock::now().time_since_epoch().count();
+            r.message = message;
+            r.fieldCount = 0;
+            size_t used = 0;
+            for (const auto &f : fields)
+            {
+                if (r.fieldCount == MAX_FIELDS)
+                    break;
+                Field &out = r.fields[r.fieldCount++];
+                out.key = f.key;
+                out.isNum = f.isNum;
+                out.num = f.isNum ? f.num : static_cast<int64_t>(f.len);
+                out.offset = used;
+                out.len = f.isNum ? 0 : std::min(f.len, TEXT_SIZE - used);
+                if (out.len)
+                    memcpy(r.text + used, f.str, out.len);
+                used += out.len;
+            }
+            slot->seq.store(pos + 1, std::memory_order_release);
+
+            startWorker();
+            if (sleeping_.load(std::memory_order_acquire))
+                wake_.notify_one();
+            return true;
+        }
+
+        /// Blocks until records queued so far were written to the sink
+        void flush()
+        {
+            const uint64_t target = tail_.load(std::memory_order_acquire);
+            while (written_.load(std::memory_order_acquire) < target)
+            {
+                wake_.notify_one();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        void setLevel(const LogLevel &level) noexcept
+        { level_.store(level, std::memory_order_relaxed); }
+
+        LogLevel getLevel() const noexcept
+        { return level_.load(std::memory_order_relaxed); }
+
+        /// Replaces default stderr sink. Sink is called from the background
+        /// thread only.
+        void setSink(const Sink &sink)
+        {
+            std::lock_guard<std::mutex> lock(sinkMutex_);
+            sink_ = sink;
+        }
+
+        /// Number of records dropped because the ring was full
+        uint64_t dropped() const noexcept
+        { return dropped_.load(std::memory_order_relaxed); }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        struct Field
+        {
+            const char *key;
+            int64_t num; // value or original string length
+            uint32_t offset;
+            uint32_t len;
+            bool isNum;
+        };
+
+        struct Record
+        {
+            LogLevel level;
+            int64_t time;
+            const char *message;
+            size_t fieldCount;
+            Field fields[MAX_FIELDS];
+            char text[TEXT_SIZE];
+        };
+
+        struct Slot
+        {
+            std::atomic<uint64_t> seq;
+            Record record;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        Slot *slots_;
+        alignas(64) std::atomic<uint64_t> tail_{0};
+        alignas(64) uint64_t head_ = 0; // consumer only
+        std::atomic<uint64_t> written_{0};
+        std::atomic<uint64_t> dropped_{0};
+        std::atomic<LogLevel> level_{LogLevel::info};
+
+        std::once_flag started_;
+        std::thread worker_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::atomic<bool> sleeping_{false};
+        bool running_ = true;
+
+        std::mutex sinkMutex_;
+        Sink sink_;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        void startWorker() noexcept
+        {
+            try
+            {
+                std::call_once(started_, [this]
+                               { worker_ = std::thread([this] { run(); }); });
+            }
+            catch (...) {}
+        }
+
+        void run()
+        {
+            for (;;)
+            {
+                if (drain())
+                    continue;
+
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (!running_)
+                    break;
+                sleeping_.store(true, std::memory_order_release);
+                // Timeout covers notification racing with going to sleep
+                wake_.wait_for(lock, std::chrono::milliseconds(50));
+                sleeping_.store(false, std::memory_order_release);
+            }
+            drain();
+        }
+
+        // Writes all committed records, returns false if there were none
+        bool drain()
+        {
+            bool any = false;
+            for (;;)
+            {
+                Slot &slot = slots_[head_ & (CAPACITY - 1)];
+                if (slot.seq.load(std::memory_order_acquire) != head_ + 1)
+                    return any;
+
+                // logfmt style, truncated values are marked with
+                // "...(<original length>)"
+                const Record &r = slot.record;
+                string line = timestamp(r.time);
+                line += " ";
+                line += logLevelName(r.level);
+                line += " ";
+                line += r.message;
+                for (size_t i = 0; i < r.fieldCount; ++i)
+                {
+                    const Field &f = r.fields[i];
+                    line += " ";
+                    line += f.key;
+                    line += "=";
+                    if (f.isNum)
+                        line += std::to_string(f.num);
+                    else
+                    {
+                        appendQuoted(line, r.text + f.offset, f.len);
+                        if (static_cast<int64_t>(f.len) < f.num)
+                            line += "...(" + std::to_string(f.num) + ")";
+                    }
+                }
+                const LogLevel level = r.level;
+                slot.seq.store(head_ + CAPACITY, std::memory_order_release);
+                ++head_;
+
+                write(level, line);
+                written_.fetch_add(1, std::memory_order_release);
+                any = true;
+            }
+        }
+
+        void write(const LogLevel &level, const string &line)
+        {
+            std::lock_guard<std::mutex> lock(sinkMutex_);
+            if (sink_)
+                sink_(level, line);
+            else
+            {
+                fwrite(line.data(), 1, line.size(), stderr);
+                fputc('\n', stderr);
+            }
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static string timestamp(const int64_t &time)
+        {
+            using namespace std::chrono;
+
+            const system_clock::duration since(time);
+            const time_t seconds = duration_cast<std::chrono::seconds>(since).count();
+            const auto micros =
+            duration_cast<microseconds>(since).count() % 1000000;
+
+            tm utc;
+            gmtime_r(&seconds, &utc);
+            char buffer[40];
+            const size_t n = strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S",
+                                      &utc);
+            snprintf(buffer + n, sizeof(buffer) - n, ".%06lldZ",
+                     static_cast<long long>(micros));
+            return buffer;
+        }
+
+        static void appendQuoted(string &out, const char *str, const size_t &len)
+        {
+            out += '"';
+            for (size_t i = 0; i < len; ++i)
+            {
+                const char c = str[i];
+                if (c == '"' || c == '\\')
+                { out += '\\'; out += c; }
+                else if (c == '\n')
+                    out += "\\n";
+                else if (c == '\r')
+                    out += "\\r";
+                else
+                    out += c;
+            }
+            out += '"';
+        }
+    };
+}
+
+#define BFX_LOG(level, ...) \
+    do { \
+        if (BfxAPI::Logger::instance().isEnabled(level)) \
+            BfxAPI::Logger::instance().log(level, __VA_ARGS__); \
+    } while (0)
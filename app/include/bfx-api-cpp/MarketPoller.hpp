@@ -0,0 +1,337 @@
+////////////////////////////////////////////////////////////////////////////////
+//  MarketPoller.hpp
+//
+//
+//  Bitfinex REST API C++ client - market data polling into ring buffers
+//
+//
+//  MarketPoller polls tickers, trades and order books of a symbol list
+//  (concurrently, see FanOut) and publishes typed records to SpscRing or
+//  MpscRing buffers read by strategy threads. Tickers and trades are
+//  decoded straight into claimed ring slots. Order books are published as
+//  BookDelta records, changes of price levels since the previous poll.
+//  Trades are published once, oldest first. Records which don't fit into
+//  a full ring are dropped and counted. Book deltas hold absolute level
+//  amounts, so after a drop the next poll publishes changes since the last
+//  fully published snapshot again. With an Executor, responses are decoded
+//  on its workers, which then publish concurrently - MpscRing only.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// internal decoders
+#include "decoders.hpp"
+
+// internal FanOut
+#include "FanOut.hpp"
+
+// internal RingBuffer
+#include "RingBuffer.hpp"
+
+// namespaces
+using std::string;
+using std::vector;
+
+
+namespace BfxAPI
+{
+
+    // Ring record, symbol is index to MarketPoller::getSymbols()
+    template <typename Record>
+    struct MarketEvent
+    {
+        uint32_t symbol;
+        Record record;
+    };
+
+    template <template <typename> class Ring>
+    class MarketPoller
+    {
+    public:
+
+        using TickerRing = Ring<MarketEvent<jsonutils::Ticker>>;
+        using TradeRing = Ring<MarketEvent<jsonutils::Trade>>;
+        using BookRing = Ring<MarketEvent<jsonutils::BookDelta>>;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        MarketPoller(BitfinexAPI &api,
+                     const vector<string> &symbols,
+                     size_t maxInFlight = 8):
+        fanOut_(api, maxInFlight),
+        symbols_(symbols),
+        books_(symbols.size()),
+        lastTids_(symbols.size(), 0)
+        {
+            for (uint32_t i = 0; i < symbols_.size(); ++i)
+                ids_.emplace(symbols_[i], i);
+        }
+
+        MarketPoller(const MarketPoller&) = delete;
+        MarketPoller& operator = (const MarketPoller&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Accessors
+        ////////////////////////////////////////////////////////////////////////
+
+        const vector<string>& getSymbols() const noexcept
+        { return symbols_; }
+
+        /// Records written to rings
+        uint64_t published() const noexcept
+        { return published_.load(std::memory_order_relaxed); }
+
+        /// Records lost because ring was full
+        uint64_t dropped() const noexcept
+        { return dropped_.load(std::memory_order_relaxed); }
+
+        /// Failed requests and undecodable responses
+        uint64_t errors() const noexcept
+        { return errors_.load(std::memory_order_relaxed); }
+
+        // Rings must outlive the poller, nullptr stops publishing
+        void publishTickers(TickerRing *ring) noexcept
+        { tickers_ = ring; }
+
+        void publishTrades(TradeRing *ring) noexcept
+        { trades_ = ring; }
+
+        void publishBookDeltas(BookRing *ring, unsigned depth = 50) noexcept
+        {
+            books_.assign(symbols_.size(), Book());
+            bookDeltas_ = ring;
+            depth_ = depth;
+        }
+
+        // Executor must outlive the poller, nullptr decodes on polling thread
+        void setExecutor(Executor *executor) noexcept
+        {
+            static_assert(std::is_same<TickerRing, MpscRing<MarketEvent<
+                          jsonutils::Ticker>>>::value,
+                          "executor workers publish concurrently, "
+                          "use MpscRing");
+            fanOut_.setExecutor(executor);
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Polls every published endpoint for all symbols once
+        void pollOnce()
+        {
+            if (tickers_)
+                fanOut_.each(symbols_,
+                    [](BitfinexAPI &api, const string &symbol)
+                    { api.getTicker(symbol); },
+                    [this](const string &symbol,
+                           BitfinexAPI::AsyncResult &result)
+                    {
+                        RingSink<jsonutils::Ticker> sink{*this, *tickers_,
+                                                         ids_.at(symbol)};
+                        if (result.hasApiError() ||
+                            jsonutils::decodeTickerTo(result.response, sink)
+                            != noError)
+                            errors_.fetch_add(1, std::memory_order_relaxed);
+                    });
+
+            if (trades_)
+                fanOut_.each(symbols_,
+                    [](BitfinexAPI &api, const string &symbol)
+                    { api.getTrades(symbol); },
+                    [this](const string &symbol,
+                           BitfinexAPI::AsyncResult &result)
+                    {
+                        const uint32_t id = ids_.at(symbol);
+                        RingSink<jsonutils::Trade> sink{*this, *trades_, id};
+                        if (result.hasApiError() ||
+                            jsonutils::decodeTradesTo(result.response, sink,
+                                                      lastTids_[id])
+                            != noError)
+                            errors_.fetch_add(1, std::memory_order_relaxed);
+                    });
+
+            if (bookDeltas_)
+                fanOut_.each(symbols_,
+                    [this](BitfinexAPI &api, const string &symbol)
+                    { api.getOrderBook(symbol, depth_, depth_); },
+                    [this](const string &symbol,
+                           BitfinexAPI::AsyncResult &result)
+                    {
+                        const uint32_t id = ids_.at(symbol);
+                        Book &book = books_[id];
+                        if (result.hasApiError() ||
+                            jsonutils::decodeOrderBook(result.response,
+                                                       book.next) != noError)
+                        {
+                            errors_.fetch_add(1, std::memory_order_relaxed);
+                            return;
+                        }
+                        const bool bids =
+                        publishDeltas(id, book.last.bids, book.next.bids,
+                                      jsonutils::Side::buy);
+                        const bool asks =
+                        publishDeltas(id, book.last.asks, book.next.asks,
+                                      jsonutils::Side::sell);
+                        // dropped deltas are published by next poll
+                        if (bids && asks)
+                            std::swap(book.last, book.next);
+                    });
+        }
+
+        /// Polls until running is false, starting a poll at most once per
+        /// interval
+        void run(const std::atomic<bool> &running,
+                 const std::chrono::milliseconds &interval)
+        {
+            auto next = std::chrono::steady_clock::now();
+            while (running.load(std::memory_order_relaxed))
+            {
+                pollOnce();
+                next += interval;
+                const auto now = std::chrono::steady_clock::now();
+                if (next > now)
+                    std::this_thread::sleep_until(next);
+                else
+                    next = now;
+            }
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        // Decoder sink claiming event slots of ring
+        template <typename Record>
+        struct RingSink
+        {
+            MarketPoller &poller;
+            Ring<MarketEvent<Record>> &ring;
+            uint32_t symbol;
+            MarketEvent<Record> *event = nullptr;
+
+            Record* claim() noexcept
+            {
+                event = ring.claim();
+                if (!event)
+                {
+                    poller.dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                event->symbol = symbol;
+                return &event->record;
+            }
+
+            void commit(Record*) noexcept
+            {
+                ring.commit(event);
+                poller.published_.fetch_add(1, std::memory_order_relaxed);
+            }
+        };
+
+        // Last published and currently decoded snapshot of symbol book
+        struct Book
+        {
+            jsonutils::OrderBook last;
+            jsonutils::OrderBook next;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        FanOut fanOut_;
+        vector<string> symbols_;
+        std::unordered_map<string, uint32_t> ids_;
+        TickerRing *tickers_ = nullptr;
+        TradeRing *trades_ = nullptr;
+        BookRing *bookDeltas_ = nullptr;
+        unsigned depth_ = 50;
+        // per symbol state, indexed by symbol id
+        vector<Book> books_;
+        vector<int64_t> lastTids_;
+        std::atomic<uint64_t> published_{0};
+        std::atomic<uint64_t> dropped_{0};
+        std::atomic<uint64_t> errors_{0};
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // Merges two book sides sorted from the best price, publishes added
+        // and changed levels and removed ones with zero amount. Returns false
+        // if some deltas were dropped.
+        bool publishDeltas(uint32_t id,
+                           const vector<jsonutils::BookLevel> &before,
+                           const vector<jsonutils::BookLevel> &after,
+                           jsonutils::Side side)
+        {
+            const int64_t now = std::chrono::duration_cast<
+                std::chrono::nanoseconds>(std::chrono::system_clock::now()
+                                          .time_since_epoch()).count();
+            auto ahead = [side](double a, double b)
+            { return side == jsonutils::Side::buy ? a > b : a < b; };
+
+            RingSink<jsonutils::BookDelta> sink{*this, *bookDeltas_, id};
+            bool complete = true;
+            auto publish = [&](int64_t timestamp, double price, double amount)
+            {
+                jsonutils::BookDelta *delta = sink.claim();
+                if (!delta)
+                {
+                    complete = false;
+                    return;
+                }
+                *delta = jsonutils::BookDelta();
+                delta->timestamp = timestamp;
+                delta->price = price;
+                delta->amount = amount;
+                delta->side = side;
+                sink.commit(delta);
+            };
+
+            size_t i = 0, j = 0;
+            while (i < before.size() || j < after.size())
+            {
+                if (j == after.size() ||
+                    (i < before.size() && ahead(before[i].price,
+                                                after[j].price)))
+                {
+                    publish(now, before[i].price, 0);
+                    ++i;
+                }
+                else if (i == before.size() ||
+                         ahead(after[j].price, before[i].price))
+                {
+                    publish(after[j].timestamp, after[j].price,
+                            after[j].amount);
+                    ++j;
+                }
+                else
+                {
+                    if (after[j].amount != before[i].amount)
+                        publish(after[j].timestamp, after[j].price,
+                                after[j].amount);
+                    ++i;
+                    ++j;
+                }
+            }
+            return complete;
+        }
+    };
+}
@@ -0,0 +1,354 @@
+////////////////////////////////////////////////////////////////////////////////
+//  Metrics.hpp
+//
+//
+//  Bitfinex REST API C++ client - metrics registry and OpenMetrics exposition
+//
+//
+//  Hot path counters are sharded per thread (ShardedCounters) and summed only
+//  when metrics are rendered. MetricsRegistry holds collectors which write
+//  their current values into MetricsWriter on every scrape. Rendered text
+//  follows OpenMetrics 1.0 and can be dumped on demand or served from an
+//  embedded HTTP endpoint bound to localhost.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// POSIX
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// namespaces
+using std::map;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+
+namespace BfxAPI
+{
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Counters
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// N counters sharded per thread. Threads are spread over shards round
+    /// robin so that concurrent increments don't share cache lines.
+    template <size_t N>
+    class ShardedCounters
+    {
+        static constexpr size_t SHARDS = 16;
+
+    public:
+
+        void add(const size_t &i, const uint64_t &n = 1) noexcept
+        {
+            shards_[shardIndex()].values[i < N ? i : N - 1]
+            .fetch_add(n, std::memory_order_relaxed);
+        }
+
+        uint64_t value(const size_t &i) const noexcept
+        {
+            uint64_t sum = 0;
+            for (const auto &shard : shards_)
+                sum += shard.values[i].load(std::memory_order_relaxed);
+            return sum;
+        }
+
+        static constexpr size_t size() noexcept { return N; }
+
+    private:
+
+        struct alignas(64) Shard
+        {
+            std::atomic<uint64_t> values[N] = {};
+        };
+
+        Shard shards_[SHARDS];
+
+        static size_t shardIndex() noexcept
+        {
+            static std::atomic<size_t> next{0};
+            thread_local const size_t index =
+            next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+            return index;
+        }
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // OpenMetrics writer
+    ////////////////////////////////////////////////////////////////////////////
+
+    class MetricsWriter
+    {
+    public:
+
+        using Labels = vector<std::pair<string, string>>;
+
+        /// Declares metric family, repeated declarations are ignored
+        void family(const string &name, const string &type, const string &help)
+        {
+            if (families_.count(name))
+                return;
+            order_.push_back(name);
+            families_[name] = Family{type, help, string()};
+        }
+
+        /// Adds sample name + suffix of declared family
+        void sample(const string &name,
+                    const string &suffix,
+                    const Labels &labels,
+                    const double &value)
+        {
+            auto it = families_.find(name);
+            if (it == families_.end())
+                return;
+
+            string &out = it->second.samples;
+            out += name + suffix;
+            if (!labels.empty())
+            {
+                out += "{";
+                for (size_t i = 0; i < labels.size(); ++i)
+                {
+                    if (i)
+                        out += ",";
+                    out += labels[i].first + "=\"" + escape(labels[i].second)
+                    + "\"";
+                }
+                out += "}";
+            }
+
+            char buffer[32];
+            snprintf(buffer, sizeof(buffer), " %.10g\n", value);
+            out += buffer;
+        }
+
+        string str() const
+        {
+            string out;
+            for (const auto &name : order_)
+            {
+                const Family &f = families_.at(name);
+                out += "# TYPE " + name + " " + f.type + "\n";
+                out += "# HELP " + name + " " + f.help + "\n";
+                out += f.samples;
+            }
+            out += "# EOF\n";
+            return out;
+        }
+
+    private:
+
+        struct Family
+        {
+            string type;
+            string help;
+            string samples;
+        };
+
+        vector<string> order_;
+        unordered_map<string, Family> families_;
+
+        static string escape(const string &value)
+        {
+            string out;
+            for (const char c : value)
+            {
+                if (c == '\\' || c == '"')
+                    out += '\\';
+                if (c == '\n')
+                { out += "\\n"; continue; }
+                out += c;
+            }
+            return out;
+        }
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Registry
+    ////////////////////////////////////////////////////////////////////////////
+
+    class MetricsRegistry
+    {
+    public:
+
+        using Collector = std::function<void(MetricsWriter&)>;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        MetricsRegistry() {}
+
+        MetricsRegistry(const MetricsRegistry&) = delete;
+        MetricsRegistry& operator = (const MetricsRegistry&) = delete;
+
+        ~MetricsRegistry() { stopServer(); }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Returns id for remove()
+        size_t add(const Collector &collector)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            collectors_[++lastId_] = collector;
+            return lastId_;
+        }
+
+        void remove(const size_t &id)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            collectors_.erase(id);
+        }
+
+        /// Renders OpenMetrics text exposition
+        string render() const
+        {
+            MetricsWriter writer;
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto &collector : collectors_)
+                collector.second(writer);
+            return writer.str();
+        }
+
+        /// Writes rendered metrics to path (atomically replaced)
+        bool dump(const string &path) const
+        {
+            const string tmpPath = path + ".tmp";
+            FILE *f = fopen(tmpPath.c_str(), "w");
+            if (!f)
+                return false;
+
+            const string text = render();
+            const bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+            fclose(f);
+            return ok && rename(tmpPath.c_str(), path.c_str()) == 0;
+        }
+
+        /// Serves metrics over HTTP on 127.0.0.1:port from background thread
+        bool startServer(const uint16_t &port = 9464)
+        {
+            if (serverFd_ >= 0)
+                return false;
+
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0)
+                return false;
+
+            int yes = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) ||
+                listen(fd, 8))
+            {
+                close(fd);
+                return false;
+            }
+
+            serverFd_ = fd;
+            running_ = true;
+            server_ = std::thread([this] { serve(); });
+            return true;
+        }
+
+        void stopServer()
+        {
+            if (serverFd_ < 0)
+                return;
+
+            running_ = false;
+            if (server_.joinable())
+                server_.join();
+            close(serverFd_);
+            serverFd_ = -1;
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        mutable std::mutex mutex_;
+        map<size_t, Collector> collectors_;
+        size_t lastId_ = 0;
+
+        int serverFd_ = -1;
+        std::atomic<bool> running_{false};
+        std::thread server_;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        void serve()
+        {
+            while (running_)
+            {
+                pollfd pfd = {serverFd_, POLLIN, 0};
+                if (poll(&pfd, 1, 200) <= 0)
+                    continue;
+
+                int client = accept(serverFd_, nullptr, nullptr);
+                if (client < 0)
+                    continue;
+
+                // Any request gets the metrics, read just the request head
+                char buffer[4096];
+                pollfd cfd = {client, POLLIN, 0};
+                if (poll(&cfd, 1, 1000) > 0)
+                {
+                    if (recv(client, buffer, sizeof(buffer), 0)) {}
+                }
+
+                const string body = render();
+                const string response =
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Type: application/openmetrics-text; version=1.0.0; "
+                "charset=utf-8\r\n"
+                "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                "Connection: close\r\n\r\n" + body;
+
+                #ifdef MSG_NOSIGNAL
+                const int flags = MSG_NOSIGNAL;
+                #else
+                const int flags = 0;
+                #endif
+                size_t sent = 0;
+                while (sent < response.size())
+                {
+                    const ssize_t n = send(client, response.data() + sent,
+                                           response.size() - sent, flags);
+                    if (n <= 0)
+                        break;
+                    sent += n;
+                }
+                close(client);
+            }
+        }
+    };
+}
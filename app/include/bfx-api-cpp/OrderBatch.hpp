@@ -0,0 +1,410 @@
+////////////////////////////////////////////////////////////////////////////////
+//  OrderBatch.hpp
+//
+//
+//  Bitfinex REST API C++ client - placing and cancelling many orders at once
+//
+//
+//  OrderBatch validates orders like newOrder() does, splits valid ones into
+//  /order/new/multi/ requests of at most BitfinexAPI::MAX_MULTI_ORDERS
+//  orders and sends them concurrently, with at most maxInFlight requests in
+//  flight. Result of every order is reported at its index: the order as
+//  accepted by the exchange, or status codes of its validation or of the
+//  failed request. A failed request fails only orders of its chunk.
+//
+//  CancelBatch spreads order IDs over concurrent /order/cancel/multi/
+//  requests and reports IDs of requests the exchange acknowledged. The
+//  exchange answers a whole request, not each ID: an acknowledged ID of an
+//  order already filled or cancelled isn't cancelled by it, OrderCache or
+//  /order/status/ tell. Cancellations have their own rate limiter bucket
+//  (EndpointGroup::cancels) so queued placements don't delay them, and
+//  warmUp() opens connections ahead of time.
+//
+//  Requests are sent by RequestScheduler. Nonce of each request is renewed
+//  just before sending, so nonces increase in sending order. A request
+//  which still overtakes a later nonce on another connection is rejected
+//  without being executed and is resent with a fresh nonce. Other failures
+//  are retried as Retrier decides, placements only if the request was
+//  never sent.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <unordered_set>
+#include <vector>
+
+// internal BitfinexAPI
+#include "BitfinexAPI.hpp"
+
+// internal decoders
+#include "decoders.hpp"
+
+// internal RequestScheduler
+#include "RequestScheduler.hpp"
+
+// namespaces
+using std::vector;
+
+
+namespace BfxAPI
+{
+
+    // Outcome of one order, order is valid if ok()
+    struct OrderResult
+    {
+        jsonutils::Order order = jsonutils::Order();
+        CURLcode curlStatusCode = CURLE_OK;
+        long httpStatusCode = 0;
+        BfxClientErrors bfxApiStatusCode = noError;
+
+        bool ok() const noexcept
+        { return bfxApiStatusCode == noError && curlStatusCode == CURLE_OK; }
+    };
+
+    struct BatchResult
+    {
+        vector<OrderResult> orders; // indexed like submitted orders
+        size_t placed = 0;
+        size_t failed = 0;
+
+        bool ok() const noexcept
+        { return failed == 0; }
+    };
+
+    struct CancelFailure
+    {
+        long long id;
+        CURLcode curlStatusCode;
+        long httpStatusCode;
+        BfxClientErrors bfxApiStatusCode;
+    };
+
+    struct CancelResult
+    {
+        // in requests acknowledged by exchange, not confirmed per ID
+        BitfinexAPI::vIds acknowledged;
+        vector<CancelFailure> failed;
+
+        bool ok() const noexcept
+        { return failed.empty(); }
+    };
+
+    // Sends authenticated requests of OrderBatch and CancelBatch
+    // concurrently
+    class BatchSender
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Accessors
+        ////////////////////////////////////////////////////////////////////////
+
+        size_t getMaxInFlight() const noexcept
+        { return scheduler_.getMaxInFlight(); }
+
+        void setMaxInFlight(size_t maxInFlight) noexcept
+        { scheduler_.setMaxInFlight(maxInFlight); }
+
+    protected:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        BatchSender(BitfinexAPI &api, size_t maxInFlight):
+        api_(api),
+        scheduler_(api, maxInFlight)
+        {}
+
+        ////////////////////////////////////////////////////////////////////////
+        // Protected types
+        ////////////////////////////////////////////////////////////////////////
+
+        // One request of the batch
+        struct Chunk: ScheduledRequest
+        {
+            vector<size_t> indices; // of its items in the batch
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Protected attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        BitfinexAPI &api_;
+        RequestScheduler scheduler_;
+    };
+
+    class OrderBatch: public BatchSender
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        explicit OrderBatch(BitfinexAPI &api, size_t maxInFlight = 4):
+        BatchSender(api, maxInFlight),
+        chunkSize_(BitfinexAPI::MAX_MULTI_ORDERS)
+        {}
+
+        ////////////////////////////////////////////////////////////////////////
+        // Accessors
+        ////////////////////////////////////////////////////////////////////////
+
+        size_t getChunkSize() const noexcept
+        { return chunkSize_; }
+
+        // Orders per request, 1 up to BitfinexAPI::MAX_MULTI_ORDERS
+        void setChunkSize(size_t chunkSize) noexcept
+        {
+            chunkSize_ = chunkSize > BitfinexAPI::MAX_MULTI_ORDERS
+            ? BitfinexAPI::MAX_MULTI_ORDERS
+            : std::max<size_t>(chunkSize, 1);
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Places orders, returns when all requests are done
+        BatchResult place(const BitfinexAPI::vOrders &orders)
+        {
+            BatchResult result;
+            result.orders.resize(orders.size());
+
+            vector<size_t> valid;
+            valid.reserve(orders.size());
+            for (size_t i = 0; i < orders.size(); ++i)
+            {
+                const BfxClientErrors code = api_.checkOrder(orders[i]);
+                if (code != noError)
+                    result.orders[i].bfxApiStatusCode = code;
+                else
+                    valid.push_back(i);
+            }
+
+            auto complete = [&result](const Chunk &chunk,
+                                      BitfinexAPI::AsyncResult &done)
+            { spread(chunk, done, result); };
+
+            std::deque<Chunk> chunks;
+            std::deque<Chunk*> ready;
+            BitfinexAPI::vOrders part;
+            for (size_t first = 0; first < valid.size(); first += chunkSize_)
+            {
+                chunks.emplace_back();
+                Chunk &chunk = chunks.back();
+                chunk.indices.assign(valid.begin() + first,
+                                     valid.begin() + std::min(first + chunkSize_,
+                                                              valid.size()));
+                part.clear();
+                for (const size_t i : chunk.indices)
+                    part.push_back(orders[i]);
+
+                BitfinexAPI::AsyncResult done;
+                if (api_.prepare([&](BitfinexAPI &api) { api.newOrders(part); },
+                                 chunk.request, done))
+                    ready.push_back(&chunk);
+                else
+                    complete(chunk, done);
+            }
+            scheduler_.run(std::move(ready), complete);
+
+            for (const OrderResult &order : result.orders)
+                ++(order.ok() ? result.placed : result.failed);
+            return result;
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        size_t chunkSize_;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // Spreads final result of chunk request to its orders
+        static void spread(const Chunk &chunk,
+                           BitfinexAPI::AsyncResult &done,
+                           BatchResult &result)
+        {
+            vector<jsonutils::Order> placed;
+            BfxClientErrors code = done.bfxApiStatusCode;
+            if (!done.hasApiError())
+            {
+                code = jsonutils::decodeOrders(done.response, placed);
+                if (code == noError && placed.size() != chunk.indices.size())
+                    code = responseSchemaError;
+            }
+
+            for (size_t i = 0; i < chunk.indices.size(); ++i)
+            {
+                OrderResult &out = result.orders[chunk.indices[i]];
+                out.curlStatusCode = done.curlStatusCode;
+                out.httpStatusCode = done.httpStatusCode;
+                out.bfxApiStatusCode = code;
+                if (out.ok())
+                    out.order = placed[i];
+            }
+        }
+    };
+
+    class CancelBatch: public BatchSender
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        explicit CancelBatch(BitfinexAPI &api, size_t maxInFlight = 8):
+        BatchSender(api, maxInFlight),
+        maxChunkSize_(MAX_CHUNK_SIZE)
+        {}
+
+        ////////////////////////////////////////////////////////////////////////
+        // Accessors
+        ////////////////////////////////////////////////////////////////////////
+
+        size_t getMaxChunkSize() const noexcept
+        { return maxChunkSize_; }
+
+        void setMaxChunkSize(size_t maxChunkSize) noexcept
+        { maxChunkSize_ = std::max<size_t>(maxChunkSize, 1); }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Opens up to maxInFlight keep-alive connections of the calling
+        /// thread transport with concurrent GET /symbols/ requests, so that
+        /// cancel() doesn't pay for TCP and TLS handshakes. Stops early
+        /// rather than wait for rate limiter or reserve its future tokens.
+        /// Idle connections get closed by the server, warm up periodically
+        /// while orders rest. Returns number of connections which answered.
+        size_t warmUp()
+        {
+            size_t answered = 0;
+            size_t inFlight = 0;
+            const BitfinexAPI::PreparedRequest symbols{false, "/symbols/",
+                                                       {}, "", nullptr};
+            for (size_t i = 0; i < getMaxInFlight(); ++i)
+            {
+                if (!api_.getRateLimiter().tryAcquire(symbols.path))
+                    break;
+                ++inFlight;
+                api_.submit(symbols, [&](BitfinexAPI::AsyncResult &done)
+                {
+                    --inFlight;
+                    if (done.curlStatusCode == CURLE_OK)
+                        ++answered;
+                });
+            }
+            while (inFlight)
+                api_.poll(std::chrono::milliseconds(100));
+            return answered;
+        }
+
+        /// Cancels orders, returns when all requests are done. IDs are
+        /// spread evenly over up to maxInFlight requests of at least
+        /// MIN_CHUNK_SIZE IDs, more requests are sent only if chunks would
+        /// exceed max chunk size. Duplicate IDs are cancelled once.
+        CancelResult cancel(const BitfinexAPI::vIds &ids)
+        {
+            BitfinexAPI::vIds unique;
+            unique.reserve(ids.size());
+            std::unordered_set<long long> seen;
+            for (const long long id : ids)
+                if (seen.insert(id).second)
+                    unique.push_back(id);
+
+            CancelResult result;
+            if (unique.empty())
+                return result;
+
+            size_t requests = (unique.size() + MIN_CHUNK_SIZE - 1) /
+                              MIN_CHUNK_SIZE;
+            requests = std::min(requests, getMaxInFlight());
+            requests = std::max(requests, (unique.size() + maxChunkSize_ - 1) /
+                                          maxChunkSize_);
+            const size_t chunkSize = (unique.size() + requests - 1) / requests;
+
+            auto complete = [&](const Chunk &chunk,
+                                BitfinexAPI::AsyncResult &done)
+            {
+                const bool acknowledged = isAcknowledged(done);
+                for (const size_t i : chunk.indices)
+                    if (acknowledged)
+                        result.acknowledged.push_back(unique[i]);
+                    else
+                        result.failed.push_back({unique[i],
+                                                 done.curlStatusCode,
+                                                 done.httpStatusCode,
+                                                 done.bfxApiStatusCode});
+            };
+
+            std::deque<Chunk> chunks;
+            std::deque<Chunk*> ready;
+            BitfinexAPI::vIds part;
+            for (size_t first = 0; first < unique.size(); first += chunkSize)
+            {
+                chunks.emplace_back();
+                Chunk &chunk = chunks.back();
+                const size_t last = std::min(first + chunkSize, unique.size());
+                part.assign(unique.begin() + first, unique.begin() + last);
+                for (size_t i = first; i < last; ++i)
+                    chunk.indices.push_back(i);
+
+                BitfinexAPI::AsyncResult done;
+                if (api_.prepare([&](BitfinexAPI &api)
+                                 { api.cancelOrders(part); },
+                                 chunk.request, done))
+                    ready.push_back(&chunk);
+                else
+                    complete(chunk, done);
+            }
+            scheduler_.run(std::move(ready), complete);
+            return result;
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Class constants
+        ////////////////////////////////////////////////////////////////////////
+
+        static constexpr size_t MIN_CHUNK_SIZE = 10;
+        static constexpr size_t MAX_CHUNK_SIZE = 100;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        size_t maxChunkSize_;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // Exchange answers {"result":"Orders cancelled"}, errors come as
+        // {"message":"..."} which passes schema validation
+        static bool isAcknowledged(const BitfinexAPI::AsyncResult &done)
+        {
+            if (done.hasApiError() || done.httpStatusCode >= 300)
+                return false;
+            rj::Document d;
+            return !d.Parse(done.response.c_str()).HasParseError() &&
+                   d.IsObject() && d.HasMember("result") &&
+                   d["result"].IsString();
+        }
+    };
+}
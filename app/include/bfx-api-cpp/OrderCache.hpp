@@ -0,0 +1,397 @@
+////////////////////////////////////////////////////////////////////////////////
+//  OrderCache.hpp
+//
+//
+//  Bitfinex REST API C++ client - local state of own orders
+//
+//
+//  OrderCache keeps the last known state of orders of one client, keyed by
+//  order ID. It observes every HTTP exchange of the client (synchronous,
+//  asynchronous, OrderBatch, OrderTemplate) and updates orders from decoded
+//  responses of /order/new/, /order/new/multi/, /order/cancel/replace/,
+//  /order/status/ and cancellation endpoints, so strategies look orders up
+//  instead of asking the exchange.
+//
+//  Orders changed on the exchange side (fills, cancellation from another
+//  session) are picked up by reconciliation with /orders/ (active orders),
+//  run on demand or periodically from a background thread. An order live
+//  in the cache but missing in the active orders is no longer live. Every
+//  order remembers start of the request it was last updated from, responses
+//  of older requests don't overwrite newer state. Orders which are no longer
+//  live are dropped by the second reconciliation after their last update.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// internal BitfinexAPI
+#include "BitfinexAPI.hpp"
+
+// internal decoders
+#include "decoders.hpp"
+
+// namespaces
+using std::string;
+using std::vector;
+
+
+namespace BfxAPI
+{
+
+    class OrderCache
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        // Observes exchanges of api next to its other observers, see
+        // BitfinexAPI::addExchangeObserver(). Client must outlive the cache.
+        // Observer holds the orders only while it applies an exchange, so
+        // requests completing after destruction of the cache are ignored.
+        explicit OrderCache(BitfinexAPI &api):
+        api_(api),
+        state_(std::make_shared<State>()),
+        observerId_(api.addExchangeObserver(observer(state_)))
+        {}
+
+        ~OrderCache()
+        {
+            stopReconciling();
+            api_.removeExchangeObserver(observerId_);
+        }
+
+        OrderCache(const OrderCache&) = delete;
+        OrderCache& operator = (const OrderCache&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Accessors
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Copies order to out, false if the order is unknown
+        bool find(const int64_t &id, jsonutils::Order &out) const
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            const auto it = state_->orders.find(id);
+            if (it == state_->orders.end())
+                return false;
+            out = it->second.order;
+            return true;
+        }
+
+        bool isLive(const int64_t &id) const
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            const auto it = state_->orders.find(id);
+            return it != state_->orders.end() && it->second.order.isLive;
+        }
+
+        /// Live orders, of symbol only if not empty
+        vector<jsonutils::Order> live(const string &symbol = "") const
+        {
+            vector<jsonutils::Order> orders;
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            for (const auto &entry : state_->orders)
+                if (entry.second.order.isLive &&
+                    (symbol.empty() || symbol == entry.second.order.symbol))
+                    orders.push_back(entry.second.order);
+            return orders;
+        }
+
+        size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            return state_->orders.size();
+        }
+
+        /// Steady clock ns of the last applied /orders/ request, 0 if none
+        int64_t lastReconciled() const
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            return state_->reconciled;
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Applies completed exchange, called by client for every exchange.
+        /// Failed requests and unrelated endpoints are ignored.
+        void update(const HttpExchange &exchange)
+        { state_->update(exchange); }
+
+        /// Requests active orders from calling thread, the response
+        /// reconciles the cache
+        void reconcile()
+        { api_.getActiveOrders(); }
+
+        /// Reconciles from background thread at most once per interval.
+        /// Requests of the thread run in its own context, client must be in
+        /// thread-safe mode (BitfinexAPI::setThreadSafe()), false otherwise
+        /// or if already running.
+        bool startReconciling(const std::chrono::milliseconds &interval)
+        {
+            std::lock_guard<std::mutex> lock(stopMutex_);
+            if (!api_.isThreadSafe() || reconciler_.joinable())
+                return false;
+
+            stopping_ = false;
+            reconciler_ = std::thread([this, interval] { run(interval); });
+            return true;
+        }
+
+        void stopReconciling()
+        {
+            {
+                std::lock_guard<std::mutex> lock(stopMutex_);
+                if (!reconciler_.joinable())
+                    return;
+                stopping_ = true;
+            }
+            stop_.notify_all();
+            reconciler_.join();
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            state_->orders.clear();
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        struct Entry
+        {
+            jsonutils::Order order;
+            int64_t updated; // start of request the order comes from
+        };
+
+        // Cached orders, shared with the observer registered in client
+        struct State
+        {
+            mutable std::mutex mutex;
+            std::unordered_map<int64_t, Entry> orders;
+            // start of the last applied /orders/ request
+            int64_t reconciled = 0;
+
+            void update(const HttpExchange &exchange)
+            {
+                if (exchange.curlCode != CURLE_OK || exchange.httpCode < 200 ||
+                    exchange.httpCode >= 300)
+                    return;
+
+                const string &path = exchange.path;
+                if (path == "/order/new/" || path == "/order/status/")
+                    applyOrder(exchange, false);
+                else if (path == "/order/cancel/")
+                    applyOrder(exchange, true);
+                else if (path == "/order/cancel/replace/")
+                {
+                    // Replaced order is cancelled, response is the new one
+                    const vector<int64_t> ids = payloadIds(exchange.payload,
+                                                           "order_id");
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        cancel(ids, exchange.start);
+                    }
+                    applyOrder(exchange, false);
+                }
+                else if (path == "/order/new/multi/")
+                    applyOrders(exchange);
+                else if (path == "/order/cancel/multi/")
+                {
+                    const vector<int64_t> ids = payloadIds(exchange.payload,
+                                                           "order_ids");
+                    std::lock_guard<std::mutex> lock(mutex);
+                    cancel(ids, exchange.start);
+                }
+                else if (path == "/order/cancel/all/")
+                {
+                    // Orders placed after the request started survive it
+                    std::lock_guard<std::mutex> lock(mutex);
+                    for (auto &entry : orders)
+                        if (entry.second.order.isLive &&
+                            entry.second.updated <= exchange.start)
+                            markCancelled(entry.second, exchange.start);
+                }
+                else if (path == "/orders/")
+                    applyActive(exchange);
+            }
+
+            void applyOrder(const HttpExchange &exchange, bool cancelled)
+            {
+                jsonutils::Order order;
+                if (jsonutils::decodeOrder(exchange.response, order) != noError)
+                    return;
+
+                std::lock_guard<std::mutex> lock(mutex);
+                Entry *entry = store(order, exchange.start);
+                // Cancellation response may show the order before it took
+                // effect
+                if (entry && cancelled)
+                    markCancelled(*entry, exchange.start);
+            }
+
+            void applyOrders(const HttpExchange &exchange)
+            {
+                vector<jsonutils::Order> decoded;
+                if (jsonutils::decodeOrders(exchange.response, decoded) !=
+                    noError)
+                    return;
+
+                std::lock_guard<std::mutex> lock(mutex);
+                for (const auto &order : decoded)
+                    store(order, exchange.start);
+            }
+
+            void applyActive(const HttpExchange &exchange)
+            {
+                vector<jsonutils::Order> active;
+                if (jsonutils::decodeOrders(exchange.response, active) !=
+                    noError)
+                    return;
+
+                std::unordered_set<int64_t> ids;
+                std::lock_guard<std::mutex> lock(mutex);
+                if (exchange.start < reconciled)
+                    return;
+
+                for (const auto &order : active)
+                {
+                    ids.insert(order.id);
+                    store(order, exchange.start);
+                }
+                for (auto it = orders.begin(); it != orders.end(); )
+                {
+                    Entry &entry = it->second;
+                    if (entry.order.isLive && entry.updated < exchange.start &&
+                        !ids.count(it->first))
+                    {
+                        entry.order.isLive = false;
+                        entry.updated = exchange.start;
+                    }
+                    // not live since before the previous reconciliation
+                    if (!entry.order.isLive && entry.updated < reconciled)
+                        it = orders.erase(it);
+                    else
+                        ++it;
+                }
+                reconciled = exchange.start;
+            }
+
+            // Stores order unless cached one is newer, returns cached entry
+            // of the order if it was stored
+            Entry* store(const jsonutils::Order &order, const int64_t &start)
+            {
+                auto inserted = orders.emplace(order.id, Entry{order, start});
+                Entry &entry = inserted.first->second;
+                if (inserted.second)
+                    return &entry;
+                if (entry.updated > start)
+                    return nullptr;
+                entry.order = order;
+                entry.updated = start;
+                return &entry;
+            }
+
+            void cancel(const vector<int64_t> &ids, const int64_t &start)
+            {
+                for (const auto id : ids)
+                {
+                    const auto it = orders.find(id);
+                    if (it != orders.end() && it->second.updated <= start)
+                        markCancelled(it->second, start);
+                }
+            }
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        BitfinexAPI &api_;
+        const std::shared_ptr<State> state_;
+        const uint64_t observerId_;
+
+        std::mutex stopMutex_;
+        std::condition_variable stop_;
+        bool stopping_ = false;
+        std::thread reconciler_;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        void run(const std::chrono::milliseconds &interval)
+        {
+            std::unique_lock<std::mutex> lock(stopMutex_);
+            while (!stopping_)
+            {
+                lock.unlock();
+                reconcile();
+                lock.lock();
+                stop_.wait_for(lock, interval, [this] { return stopping_; });
+            }
+            lock.unlock();
+            api_.releaseContext();
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static ExchangeObserver observer(const std::shared_ptr<State> &state)
+        {
+            const std::weak_ptr<State> weak = state;
+            return [weak](const HttpExchange &exchange)
+            {
+                if (const auto locked = weak.lock())
+                    locked->update(exchange);
+            };
+        }
+
+        static void markCancelled(Entry &entry, const int64_t &start) noexcept
+        {
+            entry.order.isLive = false;
+            entry.order.isCancelled = true;
+            entry.updated = start;
+        }
+
+        // Order ID or array of order IDs at key of JSON payload
+        static vector<int64_t> payloadIds(const string &payload,
+                                          const char *key)
+        {
+            vector<int64_t> ids;
+            rj::Document d;
+            if (d.Parse(payload.c_str()).HasParseError() || !d.IsObject() ||
+                !d.HasMember(key))
+                return ids;
+
+            const rj::Value &value = d[key];
+            if (value.IsInt64())
+                ids.push_back(value.GetInt64());
+            else if (value.IsArray())
+                for (const auto &id : value.GetArray())
+                    if (id.IsInt64())
+                        ids.push_back(id.GetInt64());
+            return ids;
+        }
+    };
+}
@@ -0,0 +1,255 @@
+////////////////////////////////////////////////////////////////////////////////
+//  OrderTemplate.hpp
+//
+//
+//  Bitfinex REST API C++ client - pre-built order entry requests
+//
+//
+//  OrderTemplate fixes everything of newOrder() or replaceOrder() request
+//  except amount, price (and order ID of replaced order): symbol and type
+//  are validated once, constant parts of JSON payload are serialized once
+//  and payload, base64 and header buffers are reused. sign() only writes
+//  nonce and variable fields between the constant parts, encodes and signs
+//  the payload, it doesn't allocate once buffers have grown. Payload is
+//  byte for byte the one of the endpoint method.
+//
+//  Template keeps credentials of the client at creation and must not
+//  outlive it. Like the client, it is used by one thread at a time.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+
+// internal BitfinexAPI
+#include "BitfinexAPI.hpp"
+
+// namespaces
+using std::string;
+
+
+namespace BfxAPI
+{
+
+    class OrderTemplate
+    {
+    public:
+
+        using Callback = std::function<void(BitfinexAPI::AsyncResult&)>;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        // Same parameters as BitfinexAPI::newOrder() without amount and price
+        static OrderTemplate newOrder(BitfinexAPI &api,
+                                      const string &symbol,
+                                      const string &side,
+                                      const string &type,
+                                      const bool &is_hidden = false,
+                                      const bool &is_postonly = false,
+                                      const bool &use_all_available = false,
+                                      const bool &ocoorder = false,
+                                      const double &buy_price_oco = 0)
+        {
+            OrderTemplate order(api, "/order/new/", false,
+                                api.checkOrder({symbol, 0, 0, side, type}));
+            order.symbol_ = ",\"symbol\":\"" + symbol + "\",\"amount\":\"";
+            order.tail_ = "\",\"side\":\"" + side + "\"";
+            order.tail_ += ",\"type\":\"" + type + "\"";
+            order.tail_ += ",\"is_hidden\":" + bool2string(is_hidden);
+            order.tail_ += ",\"is_postonly\":" + bool2string(is_postonly);
+            order.tail_ += ",\"use_all_available\":" +
+                           bool2string(use_all_available);
+            order.tail_ += ",\"ocoorder\":" + bool2string(ocoorder);
+            order.tail_ += ",\"buy_price_oco\":" + bool2string(buy_price_oco);
+            order.tail_ += "}";
+            return order;
+        }
+
+        // Same parameters as BitfinexAPI::replaceOrder() without order ID,
+        // amount and price
+        static OrderTemplate replaceOrder(BitfinexAPI &api,
+                                          const string &symbol,
+                                          const string &side,
+                                          const string &type,
+                                          const bool &is_hidden = false,
+                                          const bool &use_remaining = false)
+        {
+            OrderTemplate order(api, "/order/cancel/replace/", true,
+                                api.checkOrder({symbol, 0, 0, side, type}));
+            order.symbol_ = ",\"symbol\":\"" + symbol + "\",\"amount\":\"";
+            order.tail_ = "\",\"side\":\"" + side + "\"";
+            order.tail_ += ",\"type\":\"" + type + "\"";
+            order.tail_ += ",\"is_hidden\":" + bool2string(is_hidden);
+            order.tail_ += ",\"use_all_available\":" +
+                           bool2string(use_remaining);
+            order.tail_ += "}";
+            return order;
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Accessors
+        ////////////////////////////////////////////////////////////////////////
+
+        /// badSymbol or badOrderType if template can't be sent
+        BfxClientErrors getStatus() const noexcept
+        { return status_; }
+
+        const string& getPath() const noexcept
+        { return request_.path; }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Builds and signs request with fresh nonce, request is valid until
+        /// next call. order_id is used by replaceOrder() template only.
+        const BitfinexAPI::SignedRequest& sign(const double &amount,
+                                               const double &price,
+                                               const long long &order_id = 0)
+        {
+            const int64_t start = steadyNowNs();
+            string &payload = request_.payload;
+            payload.assign(head_);
+            append(payload, "%llu",
+                   static_cast<unsigned long long>(nonces_->nextValue()));
+            payload += '"';
+            if (replace_)
+            {
+                payload += ",\"order_id\":";
+                append(payload, "%lld", order_id);
+            }
+            payload += symbol_;
+            append(payload, "%f", amount);
+            payload += "\",\"price\":\"";
+            append(payload, "%f", price);
+            payload += tail_;
+
+            string &encoded = request_.header["X-BFX-PAYLOAD"];
+            encoded.clear();
+            HTTPRequest::appendBase64(payload.data(), payload.size(), encoded);
+            if (signer_)
+            {
+                string &signature = request_.header["X-BFX-SIGNATURE"];
+                signature.resize(HmacSigner::DIGEST_HEX_SIZE);
+                signer_->sign(encoded.data(), encoded.size(), &signature[0]);
+            }
+            request_.signing = steadyNowNs() - start;
+            return request_;
+        }
+
+        /// Signs and sends order, repeats it with fresh nonce as Retrier
+        /// decides. Returns status of template without sending, rateLimited,
+        /// or status of response read from client as after newOrder().
+        BfxClientErrors send(const double &amount,
+                             const double &price,
+                             const long long &order_id = 0)
+        {
+            if (status_ != noError)
+                return status_;
+
+            for (unsigned attempt = 0; ; ++attempt)
+            {
+                if (!api_.post(sign(amount, price, order_id)))
+                    return rateLimited;
+                if (!api_.getRetrier().retry(request_.path, attempt,
+                                             api_.getCurlStatusCode(),
+                                             api_.getHttpStatusCode()))
+                    break;
+            }
+            api_.hasApiError();
+            return api_.getBfxApiStatusCode();
+        }
+
+        /// Asynchronous variant of send() without retries, callback is
+        /// invoked from BitfinexAPI::poll(), or right away if template is
+        /// invalid. Concurrent orders may reach the exchange out of nonce
+        /// order and be rejected, OrderBatch resends those.
+        void submit(const double &amount,
+                    const double &price,
+                    const Callback &callback)
+        { submit(amount, price, 0, callback); }
+
+        void submit(const double &amount,
+                    const double &price,
+                    const long long &order_id,
+                    const Callback &callback)
+        {
+            if (status_ != noError)
+            {
+                BitfinexAPI::AsyncResult result{string(), CURLE_OK, 0, status_};
+                callback(result);
+                return;
+            }
+            api_.submit(sign(amount, price, order_id), callback);
+        }
+
+        /// Connects ahead of first order, see BitfinexAPI::warmUp()
+        void warmUp()
+        { api_.warmUp(); }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        BitfinexAPI &api_;
+        std::shared_ptr<const HmacSigner> signer_;
+        std::shared_ptr<NonceSequence> nonces_;
+        BfxClientErrors status_;
+        bool replace_;
+        // constant parts of payload around nonce, order ID, amount and price
+        string head_;
+        string symbol_;
+        string tail_;
+        BitfinexAPI::SignedRequest request_;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        OrderTemplate(BitfinexAPI &api,
+                      const string &path,
+                      bool replace,
+                      BfxClientErrors status):
+        api_(api),
+        signer_(api.getSigner()),
+        nonces_(api.getNonces()),
+        status_(status),
+        replace_(replace),
+        head_("{\"request\":\"/v1" + path.substr(0, path.size() - 1) +
+              "\",\"nonce\":\""),
+        request_{path, string(), Transport::Header(), 0}
+        {
+            if (!api.getAccessKey().empty())
+                request_.header["X-BFX-APIKEY"] = api.getAccessKey();
+            request_.header["X-BFX-PAYLOAD"].reserve(512);
+            request_.payload.reserve(384);
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // Formats value like std::to_string() without temporary string
+        template <typename T>
+        static void append(string &out, const char *format, const T &value)
+        {
+            char buffer[std::numeric_limits<double>::max_exponent10 + 24];
+            const int size = snprintf(buffer, sizeof(buffer), format, value);
+            out.append(buffer, size);
+        }
+
+        static string bool2string(const bool &in)
+        { return in ? "true" : "false"; }
+    };
+}
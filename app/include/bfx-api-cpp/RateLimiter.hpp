@@ -0,0 +1,257 @@
+////////////////////////////////////////////////////////////////////////////////
+//  RateLimiter.hpp
+//
+//
+//  Bitfinex REST API C++ client - client-side rate limiting
+//
+//
+//  Every endpoint group has its own token bucket. Buckets are implemented as
+//  generic cell rate algorithm (GCRA) - the bucket state is a single atomic
+//  "theoretical arrival time" updated by compare-and-swap, so acquiring a
+//  token takes no locks.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <thread>
+
+// namespaces
+using std::string;
+
+
+namespace BfxAPI
+{
+
+    enum class EndpointGroup
+    {
+        publicTicker = 0,   // /pubticker/, /stats/, /symbols/, ...
+        publicBookTrades,   // /book/, /lendbook/, /trades/, /lends/
+        orders,             // order and offer placement, replacement
+        history,            // /history/, /mytrades/, /orders/hist/, ...
+        account,            // remaining authenticated endpoints
+        cancels,            // order and offer cancellation, own bucket so
+                            // that queued placements never delay it
+        count
+    };
+
+    inline const char* endpointGroupName(const EndpointGroup &group) noexcept
+    {
+        static const char *names[] =
+        {
+            "public_ticker", "public_book_trades", "orders", "history",
+            "account", "cancels"
+        };
+        return names[static_cast<size_t>(group)];
+    }
+
+    class RateLimiter
+    {
+    public:
+
+        enum class Mode
+        {
+            off,      // no limiting
+            wait,     // block caller until a token is available
+            failFast  // return false immediately if bucket is empty
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        // Default limits are kept below published Bitfinex v1 limits
+        explicit RateLimiter(const Mode &mode = Mode::wait):
+        mode_(mode)
+        {
+            setLimit(EndpointGroup::publicTicker, 30, 5);
+            setLimit(EndpointGroup::publicBookTrades, 45, 10);
+            setLimit(EndpointGroup::orders, 90, 30);
+            setLimit(EndpointGroup::history, 20, 5);
+            setLimit(EndpointGroup::account, 60, 10);
+            setLimit(EndpointGroup::cancels, 90, 30);
+        }
+
+        RateLimiter(const RateLimiter&) = delete;
+        RateLimiter& operator = (const RateLimiter&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Takes one token for path. Returns false if the bucket is empty in
+        /// failFast mode.
+        bool acquire(const string &path) noexcept
+        {
+            const int64_t waitNs = reserve(path);
+            if (waitNs < 0)
+                return false;
+            if (waitNs > 0)
+                std::this_thread::sleep_for(std::chrono::nanoseconds(waitNs));
+            return true;
+        }
+
+        /// Non-blocking variant of acquire() for event loops. Reserves token
+        /// for path and returns nanoseconds until it becomes available (0 if
+        /// available now), -1 if the bucket is empty in failFast mode.
+        int64_t reserve(const string &path) noexcept
+        { return reserve(groupOf(path)); }
+
+        int64_t reserve(const EndpointGroup &group) noexcept
+        {
+            const Mode mode = mode_.load(std::memory_order_relaxed);
+            if (mode == Mode::off)
+                return 0;
+
+            const int64_t waitNs =
+            take(group, mode == Mode::failFast ? 0 : NO_WAIT_LIMIT);
+            if (waitNs < 0)
+            {
+                rejected_.fetch_add(1, std::memory_order_relaxed);
+                return -1;
+            }
+            if (waitNs > 0)
+                delayed_.fetch_add(1, std::memory_order_relaxed);
+            return waitNs;
+        }
+
+        /// Takes one token for path only if it is available now, in any
+        /// mode except off. Never waits and never reserves future token,
+        /// e.g. for optional requests.
+        bool tryAcquire(const string &path) noexcept
+        {
+            if (mode_.load(std::memory_order_relaxed) == Mode::off)
+                return true;
+            return take(groupOf(path), 0) == 0;
+        }
+
+        /// requestsPerMinute sustained rate, up to burst requests at once
+        void setLimit(const EndpointGroup &group,
+                      const unsigned &requestsPerMinute,
+                      const unsigned &burst) noexcept
+        {
+            Bucket &bucket = buckets_[static_cast<size_t>(group)];
+            const int64_t interval = 60000000000LL /
+            (requestsPerMinute ? requestsPerMinute : 1);
+            bucket.interval.store(interval, std::memory_order_relaxed);
+            bucket.tolerance.store(interval * ((burst ? burst : 1) - 1),
+                                   std::memory_order_relaxed);
+        }
+
+        void setMode(const Mode &mode) noexcept
+        { mode_.store(mode, std::memory_order_relaxed); }
+
+        Mode getMode() const noexcept
+        { return mode_.load(std::memory_order_relaxed); }
+
+        /// Number of requests refused in failFast mode
+        uint64_t rejected() const noexcept { return rejected_.load(); }
+
+        /// Number of requests which had to wait for a token
+        uint64_t delayed() const noexcept { return delayed_.load(); }
+
+        static EndpointGroup groupOf(const string &path) noexcept
+        {
+            auto startsWith = [&path](const char *prefix)
+            { return path.compare(0, strlen(prefix), prefix) == 0; };
+
+            if (startsWith("/book/") || startsWith("/lendbook/") ||
+                startsWith("/trades/") || startsWith("/lends/"))
+                return EndpointGroup::publicBookTrades;
+
+            if (startsWith("/pubticker/") || startsWith("/stats/") ||
+                startsWith("/symbols"))
+                return EndpointGroup::publicTicker;
+
+            if (startsWith("/orders/hist/") || startsWith("/offers/hist/") ||
+                startsWith("/history/") || startsWith("/mytrades"))
+                return EndpointGroup::history;
+
+            if ((startsWith("/order/cancel/") &&
+                 !startsWith("/order/cancel/replace/")) ||
+                startsWith("/offer/cancel/"))
+                return EndpointGroup::cancels;
+
+            if (startsWith("/order/") || startsWith("/offer/"))
+                return EndpointGroup::orders;
+
+            return EndpointGroup::account;
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Class constants
+        ////////////////////////////////////////////////////////////////////////
+
+        static constexpr int64_t NO_WAIT_LIMIT =
+        std::numeric_limits<int64_t>::max();
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        // Own cache line per bucket so that groups don't contend
+        struct alignas(64) Bucket
+        {
+            std::atomic<int64_t> tat{0};        // theoretical arrival time
+            std::atomic<int64_t> interval{0};   // ns per token
+            std::atomic<int64_t> tolerance{0};  // burst allowance in ns
+        };
+
+        Bucket buckets_[static_cast<size_t>(EndpointGroup::count)];
+        std::atomic<Mode> mode_;
+        std::atomic<uint64_t> rejected_{0};
+        std::atomic<uint64_t> delayed_{0};
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // GCRA: reserves next token of group unless it becomes available
+        // later than maxWaitNs from now. Returns nanoseconds until reserved
+        // token is available (0 if available now), -1 if refused.
+        int64_t take(const EndpointGroup &group,
+                     const int64_t &maxWaitNs) noexcept
+        {
+            Bucket &bucket = buckets_[static_cast<size_t>(group)];
+            const int64_t interval =
+            bucket.interval.load(std::memory_order_relaxed);
+            const int64_t tolerance =
+            bucket.tolerance.load(std::memory_order_relaxed);
+            const int64_t now = nowNs();
+
+            int64_t tat = bucket.tat.load(std::memory_order_relaxed);
+            int64_t newTat;
+            do
+            {
+                newTat = (tat > now ? tat : now) + interval;
+                if (newTat - now - tolerance - interval > maxWaitNs)
+                    return -1;
+            }
+            while (!bucket.tat.compare_exchange_weak(tat, newTat,
+                                                     std::memory_order_relaxed));
+
+            const int64_t waitNs = newTat - now - tolerance - interval;
+            return waitNs > 0 ? waitNs : 0;
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static int64_t nowNs() noexcept
+        {
+            using namespace std::chrono;
+            return duration_cast<nanoseconds>(
+                steady_clock::now().time_since_epoch()).count();
+        }
+    };
+}
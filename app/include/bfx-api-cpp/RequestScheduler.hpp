@@ -0,0 +1,260 @@
+////////////////////////////////////////////////////////////////////////////////
+//  RequestScheduler.hpp
+//
+//
+//  Bitfinex REST API C++ client - concurrent sending of prepared requests
+//
+//
+//  RequestScheduler sends prepared requests through the client asynchronous
+//  interface with at most maxInFlight requests in flight. Every request
+//  takes a rate limiter token before it is sent: requests which would wait
+//  are parked until their reserved token is due, so they don't hold back
+//  requests behind them. Nonce of authenticated request is renewed just
+//  before sending. A request rejected for nonce out of order is resent
+//  with a fresh nonce, other failures are retried as Retrier decides. Used
+//  by FanOut, OrderBatch and CancelBatch.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// internal BitfinexAPI
+#include "BitfinexAPI.hpp"
+
+// internal Executor
+#include "Executor.hpp"
+
+// namespaces
+using std::vector;
+
+
+namespace BfxAPI
+{
+
+    // Request of RequestScheduler, callers derive their jobs from it
+    struct ScheduledRequest
+    {
+        BitfinexAPI::PreparedRequest request;
+        unsigned attempt = 0;
+        unsigned nonceAttempt = 0;
+        // rate limiter token already reserved for readyAt
+        bool reserved = false;
+        int64_t readyAt = 0;
+    };
+
+    class RequestScheduler
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        RequestScheduler(BitfinexAPI &api,
+                         size_t maxInFlight,
+                         Executor *executor = nullptr):
+        api_(api),
+        maxInFlight_(std::max<size_t>(maxInFlight, 1)),
+        executor_(executor)
+        {}
+
+        ////////////////////////////////////////////////////////////////////////
+        // Accessors
+        ////////////////////////////////////////////////////////////////////////
+
+        BitfinexAPI& getClient() const noexcept
+        { return api_; }
+
+        size_t getMaxInFlight() const noexcept
+        { return maxInFlight_; }
+
+        void setMaxInFlight(size_t maxInFlight) noexcept
+        { maxInFlight_ = std::max<size_t>(maxInFlight, 1); }
+
+        Executor* getExecutor() const noexcept
+        { return executor_; }
+
+        // Executor must outlive the calls, nullptr handles responses on the
+        // calling thread
+        void setExecutor(Executor *executor) noexcept
+        { executor_ = executor; }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Sends ready jobs (derived from ScheduledRequest) and calls
+        /// complete(job, result) with the final result of each one. Returns
+        /// when all jobs are done. With executor, complete runs on its
+        /// workers, concurrently for different jobs.
+        template <typename Job, typename Complete>
+        void run(std::deque<Job*> ready, const Complete &complete)
+        {
+            // Completions reported by callbacks, which run on executor
+            // workers or inside poll()
+            Mailbox<Job> mailbox;
+            vector<Completion<Job>> completed;
+            vector<Job*> delayed;
+            size_t inFlight = 0;
+            while (!ready.empty() || !delayed.empty() || inFlight)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mailbox.mutex);
+                    completed.swap(mailbox.completions);
+                }
+                for (const Completion<Job> &completion : completed)
+                {
+                    --inFlight;
+                    Job &job = *completion.job;
+                    if (completion.outcome == Outcome::resend)
+                    {
+                        ++job.nonceAttempt;
+                        ready.push_back(&job);
+                    }
+                    else if (completion.outcome == Outcome::retry)
+                    {
+                        ++job.attempt;
+                        job.readyAt = completion.readyAt;
+                        delayed.push_back(&job);
+                    }
+                }
+                completed.clear();
+
+                int64_t now = steadyNowNs();
+                auto due = std::partition(delayed.begin(), delayed.end(),
+                                          [now](const Job *job)
+                                          { return job->readyAt > now; });
+                ready.insert(ready.end(), due, delayed.end());
+                delayed.erase(due, delayed.end());
+
+                while (inFlight < maxInFlight_ && !ready.empty())
+                {
+                    Job &job = *ready.front();
+                    ready.pop_front();
+                    if (!job.reserved)
+                    {
+                        const int64_t waitNs =
+                        api_.getRateLimiter().reserve(job.request.path);
+                        if (waitNs < 0)
+                        {
+                            BitfinexAPI::AsyncResult limited{string(),
+                                CURLE_OK, 0, rateLimited};
+                            complete(job, limited);
+                            continue;
+                        }
+                        if (waitNs > 0)
+                        {
+                            job.reserved = true;
+                            job.readyAt = now + waitNs;
+                            delayed.push_back(&job);
+                            continue;
+                        }
+                    }
+
+                    job.reserved = false;
+                    job.request.renewNonce();
+                    ++inFlight;
+                    auto callback =
+                    [&, jobPtr = &job](BitfinexAPI::AsyncResult &result)
+                    {
+                        Outcome outcome = Outcome::done;
+                        std::chrono::nanoseconds delay(0);
+                        if (result.nonceRejected() &&
+                            jobPtr->nonceAttempt < BitfinexAPI::NONCE_RETRIES)
+                            outcome = Outcome::resend;
+                        else if (api_.getRetrier().shouldRetry(
+                                     jobPtr->request.path, jobPtr->attempt,
+                                     result.curlStatusCode,
+                                     result.httpStatusCode, delay))
+                            outcome = Outcome::retry;
+                        else
+                            complete(*jobPtr, result);
+                        // notified under lock, run() may return as soon
+                        // as the mutex is released
+                        std::lock_guard<std::mutex> lock(mailbox.mutex);
+                        mailbox.completions.push_back(
+                            {jobPtr, outcome, steadyNowNs() + delay.count()});
+                        mailbox.ready.notify_one();
+                    };
+                    if (executor_)
+                        api_.submit(job.request, callback, *executor_);
+                    else
+                        api_.submit(job.request, callback);
+                }
+
+                // Waits for responses or for the nearest delayed request
+                now = steadyNowNs();
+                int64_t waitNs = MAX_WAIT_NS;
+                for (const Job *job : delayed)
+                    waitNs = std::min(waitNs, std::max<int64_t>(
+                                              job->readyAt - now, 0));
+                if (inFlight && api_.pending())
+                    api_.poll(std::chrono::milliseconds(
+                        (waitNs + 999999) / 1000000));
+                else if (inFlight)
+                {
+                    // responses are being handled by executor
+                    std::unique_lock<std::mutex> lock(mailbox.mutex);
+                    mailbox.ready.wait_for(lock,
+                        std::chrono::nanoseconds(waitNs),
+                        [&] { return !mailbox.completions.empty(); });
+                }
+                else if (!delayed.empty())
+                    std::this_thread::sleep_for(
+                        std::chrono::nanoseconds(waitNs));
+            }
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        enum class Outcome
+        {
+            done,
+            resend,     // right away with fresh nonce
+            retry       // at readyAt
+        };
+
+        template <typename Job>
+        struct Completion
+        {
+            Job *job;
+            Outcome outcome;
+            int64_t readyAt;
+        };
+
+        template <typename Job>
+        struct Mailbox
+        {
+            std::mutex mutex;
+            std::condition_variable ready;
+            vector<Completion<Job>> completions;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Class constants
+        ////////////////////////////////////////////////////////////////////////
+
+        static constexpr int64_t MAX_WAIT_NS = 100000000;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        BitfinexAPI &api_;
+        size_t maxInFlight_;
+        Executor *executor_;
+    };
+}
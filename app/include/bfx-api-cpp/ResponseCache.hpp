@@ -0,0 +1,148 @@
+////////////////////////////////////////////////////////////////////////////////
+//  ResponseCache.hpp
+//
+//
+//  Bitfinex REST API C++ client - TTL cache for slow changing endpoints
+//
+//
+//  Caching is opt-in per endpoint path. Only validated responses are stored
+//  and they are served until their TTL expires or they are invalidated.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// namespaces
+using std::string;
+using std::unordered_map;
+
+
+namespace BfxAPI
+{
+
+    class ResponseCache
+    {
+    public:
+
+        struct Stats
+        {
+            uint64_t hits;
+            uint64_t misses;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Enables caching of path responses for ttl, zero ttl disables it
+        void setTTL(const string &path, const std::chrono::milliseconds &ttl)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto &entry = entries_[path];
+            entry.ttl = ttl;
+            entry.valid = false;
+        }
+
+        /// True if caching is enabled for path
+        bool isEnabled(const string &path) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(path);
+            return it != entries_.end() && it->second.ttl.count() > 0;
+        }
+
+        /// Copies fresh cached response into response. Counts hits and misses
+        /// of enabled paths only.
+        bool lookup(const string &path, string &response)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(path);
+            if (it == entries_.end() || it->second.ttl.count() <= 0)
+                return false;
+
+            auto &entry = it->second;
+            if (entry.valid &&
+                std::chrono::steady_clock::now() < entry.expires)
+            {
+                ++entry.stats.hits;
+                response = entry.response;
+                return true;
+            }
+
+            ++entry.stats.misses;
+            return false;
+        }
+
+        void store(const string &path, const string &response)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(path);
+            if (it == entries_.end() || it->second.ttl.count() <= 0)
+                return;
+
+            auto &entry = it->second;
+            entry.response = response;
+            entry.expires = std::chrono::steady_clock::now() + entry.ttl;
+            entry.valid = true;
+        }
+
+        void invalidate(const string &path)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(path);
+            if (it != entries_.end())
+                it->second.valid = false;
+        }
+
+        void invalidateAll()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto &entry : entries_)
+                entry.second.valid = false;
+        }
+
+        Stats getStats(const string &path) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(path);
+            return it != entries_.end() ? it->second.stats : Stats{0, 0};
+        }
+
+        Stats getStats() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Stats total{0, 0};
+            for (const auto &entry : entries_)
+            {
+                total.hits += entry.second.stats.hits;
+                total.misses += entry.second.stats.misses;
+            }
+            return total;
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        struct Entry
+        {
+            std::chrono::milliseconds ttl{0};
+            std::chrono::steady_clock::time_point expires;
+            string response;
+            bool valid = false;
+            Stats stats{0, 0};
+        };
+
+        mutable std::mutex mutex_;
+        unordered_map<string, Entry> entries_;
+    };
+}
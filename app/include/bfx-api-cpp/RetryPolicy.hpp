@@ -0,0 +1,235 @@
+////////////////////////////////////////////////////////////////////////////////
+//  RetryPolicy.hpp
+//
+//
+//  Bitfinex REST API C++ client - request retries
+//
+//
+//  Idempotent requests are retried on any transient libcurl error or HTTP 5xx
+//  response. Non-idempotent requests (new orders, transfers, withdrawals ...)
+//  are retried only if libcurl reports that the request never left the host.
+//  Delay between attempts is exponential backoff with full jitter.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+// curl
+#include <curl/curl.h>
+
+// internal RateLimiter (EndpointGroup)
+#include "RateLimiter.hpp"
+
+// namespaces
+using std::string;
+using std::unordered_map;
+using std::unordered_set;
+
+
+namespace BfxAPI
+{
+
+    struct RetryPolicy
+    {
+        unsigned maxRetries;
+        std::chrono::milliseconds baseDelay;
+        std::chrono::milliseconds maxDelay;
+        bool idempotent;
+    };
+
+    class Retrier
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        Retrier():
+        defaultPolicy_{3, std::chrono::milliseconds(100),
+                       std::chrono::milliseconds(2000), true}
+        {
+            // Endpoints with side effects which must not be repeated
+            nonIdempotent_ =
+            {
+                "/deposit/new/",
+                "/transfer/",
+                "/withdraw/",
+                "/order/new/",
+                "/order/new/multi/",
+                "/order/cancel/replace/",
+                "/position/claim/",
+                "/offer/new/",
+                "/funding/close/",
+                "/position/close/"
+            };
+        }
+
+        Retrier(const Retrier&) = delete;
+        Retrier& operator = (const Retrier&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        RetryPolicy getPolicy(const string &path) const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = policies_.find(path);
+            if (it != policies_.end())
+                return it->second;
+
+            RetryPolicy policy = defaultPolicy_;
+            policy.idempotent = !nonIdempotent_.count(path);
+            return policy;
+        }
+
+        /// Overrides policy of single endpoint path
+        void setPolicy(const string &path, const RetryPolicy &policy)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            policies_[path] = policy;
+        }
+
+        /// Sets retry counts and delays of endpoints without own policy.
+        /// Idempotency of such endpoints stays built-in.
+        void setDefaultPolicy(const RetryPolicy &policy)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            defaultPolicy_ = policy;
+        }
+
+        /// Decides whether failed attempt (0 = first one) should be repeated.
+        /// If so, waits backoff delay before returning true.
+        bool retry(const string &path,
+                   const unsigned &attempt,
+                   const CURLcode &curlCode,
+                   const long &httpCode)
+        {
+            std::chrono::nanoseconds delay(0);
+            if (!shouldRetry(path, attempt, curlCode, httpCode, delay))
+                return false;
+            std::this_thread::sleep_for(delay);
+            return true;
+        }
+
+        /// Non-blocking variant of retry() for event loops, sets backoff
+        /// delay the caller has to wait before repeating the request
+        bool shouldRetry(const string &path,
+                         const unsigned &attempt,
+                         const CURLcode &curlCode,
+                         const long &httpCode,
+                         std::chrono::nanoseconds &delay)
+        {
+            if (curlCode == CURLE_OK && httpCode < 500)
+                return false;
+
+            const RetryPolicy policy = getPolicy(path);
+            const bool retryable = policy.idempotent
+            ? isTransient(curlCode, httpCode)
+            : neverSent(curlCode);
+
+            const auto group = static_cast<size_t>(RateLimiter::groupOf(path));
+            if (!retryable || attempt >= policy.maxRetries)
+            {
+                failures_[group].fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            retries_[group].fetch_add(1, std::memory_order_relaxed);
+            delay = backoff(policy, attempt);
+            return true;
+        }
+
+        /// Number of repeated attempts
+        uint64_t retries(const EndpointGroup &group) const noexcept
+        { return retries_[static_cast<size_t>(group)].load(); }
+
+        /// Number of requests which failed after the last allowed attempt or
+        /// which were not retryable
+        uint64_t failures(const EndpointGroup &group) const noexcept
+        { return failures_[static_cast<size_t>(group)].load(); }
+
+        /// libcurl errors which prove that nothing was sent to the server
+        static bool neverSent(const CURLcode &code) noexcept
+        {
+            switch (code)
+            {
+                case CURLE_COULDNT_RESOLVE_PROXY:
+                case CURLE_COULDNT_RESOLVE_HOST:
+                case CURLE_COULDNT_CONNECT:
+                case CURLE_SSL_CONNECT_ERROR:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        static bool isTransient(const CURLcode &code, const long &httpCode) noexcept
+        {
+            switch (code)
+            {
+                case CURLE_OK:
+                    return httpCode >= 500 && httpCode != 501;
+                // Errors caused by request setup, repeating won't help
+                case CURLE_UNSUPPORTED_PROTOCOL:
+                case CURLE_FAILED_INIT:
+                case CURLE_URL_MALFORMAT:
+                case CURLE_NOT_BUILT_IN:
+                case CURLE_BAD_FUNCTION_ARGUMENT:
+                case CURLE_OUT_OF_MEMORY:
+                    return false;
+                default:
+                    return true;
+            }
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        static constexpr auto GROUPS = static_cast<size_t>(EndpointGroup::count);
+
+        mutable std::mutex mutex_;
+        RetryPolicy defaultPolicy_;
+        unordered_map<string, RetryPolicy> policies_;
+        unordered_set<string> nonIdempotent_;
+        std::atomic<uint64_t> retries_[GROUPS] = {};
+        std::atomic<uint64_t> failures_[GROUPS] = {};
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // Full jitter - uniform delay in [0, min(maxDelay, baseDelay * 2^n)]
+        static std::chrono::microseconds backoff(const RetryPolicy &policy,
+                                                 const unsigned &attempt)
+        {
+            using std::chrono::microseconds;
+
+            thread_local std::minstd_rand rng(std::random_device{}());
+
+            const int64_t base = microseconds(policy.baseDelay).count();
+            const int64_t cap = microseconds(policy.maxDelay).count();
+            int64_t ceiling = base << (attempt < 20 ? attempt : 20);
+            if (ceiling > cap || ceiling <= 0)
+                ceiling = cap;
+
+            std::uniform_int_distribution<int64_t> jitter(0, ceiling);
+            return microseconds(jitter(rng));
+        }
+    };
+}
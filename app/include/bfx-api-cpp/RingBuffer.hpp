@@ -0,0 +1,302 @@
+////////////////////////////////////////////////////////////////////////////////
+//  RingBuffer.hpp
+//
+//
+//  Bitfinex REST API C++ client - lock-free queues of fixed-size records
+//
+//
+//  SpscRing (one producer, one consumer) and MpscRing (many producers, one
+//  consumer) are bounded ring buffers of trivially copyable records. Both
+//  have the same interface:
+//
+//      T* claim()          producer, slot to write next record to, nullptr
+//                          if the ring is full
+//      void commit(T*)     producer, publishes claimed slot
+//      const T* front()    consumer, oldest published record, nullptr if
+//                          the ring is empty
+//      void pop()          consumer, releases record returned by front()
+//
+//  Records are written and read in place, push() and pop(T&) are copying
+//  shortcuts. Producer and consumer indices live on their own cache lines,
+//  rings are therefore over-aligned, see makeAligned() for heap allocation.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+
+namespace BfxAPI
+{
+
+    template <typename T>
+    class SpscRing
+    {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "ring records must be trivially copyable");
+
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        // capacity is rounded up to power of 2
+        explicit SpscRing(size_t capacity):
+        mask_(roundUp(capacity) - 1),
+        slots_(new T[mask_ + 1])
+        {}
+
+        SpscRing(const SpscRing&) = delete;
+        SpscRing& operator = (const SpscRing&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Producer side. Slot is not visible to consumer until commit(),
+        /// slot claimed but not committed is claimed again next time.
+        T* claim() noexcept
+        {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            if (head - tailCache_ > mask_)
+            {
+                tailCache_ = tail_.load(std::memory_order_acquire);
+                if (head - tailCache_ > mask_)
+                    return nullptr;
+            }
+            return &slots_[head & mask_];
+        }
+
+        void commit(T*) noexcept
+        {
+            head_.store(head_.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_release);
+        }
+
+        bool push(const T &record) noexcept
+        {
+            T *slot = claim();
+            if (!slot)
+                return false;
+            *slot = record;
+            commit(slot);
+            return true;
+        }
+
+        /// Consumer side
+        const T* front() noexcept
+        {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail == headCache_)
+            {
+                headCache_ = head_.load(std::memory_order_acquire);
+                if (tail == headCache_)
+                    return nullptr;
+            }
+            return &slots_[tail & mask_];
+        }
+
+        void pop() noexcept
+        {
+            tail_.store(tail_.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_release);
+        }
+
+        bool pop(T &record) noexcept
+        {
+            const T *slot = front();
+            if (!slot)
+                return false;
+            record = *slot;
+            pop();
+            return true;
+        }
+
+        /// Approximate when called concurrently with producer or consumer
+        size_t size() const noexcept
+        {
+            return head_.load(std::memory_order_acquire) -
+                   tail_.load(std::memory_order_acquire);
+        }
+
+        size_t capacity() const noexcept
+        { return mask_ + 1; }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        // producer line: own index and last seen consumer index
+        alignas(64) std::atomic<size_t> head_{0};
+        size_t tailCache_ = 0;
+        // consumer line
+        alignas(64) std::atomic<size_t> tail_{0};
+        size_t headCache_ = 0;
+        // read-only after construction
+        alignas(64) const size_t mask_;
+        std::unique_ptr<T[]> slots_;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static size_t roundUp(size_t capacity) noexcept
+        {
+            size_t size = 1;
+            while (size < capacity)
+                size <<= 1;
+            return size;
+        }
+    };
+
+    template <typename T>
+    class MpscRing
+    {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "ring records must be trivially copyable");
+
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        // capacity is rounded up to power of 2
+        explicit MpscRing(size_t capacity):
+        mask_(roundUp(capacity) - 1),
+        slots_(new Slot[mask_ + 1])
+        {
+            for (size_t i = 0; i <= mask_; ++i)
+                slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        MpscRing(const MpscRing&) = delete;
+        MpscRing& operator = (const MpscRing&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Producer side, any thread. Claimed slot must be committed, the
+        /// consumer doesn't get past it until then.
+        T* claim() noexcept
+        {
+            size_t head = head_.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Slot &slot = slots_[head & mask_];
+                const size_t sequence =
+                slot.sequence.load(std::memory_order_acquire);
+                const intptr_t diff = static_cast<intptr_t>(sequence) -
+                                      static_cast<intptr_t>(head);
+                if (diff == 0)
+                {
+                    if (head_.compare_exchange_weak(head, head + 1,
+                                                    std::memory_order_relaxed))
+                        return &slot.record;
+                }
+                else if (diff < 0)
+                    return nullptr;
+                else
+                    head = head_.load(std::memory_order_relaxed);
+            }
+        }
+
+        void commit(T *record) noexcept
+        {
+            // record is the first member of its slot
+            Slot *slot = reinterpret_cast<Slot*>(record);
+            slot->sequence.store(
+                slot->sequence.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+        }
+
+        bool push(const T &record) noexcept
+        {
+            T *slot = claim();
+            if (!slot)
+                return false;
+            *slot = record;
+            commit(slot);
+            return true;
+        }
+
+        /// Consumer side, one thread
+        const T* front() noexcept
+        {
+            Slot &slot = slots_[tail_ & mask_];
+            if (slot.sequence.load(std::memory_order_acquire) != tail_ + 1)
+                return nullptr;
+            return &slot.record;
+        }
+
+        void pop() noexcept
+        {
+            slots_[tail_ & mask_].sequence.store(tail_ + mask_ + 1,
+                                                 std::memory_order_release);
+            ++tail_;
+        }
+
+        bool pop(T &record) noexcept
+        {
+            const T *slot = front();
+            if (!slot)
+                return false;
+            record = *slot;
+            pop();
+            return true;
+        }
+
+        size_t capacity() const noexcept
+        { return mask_ + 1; }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        // sequence == position: free for producer of that position,
+        // sequence == position + 1: committed, readable by consumer
+        struct Slot
+        {
+            T record;
+            std::atomic<size_t> sequence;
+        };
+        static_assert(std::is_standard_layout<Slot>::value,
+                      "record must be at the slot address");
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        // producers line
+        alignas(64) std::atomic<size_t> head_{0};
+        // consumer line
+        alignas(64) size_t tail_ = 0;
+        // read-only after construction
+        alignas(64) const size_t mask_;
+        std::unique_ptr<Slot[]> slots_;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static size_t roundUp(size_t capacity) noexcept
+        {
+            size_t size = 1;
+            while (size < capacity)
+                size <<= 1;
+            return size;
+        }
+    };
+}
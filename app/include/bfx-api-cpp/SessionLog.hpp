@@ -0,0 +1,375 @@
+////////////////////////////////////////////////////////////////////////////////
+//  SessionLog.hpp
+//
+//
+//  Bitfinex REST API C++ client - session recording and replay
+//
+//
+//  SessionRecorder appends every HTTP exchange of attached clients (path,
+//  query string, JSON payload, response body, status codes and libcurl
+//  timings) to a compact binary log. SessionReplayer serves the recorded
+//  exchanges back to BitfinexAPI as its transport, either with recorded
+//  latencies or as fast as possible.
+//
+//  File layout (native byte order):
+//
+//    "BFXSESS" '\0' uint32 version
+//    record*: uint32 size, int64 offset [ns], uint8 post, int32 curl code,
+//             int32 http code, 7 x int64 timings [ns],
+//             4 x (uint32 length, bytes) path, params, payload, response
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// internal HTTPRequest
+#include "HTTPRequest.hpp"
+
+// namespaces
+using std::string;
+using std::vector;
+
+
+namespace BfxAPI
+{
+
+    constexpr char SESSION_MAGIC[8] = {'B', 'F', 'X', 'S', 'E', 'S', 'S', 0};
+    constexpr uint32_t SESSION_VERSION = 1;
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Recorder
+    ////////////////////////////////////////////////////////////////////////////
+
+    class SessionRecorder
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        explicit SessionRecorder(const string &path):
+        file_(path, std::ios::binary | std::ios::trunc)
+        {
+            const uint32_t version = SESSION_VERSION;
+            file_.write(SESSION_MAGIC, sizeof(SESSION_MAGIC));
+            file_.write(reinterpret_cast<const char*>(&version), sizeof(version));
+        }
+
+        SessionRecorder(const SessionRecorder&) = delete;
+        SessionRecorder& operator = (const SessionRecorder&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        bool isOpen() const
+        { return file_.good(); }
+
+        /// Thread safe, clients running in several threads can share one
+        /// recorder
+        void record(const HttpExchange &exchange)
+        {
+            string buffer;
+            buffer.reserve(96 + exchange.path.size() + exchange.params.size() +
+                           exchange.payload.size() + exchange.response.size());
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!start_)
+                start_ = exchange.start;
+            put(buffer, static_cast<int64_t>(exchange.start - start_));
+            put(buffer, static_cast<uint8_t>(exchange.post));
+            put(buffer, static_cast<int32_t>(exchange.curlCode));
+            put(buffer, static_cast<int32_t>(exchange.httpCode));
+            const RequestTimings &t = exchange.timings;
+            for (int64_t value : {t.nameLookup, t.connect, t.appConnect,
+                                  t.preTransfer, t.startTransfer, t.total,
+                                  t.signing})
+                put(buffer, value);
+            for (const string *str : {&exchange.path, &exchange.params,
+                                      &exchange.payload, &exchange.response})
+            {
+                put(buffer, static_cast<uint32_t>(str->size()));
+                buffer += *str;
+            }
+
+            const auto size = static_cast<uint32_t>(buffer.size());
+            file_.write(reinterpret_cast<const char*>(&size), sizeof(size));
+            file_.write(buffer.data(), buffer.size());
+            ++records_;
+        }
+
+        void flush()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            file_.flush();
+        }
+
+        size_t records() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return records_;
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        mutable std::mutex mutex_;
+        std::ofstream file_;
+        int64_t start_ = 0;
+        size_t records_ = 0;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        template <typename T>
+        static void put(string &buffer, const T &value)
+        { buffer.append(reinterpret_cast<const char*>(&value), sizeof(value)); }
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Reader
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Loads all records of session log. Returns false if file can't be read
+    /// or isn't a session log, truncated last record is ignored.
+    inline bool readSessionLog(const string &path, vector<HttpExchange> &out)
+    {
+        std::ifstream file(path, std::ios::binary);
+        char magic[sizeof(SESSION_MAGIC)];
+        uint32_t version = 0;
+        if (!file.read(magic, sizeof(magic)) ||
+            memcmp(magic, SESSION_MAGIC, sizeof(magic)) ||
+            !file.read(reinterpret_cast<char*>(&version), sizeof(version)) ||
+            version != SESSION_VERSION)
+            return false;
+
+        uint32_t size;
+        string buffer;
+        while (file.read(reinterpret_cast<char*>(&size), sizeof(size)))
+        {
+            buffer.resize(size);
+            if (!file.read(&buffer[0], size))
+                break;
+
+            size_t pos = 0;
+            bool ok = true;
+            auto get = [&](void *value, size_t len)
+            {
+                if (!ok || pos + len > buffer.size())
+                { ok = false; return; }
+                memcpy(value, buffer.data() + pos, len);
+                pos += len;
+            };
+            auto getStr = [&](string &str)
+            {
+                uint32_t len = 0;
+                get(&len, sizeof(len));
+                if (!ok || pos + len > buffer.size())
+                { ok = false; return; }
+                str.assign(buffer, pos, len);
+                pos += len;
+            };
+
+            HttpExchange e;
+            uint8_t post = 0;
+            int32_t curlCode = 0, httpCode = 0;
+            get(&e.start, sizeof(e.start));
+            get(&post, sizeof(post));
+            get(&curlCode, sizeof(curlCode));
+            get(&httpCode, sizeof(httpCode));
+            RequestTimings &t = e.timings;
+            for (int64_t *value : {&t.nameLookup, &t.connect, &t.appConnect,
+                                   &t.preTransfer, &t.startTransfer, &t.total,
+                                   &t.signing})
+                get(value, sizeof(*value));
+            getStr(e.path);
+            getStr(e.params);
+            getStr(e.payload);
+            getStr(e.response);
+            if (!ok)
+                break;
+
+            e.post = post != 0;
+            e.curlCode = static_cast<CURLcode>(curlCode);
+            e.httpCode = httpCode;
+            out.push_back(std::move(e));
+        }
+        return true;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Replayer
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Transport serving recorded exchanges, can be shared by several
+    /// clients
+    class SessionReplayer: public Transport
+    {
+    public:
+
+        enum class Speed
+        {
+            recorded, // each exchange takes its recorded total time
+            fast      // no delays
+        };
+
+        struct Stats
+        {
+            size_t served;
+            size_t misses;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        explicit SessionReplayer(const vector<HttpExchange> &exchanges,
+                                 const Speed &speed = Speed::fast,
+                                 bool loop = false):
+        speed_(speed),
+        loop_(loop)
+        {
+            for (const auto &e : exchanges)
+                queues_[key(e.post, e.path, e.params)].exchanges.push_back(e);
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Loads session log, returns nullptr if it can't be read
+        static std::shared_ptr<SessionReplayer> load(const string &path,
+                                                     const Speed &speed =
+                                                     Speed::fast,
+                                                     bool loop = false)
+        {
+            vector<HttpExchange> exchanges;
+            if (!readSessionLog(path, exchanges))
+                return nullptr;
+            return std::make_shared<SessionReplayer>(exchanges, speed, loop);
+        }
+
+        void get(const string &url,
+                 const Header &header,
+                 HttpExchange &exchange) override
+        { serve(exchange); }
+
+        void post(const string &url,
+                  const Header &header,
+                  HttpExchange &exchange) override
+        { serve(exchange); }
+
+        /// Serves next recorded exchange with the same method, path and (for
+        /// GET) query string. Exchanges of one endpoint are served in recorded
+        /// order, POST payload isn't compared as it contains nonce. Unknown or
+        /// exhausted requests fail with CURLE_COULDNT_CONNECT.
+        void serve(HttpExchange &exchange)
+        {
+            const HttpExchange *recorded = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto it = queues_.find(key(exchange.post, exchange.path,
+                                           exchange.params));
+                if (it != queues_.end())
+                {
+                    Queue &q = it->second;
+                    if (q.next == q.exchanges.size() && loop_)
+                        q.next = 0;
+                    if (q.next < q.exchanges.size())
+                        recorded = &q.exchanges[q.next++];
+                }
+                recorded ? ++stats_.served : ++stats_.misses;
+            }
+
+            if (!recorded)
+            {
+                exchange.response.clear();
+                exchange.curlCode = CURLE_COULDNT_CONNECT;
+                exchange.httpCode = 0;
+                exchange.timings = RequestTimings();
+                return;
+            }
+
+            exchange.response = recorded->response;
+            exchange.curlCode = recorded->curlCode;
+            exchange.httpCode = recorded->httpCode;
+            exchange.timings = recorded->timings;
+            if (speed_ == Speed::recorded && recorded->timings.total > 0)
+                std::this_thread::sleep_for(
+                    std::chrono::nanoseconds(recorded->timings.total));
+        }
+
+        /// First recorded response of endpoint or empty string, doesn't
+        /// advance replay position
+        string peek(const string &path, bool post = false,
+                    const string &params = "") const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = queues_.find(key(post, path, params));
+            if (it == queues_.end() || it->second.exchanges.empty())
+                return "";
+            return it->second.exchanges.front().response;
+        }
+
+        /// Rewinds all endpoints to the first recorded exchange
+        void rewind()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto &q : queues_)
+                q.second.next = 0;
+            stats_ = Stats();
+        }
+
+        Stats getStats() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return stats_;
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        struct Queue
+        {
+            vector<HttpExchange> exchanges;
+            size_t next = 0;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        mutable std::mutex mutex_;
+        std::map<string, Queue> queues_;
+        Speed speed_;
+        bool loop_;
+        Stats stats_ = Stats();
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static string key(bool post, const string &path, const string &params)
+        { return post ? "POST " + path : "GET " + path + "?" + params; }
+    };
+}
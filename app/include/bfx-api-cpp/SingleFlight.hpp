@@ -0,0 +1,159 @@
+////////////////////////////////////////////////////////////////////////////////
+//  SingleFlight.hpp
+//
+//
+//  Bitfinex REST API C++ client - request coalescing
+//
+//
+//  SingleFlight makes concurrent callers asking for the same key share one
+//  in-flight fetch. The first caller (leader) runs the fetch, the others wait
+//  for its result. Completed results accepted by the caller's keep predicate
+//  are served from memory for the configured freshness window, others are
+//  shared only with callers which waited for them.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+// namespaces
+using std::string;
+using std::unordered_map;
+
+
+namespace BfxAPI
+{
+
+    template <typename Result>
+    class SingleFlight
+    {
+    public:
+
+        using ResultPtr = std::shared_ptr<const Result>;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        explicit SingleFlight(const std::chrono::milliseconds &freshness =
+                              std::chrono::milliseconds(0)):
+        freshness_(freshness)
+        {}
+
+        SingleFlight(const SingleFlight&) = delete;
+        SingleFlight& operator = (const SingleFlight&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Returns result of an in-flight or fresh fetch for key, otherwise
+        /// runs fetchFn() in the calling thread and shares its result.
+        template <typename Fetch>
+        ResultPtr fetch(const string &key, Fetch &&fetchFn)
+        {
+            return fetch(key, std::forward<Fetch>(fetchFn),
+                         [](const Result&) { return true; });
+        }
+
+        /// As above, result is served for freshness window only if
+        /// keep(result) is true (e.g. failed requests are not reused)
+        template <typename Fetch, typename Keep>
+        ResultPtr fetch(const string &key, Fetch &&fetchFn, const Keep &keep)
+        {
+            using std::chrono::steady_clock;
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto it = flights_.find(key);
+            if (it != flights_.end() &&
+                (!it->second.done ||
+                 steady_clock::now() - it->second.completed < freshness_))
+            {
+                auto future = it->second.future;
+                lock.unlock();
+                shared_.fetch_add(1, std::memory_order_relaxed);
+                return future.get();
+            }
+
+            std::promise<ResultPtr> promise;
+            Flight &flight = flights_[key];
+            flight.future = promise.get_future().share();
+            flight.done = false;
+            lock.unlock();
+
+            fetched_.fetch_add(1, std::memory_order_relaxed);
+            try
+            {
+                ResultPtr result = std::make_shared<const Result>(fetchFn());
+                promise.set_value(result);
+
+                lock.lock();
+                if (freshness_.count() > 0 && keep(*result))
+                {
+                    flight.done = true;
+                    flight.completed = steady_clock::now();
+                }
+                else
+                    flights_.erase(key);
+                return result;
+            }
+            catch (...)
+            {
+                promise.set_exception(std::current_exception());
+                lock.lock();
+                flights_.erase(key);
+                throw;
+            }
+        }
+
+        /// Drops completed results so next fetch goes to the network
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto it = flights_.begin(); it != flights_.end();)
+                it = it->second.done ? flights_.erase(it) : ++it;
+        }
+
+        void setFreshness(const std::chrono::milliseconds &freshness)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            freshness_ = freshness;
+        }
+
+        /// Number of fetches which went to the network
+        uint64_t fetched() const noexcept { return fetched_.load(); }
+
+        /// Number of callers served by another caller's fetch
+        uint64_t shared() const noexcept { return shared_.load(); }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        struct Flight
+        {
+            std::shared_future<ResultPtr> future;
+            std::chrono::steady_clock::time_point completed;
+            bool done;
+        };
+
+        std::mutex mutex_;
+        std::chrono::milliseconds freshness_;
+        unordered_map<string, Flight> flights_;
+        std::atomic<uint64_t> fetched_{0};
+        std::atomic<uint64_t> shared_{0};
+    };
+}
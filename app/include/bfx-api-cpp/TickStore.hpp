@@ -0,0 +1,564 @@
+////////////////////////////////////////////////////////////////////////////////
+//  TickStore.hpp
+//
+//
+//  Bitfinex REST API C++ client - memory mapped append-only tick store
+//
+//
+//  Ticks are stored as fixed-size binary records (see decoders.hpp) in one
+//  file per symbol, day and record type:
+//
+//      <root>/<symbol>/<YYYYMMDD>.<ticker|trades|book>
+//
+//  Every file starts with a 64 byte TickFileHeader followed by records laid
+//  out back to back, so readers can map the file and iterate the records in
+//  place without any parsing or copying.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// internal decoders
+#include "decoders.hpp"
+
+// internal error
+#include "error.hpp"
+
+// namespaces
+using std::map;
+using std::string;
+using std::to_string;
+using std::vector;
+
+
+namespace BfxAPI
+{
+
+    ////////////////////////////////////////////////////////////////////////////
+    // On-disk format
+    ////////////////////////////////////////////////////////////////////////////
+
+    struct TickFileHeader
+    {
+        char magic[8];        // "BFXTICK"
+        uint32_t version;
+        uint32_t recordType;  // see TickRecordTraits
+        uint32_t recordSize;
+        uint32_t day;         // YYYYMMDD (UTC)
+        uint64_t count;       // committed records, written with release store
+        char symbol[32];
+    };
+    static_assert(sizeof(TickFileHeader) == 64, "unexpected header layout");
+
+    template <typename Record> struct TickRecordTraits;
+
+    template <> struct TickRecordTraits<jsonutils::Ticker>
+    {
+        static constexpr uint32_t type = 1;
+        static constexpr auto extension = "ticker";
+    };
+
+    template <> struct TickRecordTraits<jsonutils::Trade>
+    {
+        static constexpr uint32_t type = 2;
+        static constexpr auto extension = "trades";
+    };
+
+    template <> struct TickRecordTraits<jsonutils::BookRecord>
+    {
+        static constexpr uint32_t type = 3;
+        static constexpr auto extension = "book";
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Writer
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Single writer for one tick file. Records are copied straight into the
+    /// mapping; the file grows by doubling its capacity.
+    template <typename Record>
+    class TickAppender
+    {
+        static constexpr auto TICK_FILE_VERSION = 1U;
+
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        TickAppender() {}
+
+        TickAppender(const TickAppender&) = delete;
+        TickAppender& operator = (const TickAppender&) = delete;
+
+        TickAppender(TickAppender &&other) noexcept { swap(other); }
+        TickAppender& operator = (TickAppender &&other) noexcept
+        { close(); swap(other); return *this; }
+
+        ~TickAppender() { close(); }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        BfxClientErrors open(const string &path,
+                             const string &symbol,
+                             const uint32_t &day,
+                             const size_t &initialCapacity = 65536)
+        {
+            close();
+
+            fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd_ < 0)
+                return tickStoreIOError;
+
+            struct stat st;
+            if (fstat(fd_, &st) != 0)
+            { close(); return tickStoreIOError; }
+
+            size_t capacity = initialCapacity ? initialCapacity : 1;
+            if (static_cast<size_t>(st.st_size) >= sizeof(TickFileHeader))
+            {
+                // Existing file - validate header and continue after the last
+                // committed record
+                TickFileHeader header;
+                if (pread(fd_, &header, sizeof(header), 0) != sizeof(header) ||
+                    strncmp(header.magic, "BFXTICK", sizeof(header.magic)) ||
+                    header.recordType != TickRecordTraits<Record>::type ||
+                    header.recordSize != sizeof(Record))
+                { close(); return tickStoreIOError; }
+
+                while (capacity < header.count)
+                    capacity *= 2;
+            }
+
+            if (static_cast<size_t>(st.st_size) < fileSize(capacity) &&
+                ftruncate(fd_, fileSize(capacity)) != 0)
+            { close(); return tickStoreIOError; }
+
+            if (!map(capacity))
+            { close(); return tickStoreIOError; }
+
+            if (!header_->magic[0])
+            {
+                strncpy(header_->magic, "BFXTICK", sizeof(header_->magic));
+                header_->version = TICK_FILE_VERSION;
+                header_->recordType = TickRecordTraits<Record>::type;
+                header_->recordSize = sizeof(Record);
+                header_->day = day;
+                strncpy(header_->symbol, symbol.c_str(),
+                        sizeof(header_->symbol) - 1);
+            }
+
+            return noError;
+        }
+
+        BfxClientErrors append(const Record *records, const size_t &n)
+        {
+            if (!header_)
+                return tickStoreIOError;
+
+            const uint64_t count = header_->count;
+            if (count + n > capacity_)
+            {
+                size_t capacity = capacity_;
+                while (capacity < count + n)
+                    capacity *= 2;
+                if (!grow(capacity))
+                    return tickStoreIOError;
+            }
+
+            memcpy(records_ + count, records, n * sizeof(Record));
+            // Publish records to concurrent readers of the mapping
+            __atomic_store_n(&header_->count, count + n, __ATOMIC_RELEASE);
+
+            return noError;
+        }
+
+        BfxClientErrors append(const Record &record)
+        { return append(&record, 1); }
+
+        BfxClientErrors sync() noexcept
+        {
+            if (header_ &&
+                msync(header_, fileSize(capacity_), MS_ASYNC) != 0)
+                return tickStoreIOError;
+            return noError;
+        }
+
+        void close() noexcept
+        {
+            if (header_)
+            {
+                const uint64_t count = header_->count;
+                munmap(header_, fileSize(capacity_));
+                // Drop unused preallocated space
+                if (ftruncate(fd_, fileSize(count)) != 0) {}
+            }
+            if (fd_ >= 0)
+                ::close(fd_);
+
+            fd_ = -1;
+            header_ = nullptr;
+            records_ = nullptr;
+            capacity_ = 0;
+        }
+
+        bool isOpen() const noexcept { return header_ != nullptr; }
+
+        uint64_t size() const noexcept { return header_ ? header_->count : 0; }
+
+        uint32_t day() const noexcept { return header_ ? header_->day : 0; }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        int fd_ = -1;
+        TickFileHeader *header_ = nullptr;
+        Record *records_ = nullptr;
+        size_t capacity_ = 0;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static size_t fileSize(const size_t &capacity) noexcept
+        { return sizeof(TickFileHeader) + capacity * sizeof(Record); }
+
+        bool map(const size_t &capacity) noexcept
+        {
+            void *addr = mmap(nullptr, fileSize(capacity),
+                              PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if (addr == MAP_FAILED)
+                return false;
+
+            header_ = static_cast<TickFileHeader*>(addr);
+            records_ = reinterpret_cast<Record*>(header_ + 1);
+            capacity_ = capacity;
+            return true;
+        }
+
+        bool grow(const size_t &capacity) noexcept
+        {
+            munmap(header_, fileSize(capacity_));
+            header_ = nullptr;
+            if (ftruncate(fd_, fileSize(capacity)) != 0)
+                return map(capacity_);
+            return map(capacity);
+        }
+
+        void swap(TickAppender &other) noexcept
+        {
+            std::swap(fd_, other.fd_);
+            std::swap(header_, other.header_);
+            std::swap(records_, other.records_);
+            std::swap(capacity_, other.capacity_);
+        }
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Reader
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Zero-copy read-only view of one tick file. Iterators point directly
+    /// into the mapping.
+    template <typename Record>
+    class TickReader
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        explicit TickReader(const string &path)
+        {
+            fd_ = ::open(path.c_str(), O_RDONLY);
+            if (fd_ >= 0)
+                refresh();
+        }
+
+        TickReader(const TickReader&) = delete;
+        TickReader& operator = (const TickReader&) = delete;
+
+        TickReader(TickReader &&other) noexcept
+        {
+            std::swap(fd_, other.fd_);
+            std::swap(header_, other.header_);
+            std::swap(mapSize_, other.mapSize_);
+            std::swap(count_, other.count_);
+        }
+        TickReader& operator = (TickReader&&) = delete;
+
+        ~TickReader()
+        {
+            unmap();
+            if (fd_ >= 0)
+                ::close(fd_);
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Picks up records committed by a writer since the last call
+        bool refresh() noexcept
+        {
+            struct stat st;
+            if (fd_ < 0 || fstat(fd_, &st) != 0 ||
+                static_cast<size_t>(st.st_size) < sizeof(TickFileHeader))
+                return false;
+
+            if (static_cast<size_t>(st.st_size) != mapSize_)
+            {
+                unmap();
+                void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED,
+                                  fd_, 0);
+                if (addr == MAP_FAILED)
+                    return false;
+                header_ = static_cast<const TickFileHeader*>(addr);
+                mapSize_ = st.st_size;
+                madvise(addr, mapSize_, MADV_SEQUENTIAL);
+
+                if (strncmp(header_->magic, "BFXTICK", sizeof(header_->magic)) ||
+                    header_->recordType != TickRecordTraits<Record>::type ||
+                    header_->recordSize != sizeof(Record))
+                { unmap(); return false; }
+            }
+
+            const uint64_t mapped =
+            (mapSize_ - sizeof(TickFileHeader)) / sizeof(Record);
+            const uint64_t committed =
+            __atomic_load_n(&header_->count, __ATOMIC_ACQUIRE);
+            count_ = committed < mapped ? committed : mapped;
+            return true;
+        }
+
+        bool isOpen() const noexcept { return header_ != nullptr; }
+
+        const Record* begin() const noexcept
+        {
+            return header_
+            ? reinterpret_cast<const Record*>(header_ + 1)
+            : nullptr;
+        }
+
+        const Record* end() const noexcept { return begin() + count_; }
+
+        const Record& operator[](const size_t &i) const noexcept
+        { return begin()[i]; }
+
+        size_t size() const noexcept { return count_; }
+
+        string symbol() const
+        { return header_ ? string(header_->symbol) : string(); }
+
+        uint32_t day() const noexcept { return header_ ? header_->day : 0; }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        int fd_ = -1;
+        const TickFileHeader *header_ = nullptr;
+        size_t mapSize_ = 0;
+        size_t count_ = 0;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        void unmap() noexcept
+        {
+            if (header_)
+                munmap(const_cast<TickFileHeader*>(header_), mapSize_);
+            header_ = nullptr;
+            mapSize_ = 0;
+            count_ = 0;
+        }
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Store
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Routes decoded records to per symbol and day TickAppenders. Not
+    /// thread-safe; use one TickStore per writer thread.
+    class TickStore
+    {
+        static constexpr auto NS_PER_DAY = 86400000000000LL;
+
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        explicit TickStore(const string &rootDir,
+                           const size_t &initialCapacity = 65536):
+        rootDir_(rootDir),
+        initialCapacity_(initialCapacity)
+        {
+            mkdir(rootDir_.c_str(), 0755);
+        }
+
+        TickStore(const TickStore&) = delete;
+        TickStore& operator = (const TickStore&) = delete;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        BfxClientErrors append(const string &symbol,
+                               const jsonutils::Ticker &ticker)
+        { return appendRecords(symbol, &ticker, 1, tickers_); }
+
+        BfxClientErrors append(const string &symbol,
+                               const vector<jsonutils::Trade> &trades)
+        { return appendRecords(symbol, trades.data(), trades.size(), trades_); }
+
+        BfxClientErrors append(const string &symbol,
+                               const jsonutils::OrderBook &book,
+                               const int64_t &snapshot)
+        {
+            bookBuffer_.clear();
+            bookBuffer_.reserve(book.bids.size() + book.asks.size());
+            auto flatten = [&](const vector<jsonutils::BookLevel> &levels,
+                               const jsonutils::Side &side)
+            {
+                uint32_t level = 0;
+                for (const auto &l : levels)
+                {
+                    jsonutils::BookRecord record = {};
+                    record.snapshot = snapshot;
+                    record.timestamp = l.timestamp;
+                    record.price = l.price;
+                    record.amount = l.amount;
+                    record.level = level++;
+                    record.side = side;
+                    bookBuffer_.push_back(record);
+                }
+            };
+            flatten(book.bids, jsonutils::Side::buy);
+            flatten(book.asks, jsonutils::Side::sell);
+
+            // Whole snapshot belongs to the day it was taken
+            return appendRecords(symbol, bookBuffer_.data(), bookBuffer_.size(),
+                                 books_, snapshot);
+        }
+
+        BfxClientErrors sync() noexcept
+        {
+            BfxClientErrors code = noError;
+            for (auto &a : tickers_) if (a.second.sync() != noError) code = tickStoreIOError;
+            for (auto &a : trades_) if (a.second.sync() != noError) code = tickStoreIOError;
+            for (auto &a : books_) if (a.second.sync() != noError) code = tickStoreIOError;
+            return code;
+        }
+
+        template <typename Record>
+        string path(const string &symbol, const uint32_t &day) const
+        {
+            return rootDir_ + "/" + symbol + "/" + to_string(day) + "." +
+            TickRecordTraits<Record>::extension;
+        }
+
+        template <typename Record>
+        TickReader<Record> reader(const string &symbol,
+                                  const uint32_t &day) const
+        { return TickReader<Record>(path<Record>(symbol, day)); }
+
+        /// Converts nanoseconds since epoch to YYYYMMDD (UTC)
+        static uint32_t dayOf(const int64_t &ns) noexcept
+        {
+            time_t seconds = ns / 1000000000LL;
+            struct tm t;
+            gmtime_r(&seconds, &t);
+            return (t.tm_year + 1900) * 10000 + (t.tm_mon + 1) * 100 + t.tm_mday;
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        template <typename Record>
+        using Appenders = map<string, TickAppender<Record>>;
+
+        string rootDir_;
+        size_t initialCapacity_;
+        Appenders<jsonutils::Ticker> tickers_;
+        Appenders<jsonutils::Trade> trades_;
+        Appenders<jsonutils::BookRecord> books_;
+        vector<jsonutils::BookRecord> bookBuffer_;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // Appends records in runs which fall into the same day. If dayTime is
+        // nonzero whole batch is stored under its day.
+        template <typename Record>
+        BfxClientErrors appendRecords(const string &symbol,
+                                      const Record *records,
+                                      const size_t &n,
+                                      Appenders<Record> &appenders,
+                                      const int64_t &dayTime = 0)
+        {
+            auto &appender = appenders[symbol];
+            size_t first = 0;
+            while (first < n)
+            {
+                const int64_t time = dayTime ? dayTime : records[first].timestamp;
+                const uint32_t day = dayOf(time);
+                if (!appender.isOpen() || appender.day() != day)
+                {
+                    mkdir((rootDir_ + "/" + symbol).c_str(), 0755);
+                    BfxClientErrors code =
+                    appender.open(path<Record>(symbol, day), symbol, day,
+                                  initialCapacity_);
+                    if (code != noError)
+                        return code;
+                }
+
+                // Extend the run while records stay within the same day
+                const int64_t dayStart = time - ((time % NS_PER_DAY) + NS_PER_DAY) % NS_PER_DAY;
+                size_t last = first + 1;
+                while (last < n && (dayTime ||
+                       (records[last].timestamp >= dayStart &&
+                        records[last].timestamp < dayStart + NS_PER_DAY)))
+                    ++last;
+
+                BfxClientErrors code = appender.append(records + first,
+                                                       last - first);
+                if (code != noError)
+                    return code;
+                first = last;
+            }
+            return noError;
+        }
+    };
+}
@@ -0,0 +1,259 @@
+////////////////////////////////////////////////////////////////////////////////
+//  Trace.hpp
+//
+//
+//  Bitfinex REST API C++ client - request lifecycle tracing
+//
+//
+//  Spans are recorded into per-thread ring buffers and written out as Chrome
+//  trace_event JSON (load in chrome://tracing or https://ui.perfetto.dev).
+//  Tracing is disabled by default; a disabled span costs one relaxed atomic
+//  load. Define BFX_DISABLE_TRACING to compile spans out completely.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// namespaces
+using std::string;
+using std::vector;
+
+
+namespace BfxAPI
+{
+
+    class Tracer
+    {
+    public:
+
+        // Span names must be string literals, detail is copied (truncated)
+        struct Event
+        {
+            const char *name;
+            int64_t start; // ns
+            int64_t duration; // ns
+            char detail[48];
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Starts recording. Each thread keeps last capacity events.
+        static void enable(const size_t &capacity = 65536) noexcept
+        {
+            state().capacity.store(capacity ? capacity : 1,
+                                   std::memory_order_relaxed);
+            state().enabled.store(true, std::memory_order_release);
+        }
+
+        static void disable() noexcept
+        { state().enabled.store(false, std::memory_order_release); }
+
+        static bool isEnabled() noexcept
+        { return state().enabled.load(std::memory_order_relaxed); }
+
+        static int64_t now() noexcept
+        {
+            using namespace std::chrono;
+            return duration_cast<nanoseconds>(
+                steady_clock::now().time_since_epoch()).count();
+        }
+
+        /// Records finished span [start, end). Span is dropped if ring of
+        /// the thread cannot be allocated.
+        static void complete(const char *name,
+                             const int64_t &start,
+                             const int64_t &end,
+                             const char *detail = nullptr) noexcept
+        {
+            if (!isEnabled())
+                return;
+
+            Ring *ringPtr = threadRing();
+            if (!ringPtr)
+                return;
+            Ring &ring = *ringPtr;
+            Event &e = ring.events[ring.head % ring.events.size()];
+            e.name = name;
+            e.start = start;
+            e.duration = end - start;
+            e.detail[0] = '\0';
+            if (detail)
+            {
+                strncpy(e.detail, detail, sizeof(e.detail) - 1);
+                e.detail[sizeof(e.detail) - 1] = '\0';
+            }
+            ring.head.store(ring.head + 1, std::memory_order_release);
+        }
+
+        /// Chrome trace_event JSON of recorded spans. Spans recorded while
+        /// the JSON is being built may be torn - call it after traced
+        /// activity has stopped.
+        static string toJson()
+        {
+            string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+            bool first = true;
+            char buffer[160];
+
+            std::lock_guard<std::mutex> lock(state().mutex);
+            for (const auto &ring : state().rings)
+            {
+                const uint64_t head = ring->head.load(std::memory_order_acquire);
+                const uint64_t size = ring->events.size();
+                for (uint64_t i = head > size ? head - size : 0; i < head; ++i)
+                {
+                    const Event &e = ring->events[i % size];
+                    snprintf(buffer, sizeof(buffer),
+                             "%s{\"name\":\"%s\",\"cat\":\"bfx\",\"ph\":\"X\","
+                             "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u",
+                             first ? "" : ",", e.name, e.start / 1e3,
+                             e.duration / 1e3, ring->tid);
+                    out += buffer;
+                    if (e.detail[0])
+                    {
+                        out += ",\"args\":{\"detail\":\"";
+                        for (const char *c = e.detail; *c; ++c)
+                            if (*c != '"' && *c != '\\')
+                                out += *c;
+                        out += "\"}";
+                    }
+                    out += "}";
+                    first = false;
+                }
+            }
+            out += "]}";
+            return out;
+        }
+
+        static bool write(const string &path)
+        {
+            FILE *f = fopen(path.c_str(), "w");
+            if (!f)
+                return false;
+
+            const string json = toJson();
+            const bool ok = fwrite(json.data(), 1, json.size(), f) == json.size();
+            fclose(f);
+            return ok;
+        }
+
+        /// Drops recorded spans of all threads
+        static void clear()
+        {
+            std::lock_guard<std::mutex> lock(state().mutex);
+            for (auto &ring : state().rings)
+                ring->head.store(0, std::memory_order_release);
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        struct Ring
+        {
+            Ring(const size_t &capacity, const unsigned &inTid):
+            events(capacity), tid(inTid) {}
+
+            vector<Event> events;
+            std::atomic<uint64_t> head{0};
+            const unsigned tid;
+        };
+
+        // Rings are owned by the global state so spans of finished threads
+        // stay available
+        struct State
+        {
+            std::atomic<bool> enabled{false};
+            std::atomic<size_t> capacity{65536};
+            std::mutex mutex;
+            vector<std::shared_ptr<Ring>> rings;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static State& state() noexcept
+        {
+            static State s;
+            return s;
+        }
+
+        // Allocates ring on first use of the thread, nullptr if allocation
+        // fails (allocation is tried again by next span)
+        static Ring* threadRing() noexcept
+        {
+            thread_local std::shared_ptr<Ring> ring;
+            if (!ring)
+            {
+                try
+                {
+                    std::lock_guard<std::mutex> lock(state().mutex);
+                    auto created = std::make_shared<Ring>(
+                        state().capacity.load(std::memory_order_relaxed),
+                        static_cast<unsigned>(state().rings.size() + 1));
+                    state().rings.push_back(created);
+                    ring = std::move(created);
+                }
+                catch (...)
+                {
+                    return nullptr;
+                }
+            }
+            return ring.get();
+        }
+    };
+
+    /// RAII span, records nothing if tracing was disabled when it started
+    class TraceSpan
+    {
+    public:
+
+        explicit TraceSpan(const char *name, const char *detail = nullptr)
+        noexcept:
+        name_(name),
+        detail_(detail),
+        start_(Tracer::isEnabled() ? Tracer::now() : 0)
+        {}
+
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator = (const TraceSpan&) = delete;
+
+        ~TraceSpan()
+        {
+            if (start_)
+                Tracer::complete(name_, start_, Tracer::now(), detail_);
+        }
+
+    private:
+
+        const char *name_;
+        const char *detail_;
+        const int64_t start_;
+    };
+}
+
+#define BFX_TRACE_CONCAT_(a, b) a##b
+#define BFX_TRACE_CONCAT(a, b) BFX_TRACE_CONCAT_(a, b)
+
+#ifndef BFX_DISABLE_TRACING
+#define BFX_TRACE_SPAN(...) \
+    BfxAPI::TraceSpan BFX_TRACE_CONCAT(bfxTraceSpan_, __LINE__)(__VA_ARGS__)
+#else
+#define BFX_TRACE_SPAN(...)
+#endif
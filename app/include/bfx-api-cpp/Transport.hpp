@@ -0,0 +1,550 @@
+////////////////////////////////////////////////////////////////////////////////
+//  Transport.hpp
+//
+//
+//  Bitfinex REST API C++ client - HTTP transports
+//
+//
+//  HTTPRequest builds and signs requests, Transport moves them over the
+//  wire. CurlTransport (libcurl easy handles for blocking calls, curl multi
+//  for asynchronous ones) is the default, FakeTransport serves canned
+//  responses in-process. Other transports can be passed to BitfinexAPI
+//  constructor without touching endpoint code.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// std
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// curl
+#include <curl/curl.h>
+
+// internal LatencyHistogram (RequestTimings)
+#include "LatencyHistogram.hpp"
+
+// internal Trace
+#include "Trace.hpp"
+
+// namespaces
+using std::map;
+using std::string;
+
+
+namespace BfxAPI
+{
+
+    /// Single request - response round trip. Request fields (post, path,
+    /// params, payload, start) are set by HTTPRequest, result fields
+    /// (response, curlCode, httpCode, timings) by transport.
+    struct HttpExchange
+    {
+        bool post;
+        string path;
+        string params;   // GET query string
+        string payload;  // POST JSON payload (before base64 encoding)
+        string response;
+        CURLcode curlCode;
+        long httpCode;
+        RequestTimings timings;
+        int64_t start;   // steady clock ns
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Interface
+    ////////////////////////////////////////////////////////////////////////////
+
+    class Transport
+    {
+    public:
+
+        using Header = map<string, string>;
+        using Callback = std::function<void(HttpExchange&)>;
+
+        virtual ~Transport() = default;
+
+        /// Blocking GET of url, fills result fields of exchange. Transport
+        /// errors are reported through exchange.curlCode.
+        virtual void get(const string &url,
+                         const Header &header,
+                         HttpExchange &exchange) = 0;
+
+        /// Blocking POST of url with empty body, Bitfinex v1 payload travels
+        /// in header
+        virtual void post(const string &url,
+                          const Header &header,
+                          HttpExchange &exchange) = 0;
+
+        /// Queues request, callback is invoked from poll() once the request
+        /// completes. Default implementation performs it synchronously.
+        virtual void submit(const string &url,
+                            const Header &header,
+                            HttpExchange exchange,
+                            const Callback &callback)
+        {
+            if (exchange.post)
+                post(url, header, exchange);
+            else
+                get(url, header, exchange);
+            callback(exchange);
+        }
+
+        /// Drives submitted requests, waits up to timeout for progress.
+        /// Returns number of requests completed by this call.
+        virtual size_t poll(const std::chrono::milliseconds &timeout =
+                            std::chrono::milliseconds(0))
+        { return 0; }
+
+        /// Number of submitted requests not completed yet
+        virtual size_t pending() const
+        { return 0; }
+
+        /// Opens keep-alive connection used by post() ahead of time with GET
+        /// of url, response is dropped. No-op for transports without
+        /// connections.
+        virtual void warmUp(const string &url)
+        {}
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // libcurl
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// libcurl share handle, thread safe. CurlTransports attached to one
+    /// share reuse DNS cache and TLS sessions, so a new transport skips name
+    /// resolution and full TLS handshake. Connection cache isn't shared as
+    /// libcurl doesn't support sharing connections between concurrent
+    /// threads, every transport keeps its own keep-alive connections.
+    class CurlShare
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        CurlShare():
+        share_(curl_share_init())
+        {
+            if (!share_)
+                return;
+            curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lock);
+            curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlock);
+            curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+            curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(share_, CURLSHOPT_SHARE,
+                              CURL_LOCK_DATA_SSL_SESSION);
+        }
+
+        CurlShare(const CurlShare&) = delete;
+        CurlShare& operator = (const CurlShare&) = delete;
+
+        ~CurlShare()
+        {
+            if (share_)
+                curl_share_cleanup(share_);
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        CURLSH* handle() const noexcept
+        { return share_; }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        CURLSH *share_;
+        std::mutex mutexes_[CURL_LOCK_DATA_LAST];
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static void lock(CURL *handle, curl_lock_data data,
+                         curl_lock_access access, void *userp)
+        { static_cast<CurlShare*>(userp)->mutexes_[data].lock(); }
+
+        static void unlock(CURL *handle, curl_lock_data data, void *userp)
+        { static_cast<CurlShare*>(userp)->mutexes_[data].unlock(); }
+    };
+
+    /// Not thread safe, use one instance per HTTPRequest (the default)
+    class CurlTransport: public Transport
+    {
+        static constexpr auto CURL_TIMEOUT = 30L;
+        static constexpr auto CURL_DEBUG_VERBOSE = 0L;
+
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        // Transports of several clients (and threads) can share one
+        // CurlShare
+        explicit CurlTransport(const std::shared_ptr<CurlShare> &share =
+                               nullptr):
+        share_(share),
+        curlGET_(newHandle()),
+        curlPOST_(newHandle()),
+        multi_(nullptr)
+        {}
+
+        CurlTransport(const CurlTransport&) = delete;
+        CurlTransport& operator = (const CurlTransport&) = delete;
+
+        ~CurlTransport()
+        {
+            for (auto &t : active_)
+            {
+                curl_multi_remove_handle(multi_, t.first);
+                curl_slist_free_all(t.second->header);
+                curl_easy_cleanup(t.first);
+            }
+            for (CURL *handle : idle_)
+                curl_easy_cleanup(handle);
+            if (multi_)
+                curl_multi_cleanup(multi_);
+            curl_easy_cleanup(curlGET_);
+            curl_easy_cleanup(curlPOST_);
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        void get(const string &url,
+                 const Header &header,
+                 HttpExchange &exchange) override
+        { perform(curlGET_, url, header, exchange); }
+
+        void post(const string &url,
+                  const Header &header,
+                  HttpExchange &exchange) override
+        { perform(curlPOST_, url, header, exchange); }
+
+        void submit(const string &url,
+                    const Header &header,
+                    HttpExchange exchange,
+                    const Callback &callback) override
+        {
+            if (!multi_)
+                multi_ = curl_multi_init();
+            CURL *handle = nullptr;
+            if (!idle_.empty())
+            {
+                handle = idle_.back();
+                idle_.pop_back();
+            }
+            else
+                handle = newHandle();
+
+            if (!multi_ || !handle)
+            {
+                if (handle)
+                    idle_.push_back(handle);
+                exchange.curlCode = CURLE_FAILED_INIT;
+                callback(exchange);
+                return;
+            }
+
+            curl_slist *curlHeader = setup(handle, url, header, exchange.post);
+            std::unique_ptr<Transfer> transfer(
+                new Transfer{std::move(exchange), callback, curlHeader});
+            curl_easy_setopt(handle, CURLOPT_WRITEDATA,
+                             &transfer->exchange.response);
+            active_[handle] = std::move(transfer);
+            curl_multi_add_handle(multi_, handle);
+        }
+
+        size_t poll(const std::chrono::milliseconds &timeout =
+                    std::chrono::milliseconds(0)) override
+        {
+            if (active_.empty())
+                return 0;
+
+            int running = 0;
+            curl_multi_perform(multi_, &running);
+            size_t completed = complete();
+            if (!completed && running && timeout.count() > 0)
+            {
+                curl_multi_poll(multi_, nullptr, 0,
+                                static_cast<int>(timeout.count()), nullptr);
+                curl_multi_perform(multi_, &running);
+                completed = complete();
+            }
+            return completed;
+        }
+
+        size_t pending() const override
+        { return active_.size(); }
+
+        // Blocking POST has its own handle and therefore own connection
+        void warmUp(const string &url) override
+        {
+            HttpExchange exchange{false, string(), string(), string(),
+                                  string(), CURLE_OK, 0, RequestTimings(), 0};
+            perform(curlPOST_, url, Header(), exchange);
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        struct Transfer
+        {
+            HttpExchange exchange;
+            Callback callback;
+            curl_slist *header;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        // DNS and TLS session cache, must outlive the handles
+        std::shared_ptr<CurlShare> share_;
+        // blocking calls
+        CURL *curlGET_;
+        CURL *curlPOST_;
+        // asynchronous calls
+        CURLM *multi_;
+        std::vector<CURL*> idle_;
+        std::unordered_map<CURL*, std::unique_ptr<Transfer>> active_;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        CURL* newHandle() const
+        {
+            CURL *handle = curl_easy_init();
+            if (handle && share_ && share_->handle())
+                curl_easy_setopt(handle, CURLOPT_SHARE, share_->handle());
+            return handle;
+        }
+
+        void perform(CURL *handle,
+                     const string &url,
+                     const Header &header,
+                     HttpExchange &exchange)
+        {
+            exchange.response.clear();
+            exchange.httpCode = 0;
+            exchange.timings = RequestTimings();
+            if (!handle)
+            {
+                exchange.curlCode = CURLE_FAILED_INIT;
+                return;
+            }
+
+            curl_slist *curlHeader = setup(handle, url, header, exchange.post);
+            curl_easy_setopt(handle, CURLOPT_WRITEDATA, &exchange.response);
+            {
+                BFX_TRACE_SPAN("curl_transfer", exchange.path.c_str());
+                exchange.curlCode = curl_easy_perform(handle);
+            }
+            curl_slist_free_all(curlHeader);
+            readResult(handle, exchange);
+        }
+
+        // Moves finished transfers to idle handles and invokes their
+        // callbacks
+        size_t complete()
+        {
+            size_t completed = 0;
+            int queued = 0;
+            while (CURLMsg *msg = curl_multi_info_read(multi_, &queued))
+            {
+                if (msg->msg != CURLMSG_DONE)
+                    continue;
+
+                CURL *handle = msg->easy_handle;
+                const CURLcode code = msg->data.result;
+                auto it = active_.find(handle);
+                if (it == active_.end())
+                    continue;
+
+                std::unique_ptr<Transfer> transfer = std::move(it->second);
+                active_.erase(it);
+                curl_multi_remove_handle(multi_, handle);
+                curl_slist_free_all(transfer->header);
+
+                transfer->exchange.curlCode = code;
+                readResult(handle, transfer->exchange);
+                idle_.push_back(handle);
+                ++completed;
+                // callback may submit further requests
+                transfer->callback(transfer->exchange);
+            }
+            return completed;
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        // Sets request options, returns header list owned by caller
+        static curl_slist* setup(CURL *handle,
+                                 const string &url,
+                                 const Header &header,
+                                 bool post)
+        {
+            curl_slist *curlHeader = nullptr;
+            for (const auto &field : header)
+                curlHeader = curl_slist_append(
+                    curlHeader, (field.first + ": " + field.second).c_str());
+
+            curl_easy_setopt(handle, CURLOPT_HTTPHEADER, curlHeader);
+            if (post)
+            {
+                curl_easy_setopt(handle, CURLOPT_POST, 1L);
+                curl_easy_setopt(handle, CURLOPT_POSTFIELDS, "\n");
+            }
+            else
+                curl_easy_setopt(handle, CURLOPT_HTTPGET, 1L);
+            curl_easy_setopt(handle, CURLOPT_TIMEOUT, CURL_TIMEOUT);
+            curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+            curl_easy_setopt(handle, CURLOPT_VERBOSE, CURL_DEBUG_VERBOSE);
+            curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, writeCallback);
+            return curlHeader;
+        }
+
+        static void readResult(CURL *handle, HttpExchange &exchange) noexcept
+        {
+            curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &exchange.httpCode);
+
+            auto info = [handle](CURLINFO what) -> int64_t
+            {
+                curl_off_t us = 0;
+                curl_easy_getinfo(handle, what, &us);
+                return static_cast<int64_t>(us) * 1000;
+            };
+            RequestTimings &t = exchange.timings;
+            t.nameLookup = info(CURLINFO_NAMELOOKUP_TIME_T);
+            t.connect = info(CURLINFO_CONNECT_TIME_T);
+            t.appConnect = info(CURLINFO_APPCONNECT_TIME_T);
+            t.preTransfer = info(CURLINFO_PRETRANSFER_TIME_T);
+            t.startTransfer = info(CURLINFO_STARTTRANSFER_TIME_T);
+            t.total = info(CURLINFO_TOTAL_TIME_T);
+        }
+
+        // Appends fetched data to string set by CURLOPT_WRITEDATA
+        static size_t writeCallback(void *data,
+                                    size_t size,
+                                    size_t nmemb,
+                                    void *userp) noexcept
+        {
+            static_cast<string*>(userp)->append(static_cast<char*>(data),
+                                                size * nmemb);
+            return size * nmemb;
+        }
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // In-process fake
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Serves canned responses by request path, e.g. in examples and tools
+    /// running without network. Thread safe.
+    class FakeTransport: public Transport
+    {
+    public:
+
+        using Handler = std::function<void(HttpExchange&)>;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        /// Response of path (e.g. "/pubticker/btcusd")
+        void setResponse(const string &path,
+                         const string &response,
+                         long httpCode = 200)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            responses_[path] = {response, httpCode};
+        }
+
+        /// Called for paths without canned response, unhandled paths get
+        /// HTTP 404
+        void setHandler(const Handler &handler)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            handler_ = handler;
+        }
+
+        void get(const string &url,
+                 const Header &header,
+                 HttpExchange &exchange) override
+        { serve(exchange); }
+
+        void post(const string &url,
+                  const Header &header,
+                  HttpExchange &exchange) override
+        { serve(exchange); }
+
+        /// Number of requests served
+        size_t requests() const
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return requests_;
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        mutable std::mutex mutex_;
+        map<string, std::pair<string, long>> responses_;
+        Handler handler_;
+        size_t requests_ = 0;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        void serve(HttpExchange &exchange)
+        {
+            exchange.curlCode = CURLE_OK;
+            exchange.timings = RequestTimings();
+
+            Handler handler;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                ++requests_;
+                auto it = responses_.find(exchange.path);
+                if (it != responses_.end())
+                {
+                    exchange.response = it->second.first;
+                    exchange.httpCode = it->second.second;
+                    return;
+                }
+                handler = handler_;
+            }
+
+            exchange.response = "{\"message\":\"Not Found\"}";
+            exchange.httpCode = 404;
+            if (handler)
+                handler(exchange);
+        }
+    };
+}
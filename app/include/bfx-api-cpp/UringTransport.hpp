@@ -0,0 +1,1347 @@
+////////////////////////////////////////////////////////////////////////////////
+//  UringTransport.hpp
+//
+//
+//  Bitfinex REST API C++ client - Linux io_uring transport
+//
+//
+//  HTTP/1.1 client driving a pool of keep-alive TCP connections through one
+//  io_uring instance. Connect, send and receive operations of all submitted
+//  requests are queued to the submission ring and flushed by a single
+//  io_uring_enter() per poll(), send and receive of one request are linked
+//  so they cost one submission, receives carry linked timeouts.
+//
+//  https:// connections run OpenSSL over memory BIOs: the ring carries TLS
+//  records, OpenSSL only encrypts and decrypts them. Server certificate and
+//  host name are verified against OpenSSL default CA paths or setCaFile().
+//  After TLS 1.3 handshake with AES-GCM, encryption of sent records moves
+//  to the kernel (kTLS) where the tls module is available, so requests are
+//  sent from the ring as plaintext. Received records are still decrypted by
+//  OpenSSL.
+//
+//  Uses raw syscalls, liburing is not required. Requires OpenSSL 1.1.1+ and
+//  Linux 5.11+ (IORING_FEAT_EXT_ARG), construction on older kernels leaves
+//  the transport unusable and requests fail with CURLE_FAILED_INIT.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifdef __linux__
+
+// std
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// POSIX
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Linux
+#include <linux/io_uring.h>
+#include <linux/tls.h>
+
+// OpenSSL
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/ssl.h>
+
+// internal Transport
+#include "Transport.hpp"
+
+// namespaces
+using std::string;
+using std::vector;
+
+
+namespace BfxAPI
+{
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Ring
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Minimal io_uring wrapper (setup, SQE allocation, submit / wait, CQE
+    /// reaping), single threaded
+    class IoUring
+    {
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        explicit IoUring(unsigned entries)
+        {
+            io_uring_params params;
+            memset(&params, 0, sizeof(params));
+            fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            if (fd_ < 0)
+                return;
+            if (!(params.features & IORING_FEAT_EXT_ARG))
+            {
+                close(fd_);
+                fd_ = -1;
+                return;
+            }
+
+            sqMapSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqMapSize_ = params.cq_off.cqes +
+            params.cq_entries * sizeof(io_uring_cqe);
+            const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (single)
+                sqMapSize_ = cqMapSize_ = std::max(sqMapSize_, cqMapSize_);
+
+            sqMap_ = mmap(nullptr, sqMapSize_, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+            cqMap_ = single ? sqMap_ :
+            mmap(nullptr, cqMapSize_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+            sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+            void *sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+            if (sqMap_ == MAP_FAILED || cqMap_ == MAP_FAILED ||
+                sqes == MAP_FAILED)
+            {
+                release();
+                return;
+            }
+            sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+            char *sq = static_cast<char*>(sqMap_);
+            sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+            sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+            sqEntries_ = params.sq_entries;
+            sqLocalTail_ = *sqTail_;
+
+            char *cq = static_cast<char*>(cqMap_);
+            cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        }
+
+        IoUring(const IoUring&) = delete;
+        IoUring& operator = (const IoUring&) = delete;
+
+        ~IoUring()
+        { release(); }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        bool isValid() const noexcept
+        { return fd_ >= 0; }
+
+        /// Zeroed SQE or nullptr if submission ring is full even after
+        /// submitting queued entries
+        io_uring_sqe* getSqe()
+        {
+            if (sqLocalTail_ - load(sqHead_) == sqEntries_)
+            {
+                submit(0, nullptr);
+                if (sqLocalTail_ - load(sqHead_) == sqEntries_)
+                    return nullptr;
+            }
+            const unsigned index = sqLocalTail_ & sqMask_;
+            io_uring_sqe *sqe = &sqes_[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqArray_[index] = index;
+            ++sqLocalTail_;
+            return sqe;
+        }
+
+        /// Submits queued SQEs, optionally waits for waitFor completions or
+        /// timeout (nullptr waits indefinitely)
+        int submit(unsigned waitFor, const __kernel_timespec *timeout)
+        {
+            const unsigned toSubmit = sqLocalTail_ - load(sqTail_);
+            __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+            if (!toSubmit && !waitFor)
+                return 0;
+
+            io_uring_getevents_arg arg;
+            memset(&arg, 0, sizeof(arg));
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = reinterpret_cast<uint64_t>(timeout);
+            unsigned flags = IORING_ENTER_EXT_ARG;
+            if (waitFor)
+                flags |= IORING_ENTER_GETEVENTS;
+            int ret;
+            do
+                ret = static_cast<int>(syscall(__NR_io_uring_enter, fd_,
+                                               toSubmit, waitFor, flags, &arg,
+                                               sizeof(arg)));
+            while (ret < 0 && errno == EINTR);
+            return ret;
+        }
+
+        /// Calls handler for every available CQE, returns their count
+        template <typename Handler>
+        unsigned reap(Handler handler)
+        {
+            unsigned head = *cqHead_;
+            unsigned count = 0;
+            while (head != load(cqTail_))
+            {
+                const io_uring_cqe cqe = cqes_[head & cqMask_];
+                ++head;
+                __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+                handler(cqe);
+                ++count;
+            }
+            return count;
+        }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        int fd_ = -1;
+        void *sqMap_ = MAP_FAILED;
+        void *cqMap_ = MAP_FAILED;
+        size_t sqMapSize_ = 0;
+        size_t cqMapSize_ = 0;
+        size_t sqesSize_ = 0;
+        io_uring_sqe *sqes_ = nullptr;
+        unsigned *sqHead_ = nullptr;
+        unsigned *sqTail_ = nullptr;
+        unsigned *sqArray_ = nullptr;
+        unsigned sqMask_ = 0;
+        unsigned sqEntries_ = 0;
+        unsigned sqLocalTail_ = 0;
+        unsigned *cqHead_ = nullptr;
+        unsigned *cqTail_ = nullptr;
+        unsigned cqMask_ = 0;
+        io_uring_cqe *cqes_ = nullptr;
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static unsigned load(const unsigned *value) noexcept
+        { return __atomic_load_n(value, __ATOMIC_ACQUIRE); }
+
+        void release() noexcept
+        {
+            if (sqes_)
+                munmap(sqes_, sqesSize_);
+            if (cqMap_ != MAP_FAILED && cqMap_ != sqMap_)
+                munmap(cqMap_, cqMapSize_);
+            if (sqMap_ != MAP_FAILED)
+                munmap(sqMap_, sqMapSize_);
+            if (fd_ >= 0)
+                close(fd_);
+            sqes_ = nullptr;
+            sqMap_ = cqMap_ = MAP_FAILED;
+            fd_ = -1;
+        }
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Transport
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Not thread safe, use one instance per HTTPRequest
+    class UringTransport: public Transport
+    {
+        static constexpr auto TIMEOUT_S = 30;
+        static constexpr size_t RECV_BUFFER = 64 * 1024;
+        static constexpr uint64_t SEQ_MASK = 0xffffffffffULL;
+
+    public:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Constructor - Destructor
+        ////////////////////////////////////////////////////////////////////////
+
+        /// maxConnections limits keep-alive connections per transport,
+        /// further requests wait for a free connection
+        explicit UringTransport(size_t maxConnections = 16):
+        maxConnections_(std::max<size_t>(maxConnections, 1)),
+        ring_(static_cast<unsigned>(std::max<size_t>(maxConnections_ * 4, 32)))
+        {
+            timeout_.tv_sec = TIMEOUT_S;
+            timeout_.tv_nsec = 0;
+        }
+
+        UringTransport(const UringTransport&) = delete;
+        UringTransport& operator = (const UringTransport&) = delete;
+
+        ~UringTransport()
+        {
+            // Pending operations hold buffers of connections, cancel them
+            // by closing sockets and wait until the kernel releases them
+            for (auto &conn : connections_)
+                if (conn->fd >= 0)
+                {
+                    shutdown(conn->fd, SHUT_RDWR);
+                    close(conn->fd);
+                    conn->fd = -1;
+                }
+            if (ring_.isValid())
+                while (inflight_)
+                {
+                    __kernel_timespec ts = {1, 0};
+                    if (ring_.submit(1, &ts) < 0 && errno != ETIME)
+                        break;
+                    ring_.reap([this](const io_uring_cqe&) { --inflight_; });
+                }
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Accessors
+        ////////////////////////////////////////////////////////////////////////
+
+        /// CA bundle verifying https:// servers instead of OpenSSL default
+        /// paths (SSL_CERT_FILE, SSL_CERT_DIR), used by new connections
+        void setCaFile(const string &caFile)
+        {
+            caFile_ = caFile;
+            tlsContext_ = nullptr;
+        }
+
+        /// kTLS after handshake, on by default
+        void setKernelTls(bool enabled) noexcept
+        { kernelTls_ = enabled; }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Public methods
+        ////////////////////////////////////////////////////////////////////////
+
+        void get(const string &url,
+                 const Header &header,
+                 HttpExchange &exchange) override
+        { perform(url, header, exchange); }
+
+        void post(const string &url,
+                  const Header &header,
+                  HttpExchange &exchange) override
+        { perform(url, header, exchange); }
+
+        // Connection returns to the pool shared by all requests
+        void warmUp(const string &url) override
+        {
+            HttpExchange exchange{false, string(), string(), string(),
+                                  string(), CURLE_OK, 0, RequestTimings(), 0};
+            perform(url, Header(), exchange);
+        }
+
+        void submit(const string &url,
+                    const Header &header,
+                    HttpExchange exchange,
+                    const Callback &callback) override
+        {
+            std::unique_ptr<Request> request(new Request);
+            request->exchange = std::move(exchange);
+            request->callback = callback;
+            request->start = steadyNowNs();
+
+            string host, port, target;
+            bool tls = false;
+            CURLcode code = CURLE_OK;
+            if (!ring_.isValid())
+                code = CURLE_FAILED_INIT;
+            else
+                code = parseUrl(url, tls, host, port, target);
+            if (code == CURLE_OK && tls)
+                code = initTls();
+            size_t origin = 0;
+            if (code == CURLE_OK)
+                code = resolve(tls, host, port, origin,
+                               request->exchange.timings);
+            if (code != CURLE_OK)
+            {
+                request->exchange.curlCode = code;
+                request->exchange.httpCode = 0;
+                request->callback(request->exchange);
+                return;
+            }
+
+            request->data = buildRequest(request->exchange.post, target,
+                                         origins_[origin].hostHeader, header);
+            origins_[origin].queue.push_back(std::move(request));
+            ++pending_;
+            dispatch(origin);
+        }
+
+        size_t poll(const std::chrono::milliseconds &timeout =
+                    std::chrono::milliseconds(0)) override
+        {
+            if (!ring_.isValid())
+                return 0;
+
+            completed_ = 0;
+            if (inflight_)
+            {
+                const auto ns = std::chrono::duration_cast<
+                std::chrono::nanoseconds>(timeout).count();
+                __kernel_timespec ts;
+                ts.tv_sec = ns / 1000000000;
+                ts.tv_nsec = ns % 1000000000;
+                ring_.submit(1, &ts);
+            }
+            else
+                ring_.submit(0, nullptr);
+            ring_.reap([this](const io_uring_cqe &cqe) { handle(cqe); });
+            return completed_;
+        }
+
+        size_t pending() const override
+        { return pending_; }
+
+    private:
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private types
+        ////////////////////////////////////////////////////////////////////////
+
+        enum class Op : uint8_t
+        {
+            connect = 1,
+            send,
+            recv,
+            timeout
+        };
+
+        struct SslFree
+        {
+            void operator () (SSL *ssl) const noexcept
+            { SSL_free(ssl); }
+
+            void operator () (SSL_CTX *ctx) const noexcept
+            { SSL_CTX_free(ctx); }
+        };
+
+        struct Request
+        {
+            HttpExchange exchange;
+            Callback callback;
+            string data;    // serialized HTTP request
+            int64_t start;  // steady clock ns
+            bool retried = false;
+        };
+
+        struct Connection
+        {
+            size_t index = 0;
+            int fd = -1;
+            size_t origin = 0;
+            bool connected = false;
+            bool reused = false;
+            uint64_t seq = 0;       // identifies operations of current request
+            unsigned inflight = 0;  // operations owning buffers
+            string out;             // request being sent
+            size_t sent = 0;
+            string in;
+            std::unique_ptr<char[]> buffer;
+            std::unique_ptr<Request> request;
+            // TLS session of https:// connection
+            std::unique_ptr<SSL, SslFree> ssl;
+            bool handshaken = false;
+            bool kernelTls = false;     // kernel encrypts sent records
+            bool captureSecret = false;
+            string txSecret;            // TLS 1.3 client traffic secret
+        };
+
+        struct Origin
+        {
+            string key;
+            string host;
+            bool tls;
+            string hostHeader;
+            sockaddr_storage addr;
+            socklen_t addrLen;
+            std::deque<std::unique_ptr<Request>> queue;
+        };
+
+        ////////////////////////////////////////////////////////////////////////
+        // Private attributes
+        ////////////////////////////////////////////////////////////////////////
+
+        size_t maxConnections_;
+        IoUring ring_;
+        __kernel_timespec timeout_;
+        vector<std::unique_ptr<Connection>> connections_;
+        std::deque<Origin> origins_; // stable addresses for connect
+        std::unordered_map<string, size_t> originIndex_;
+        size_t inflight_ = 0;
+        size_t pending_ = 0;
+        size_t completed_ = 0;
+        std::unique_ptr<SSL_CTX, SslFree> tlsContext_;
+        string caFile_;
+        bool kernelTls_ = true; // cleared when kernel lacks tls module
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private methods
+        ////////////////////////////////////////////////////////////////////////
+
+        void perform(const string &url,
+                     const Header &header,
+                     HttpExchange &exchange)
+        {
+            bool done = false;
+            submit(url, header, std::move(exchange),
+                   [&exchange, &done](HttpExchange &result)
+                   {
+                       exchange = std::move(result);
+                       done = true;
+                   });
+            while (!done)
+                poll(std::chrono::seconds(1));
+        }
+
+        CURLcode resolve(bool tls,
+                         const string &host,
+                         const string &port,
+                         size_t &origin,
+                         RequestTimings &timings)
+        {
+            const string key = (tls ? "https://" : "http://") + host + ":" +
+                               port;
+            auto it = originIndex_.find(key);
+            if (it != originIndex_.end())
+            {
+                origin = it->second;
+                return CURLE_OK;
+            }
+
+            const int64_t start = steadyNowNs();
+            addrinfo hints;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_STREAM;
+            addrinfo *result = nullptr;
+            if (getaddrinfo(host.c_str(), port.c_str(), &hints, &result) ||
+                !result)
+                return CURLE_COULDNT_RESOLVE_HOST;
+
+            Origin o;
+            o.key = key;
+            o.host = host;
+            o.tls = tls;
+            o.hostHeader = port == (tls ? "443" : "80") ? host
+                                                        : host + ":" + port;
+            memcpy(&o.addr, result->ai_addr, result->ai_addrlen);
+            o.addrLen = result->ai_addrlen;
+            freeaddrinfo(result);
+            timings.nameLookup = steadyNowNs() - start;
+
+            origin = origins_.size();
+            origins_.push_back(std::move(o));
+            originIndex_[key] = origin;
+            return CURLE_OK;
+        }
+
+        // Starts queued requests of origin on idle or new connections
+        void dispatch(size_t origin)
+        {
+            auto &queue = origins_[origin].queue;
+            while (!queue.empty())
+            {
+                Connection *conn = acquire(origin);
+                if (!conn)
+                    return;
+                conn->request = std::move(queue.front());
+                queue.pop_front();
+                start(*conn);
+            }
+        }
+
+        void dispatchAll()
+        {
+            for (size_t origin = 0; origin < origins_.size(); ++origin)
+                if (!origins_[origin].queue.empty())
+                    dispatch(origin);
+        }
+
+        // Idle keep-alive connection to origin, new one if the limit allows
+        Connection* acquire(size_t origin)
+        {
+            Connection *reusable = nullptr;
+            size_t open = 0;
+            for (auto &conn : connections_)
+            {
+                if (conn->fd >= 0)
+                {
+                    ++open;
+                    // Only linked timeout completion may still be pending
+                    if (conn->origin == origin && conn->connected &&
+                        !conn->request)
+                        return conn.get();
+                }
+                else if (!conn->inflight && !reusable)
+                    reusable = conn.get();
+            }
+            if (open >= maxConnections_)
+            {
+                // Close idle connection to another origin
+                for (auto &conn : connections_)
+                    if (conn->fd >= 0 && !conn->request)
+                    {
+                        closeConnection(*conn);
+                        return acquire(origin);
+                    }
+                return nullptr;
+            }
+            if (!reusable)
+            {
+                connections_.emplace_back(new Connection);
+                reusable = connections_.back().get();
+                reusable->index = connections_.size() - 1;
+                reusable->buffer.reset(new char[RECV_BUFFER]);
+            }
+            reusable->origin = origin;
+            reusable->connected = false;
+            reusable->reused = false;
+            return reusable;
+        }
+
+        void start(Connection &conn)
+        {
+            ++conn.seq;
+            conn.in.clear();
+
+            if (conn.connected)
+            {
+                conn.reused = true;
+                sendRequest(conn);
+                return;
+            }
+
+            const Origin &origin = origins_[conn.origin];
+            conn.fd = socket(origin.addr.ss_family,
+                             SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (conn.fd < 0)
+            {
+                fail(conn, CURLE_COULDNT_CONNECT);
+                return;
+            }
+            const int one = 1;
+            setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            io_uring_sqe *sqe = prepare(conn, Op::connect);
+            if (!sqe)
+                return;
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->fd = conn.fd;
+            sqe->addr = reinterpret_cast<uint64_t>(&origin.addr);
+            sqe->off = origin.addrLen;
+            linkTimeout(conn, sqe);
+        }
+
+        // Sends the whole request, encrypted by OpenSSL unless kTLS is on
+        void sendRequest(Connection &conn)
+        {
+            Request &request = *conn.request;
+            request.exchange.timings.preTransfer = steadyNowNs() - request.start;
+
+            // Connection owns buffers of its pending operations
+            conn.out.clear();
+            if (conn.ssl && !conn.kernelTls)
+            {
+                ERR_clear_error();
+                if (SSL_write(conn.ssl.get(), request.data.data(),
+                              static_cast<int>(request.data.size())) <= 0)
+                {
+                    fail(conn, CURLE_SEND_ERROR);
+                    return;
+                }
+                drain(conn.ssl.get(), conn.out);
+            }
+            else
+                conn.out = request.data;
+            transmit(conn);
+        }
+
+        // Linked send of conn.out and receive
+        void transmit(Connection &conn)
+        {
+            conn.sent = 0;
+            io_uring_sqe *sqe = prepare(conn, Op::send);
+            if (!sqe)
+                return;
+            sqe->opcode = IORING_OP_SEND;
+            sqe->fd = conn.fd;
+            sqe->addr = reinterpret_cast<uint64_t>(conn.out.data());
+            sqe->len = static_cast<uint32_t>(conn.out.size());
+            sqe->msg_flags = MSG_NOSIGNAL;
+            sqe->flags |= IOSQE_IO_LINK;
+            receive(conn);
+        }
+
+        void receive(Connection &conn)
+        {
+            io_uring_sqe *sqe = prepare(conn, Op::recv);
+            if (!sqe)
+                return;
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = conn.fd;
+            sqe->addr = reinterpret_cast<uint64_t>(conn.buffer.get());
+            sqe->len = RECV_BUFFER;
+            linkTimeout(conn, sqe);
+        }
+
+        void linkTimeout(Connection &conn, io_uring_sqe *sqe)
+        {
+            sqe->flags |= IOSQE_IO_LINK;
+            io_uring_sqe *timeout = prepare(conn, Op::timeout);
+            if (!timeout)
+                return;
+            timeout->opcode = IORING_OP_LINK_TIMEOUT;
+            timeout->fd = -1;
+            timeout->addr = reinterpret_cast<uint64_t>(&timeout_);
+            timeout->len = 1;
+        }
+
+        io_uring_sqe* prepare(Connection &conn, const Op &op)
+        {
+            io_uring_sqe *sqe = ring_.getSqe();
+            if (!sqe)
+            {
+                fail(conn, CURLE_OUT_OF_MEMORY);
+                return nullptr;
+            }
+            sqe->user_data = userData(conn, op);
+            ++conn.inflight;
+            ++inflight_;
+            return sqe;
+        }
+
+        // connection index | operation | request sequence
+        static uint64_t userData(const Connection &conn, const Op &op) noexcept
+        {
+            return conn.index | static_cast<uint64_t>(op) << 16 |
+            (conn.seq & SEQ_MASK) << 24;
+        }
+
+        void handle(const io_uring_cqe &cqe)
+        {
+            --inflight_;
+            const size_t index = cqe.user_data & 0xffff;
+            const auto op = static_cast<Op>((cqe.user_data >> 16) & 0xff);
+            const uint64_t seq = cqe.user_data >> 24;
+            if (index >= connections_.size())
+                return;
+            Connection &conn = *connections_[index];
+            --conn.inflight;
+
+            // Timeouts report through the operation they guard, operations
+            // of finished requests are stale
+            if (op == Op::timeout || !conn.request ||
+                seq != (conn.seq & SEQ_MASK))
+            {
+                // Closed connection slot can be reused now
+                if (conn.fd < 0 && !conn.inflight)
+                    dispatchAll();
+                return;
+            }
+
+            const int res = cqe.res;
+            switch (op)
+            {
+            case Op::connect:
+                if (res < 0)
+                    fail(conn, res == -ECANCELED ? CURLE_OPERATION_TIMEDOUT
+                                                 : CURLE_COULDNT_CONNECT);
+                else
+                {
+                    conn.connected = true;
+                    conn.request->exchange.timings.connect =
+                    steadyNowNs() - conn.request->start;
+                    if (origins_[conn.origin].tls)
+                        startTls(conn);
+                    else
+                        sendRequest(conn);
+                }
+                break;
+
+            case Op::send:
+                if (res < 0)
+                    failOrRetry(conn, CURLE_SEND_ERROR);
+                else if (conn.sent + res < conn.out.size())
+                {
+                    // Short send, receive is already queued
+                    conn.sent += res;
+                    io_uring_sqe *sqe = prepare(conn, Op::send);
+                    if (!sqe)
+                        return;
+                    sqe->opcode = IORING_OP_SEND;
+                    sqe->fd = conn.fd;
+                    sqe->addr = reinterpret_cast<uint64_t>(
+                        conn.out.data() + conn.sent);
+                    sqe->len = static_cast<uint32_t>(conn.out.size() - conn.sent);
+                    sqe->msg_flags = MSG_NOSIGNAL;
+                }
+                else
+                    conn.sent += res;
+                break;
+
+            case Op::recv:
+                onReceive(conn, res);
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        void onReceive(Connection &conn, int res)
+        {
+            if (res < 0)
+            {
+                // Canceled by linked timeout or broken link (send failed)
+                failOrRetry(conn, res == -ECANCELED ? CURLE_OPERATION_TIMEDOUT
+                                                    : CURLE_RECV_ERROR);
+                return;
+            }
+
+            Request &request = *conn.request;
+            const bool first = conn.in.empty();
+            bool eof = res == 0;
+            if (conn.ssl)
+            {
+                if (res > 0)
+                    BIO_write(SSL_get_rbio(conn.ssl.get()), conn.buffer.get(),
+                              res);
+                if (!conn.handshaken)
+                {
+                    if (eof)
+                        fail(conn, CURLE_SSL_CONNECT_ERROR);
+                    else
+                        handshake(conn);
+                    return;
+                }
+                if (!decrypt(conn, eof))
+                {
+                    failOrRetry(conn, CURLE_RECV_ERROR);
+                    return;
+                }
+            }
+            else if (res > 0)
+                conn.in.append(conn.buffer.get(), res);
+            if (first && !conn.in.empty())
+                request.exchange.timings.startTransfer =
+                steadyNowNs() - request.start;
+
+            long status = 0;
+            bool keepAlive = true;
+            if (parseResponse(conn.in, eof, status, request.exchange.response,
+                              keepAlive))
+            {
+                request.exchange.httpCode = status;
+                request.exchange.curlCode = CURLE_OK;
+                // Records OpenSSL wants to send can't pass kTLS
+                if (!keepAlive || eof ||
+                    (conn.kernelTls &&
+                     BIO_ctrl_pending(SSL_get_wbio(conn.ssl.get()))))
+                    closeConnection(conn);
+                complete(conn);
+            }
+            else if (eof)
+                failOrRetry(conn, conn.in.empty() ? CURLE_GOT_NOTHING
+                                                  : CURLE_RECV_ERROR);
+            else
+                receive(conn);
+        }
+
+        // Request on reused connection may hit server closing idle
+        // connection, it is resent once on a fresh one before any response
+        // byte arrived
+        void failOrRetry(Connection &conn, CURLcode code)
+        {
+            Request &request = *conn.request;
+            if (conn.reused && conn.in.empty() && !request.retried &&
+                code != CURLE_OPERATION_TIMEDOUT)
+            {
+                request.retried = true;
+                const size_t origin = conn.origin;
+                std::unique_ptr<Request> retry = std::move(conn.request);
+                ++conn.seq;
+                closeConnection(conn);
+                origins_[origin].queue.push_front(std::move(retry));
+                dispatch(origin);
+                return;
+            }
+            fail(conn, code);
+        }
+
+        void fail(Connection &conn, CURLcode code)
+        {
+            if (!conn.request)
+                return;
+            conn.request->exchange.curlCode = code;
+            conn.request->exchange.httpCode = 0;
+            conn.request->exchange.response.clear();
+            closeConnection(conn);
+            complete(conn);
+        }
+
+        void complete(Connection &conn)
+        {
+            std::unique_ptr<Request> request = std::move(conn.request);
+            ++conn.seq;
+            --pending_;
+            ++completed_;
+            request->exchange.timings.total = steadyNowNs() - request->start;
+            const size_t origin = conn.origin;
+            request->callback(request->exchange);
+            dispatch(origin);
+        }
+
+        void closeConnection(Connection &conn)
+        {
+            if (conn.fd >= 0)
+            {
+                // Pending operations complete with errors and are ignored
+                shutdown(conn.fd, SHUT_RDWR);
+                close(conn.fd);
+            }
+            conn.fd = -1;
+            conn.connected = false;
+            conn.ssl = nullptr;
+            conn.handshaken = false;
+            conn.kernelTls = false;
+            OPENSSL_cleanse(&conn.txSecret[0], conn.txSecret.size());
+            conn.txSecret.clear();
+        }
+
+        CURLcode initTls()
+        {
+            if (tlsContext_)
+                return CURLE_OK;
+
+            std::unique_ptr<SSL_CTX, SslFree> ctx(
+                SSL_CTX_new(TLS_client_method()));
+            if (!ctx)
+                return CURLE_FAILED_INIT;
+            SSL_CTX_set_min_proto_version(ctx.get(), TLS1_2_VERSION);
+            SSL_CTX_set_verify(ctx.get(), SSL_VERIFY_PEER, nullptr);
+            if ((caFile_.empty()
+                 ? SSL_CTX_set_default_verify_paths(ctx.get())
+                 : SSL_CTX_load_verify_locations(ctx.get(), caFile_.c_str(),
+                                                 nullptr)) != 1)
+            {
+                ERR_clear_error();
+                return CURLE_SSL_CACERT_BADFILE;
+            }
+            SSL_CTX_set_keylog_callback(ctx.get(), keylog);
+            tlsContext_ = std::move(ctx);
+            return CURLE_OK;
+        }
+
+        void startTls(Connection &conn)
+        {
+            const CURLcode code = initTls();
+            if (code != CURLE_OK)
+            {
+                fail(conn, code);
+                return;
+            }
+
+            conn.ssl.reset(SSL_new(tlsContext_.get()));
+            BIO *in = BIO_new(BIO_s_mem());
+            BIO *out = BIO_new(BIO_s_mem());
+            if (!conn.ssl || !in || !out)
+            {
+                BIO_free(in);
+                BIO_free(out);
+                fail(conn, CURLE_OUT_OF_MEMORY);
+                return;
+            }
+            SSL *ssl = conn.ssl.get();
+            SSL_set_bio(ssl, in, out);
+            SSL_set_connect_state(ssl);
+            SSL_set_app_data(ssl, &conn);
+            conn.captureSecret = kernelTls_;
+
+            const string &host = origins_[conn.origin].host;
+            unsigned char address[sizeof(in6_addr)];
+            if (inet_pton(AF_INET, host.c_str(), address) == 1 ||
+                inet_pton(AF_INET6, host.c_str(), address) == 1)
+                X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl),
+                                              host.c_str());
+            else
+            {
+                SSL_set_tlsext_host_name(ssl, host.c_str());
+                SSL_set1_host(ssl, host.c_str());
+            }
+            handshake(conn);
+        }
+
+        // Advances handshake with received records, sends the request
+        // once it is done
+        void handshake(Connection &conn)
+        {
+            SSL *ssl = conn.ssl.get();
+            ERR_clear_error();
+            const int ret = SSL_do_handshake(ssl);
+            if (ret == 1)
+            {
+                Request &request = *conn.request;
+                request.exchange.timings.appConnect =
+                steadyNowNs() - request.start;
+                conn.handshaken = true;
+                conn.kernelTls = kernelTls_ && enableKernelTls(conn);
+                OPENSSL_cleanse(&conn.txSecret[0], conn.txSecret.size());
+                conn.txSecret.clear();
+                sendRequest(conn);
+                return;
+            }
+            if (SSL_get_error(ssl, ret) != SSL_ERROR_WANT_READ)
+            {
+                const bool verified = SSL_get_verify_result(ssl) == X509_V_OK;
+                ERR_clear_error();
+                fail(conn, verified ? CURLE_SSL_CONNECT_ERROR
+                                    : CURLE_PEER_FAILED_VERIFICATION);
+                return;
+            }
+
+            conn.out.clear();
+            drain(ssl, conn.out);
+            if (conn.out.empty())
+                receive(conn);
+            else
+                transmit(conn);
+        }
+
+        // Appends decrypted records to conn.in, eof is set by close_notify.
+        // False on broken record.
+        bool decrypt(Connection &conn, bool &eof)
+        {
+            SSL *ssl = conn.ssl.get();
+            for (;;)
+            {
+                ERR_clear_error();
+                const int size = SSL_read(ssl, conn.buffer.get(),
+                                          static_cast<int>(RECV_BUFFER));
+                if (size > 0)
+                {
+                    conn.in.append(conn.buffer.get(), size);
+                    continue;
+                }
+                switch (SSL_get_error(ssl, size))
+                {
+                case SSL_ERROR_WANT_READ:
+                    return true;
+                case SSL_ERROR_ZERO_RETURN:
+                    eof = true;
+                    return true;
+                default:
+                    ERR_clear_error();
+                    // Peer closed without close_notify
+                    return eof;
+                }
+            }
+        }
+
+        // Moves encryption of sent records to the kernel, TLS 1.3 with
+        // AES-GCM only. Last handshake flight is sent before.
+        bool enableKernelTls(Connection &conn)
+        {
+            SSL *ssl = conn.ssl.get();
+            const SSL_CIPHER *cipher = SSL_get_current_cipher(ssl);
+            const int nid = cipher ? SSL_CIPHER_get_cipher_nid(cipher)
+                                   : NID_undef;
+            if (SSL_version(ssl) != TLS1_3_VERSION || conn.txSecret.empty() ||
+                (nid != NID_aes_128_gcm && nid != NID_aes_256_gcm))
+                return false;
+
+            // No ring operation of the connection is pending here
+            string flight;
+            drain(ssl, flight);
+            const ssize_t sent = flight.empty()
+            ? 0
+            : ::send(conn.fd, flight.data(), flight.size(), MSG_NOSIGNAL);
+            if (sent != static_cast<ssize_t>(flight.size()))
+            {
+                // Rest goes out with the request encrypted by OpenSSL
+                const size_t done = sent > 0 ? static_cast<size_t>(sent) : 0;
+                BIO_write(SSL_get_wbio(ssl), flight.data() + done,
+                          static_cast<int>(flight.size() - done));
+                return false;
+            }
+
+            if (setsockopt(conn.fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")))
+            {
+                if (errno == ENOENT || errno == ENOPROTOOPT)
+                    kernelTls_ = false;
+                return false;
+            }
+
+            // Socket without TLS_TX still sends plaintext, OpenSSL
+            // encrypts then
+            const EVP_MD *md = SSL_CIPHER_get_handshake_digest(cipher);
+            unsigned char key[TLS_CIPHER_AES_GCM_256_KEY_SIZE];
+            unsigned char iv[TLS_CIPHER_AES_GCM_256_SALT_SIZE +
+                             TLS_CIPHER_AES_GCM_256_IV_SIZE];
+            const bool aes128 = nid == NID_aes_128_gcm;
+            const size_t keySize = aes128 ? TLS_CIPHER_AES_GCM_128_KEY_SIZE
+                                          : TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+            bool ok = expandLabel(md, conn.txSecret, "key", key, keySize) &&
+                      expandLabel(md, conn.txSecret, "iv", iv, sizeof(iv));
+            if (ok && aes128)
+            {
+                tls12_crypto_info_aes_gcm_128 info;
+                memset(&info, 0, sizeof(info));
+                info.info.version = TLS_1_3_VERSION;
+                info.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+                memcpy(info.salt, iv, sizeof(info.salt));
+                memcpy(info.iv, iv + sizeof(info.salt), sizeof(info.iv));
+                memcpy(info.key, key, sizeof(info.key));
+                ok = !setsockopt(conn.fd, SOL_TLS, TLS_TX, &info, sizeof(info));
+                OPENSSL_cleanse(&info, sizeof(info));
+            }
+            else if (ok)
+            {
+                tls12_crypto_info_aes_gcm_256 info;
+                memset(&info, 0, sizeof(info));
+                info.info.version = TLS_1_3_VERSION;
+                info.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+                memcpy(info.salt, iv, sizeof(info.salt));
+                memcpy(info.iv, iv + sizeof(info.salt), sizeof(info.iv));
+                memcpy(info.key, key, sizeof(info.key));
+                ok = !setsockopt(conn.fd, SOL_TLS, TLS_TX, &info, sizeof(info));
+                OPENSSL_cleanse(&info, sizeof(info));
+            }
+            OPENSSL_cleanse(key, sizeof(key));
+            OPENSSL_cleanse(iv, sizeof(iv));
+            return ok;
+        }
+
+        ////////////////////////////////////////////////////////////////////////
+        // Utility private static methods
+        ////////////////////////////////////////////////////////////////////////
+
+        static CURLcode parseUrl(const string &url,
+                                 bool &tls,
+                                 string &host,
+                                 string &port,
+                                 string &target)
+        {
+            static const string http = "http://";
+            static const string https = "https://";
+            tls = !url.compare(0, https.size(), https);
+            if (!tls && url.compare(0, http.size(), http))
+                return CURLE_URL_MALFORMAT;
+
+            const size_t hostStart = tls ? https.size() : http.size();
+            size_t pathStart = url.find('/', hostStart);
+            if (pathStart == string::npos)
+                pathStart = url.size();
+            const string authority = url.substr(hostStart, pathStart - hostStart);
+            target = pathStart < url.size() ? url.substr(pathStart) : "/";
+
+            const size_t colon = authority.rfind(':');
+            if (colon != string::npos && authority.find(']', colon) == string::npos)
+            {
+                host = authority.substr(0, colon);
+                port = authority.substr(colon + 1);
+            }
+            else
+            {
+                host = authority;
+                port = tls ? "443" : "80";
+            }
+            if (host.size() > 2 && host.front() == '[' && host.back() == ']')
+                host = host.substr(1, host.size() - 2);
+            return host.empty() ? CURLE_URL_MALFORMAT : CURLE_OK;
+        }
+
+        // Pending records OpenSSL wrote for the peer
+        static void drain(SSL *ssl, string &out)
+        {
+            BIO *bio = SSL_get_wbio(ssl);
+            const size_t pending = BIO_ctrl_pending(bio);
+            if (!pending)
+                return;
+            const size_t size = out.size();
+            out.resize(size + pending);
+            BIO_read(bio, &out[size], static_cast<int>(pending));
+        }
+
+        // Keeps TLS 1.3 client traffic secret for enableKernelTls()
+        static void keylog(const SSL *ssl, const char *line)
+        {
+            static const char label[] = "CLIENT_TRAFFIC_SECRET_0 ";
+            if (strncmp(line, label, sizeof(label) - 1))
+                return;
+            auto *conn = static_cast<Connection*>(SSL_get_app_data(ssl));
+            const char *secret = strchr(line + sizeof(label) - 1, ' ');
+            if (!conn || !conn->captureSecret || !secret)
+                return;
+
+            long size = 0;
+            unsigned char *bytes = OPENSSL_hexstr2buf(secret + 1, &size);
+            if (!bytes)
+                return;
+            conn->txSecret.assign(reinterpret_cast<char*>(bytes),
+                                  static_cast<size_t>(size));
+            OPENSSL_clear_free(bytes, static_cast<size_t>(size));
+        }
+
+        // HKDF-Expand-Label of RFC 8446 with empty context
+        static bool expandLabel(const EVP_MD *md,
+                                const string &secret,
+                                const char *label,
+                                unsigned char *out,
+                                size_t size)
+        {
+            const string tlsLabel = string("tls13 ") + label;
+            string info;
+            info += static_cast<char>(size >> 8);
+            info += static_cast<char>(size & 0xff);
+            info += static_cast<char>(tlsLabel.size());
+            info += tlsLabel;
+            info += '\0';
+
+            EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+            size_t derived = size;
+            const bool ok = ctx && EVP_PKEY_derive_init(ctx) > 0 &&
+            EVP_PKEY_CTX_hkdf_mode(ctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0 &&
+            EVP_PKEY_CTX_set_hkdf_md(ctx, md) > 0 &&
+            EVP_PKEY_CTX_set1_hkdf_key(
+                ctx, reinterpret_cast<const unsigned char*>(secret.data()),
+                static_cast<int>(secret.size())) > 0 &&
+            EVP_PKEY_CTX_add1_hkdf_info(
+                ctx, reinterpret_cast<const unsigned char*>(info.data()),
+                static_cast<int>(info.size())) > 0 &&
+            EVP_PKEY_derive(ctx, out, &derived) > 0 && derived == size;
+            EVP_PKEY_CTX_free(ctx);
+            return ok;
+        }
+
+        static string buildRequest(bool post,
+                                   const string &target,
+                                   const string &host,
+                                   const Header &header)
+        {
+            string data;
+            data.reserve(256 + target.size());
+            data += post ? "POST " : "GET ";
+            data += target;
+            data += " HTTP/1.1\r\nHost: ";
+            data += host;
+            data += "\r\nAccept: */*\r\n";
+            for (const auto &field : header)
+            {
+                data += field.first;
+                data += ": ";
+                data += field.second;
+                data += "\r\n";
+            }
+            // Same body as CurlTransport, payload travels in header
+            data += post ? "Content-Length: 1\r\n\r\n\n" : "\r\n";
+            return data;
+        }
+
+        /// Returns true when in holds complete response, body is decoded
+        /// (chunked transfer encoding) into body
+        static bool parseResponse(const string &in,
+                                  bool eof,
+                                  long &status,
+                                  string &body,
+                                  bool &keepAlive)
+        {
+            const size_t headerEnd = in.find("\r\n\r\n");
+            if (headerEnd == string::npos)
+                return false;
+            const size_t bodyStart = headerEnd + 4;
+
+            const size_t space = in.find(' ');
+            if (space == string::npos || space > headerEnd)
+                return false;
+            status = strtol(in.c_str() + space + 1, nullptr, 10);
+
+            long long length = -1;
+            bool chunked = false;
+            keepAlive = in.compare(0, 8, "HTTP/1.0") != 0;
+            size_t line = in.find("\r\n") + 2;
+            while (line < headerEnd)
+            {
+                size_t next = in.find("\r\n", line);
+                const size_t colon = in.find(':', line);
+                if (colon != string::npos && colon < next)
+                {
+                    string name = in.substr(line, colon - line);
+                    std::transform(name.begin(), name.end(), name.begin(),
+                                   ::tolower);
+                    size_t v = colon + 1;
+                    while (v < next && in[v] == ' ')
+                        ++v;
+                    string value = in.substr(v, next - v);
+                    std::transform(value.begin(), value.end(), value.begin(),
+                                   ::tolower);
+                    if (name == "content-length")
+                        length = strtoll(value.c_str(), nullptr, 10);
+                    else if (name == "transfer-encoding")
+                        chunked = value.find("chunked") != string::npos;
+                    else if (name == "connection")
+                        keepAlive = value.find("close") == string::npos;
+                }
+                line = next + 2;
+            }
+
+            if (chunked)
+                return decodeChunked(in, bodyStart, body);
+            if (length >= 0)
+            {
+                if (in.size() - bodyStart < static_cast<size_t>(length))
+                    return false;
+                body.assign(in, bodyStart, static_cast<size_t>(length));
+                return true;
+            }
+            // Body delimited by connection close
+            if (!eof)
+                return false;
+            keepAlive = false;
+            body.assign(in, bodyStart, string::npos);
+            return true;
+        }
+
+        static bool decodeChunked(const string &in, size_t pos, string &body)
+        {
+            body.clear();
+            for (;;)
+            {
+                const size_t lineEnd = in.find("\r\n", pos);
+                if (lineEnd == string::npos)
+                    return false;
+                const size_t size = strtoul(in.c_str() + pos, nullptr, 16);
+                pos = lineEnd + 2;
+                if (!size)
+                    // Trailer section ends with empty line
+                    return in.find("\r\n", pos) != string::npos;
+                if (in.size() < pos + size + 2)
+                    return false;
+                body.append(in, pos, size);
+                pos += size + 2;
+            }
+        }
+    };
+}
+
+#endif // __linux__
@@ -0,0 +1,459 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// Typed decoders for BitfinexAPI market data and order responses
+//
+////////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// rapidjson
+#include "rapidjson/document.h"
+
+// internal error
+#include "error.hpp"
+
+// std
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// namespaces
+using std::string;
+using std::vector;
+namespace rj = rapidjson;
+
+
+namespace jsonutils
+{
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Records
+    ////////////////////////////////////////////////////////////////////////////
+
+    // All records are fixed-size and trivially copyable so they can be written
+    // to and read from memory mapped files (see TickStore.hpp) as they are.
+    // Timestamps are nanoseconds since epoch.
+
+    enum class Side : uint8_t
+    {
+        buy = 0, // bid side in order book
+        sell = 1 // ask side in order book
+    };
+
+    /// /pubticker/[symbol] response
+    struct Ticker
+    {
+        int64_t timestamp;
+        double mid;
+        double bid;
+        double ask;
+        double lastPrice;
+        double low;
+        double high;
+        double volume;
+    };
+
+    /// Single item of /stats/[symbol] response
+    struct VolumeStats
+    {
+        int64_t period; // days
+        double volume;
+    };
+
+    /// Single item of /trades/[symbol] response
+    struct Trade
+    {
+        int64_t timestamp;
+        int64_t tid;
+        double price;
+        double amount;
+        Side side;
+        uint8_t reserved[7];
+    };
+
+    /// Single price level of /book/[symbol] response
+    struct BookLevel
+    {
+        int64_t timestamp;
+        double price;
+        double amount;
+    };
+
+    /// /book/[symbol] response
+    struct OrderBook
+    {
+        vector<BookLevel> bids;
+        vector<BookLevel> asks;
+    };
+
+    /// Flattened order book level used for storing book snapshots
+    struct BookRecord
+    {
+        int64_t snapshot; // time the snapshot was taken
+        int64_t timestamp;
+        double price;
+        double amount;
+        uint32_t level;   // 0 = top of the book
+        Side side;
+        uint8_t reserved[3];
+    };
+
+    /// Change of order book price level between two /book/[symbol]
+    /// snapshots, zero amount removes the level
+    struct BookDelta
+    {
+        int64_t timestamp;
+        double price;
+        double amount;
+        Side side;
+        uint8_t reserved[7];
+    };
+
+    /// Order of /order/new/, /order/status/, /orders/ and similar responses
+    struct Order
+    {
+        int64_t id;
+        int64_t timestamp;
+        double price;
+        double avgExecutionPrice;
+        double originalAmount;
+        double remainingAmount;
+        double executedAmount;
+        char symbol[16];   // zero terminated
+        char type[24];     // zero terminated, e.g. "exchange limit"
+        Side side;
+        bool isLive;
+        bool isCancelled;
+        bool isHidden;
+        uint8_t reserved[4];
+    };
+
+    static_assert(sizeof(Ticker) == 64, "unexpected Ticker layout");
+    static_assert(sizeof(Trade) == 40, "unexpected Trade layout");
+    static_assert(sizeof(BookRecord) == 40, "unexpected BookRecord layout");
+    static_assert(sizeof(BookDelta) == 32, "unexpected BookDelta layout");
+    static_assert(sizeof(Order) == 104, "unexpected Order layout");
+    static_assert(std::is_trivially_copyable<Ticker>::value &&
+                  std::is_trivially_copyable<Trade>::value &&
+                  std::is_trivially_copyable<BookRecord>::value &&
+                  std::is_trivially_copyable<BookDelta>::value &&
+                  std::is_trivially_copyable<Order>::value,
+                  "records must be trivially copyable");
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Sinks
+    ////////////////////////////////////////////////////////////////////////////
+
+    // decode...To() routines write records straight to storage of a sink:
+    // Record* claim() returns storage of the next record (nullptr skips
+    // the record), commit(Record*) publishes it. Sink of a ring buffer
+    // (see RingBuffer.hpp) avoids any copy of decoded records. Records
+    // are claimed only after their JSON was checked.
+
+    template <typename Record>
+    struct ValueSink
+    {
+        Record &value;
+
+        Record* claim() noexcept { return &value; }
+        void commit(Record*) noexcept {}
+    };
+
+    ////////////////////////////////////////////////////////////////////////////
+    // Routines
+    ////////////////////////////////////////////////////////////////////////////
+
+    /// Converts "1444253422.348340958" or "1444253422" to nanoseconds since
+    /// epoch without going through double precision.
+    inline int64_t secondsStrToNs(const char *str) noexcept
+    {
+        char *end;
+        int64_t ns = strtoll(str, &end, 10) * 1000000000LL;
+        if (*end == '.')
+        {
+            int64_t scale = 100000000LL;
+            for (++end; *end >= '0' && *end <= '9' && scale; ++end)
+            {
+                ns += (*end - '0') * scale;
+                scale /= 10;
+            }
+        }
+        return ns;
+    }
+
+    template <typename Sink>
+    BfxClientErrors decodeTickerTo(const string &inputJson, Sink &sink)
+    {
+        rj::Document d;
+        if (d.Parse(inputJson.c_str()).HasParseError() || !d.IsObject())
+            return BfxClientErrors::responseParseError;
+
+        for (const char *key : {"mid", "bid", "ask", "last_price", "low",
+                                "high", "volume", "timestamp"})
+        {
+            if (!d.HasMember(key) || !d[key].IsString())
+                return BfxClientErrors::responseSchemaError;
+        }
+
+        Ticker *ticker = sink.claim();
+        if (!ticker)
+            return BfxClientErrors::noError;
+
+        ticker->timestamp = secondsStrToNs(d["timestamp"].GetString());
+        ticker->mid       = strtod(d["mid"].GetString(), nullptr);
+        ticker->bid       = strtod(d["bid"].GetString(), nullptr);
+        ticker->ask       = strtod(d["ask"].GetString(), nullptr);
+        ticker->lastPrice = strtod(d["last_price"].GetString(), nullptr);
+        ticker->low       = strtod(d["low"].GetString(), nullptr);
+        ticker->high      = strtod(d["high"].GetString(), nullptr);
+        ticker->volume    = strtod(d["volume"].GetString(), nullptr);
+        sink.commit(ticker);
+
+        return BfxClientErrors::noError;
+    }
+
+    inline BfxClientErrors decodeTicker(const string &inputJson, Ticker &ticker)
+    {
+        ValueSink<Ticker> sink{ticker};
+        return decodeTickerTo(inputJson, sink);
+    }
+
+    inline BfxClientErrors decodeStats(const string &inputJson,
+                                       vector<VolumeStats> &stats)
+    {
+        rj::Document d;
+        if (d.Parse(inputJson.c_str()).HasParseError() || !d.IsArray())
+            return BfxClientErrors::responseParseError;
+
+        stats.clear();
+        stats.reserve(d.Size());
+        for (const auto &item : d.GetArray())
+        {
+            if (!item.IsObject() ||
+                !item.HasMember("period") || !item["period"].IsInt64() ||
+                !item.HasMember("volume") || !item["volume"].IsString())
+                return BfxClientErrors::responseSchemaError;
+
+            stats.push_back({item["period"].GetInt64(),
+                             strtod(item["volume"].GetString(), nullptr)});
+        }
+
+        return BfxClientErrors::noError;
+    }
+
+    inline bool isTrade(const rj::Value &item) noexcept
+    {
+        return item.IsObject() &&
+               item.HasMember("timestamp") && item["timestamp"].IsInt64() &&
+               item.HasMember("tid") && item["tid"].IsInt64() &&
+               item.HasMember("price") && item["price"].IsString() &&
+               item.HasMember("amount") && item["amount"].IsString() &&
+               item.HasMember("type") && item["type"].IsString();
+    }
+
+    inline void toTrade(const rj::Value &item, Trade &trade) noexcept
+    {
+        trade = Trade();
+        trade.timestamp = item["timestamp"].GetInt64() * 1000000000LL;
+        trade.tid       = item["tid"].GetInt64();
+        trade.price     = strtod(item["price"].GetString(), nullptr);
+        trade.amount    = strtod(item["amount"].GetString(), nullptr);
+        trade.side      = item["type"] == "sell" ? Side::sell : Side::buy;
+    }
+
+    inline BfxClientErrors decodeTrades(const string &inputJson,
+                                        vector<Trade> &trades)
+    {
+        rj::Document d;
+        if (d.Parse(inputJson.c_str()).HasParseError() || !d.IsArray())
+            return BfxClientErrors::responseParseError;
+
+        trades.clear();
+        trades.reserve(d.Size());
+        for (const auto &item : d.GetArray())
+        {
+            if (!isTrade(item))
+                return BfxClientErrors::responseSchemaError;
+
+            trades.emplace_back();
+            toTrade(item, trades.back());
+        }
+
+        return BfxClientErrors::noError;
+    }
+
+    /// Trades newer than lastTid, oldest first (response lists newest
+    /// first). lastTid is advanced to the newest trade of the response.
+    template <typename Sink>
+    BfxClientErrors decodeTradesTo(const string &inputJson,
+                                   Sink &sink,
+                                   int64_t &lastTid)
+    {
+        rj::Document d;
+        if (d.Parse(inputJson.c_str()).HasParseError() || !d.IsArray())
+            return BfxClientErrors::responseParseError;
+
+        for (const auto &item : d.GetArray())
+        {
+            if (!isTrade(item))
+                return BfxClientErrors::responseSchemaError;
+        }
+
+        int64_t newest = lastTid;
+        for (rj::SizeType i = d.Size(); i-- > 0;)
+        {
+            const rj::Value &item = d[i];
+            const int64_t tid = item["tid"].GetInt64();
+            if (tid <= lastTid)
+                continue;
+            newest = tid > newest ? tid : newest;
+
+            Trade *trade = sink.claim();
+            if (!trade)
+                continue;
+            toTrade(item, *trade);
+            sink.commit(trade);
+        }
+        lastTid = newest;
+
+        return BfxClientErrors::noError;
+    }
+
+    inline BfxClientErrors decodeOrderBook(const string &inputJson,
+                                           OrderBook &book)
+    {
+        rj::Document d;
+        if (d.Parse(inputJson.c_str()).HasParseError() || !d.IsObject())
+            return BfxClientErrors::responseParseError;
+
+        if (!d.HasMember("bids") || !d["bids"].IsArray() ||
+            !d.HasMember("asks") || !d["asks"].IsArray())
+            return BfxClientErrors::responseSchemaError;
+
+        auto decodeSide = [](const rj::Value &levels, vector<BookLevel> &out)
+        {
+            out.clear();
+            out.reserve(levels.Size());
+            for (const auto &item : levels.GetArray())
+            {
+                if (!item.IsObject() ||
+                    !item.HasMember("price") || !item["price"].IsString() ||
+                    !item.HasMember("amount") || !item["amount"].IsString() ||
+                    !item.HasMember("timestamp") ||
+                    !item["timestamp"].IsString())
+                    return false;
+
+                out.push_back({
+                    secondsStrToNs(item["timestamp"].GetString()),
+                    strtod(item["price"].GetString(), nullptr),
+                    strtod(item["amount"].GetString(), nullptr)
+                });
+            }
+            return true;
+        };
+
+        if (!decodeSide(d["bids"], book.bids) ||
+            !decodeSide(d["asks"], book.asks))
+            return BfxClientErrors::responseSchemaError;
+
+        return BfxClientErrors::noError;
+    }
+
+    inline bool isOrder(const rj::Value &item) noexcept
+    {
+        if (!item.IsObject() || !item.HasMember("id") || !item["id"].IsInt64())
+            return false;
+        for (const char *key : {"symbol", "price", "avg_execution_price",
+                                "side", "type", "timestamp",
+                                "original_amount", "remaining_amount",
+                                "executed_amount"})
+        {
+            if (!item.HasMember(key) || !item[key].IsString())
+                return false;
+        }
+        for (const char *key : {"is_live", "is_cancelled", "is_hidden"})
+        {
+            if (!item.HasMember(key) || !item[key].IsBool())
+                return false;
+        }
+        return true;
+    }
+
+    inline void toOrder(const rj::Value &item, Order &order) noexcept
+    {
+        auto copy = [](const rj::Value &value, char *out, size_t size)
+        {
+            const size_t length = value.GetStringLength() < size - 1
+            ? value.GetStringLength()
+            : size - 1;
+            memcpy(out, value.GetString(), length);
+            out[length] = '\0';
+        };
+
+        order = Order();
+        order.id                = item["id"].GetInt64();
+        order.timestamp         = secondsStrToNs(item["timestamp"].GetString());
+        order.price             = strtod(item["price"].GetString(), nullptr);
+        order.avgExecutionPrice =
+        strtod(item["avg_execution_price"].GetString(), nullptr);
+        order.originalAmount    =
+        strtod(item["original_amount"].GetString(), nullptr);
+        order.remainingAmount   =
+        strtod(item["remaining_amount"].GetString(), nullptr);
+        order.executedAmount    =
+        strtod(item["executed_amount"].GetString(), nullptr);
+        copy(item["symbol"], order.symbol, sizeof(order.symbol));
+        copy(item["type"], order.type, sizeof(order.type));
+        order.side        = item["side"] == "sell" ? Side::sell : Side::buy;
+        order.isLive      = item["is_live"].GetBool();
+        order.isCancelled = item["is_cancelled"].GetBool();
+        order.isHidden    = item["is_hidden"].GetBool();
+    }
+
+    /// /order/new/, /order/status/, /order/cancel/ and
+    /// /order/cancel/replace/ response
+    inline BfxClientErrors decodeOrder(const string &inputJson, Order &order)
+    {
+        rj::Document d;
+        if (d.Parse(inputJson.c_str()).HasParseError() || !d.IsObject())
+            return BfxClientErrors::responseParseError;
+
+        if (!isOrder(d))
+            return BfxClientErrors::responseSchemaError;
+
+        toOrder(d, order);
+        return BfxClientErrors::noError;
+    }
+
+    /// /orders/ and /orders/hist/ response, or "order_ids" of
+    /// /order/new/multi/ response (in order of the request payload)
+    inline BfxClientErrors decodeOrders(const string &inputJson,
+                                        vector<Order> &orders)
+    {
+        rj::Document d;
+        if (d.Parse(inputJson.c_str()).HasParseError() ||
+            !(d.IsArray() || d.IsObject()))
+            return BfxClientErrors::responseParseError;
+
+        if (d.IsObject() &&
+            !(d.HasMember("order_ids") && d["order_ids"].IsArray()))
+            return BfxClientErrors::responseSchemaError;
+
+        const rj::Value &items = d.IsArray() ? d : d["order_ids"];
+        orders.clear();
+        orders.reserve(items.Size());
+        for (const auto &item : items.GetArray())
+        {
+            if (!isOrder(item))
+                return BfxClientErrors::responseSchemaError;
+
+            orders.emplace_back();
+            toOrder(item, orders.back());
+        }
+
+        return BfxClientErrors::noError;
+    }
+}
@@ -22,5 +22,33 @@ enum BfxClientErrors
     jsonStrToUSetError,     // 10
     badWDconfFilePath,      // 11
     responseParseError,     // 12
-    responseSchemaError     // 13
+    responseSchemaError,    // 13
+    tickStoreIOError,       // 14
+    rateLimited,            // 15
+    tooManyOrders           // 16
 };
+
+inline const char* bfxClientErrorName(const BfxClientErrors &code) noexcept
+{
+    switch (code)
+    {
+        case noError:               return "noError";
+        case curlERR:               return "curlERR";
+        case badSymbol:             return "badSymbol";
+        case badCurrency:           return "badCurrency";
+        case badDepositMethod:      return "badDepositMethod";
+        case badWalletType:         return "badWalletType";
+        case requiredParamsMissing: return "requiredParamsMissing";
+        case wireParamsMissing:     return "wireParamsMissing";
+        case addressParamsMissing:  return "addressParamsMissing";
+        case badOrderType:          return "badOrderType";
+        case jsonStrToUSetError:    return "jsonStrToUSetError";
+        case badWDconfFilePath:     return "badWDconfFilePath";
+        case responseParseError:    return "responseParseError";
+        case responseSchemaError:   return "responseSchemaError";
+        case tickStoreIOError:      return "tickStoreIOError";
+        case rateLimited:           return "rateLimited";
+        case tooManyOrders:         return "tooManyOrders";
+    }
+    return "unknown";
+}
@@ -17,8 +17,14 @@
 // internal error
 #include "error.hpp"
 
+// internal Logger
+#include "Logger.hpp"
+
 // std
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <unordered_set>
 #include <unordered_map>
@@ -40,6 +46,13 @@ namespace jsonutils
     // Classes
     ////////////////////////////////////////////////////////////////////////////
     
+    /// Time spent in validateSchema() phases in nanoseconds
+    struct SchemaTimings
+    {
+        int64_t parse;
+        int64_t validation;
+    };
+
     /// Helper class resolving remote schema for schema $ref operator
     class MyRemoteSchemaDocumentProvider: public rj::IRemoteSchemaDocumentProvider
     {
@@ -83,8 +96,8 @@ namespace jsonutils
     public:
         
         BfxSchemaValidator() {}
-        BfxSchemaValidator(unordered_set<string> &symbols,
-                           unordered_set<string> &currencies)
+        BfxSchemaValidator(const unordered_set<string> &symbols,
+                           const unordered_set<string> &currencies)
         {
             // Mapping is needed because rapidjson implementation of $ref
             // keyword in json schema doesn't support json schema names which
@@ -177,44 +190,79 @@ namespace jsonutils
             apiEndPointToSchemaMap_.emplace("/funding/close/", "funding_close");
             apiEndPointToSchemaMap_.emplace("/position/close/", "position_close");
             
+            // Compile every schema once, validation then only reads the
+            // schema documents and can run concurrently
+            for (const auto &endpoint : apiEndPointToSchemaMap_)
+                if (!schemas_.count(endpoint.second))
+                    schemas_.emplace(endpoint.second,
+                                     compileSchema(endpoint.second));
         }
         
-        auto validateSchema(const string &apiEndPoint, const string &inputJson)
+        auto validateSchema(const string &apiEndPoint,
+                            const string &inputJson,
+                            SchemaTimings *timings = nullptr) const
         {
+            using std::chrono::steady_clock;
+            const auto start = steady_clock::now();
             const auto schemaName = getApiEndPointSchemaName(apiEndPoint);
             
-            // Create rapidjson schema document
-            rj::Document sd;
-            string schema =
-            "{ \"$ref\": \"definitions.json#/" + schemaName + "\" }";
-            sd.Parse(schema.c_str());
-            rj::SchemaDocument schemaDocument(sd, 0, 0, &provider_);
+            // Compiled schema document, endpoints without schema mapping
+            // compile it per call
+            std::unique_ptr<rj::SchemaDocument> adHoc;
+            const rj::SchemaDocument *schemaDocument;
+            const auto compiled = schemas_.find(schemaName);
+            if (compiled != schemas_.end())
+                schemaDocument = compiled->second.get();
+            else
+            {
+                adHoc = compileSchema(schemaName);
+                schemaDocument = adHoc.get();
+            }
             
             // Create rapidjson document and check for parse errors
+            const auto parseStart = steady_clock::now();
             rj::Document d;
-            if (d.Parse(inputJson.c_str()).HasParseError())
+            const bool parseError = d.Parse(inputJson.c_str()).HasParseError();
+            const auto parseEnd = steady_clock::now();
+            if (timings)
             {
-                cerr << "Invalid json - response:" << endl;
-                cerr << inputJson << endl;
-                cerr << "API endpoint: " << apiEndPoint << endl;
+                timings->parse = (parseEnd - parseStart).count();
+                timings->validation = (parseStart - start).count();
+            }
+            if (parseError)
+            {
+                BFX_LOG(BfxAPI::LogLevel::error, "Invalid json",
+                        {{"endpoint", apiEndPoint},
+                         {"offset", d.GetErrorOffset()},
+                         {"error", rj::GetParseError_En(d.GetParseError())},
+                         {"response", inputJson}});
                 return BfxClientErrors::responseParseError;
             }
             
             // Create rapidjson validator and check for schema errors
-            rj::SchemaValidator validator(schemaDocument);
-            if (!d.Accept(validator))
+            rj::SchemaValidator validator(*schemaDocument);
+            const bool valid = d.Accept(validator);
+            if (timings)
+                timings->validation += (steady_clock::now() - parseEnd).count();
+            if (!valid)
             {
                 // Input JSON is invalid according to the schema
                 // Output diagnostic information
-                rj::StringBuffer sb;
-                validator.GetInvalidSchemaPointer().StringifyUriFragment(sb);
-                cerr << "Invalid schema: " << sb.GetString() << endl;
-                cerr << "Invalid keyword: " << validator.GetInvalidSchemaKeyword() << endl;
-                sb.Clear();
-                validator.GetInvalidDocumentPointer().StringifyUriFragment(sb);
-                cerr << "Invalid document: " << sb.GetString() << endl;
-                cerr << "Invalid response: " << inputJson << endl;
-                cerr << "Invalid API endpoint: " << apiEndPoint << endl;
+                if (BfxAPI::Logger::instance().isEnabled(BfxAPI::LogLevel::error))
+                {
+                    rj::StringBuffer schemaSb, documentSb;
+                    validator.GetInvalidSchemaPointer()
+                    .StringifyUriFragment(schemaSb);
+                    validator.GetInvalidDocumentPointer()
+                    .StringifyUriFragment(documentSb);
+                    BfxAPI::Logger::instance().log(
+                        BfxAPI::LogLevel::error, "Invalid response",
+                        {{"endpoint", apiEndPoint},
+                         {"schema", schemaSb.GetString()},
+                         {"keyword", validator.GetInvalidSchemaKeyword()},
+                         {"document", documentSb.GetString()},
+                         {"response", inputJson}});
+                }
                 return BfxClientErrors::responseSchemaError;
             }
             
@@ -223,12 +271,30 @@ namespace jsonutils
         
     private:
         
-        MyRemoteSchemaDocumentProvider provider_;
+        mutable MyRemoteSchemaDocumentProvider provider_;
         unordered_map<string, string> apiEndPointToSchemaMap_;
+        // schema name -> compiled schema
+        unordered_map<string, std::unique_ptr<rj::SchemaDocument>> schemas_;
+        
+        std::unique_ptr<rj::SchemaDocument>
+        compileSchema(const string &schemaName) const
+        {
+            rj::Document sd;
+            string schema =
+            "{ \"$ref\": \"definitions.json#/" + schemaName + "\" }";
+            sd.Parse(schema.c_str());
+            return std::unique_ptr<rj::SchemaDocument>(
+                new rj::SchemaDocument(sd, 0, 0, &provider_));
+        }
         
-        const string& getApiEndPointSchemaName(const string& apiEndpoint) noexcept
+        // Read only lookup, validator is shared by threads of thread-safe
+        // BitfinexAPI
+        const string& getApiEndPointSchemaName(const string& apiEndpoint) const
+        noexcept
         {
-            return apiEndPointToSchemaMap_[apiEndpoint];
+            static const string unknown;
+            const auto it = apiEndPointToSchemaMap_.find(apiEndpoint);
+            return it != apiEndPointToSchemaMap_.end() ? it->second : unknown;
         }
         
     };
@@ -313,19 +379,23 @@ namespace jsonutils
         {
             // Input JSON is invalid according to the schema
             // Output diagnostic information
-            cerr << "Error(offset " << reader.GetErrorOffset() << "): ";
-            cerr << GetParseError_En(reader.GetParseErrorCode()) << endl;
+            BFX_LOG(BfxAPI::LogLevel::error, "Invalid json array",
+                    {{"offset", reader.GetErrorOffset()},
+                     {"error", GetParseError_En(reader.GetParseErrorCode())}});
             
-            if (!validator.IsValid())
+            if (!validator.IsValid() &&
+                BfxAPI::Logger::instance().isEnabled(BfxAPI::LogLevel::error))
             {
-                rj::StringBuffer sb;
-                validator.GetInvalidSchemaPointer().StringifyUriFragment(sb);
-                cerr << "Invalid schema: " << sb.GetString() << endl;
-                cerr << "Invalid keyword: " << validator.GetInvalidSchemaKeyword() << endl;
-                sb.Clear();
-                validator.GetInvalidDocumentPointer().StringifyUriFragment(sb);
-                cerr << "Invalid document: " << sb.GetString() << endl;
-                cerr << "Invalid response: " << inputJson << endl;
+                rj::StringBuffer schemaSb, documentSb;
+                validator.GetInvalidSchemaPointer().StringifyUriFragment(schemaSb);
+                validator.GetInvalidDocumentPointer()
+                .StringifyUriFragment(documentSb);
+                BfxAPI::Logger::instance().log(
+                    BfxAPI::LogLevel::error, "Invalid response",
+                    {{"schema", schemaSb.GetString()},
+                     {"keyword", validator.GetInvalidSchemaKeyword()},
+                     {"document", documentSb.GetString()},
+                     {"response", inputJson}});
             }
             return BfxClientErrors::jsonStrToUSetError;
         }
@@ -0,0 +1,506 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  bench.cpp
+//
+//
+//  Bitfinex REST API C++ client - micro-benchmarks
+//
+//
+//  Measures time and heap allocations of the client's own code: payload
+//  building of authenticated requests, signing, parameter encoding,
+//  response validation and decoding against recorded responses in
+//  doc/fixtures.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// std
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Google Benchmark
+#include <benchmark/benchmark.h>
+
+// BitfinexAPI
+#include "bfx-api-cpp/BitfinexAPI.hpp"
+
+// MarketPoller (ring buffers, decoders)
+#include "bfx-api-cpp/MarketPoller.hpp"
+
+// OrderTemplate
+#include "bfx-api-cpp/OrderTemplate.hpp"
+
+
+// namespaces
+using std::cerr;
+using std::endl;
+using std::function;
+using std::pair;
+using std::string;
+using std::vector;
+using BfxAPI::BitfinexAPI;
+
+#ifndef BENCH_FIXTURES_PATH
+#define BENCH_FIXTURES_PATH "doc/fixtures"
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+///  Allocation counting
+////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<uint64_t> allocCount{0};
+static std::atomic<uint64_t> allocBytes{0};
+
+void* operator new(size_t size)
+{
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    allocBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+// Kept out of line, GCC otherwise reports free() of operator new memory
+__attribute__((noinline)) static void release(void *p) noexcept { free(p); }
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { release(p); }
+void operator delete[](void *p) noexcept { release(p); }
+void operator delete(void *p, size_t) noexcept { release(p); }
+void operator delete[](void *p, size_t) noexcept { release(p); }
+
+// Reports allocations per iteration made since construction
+class AllocCounter
+{
+public:
+
+    AllocCounter():
+    count_(allocCount.load()),
+    bytes_(allocBytes.load())
+    {}
+
+    void report(benchmark::State &state) const
+    {
+        using benchmark::Counter;
+        state.counters["allocs"] =
+        Counter(allocCount.load() - count_, Counter::kAvgIterations);
+        state.counters["alloc_bytes"] =
+        Counter(allocBytes.load() - bytes_, Counter::kAvgIterations);
+    }
+
+private:
+
+    const uint64_t count_;
+    const uint64_t bytes_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///  Fixtures
+////////////////////////////////////////////////////////////////////////////////
+
+static string readFixture(const string &name)
+{
+    std::ifstream ifs(string(BENCH_FIXTURES_PATH) + "/" + name + ".json");
+    if (!ifs.is_open())
+    {
+        cerr << "Missing fixture " << name << endl;
+        exit(1);
+    }
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+static const unordered_set<string>& symbols()
+{
+    static unordered_set<string> symbols;
+    if (symbols.empty())
+        jsonutils::jsonStrToUset(symbols, readFixture("symbols"));
+    return symbols;
+}
+
+// Recorded response of every schema in definitions.json and endpoint path
+// it was fetched from
+static const vector<pair<string, string>> schemaFixtures =
+{
+    {"pubticker", "/pubticker/btcusd"},
+    {"stats", "/stats/btcusd"},
+    {"book", "/book/btcusd"},
+    {"trades", "/trades/btcusd"},
+    {"lendbook", "/lendbook/USD"},
+    {"lends", "/lends/USD"},
+    {"symbols", "/symbols/"},
+    {"symbols_details", "/symbols_details/"}
+};
+
+static const string orderPayload =
+"{\"request\":\"/v1/order/new\",\"nonce\":\"1539950000123\","
+"\"symbol\":\"btcusd\",\"amount\":\"0.010000\",\"price\":\"983.000000\","
+"\"side\":\"sell\",\"type\":\"exchange limit\",\"is_hidden\":false,"
+"\"is_postonly\":true,\"use_all_available\":false,\"ocoorder\":false,"
+"\"buy_price_oco\":false}";
+
+// Client with keys and recorded symbols on context built without I/O.
+// FakeTransport answers unconfigured paths with 404 and its rate limiter
+// refuses requests in fail-fast mode once drained, so authenticated
+// methods return right after the payload is built and nothing is sent.
+static BitfinexAPI& client()
+{
+    static BitfinexAPI api(std::make_shared<BfxAPI::ClientContext>(
+                               "http://127.0.0.1/v1", symbols()),
+                           "AbCdEfGhIjKlMnOpQrStUvWxYz0123456789AbCdEfG",
+                           "0123456789AbCdEfGhIjKlMnOpQrStUvWxYzAbCdEfG",
+                           std::make_shared<BfxAPI::FakeTransport>());
+    static bool configured = false;
+    if (!configured)
+    {
+        auto &limiter = api.getRateLimiter();
+        limiter.setMode(BfxAPI::RateLimiter::Mode::failFast);
+        for (size_t g = 0; g < static_cast<size_t>(BfxAPI::EndpointGroup::count);
+             ++g)
+            limiter.setLimit(static_cast<BfxAPI::EndpointGroup>(g), 1, 1);
+        configured = true;
+    }
+    return api;
+}
+
+// Empties every bucket, fail-fast limiter refuses requests of any group
+static void drainRateLimiter(BitfinexAPI &api)
+{
+    for (size_t g = 0; g < static_cast<size_t>(BfxAPI::EndpointGroup::count);
+         ++g)
+        while (api.getRateLimiter().reserve(
+                   static_cast<BfxAPI::EndpointGroup>(g)) == 0) {}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///  Benchmarks
+////////////////////////////////////////////////////////////////////////////////
+
+static void BM_Payload(benchmark::State &state,
+                       const function<void(BitfinexAPI&)> &call)
+{
+    BitfinexAPI &api = client();
+    drainRateLimiter(api);
+
+    AllocCounter allocs;
+    for (auto _ : state)
+        call(api);
+    allocs.report(state);
+
+    if (api.getBfxApiStatusCode() != rateLimited)
+        state.SkipWithError(bfxClientErrorName(api.getBfxApiStatusCode()));
+}
+
+static void BM_getBase64(benchmark::State &state)
+{
+    const string content(state.range(0), 'x');
+
+    AllocCounter allocs;
+    for (auto _ : state)
+    {
+        string encoded;
+        BfxAPI::HTTPRequest::getBase64(content, encoded);
+        benchmark::DoNotOptimize(encoded);
+    }
+    allocs.report(state);
+    state.SetBytesProcessed(state.iterations() * content.size());
+}
+BENCHMARK(BM_getBase64)->RangeMultiplier(4)->Range(64, 4096);
+
+static void BM_getHmacSha384(benchmark::State &state)
+{
+    const string key = "0123456789AbCdEfGhIjKlMnOpQrStUvWxYzAbCdEfG";
+    string content;
+    BfxAPI::HTTPRequest::getBase64(string(state.range(0), 'x'), content);
+
+    AllocCounter allocs;
+    for (auto _ : state)
+    {
+        string digest;
+        BfxAPI::HTTPRequest::getHmacSha384(key, content, digest);
+        benchmark::DoNotOptimize(digest);
+    }
+    allocs.report(state);
+    state.SetBytesProcessed(state.iterations() * content.size());
+}
+BENCHMARK(BM_getHmacSha384)->RangeMultiplier(4)->Range(64, 4096);
+
+static void BM_signOrderPayload(benchmark::State &state)
+{
+    const string key = "0123456789AbCdEfGhIjKlMnOpQrStUvWxYzAbCdEfG";
+
+    AllocCounter allocs;
+    for (auto _ : state)
+    {
+        string payload, signature;
+        BfxAPI::HTTPRequest::getBase64(orderPayload, payload);
+        BfxAPI::HTTPRequest::getHmacSha384(key, payload, signature);
+        benchmark::DoNotOptimize(signature);
+    }
+    allocs.report(state);
+}
+BENCHMARK(BM_signOrderPayload);
+
+static void BM_signOrderPayloadKeyed(benchmark::State &state)
+{
+    const BfxAPI::HmacSigner signer("0123456789AbCdEfGhIjKlMnOpQrStUvWxYzAbCdEfG");
+
+    AllocCounter allocs;
+    for (auto _ : state)
+    {
+        string payload;
+        BfxAPI::HTTPRequest::getBase64(orderPayload, payload);
+        string signature = signer.sign(payload);
+        benchmark::DoNotOptimize(signature);
+    }
+    allocs.report(state);
+}
+BENCHMARK(BM_signOrderPayloadKeyed);
+
+// Whole request of pre-built order (payload, base64, signature), compare
+// with newOrder payload building plus BM_signOrderPayloadKeyed
+static void BM_orderTemplateSign(benchmark::State &state)
+{
+    auto order = BfxAPI::OrderTemplate::newOrder(client(), "btcusd", "sell",
+                                                 "exchange limit", false, true);
+
+    AllocCounter allocs;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(order.sign(0.01, 983).header);
+    allocs.report(state);
+}
+BENCHMARK(BM_orderTemplateSign);
+
+static void BM_parseParams(benchmark::State &state)
+{
+    BfxAPI::HTTPRequest request("https://api.bitfinex.com/v1");
+    const map<string, string> params =
+    {
+        {"limit_bids", "50"},
+        {"limit_asks", "50"},
+        {"group", "1"}
+    };
+
+    AllocCounter allocs;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(request.parseParams(params));
+    allocs.report(state);
+}
+BENCHMARK(BM_parseParams);
+
+static void BM_jsonStrToUset(benchmark::State &state)
+{
+    const string response = readFixture("symbols");
+
+    AllocCounter allocs;
+    for (auto _ : state)
+    {
+        unordered_set<string> uSet;
+        jsonutils::jsonStrToUset(uSet, response);
+        benchmark::DoNotOptimize(uSet);
+    }
+    allocs.report(state);
+    state.SetBytesProcessed(state.iterations() * response.size());
+}
+BENCHMARK(BM_jsonStrToUset);
+
+static void BM_validateSchema(benchmark::State &state,
+                              const string &schema,
+                              const string &path)
+{
+    unordered_set<string> symbolSet(symbols());
+    unordered_set<string> currencies = {"USD"};
+    jsonutils::BfxSchemaValidator validator(symbolSet, currencies);
+    const string response = readFixture(schema);
+
+    if (validator.validateSchema(path, response) != noError)
+    {
+        state.SkipWithError("fixture does not match schema");
+        return;
+    }
+
+    AllocCounter allocs;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(validator.validateSchema(path, response));
+    allocs.report(state);
+    state.SetBytesProcessed(state.iterations() * response.size());
+}
+
+static void BM_inArray(benchmark::State &state, const string &value)
+{
+    const unordered_set<string> &symbolSet = symbols();
+
+    AllocCounter allocs;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(BitfinexAPI::inArray(value, symbolSet));
+    allocs.report(state);
+}
+BENCHMARK_CAPTURE(BM_inArray, hit, string("btcusd"));
+BENCHMARK_CAPTURE(BM_inArray, miss, string("xyzusd"));
+
+static void BM_decodeTrades(benchmark::State &state)
+{
+    const string response = readFixture("trades");
+    vector<jsonutils::Trade> trades;
+
+    AllocCounter allocs;
+    for (auto _ : state)
+    {
+        jsonutils::decodeTrades(response, trades);
+        benchmark::DoNotOptimize(trades.data());
+    }
+    allocs.report(state);
+    state.SetBytesProcessed(state.iterations() * response.size());
+}
+BENCHMARK(BM_decodeTrades);
+
+static void BM_decodeTradesToRing(benchmark::State &state)
+{
+    using Event = BfxAPI::MarketEvent<jsonutils::Trade>;
+    using Ring = BfxAPI::SpscRing<Event>;
+    struct Sink
+    {
+        Ring &ring;
+        Event *event;
+
+        jsonutils::Trade* claim()
+        {
+            event = ring.claim();
+            return event ? &event->record : nullptr;
+        }
+        void commit(jsonutils::Trade*) { ring.commit(event); }
+    };
+
+    const string response = readFixture("trades");
+    auto ring = BfxAPI::makeAligned<Ring>(64);
+    Sink sink{*ring, nullptr};
+
+    AllocCounter allocs;
+    for (auto _ : state)
+    {
+        int64_t lastTid = 0;
+        jsonutils::decodeTradesTo(response, sink, lastTid);
+        while (const Event *event = ring->front())
+        {
+            benchmark::DoNotOptimize(event->record.price);
+            ring->pop();
+        }
+    }
+    allocs.report(state);
+    state.SetBytesProcessed(state.iterations() * response.size());
+}
+BENCHMARK(BM_decodeTradesToRing);
+
+
+int main(int argc, char *argv[])
+{
+    // Payload building of every authenticated method
+    const vector<pair<string, function<void(BitfinexAPI&)>>> payloads =
+    {
+        {"getAccountInfo", [](BitfinexAPI &api) { api.getAccountInfo(); }},
+        {"getAccountFees", [](BitfinexAPI &api) { api.getAccountFees(); }},
+        {"getSummary", [](BitfinexAPI &api) { api.getSummary(); }},
+        {"deposit", [](BitfinexAPI &api)
+            { api.deposit("litecoin", "deposit", true); }},
+        {"getKeyPermissions", [](BitfinexAPI &api)
+            { api.getKeyPermissions(); }},
+        {"getMarginInfos", [](BitfinexAPI &api) { api.getMarginInfos(); }},
+        {"getBalances", [](BitfinexAPI &api) { api.getBalances(); }},
+        {"transfer", [](BitfinexAPI &api)
+            { api.transfer(0.1, "USD", "trading", "deposit"); }},
+        {"withdraw", [](BitfinexAPI &api) { api.withdraw(); }},
+        {"newOrder", [](BitfinexAPI &api)
+            {
+                api.newOrder("btcusd", 0.01, 983, "sell", "exchange limit",
+                             false, true, false, false, 0);
+            }},
+        {"newOrders", [](BitfinexAPI &api)
+            {
+                api.newOrders({
+                    {"btcusd", 0.1, 950, "sell", "exchange limit"},
+                    {"btcusd", 0.1, 951, "sell", "exchange limit"},
+                    {"btcusd", 0.1, 952, "sell", "exchange limit"},
+                    {"btcusd", 0.1, 953, "sell", "exchange limit"},
+                    {"btcusd", 0.1, 954, "sell", "exchange limit"},
+                    {"btcusd", 0.1, 955, "sell", "exchange limit"},
+                    {"btcusd", 0.1, 956, "sell", "exchange limit"},
+                    {"btcusd", 0.1, 957, "sell", "exchange limit"},
+                    {"btcusd", 0.1, 958, "sell", "exchange limit"},
+                    {"btcusd", 0.1, 959, "sell", "exchange limit"}
+                });
+            }},
+        {"cancelOrder", [](BitfinexAPI &api)
+            { api.cancelOrder(13265453586LL); }},
+        {"cancelOrders", [](BitfinexAPI &api)
+            {
+                api.cancelOrders({12324589754LL, 12356754322LL, 12354996754LL,
+                                  12324589755LL, 12356754323LL, 12354996755LL,
+                                  12324589756LL, 12356754324LL, 12354996756LL,
+                                  12324589757LL});
+            }},
+        {"cancelAllOrders", [](BitfinexAPI &api) { api.cancelAllOrders(); }},
+        {"replaceOrder", [](BitfinexAPI &api)
+            {
+                api.replaceOrder(1321548521LL, "btcusd", 0.05, 1212, "sell",
+                                 "exchange limit", false, false);
+            }},
+        {"getOrderStatus", [](BitfinexAPI &api)
+            { api.getOrderStatus(12113548453LL); }},
+        {"getActiveOrders", [](BitfinexAPI &api) { api.getActiveOrders(); }},
+        {"getOrdersHistory", [](BitfinexAPI &api)
+            { api.getOrdersHistory(10); }},
+        {"getActivePositions", [](BitfinexAPI &api)
+            { api.getActivePositions(); }},
+        {"claimPosition", [](BitfinexAPI &api)
+            { long long id = 156321412LL; api.claimPosition(id, 150); }},
+        {"getBalanceHistory", [](BitfinexAPI &api)
+            { api.getBalanceHistory("USD", 0L, 0L, 500, "all"); }},
+        {"getWithdrawalHistory", [](BitfinexAPI &api)
+            { api.getWithdrawalHistory("USD", "all", 0L , 0L, 500); }},
+        {"getPastTrades", [](BitfinexAPI &api)
+            { api.getPastTrades("btcusd", 0L, 0L, 500, false); }},
+        {"newOffer", [](BitfinexAPI &api)
+            { api.newOffer("USD", 12000, 25.2, 30, "lend"); }},
+        {"cancelOffer", [](BitfinexAPI &api)
+            { api.cancelOffer(12354245628LL); }},
+        {"getOfferStatus", [](BitfinexAPI &api)
+            { api.getOfferStatus(12313541215LL); }},
+        {"getActiveCredits", [](BitfinexAPI &api) { api.getActiveCredits(); }},
+        {"getOffers", [](BitfinexAPI &api) { api.getOffers(); }},
+        {"getOffersHistory", [](BitfinexAPI &api)
+            { api.getOffersHistory(50); }},
+        {"getPastFundingTrades", [](BitfinexAPI &api)
+            { api.getPastFundingTrades("USD", 0, 50); }},
+        {"getTakenFunds", [](BitfinexAPI &api) { api.getTakenFunds(); }},
+        {"getUnusedTakenFunds", [](BitfinexAPI &api)
+            { api.getUnusedTakenFunds(); }},
+        {"getTotalTakenFunds", [](BitfinexAPI &api)
+            { api.getTotalTakenFunds(); }},
+        {"closeLoan", [](BitfinexAPI &api) { api.closeLoan(1235845634LL); }},
+        {"closePosition", [](BitfinexAPI &api)
+            { api.closePosition(1235845634LL); }}
+    };
+    for (const auto &payload : payloads)
+        benchmark::RegisterBenchmark(("BM_Payload/" + payload.first).c_str(),
+                                     BM_Payload, payload.second);
+
+    for (const auto &fixture : schemaFixtures)
+        benchmark::RegisterBenchmark(
+            ("BM_validateSchema/" + fixture.first).c_str(),
+            BM_validateSchema, fixture.first, fixture.second);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -0,0 +1,117 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  coroutines.cpp
+//
+//
+//  Bitfinex REST API C++ client - coroutine flows driver
+//
+//
+//  Runs concurrent order flows of Coroutines.hpp on one EventLoop thread
+//  against mockserver (or any API compatible endpoint) and reports failed
+//  requests. Built with -std=c++20 only.
+//
+//  ./coroutines --url http://127.0.0.1:8080/v1 --flows 32 --orders 10
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// std
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// BitfinexAPI
+#include "bfx-api-cpp/BitfinexAPI.hpp"
+#include "bfx-api-cpp/Coroutines.hpp"
+
+#if !defined(__cpp_impl_coroutine)
+#error "coroutines.cpp requires compiler with coroutine support (-std=c++20)"
+#endif
+
+
+// namespaces
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using BfxAPI::AsyncBitfinexAPI;
+using BfxAPI::BitfinexAPI;
+
+struct Config
+{
+    string url = "http://127.0.0.1:8080/v1";
+    string key = "mock-access-key";
+    string secret = "mock-secret-key";
+    unsigned flows = 32;
+    unsigned orders = 10; // per flow
+};
+
+struct Counters
+{
+    unsigned requests = 0;
+    unsigned errors = 0;
+};
+
+static void usage(const char *name)
+{
+    cerr << "Usage: " << name << " [--url URL] [--key KEY] [--secret SECRET]"
+    " [--flows N] [--orders N]" << endl;
+}
+
+// Places orders and checks their status, every request of the flow is
+// in flight together with requests of the other flows
+static BfxAPI::Task<> flow(AsyncBitfinexAPI &api,
+                           const Config &config,
+                           Counters &counters,
+                           double price)
+{
+    for (unsigned i = 0; i < config.orders; ++i)
+    {
+        auto order = co_await api.newOrderAsync("btcusd", 0.01, price, "buy",
+                                                "exchange limit");
+        auto status = co_await api.getOrderStatusAsync(1);
+        counters.requests += 2;
+        // Error responses of endpoints without schema pass validation,
+        // check HTTP status as well
+        for (const auto *result : {&order, &status})
+            if (result->hasApiError() || result->httpStatusCode >= 400)
+                ++counters.errors;
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    Config config;
+    for (int i = 1; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if (i + 1 >= argc)
+        { usage(argv[0]); return 1; }
+        if (arg == "--url")
+            config.url = argv[++i];
+        else if (arg == "--key")
+            config.key = argv[++i];
+        else if (arg == "--secret")
+            config.secret = argv[++i];
+        else if (arg == "--flows")
+            config.flows = atoi(argv[++i]);
+        else if (arg == "--orders")
+            config.orders = atoi(argv[++i]);
+        else
+        { usage(argv[0]); return 1; }
+    }
+
+    BitfinexAPI client(config.key, config.secret, config.url);
+    client.getRateLimiter().setMode(BfxAPI::RateLimiter::Mode::off);
+
+    BfxAPI::EventLoop loop;
+    AsyncBitfinexAPI api(client, loop);
+    Counters counters;
+    for (unsigned f = 0; f < config.flows; ++f)
+        loop.spawn(flow(api, config, counters, 900 + f));
+    loop.run();
+
+    cout << counters.requests << " requests, " << counters.errors
+         << " errors" << endl;
+    return counters.errors ? 1 : 0;
+}
@@ -105,7 +105,7 @@ int main(int argc, char *argv[])
     //      {"btcusd", 0.1, 950, "sell", "exchange limit"},
     //      {"btcusd", 0.1, 950, "sell", "exchange limit"}
     //  };
-    //  bfxAPI.newOrders(orders);
+    //  bfxAPI.newOrders(orders); // up to BitfinexAPI::MAX_MULTI_ORDERS
     //
     //  bfxAPI.cancelOrder(13265453586LL);
     //
@@ -154,5 +154,336 @@ int main(int argc, char *argv[])
     //  bfxAPI.closeLoan(1235845634LL);
     //  bfxAPI.closePosition(1235845634LL);
 
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Request coalescing
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Share one coalescer between BitfinexAPI instances used by different
+    //  threads. Identical public requests issued at the same time are sent
+    //  once and results younger than 100ms are served from memory.
+    //  auto coalescer = std::make_shared<BfxAPI::BitfinexAPI::PublicCoalescer>(
+    //      std::chrono::milliseconds(100));
+    //  bfxAPI.setCoalescer(coalescer);
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Rate limiting
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Requests wait for a free token by default. In failFast mode requests
+    //  over the limit are not sent and getBfxApiStatusCode() returns
+    //  rateLimited.
+    //  bfxAPI.getRateLimiter().setMode(BfxAPI::RateLimiter::Mode::failFast);
+    //  bfxAPI.getRateLimiter().setLimit(BfxAPI::EndpointGroup::orders, 60, 20);
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Retries
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Idempotent requests are retried up to 3 times with jittered backoff,
+    //  non-idempotent ones (e.g. newOrder) only if they never left the host.
+    //  bfxAPI.getRetrier().setPolicy("/orders/",
+    //      {5, std::chrono::milliseconds(50), std::chrono::seconds(1), true});
+    //  cout << bfxAPI.getRetrier().retries(BfxAPI::EndpointGroup::orders);
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Latency histograms
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Every request records libcurl phases (namelookup, connect, appconnect,
+    //  pretransfer, starttransfer, transfer, total) and local phases
+    //  (payload_build, signing, parse, validation).
+    //  auto h = bfxAPI.getLatencies().find("/order/new/",
+    //                                      BfxAPI::Phase::startTransfer);
+    //  if (h)
+    //      cout << "p99 server time [ns]: " << h->percentile(0.99) << endl;
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Metrics
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  BfxAPI::MetricsRegistry registry;
+    //  bfxAPI.registerMetrics(registry, "main");
+    //  Serve OpenMetrics text on http://127.0.0.1:9464/metrics ...
+    //  registry.startServer(9464);
+    //  ... or render / dump it on demand
+    //  cout << registry.render();
+    //  registry.dump("../metrics.txt");
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Logging
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Diagnostics are written to stderr from a background thread
+    //  auto &logger = BfxAPI::Logger::instance();
+    //  logger.setLevel(BfxAPI::LogLevel::warning);
+    //  logger.setSink([](const BfxAPI::LogLevel &level, const string &line)
+    //                 { syslog(LOG_ERR, "%s", line.c_str()); });
+    //  cout << logger.dropped() << endl;
+    //  logger.flush();
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Tracing
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  BfxAPI::Tracer::enable();
+    //  bfxAPI.newOrder("btcusd", 0.01, 1000, "sell", "exchange limit",
+    //                  false, true, false, false, 0);
+    //  BfxAPI::Tracer::disable();
+    //  Open in chrome://tracing or https://ui.perfetto.dev
+    //  BfxAPI::Tracer::write("../trace.json");
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Response cache
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  bfxAPI.setCacheTTL("/symbols_details/", std::chrono::minutes(10));
+    //  bfxAPI.setCacheTTL("/account_fees/", std::chrono::minutes(10));
+    //  bfxAPI.getSymbolsDetails(); // network
+    //  bfxAPI.getSymbolsDetails(); // served from cache
+    //  bfxAPI.invalidateCache("/account_fees/");
+    //  cout << bfxAPI.getCache().getStats().hits << endl;
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Tick store (bfx-api-cpp/TickStore.hpp)
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  #include "bfx-api-cpp/TickStore.hpp"
+    //
+    //  BfxAPI::TickStore store("../ticks");
+    //
+    //  jsonutils::Ticker ticker;
+    //  if (!bfxAPI.getTicker("btcusd").hasApiError() &&
+    //      jsonutils::decodeTicker(bfxAPI.strResponse(), ticker) == noError)
+    //      store.append("btcusd", ticker);
+    //
+    //  Scan one day of stored tickers in place
+    //  auto tickers = store.reader<jsonutils::Ticker>("btcusd", 20181001);
+    //  for (const auto &t : tickers)
+    //      cout << t.timestamp << " " << t.lastPrice << endl;
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Transports
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  libcurl is the default transport, any BfxAPI::Transport implementation
+    //  can be selected at construction time
+    //  auto fake = std::make_shared<BfxAPI::FakeTransport>();
+    //  fake->setResponse("/symbols/", "[\"btcusd\"]");
+    //  fake->setResponse("/pubticker/btcusd", "{...}");
+    //  BfxAPI::BitfinexAPI offline("", "", "https://api.bitfinex.com/v1", fake);
+    //
+    //  Asynchronous requests (curl multi with the default transport)
+    //  BfxAPI::HTTPRequest request("https://api.bitfinex.com/v1");
+    //  request.submitGet("/pubticker/btcusd", {},
+    //                    [](BfxAPI::HttpExchange &e) { cout << e.response; });
+    //  while (request.pending())
+    //      request.poll(std::chrono::milliseconds(100));
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Record and replay
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Record session to binary log ...
+    //  auto recorder = std::make_shared<BfxAPI::SessionRecorder>("../session.bfxs");
+    //  bfxAPI.setRecorder(recorder);
+    //  bfxAPI.getSymbols(); // lets replaying client load recorded symbols
+    //  bfxAPI.getTicker("btcusd");
+    //  bfxAPI.setRecorder(nullptr);
+    //
+    //  ... and serve it back without network, at recorded speed or as fast
+    //  as possible (Speed::fast)
+    //  auto replayer = BfxAPI::SessionReplayer::load(
+    //      "../session.bfxs", BfxAPI::SessionReplayer::Speed::recorded);
+    //  if (replayer)
+    //      bfxAPI.setReplayer(replayer);
+    //  bfxAPI.getTicker("btcusd");
+    //  cout << replayer->getStats().misses << endl;
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Coroutines (bfx-api-cpp/Coroutines.hpp, C++20)
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Every endpoint has awaitable variant, one EventLoop thread drives
+    //  thousands of concurrent flows over the client transport
+    //  BfxAPI::EventLoop loop;
+    //  BfxAPI::AsyncBitfinexAPI api(bfxAPI, loop);
+    //  auto flow = [](BfxAPI::AsyncBitfinexAPI &api,
+    //                 double price) -> BfxAPI::Task<>
+    //  {
+    //      auto order = co_await api.newOrderAsync("btcusd", 0.01, price,
+    //                                              "buy", "exchange limit");
+    //      if (order.hasApiError())
+    //          co_return;
+    //      auto ticker = co_await api.getTickerAsync("btcusd");
+    //      cout << ticker.response << endl;
+    //  };
+    //  for (double price = 900; price < 1000; price += 10)
+    //      loop.spawn(flow(api, price));
+    //  loop.run();
+    //
+    //  Single result
+    //  auto ticker = loop.runUntilComplete(api.getTickerAsync("btcusd"));
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Thread-safe mode
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  One client can be called from several threads, each thread gets its
+    //  own request context (buffers, transport, status of the last call)
+    //  bfxAPI.setThreadSafe(true);
+    //  std::thread worker([&bfxAPI]
+    //  {
+    //      bfxAPI.getTicker("btcusd");
+    //      if (!bfxAPI.hasApiError())
+    //          cout << bfxAPI.strResponse() << endl;
+    //      bfxAPI.releaseContext();
+    //  });
+    //  bfxAPI.getBalances();
+    //  worker.join();
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Shared client context
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Symbols, compiled schemas and curl share handle are fetched and built
+    //  once, further clients are constructed without I/O and are movable
+    //  auto context = BfxAPI::BitfinexAPI::createContext();
+    //  vector<BfxAPI::BitfinexAPI> clients;
+    //  clients.emplace_back(context, "accessKey1", "secretKey1");
+    //  clients.emplace_back(bfxAPI.getContext(), "accessKey2", "secretKey2");
+    //  std::thread worker([client = std::move(clients.back())]() mutable
+    //  { client.getBalances(); });
+    //  worker.join();
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Accounts (bfx-api-cpp/AccountManager.hpp)
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Sub-accounts share context and connections, each keeps own signer
+    //  and nonce sequence
+    //  BfxAPI::AccountManager accounts(bfxAPI.getContext());
+    //  accounts.add("main", "accessKey1", "secretKey1");
+    //  accounts.add("hedge", "accessKey2", "secretKey2");
+    //  accounts.find("hedge")->getBalances();
+    //  accounts.forEach([](const string &name, BfxAPI::BitfinexAPI &api)
+    //  { api.getActiveOrders(); });
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Fan-out (bfx-api-cpp/FanOut.hpp)
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Public endpoint for many symbols, up to 8 concurrent requests,
+    //  results decoded and indexed by symbol
+    //  BfxAPI::FanOut fanOut(bfxAPI, 8);
+    //  auto tickers = fanOut.tickers(bfxAPI.getContext()->getSymbols());
+    //  for (const auto &ticker : tickers)
+    //      if (ticker.second.ok())
+    //          cout << ticker.first << " " << ticker.second.value.mid << endl;
+    //      else
+    //          cout << ticker.first << " error "
+    //          << ticker.second.bfxApiStatusCode << endl;
+    //  auto books = fanOut.orderBooks(vector<string>{"btcusd", "ethusd"}, 5, 5);
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Market data rings (bfx-api-cpp/MarketPoller.hpp)
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Poller thread decodes tickers straight into lock-free ring read by
+    //  strategy thread (MpscRing if several pollers share the ring)
+    //  using Poller = BfxAPI::MarketPoller<BfxAPI::SpscRing>;
+    //  auto tickers = BfxAPI::makeAligned<Poller::TickerRing>(1024);
+    //  Poller poller(bfxAPI, {"btcusd", "ethusd"});
+    //  poller.publishTickers(tickers.get());
+    //  std::atomic<bool> running{true};
+    //  std::thread polling([&]
+    //  { poller.run(running, std::chrono::milliseconds(1000)); });
+    //  while (running)
+    //      if (auto event = tickers->front())
+    //      {
+    //          cout << poller.getSymbols()[event->symbol] << " "
+    //          << event->record.mid << endl;
+    //          tickers->pop();
+    //      }
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Executor (bfx-api-cpp/Executor.hpp)
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Validate and decode responses on worker threads, thread calling
+    //  poll() only drives network I/O
+    //  BfxAPI::Executor executor; // hardware_concurrency() - 1 workers
+    //  BfxAPI::FanOut fanOut(bfxAPI, 16, &executor);
+    //  auto books = fanOut.orderBooks(bfxAPI.getContext()->getSymbols());
+    //
+    //  Callbacks of submit() with executor run on its workers
+    //  bfxAPI.submit(request,
+    //                [](BfxAPI::BitfinexAPI::AsyncResult &result)
+    //                { /* decode result.response */ },
+    //                executor);
+    //
+    //  MarketPoller<MpscRing> publishes from workers as well
+    //  poller.setExecutor(&executor);
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Order batches (bfx-api-cpp/OrderBatch.hpp)
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Any number of orders, sent as concurrent /order/new/multi/ requests
+    //  BitfinexAPI::vOrders ladder;
+    //  for (int i = 0; i < 200; ++i)
+    //      ladder.push_back({"btcusd", 0.01, 950.0 + i, "sell",
+    //                        "exchange limit"});
+    //  BfxAPI::OrderBatch batch(bfxAPI, 4);
+    //  BfxAPI::BatchResult placed = batch.place(ladder);
+    //  if (!placed.ok())
+    //      for (size_t i = 0; i < placed.orders.size(); ++i)
+    //          if (!placed.orders[i].ok())
+    //              cout << "order " << i << " error "
+    //              << placed.orders[i].bfxApiStatusCode << endl;
+    //
+    //  Cancelling hundreds of orders, connections opened ahead of time
+    //  BfxAPI::CancelBatch cancels(bfxAPI, 8);
+    //  cancels.warmUp(); // periodically while orders rest
+    //  BfxAPI::CancelResult cancelled = cancels.cancel(ids);
+    //  for (const auto &failure : cancelled.failed)
+    //      cout << "order " << failure.id << " not cancelled" << endl;
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Order templates (bfx-api-cpp/OrderTemplate.hpp)
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Order entry with request built and validated ahead of time, only
+    //  nonce, amount and price are written and signed per order
+    //  auto quote = BfxAPI::OrderTemplate::newOrder(bfxAPI, "btcusd", "sell",
+    //                                               "exchange limit");
+    //  quote.warmUp(); // connect before the first order
+    //  if (quote.send(0.01, 983) == noError &&
+    //      bfxAPI.getHttpStatusCode() == 200)
+    //      cout << bfxAPI.strResponse() << endl;
+    //
+    //  Moving a resting order
+    //  auto requote = BfxAPI::OrderTemplate::replaceOrder(bfxAPI, "btcusd",
+    //                                                     "sell",
+    //                                                     "exchange limit");
+    //  requote.send(0.01, 984, 448364249);
+
+    ////////////////////////////////////////////////////////////////////////////
+    ///  Order cache (bfx-api-cpp/OrderCache.hpp)
+    ////////////////////////////////////////////////////////////////////////////
+
+    //  Own orders kept up to date from order responses of the client
+    //  BfxAPI::OrderCache orders(bfxAPI);
+    //  bfxAPI.newOrder("btcusd", 0.01, 983, "sell", "exchange limit");
+    //  jsonutils::Order order;
+    //  if (orders.find(448364249, order) && order.isLive)
+    //      cout << order.remainingAmount << endl;
+    //  for (const auto &resting : orders.live("btcusd"))
+    //      cout << resting.id << " " << resting.price << endl;
+    //
+    //  Fills and cancellations made elsewhere come with reconciliation,
+    //  background thread needs thread-safe client
+    //  bfxAPI.setThreadSafe(true);
+    //  orders.startReconciling(std::chrono::seconds(5));
+
     return 0;
 }
@@ -0,0 +1,177 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  mockdriver.cpp
+//
+//
+//  Bitfinex REST API C++ client - end-to-end load driver
+//
+//
+//  Runs public and authenticated request flows against mockserver (or any
+//  API compatible endpoint) from several threads and reports throughput and
+//  tail latency of complete BitfinexAPI calls including response validation.
+//
+//  ./mockdriver --url http://127.0.0.1:8080/v1 --threads 4 --duration 10
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// std
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// BitfinexAPI
+#include "bfx-api-cpp/BitfinexAPI.hpp"
+
+
+// namespaces
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::function;
+using std::string;
+using std::vector;
+using BfxAPI::BitfinexAPI;
+using BfxAPI::LatencyHistogram;
+
+struct Config
+{
+    string url = "http://127.0.0.1:8080/v1";
+    string key = "mock-access-key";
+    string secret = "mock-secret-key";
+    unsigned threads = 4;
+    double duration = 10; // seconds
+    string flow = "all";
+};
+
+// Sequence of calls executed in a loop by every thread
+struct Flow
+{
+    string name;
+    vector<function<void(BitfinexAPI&)>> calls;
+    LatencyHistogram latency;
+    std::atomic<uint64_t> errors{0};
+};
+
+static void usage(const char *name)
+{
+    cerr << "Usage: " << name << " [--url URL] [--key KEY] [--secret SECRET]"
+    " [--threads N] [--duration S] [--flow public|auth|all]" << endl;
+}
+
+static void runFlow(const Config &config, Flow &flow)
+{
+    vector<std::thread> threads;
+    const auto deadline = std::chrono::steady_clock::now() +
+    std::chrono::milliseconds(static_cast<int64_t>(config.duration * 1000));
+
+    for (unsigned t = 0; t < config.threads; ++t)
+        threads.emplace_back([&config, &flow, deadline]
+        {
+            BitfinexAPI api(config.key, config.secret, config.url);
+            // Measure the client itself, not its protective limits
+            api.getRateLimiter().setMode(BfxAPI::RateLimiter::Mode::off);
+            api.getRetrier().setDefaultPolicy(
+                {0, std::chrono::milliseconds(0), std::chrono::milliseconds(0),
+                 true});
+
+            while (std::chrono::steady_clock::now() < deadline)
+                for (const auto &call : flow.calls)
+                {
+                    const int64_t start = BfxAPI::steadyNowNs();
+                    call(api);
+                    // Error responses of endpoints without schema pass
+                    // validation, check HTTP status as well
+                    const bool error = api.hasApiError() ||
+                    api.getHttpStatusCode() >= 400;
+                    flow.latency.record(BfxAPI::steadyNowNs() - start);
+                    if (error)
+                        flow.errors.fetch_add(1, std::memory_order_relaxed);
+                }
+        });
+
+    for (auto &thread : threads)
+        thread.join();
+}
+
+static void report(const Config &config, const Flow &flow)
+{
+    const LatencyHistogram &h = flow.latency;
+    printf("%-8s %10llu %8llu %10.0f %9.1f %9.1f %9.1f %9.1f %9.1f\n",
+           flow.name.c_str(),
+           static_cast<unsigned long long>(h.count()),
+           static_cast<unsigned long long>(flow.errors.load()),
+           h.count() / config.duration,
+           h.percentile(0.5) / 1e3, h.percentile(0.9) / 1e3,
+           h.percentile(0.99) / 1e3, h.percentile(0.999) / 1e3,
+           h.max() / 1e3);
+}
+
+
+int main(int argc, char *argv[])
+{
+    Config config;
+    for (int i = 1; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if (i + 1 >= argc)
+        { usage(argv[0]); return 1; }
+        if (arg == "--url")
+            config.url = argv[++i];
+        else if (arg == "--key")
+            config.key = argv[++i];
+        else if (arg == "--secret")
+            config.secret = argv[++i];
+        else if (arg == "--threads")
+            config.threads = atoi(argv[++i]);
+        else if (arg == "--duration")
+            config.duration = atof(argv[++i]);
+        else if (arg == "--flow")
+            config.flow = argv[++i];
+        else
+        { usage(argv[0]); return 1; }
+    }
+
+    Flow publicFlow;
+    publicFlow.name = "public";
+    publicFlow.calls =
+    {
+        [](BitfinexAPI &api) { api.getTicker("btcusd"); },
+        [](BitfinexAPI &api) { api.getOrderBook("btcusd", 25, 25, false); },
+        [](BitfinexAPI &api) { api.getTrades("btcusd", 0L, 50); }
+    };
+
+    Flow authFlow;
+    authFlow.name = "auth";
+    authFlow.calls =
+    {
+        [](BitfinexAPI &api)
+        {
+            api.newOrder("btcusd", 0.01, 983, "sell", "exchange limit",
+                         false, true, false, false, 0);
+        },
+        [](BitfinexAPI &api) { api.getActiveOrders(); },
+        [](BitfinexAPI &api) { api.cancelOrder(448364249LL); },
+        [](BitfinexAPI &api) { api.getBalances(); }
+    };
+
+    printf("%u threads, %.1f s per flow against %s\n\n", config.threads,
+           config.duration, config.url.c_str());
+    printf("%-8s %10s %8s %10s %9s %9s %9s %9s %9s\n", "flow", "requests",
+           "errors", "req/s", "p50 us", "p90 us", "p99 us", "p99.9 us",
+           "max us");
+
+    for (Flow *flow : {&publicFlow, &authFlow})
+    {
+        if (config.flow != "all" && config.flow != flow->name)
+            continue;
+        runFlow(config, *flow);
+        report(config, *flow);
+    }
+    return 0;
+}
@@ -0,0 +1,445 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  mockserver.cpp
+//
+//
+//  Bitfinex REST API C++ client - local mock of Bitfinex REST API v1
+//
+//
+//  Serves every endpoint known to BfxSchemaValidator over plain HTTP/1.1
+//  (keep-alive) on 127.0.0.1 with recorded responses from doc/fixtures.
+//  Authenticated requests are checked like the real API does: API key,
+//  X-BFX-SIGNATURE (HMAC-SHA384 of X-BFX-PAYLOAD), request path inside the
+//  payload and optionally strictly increasing nonce. Latency and errors can
+//  be injected.
+//
+//  ./mockserver --port 8080 --key <key> --secret <secret> --latency-ms 2
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// std
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+
+// POSIX
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// rapidjson
+#include "rapidjson/document.h"
+
+// BitfinexAPI (HTTPRequest signing routines)
+#include "bfx-api-cpp/HTTPRequest.hpp"
+
+
+// namespaces
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::map;
+using std::string;
+
+#ifndef BENCH_FIXTURES_PATH
+#define BENCH_FIXTURES_PATH "doc/fixtures"
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+///  Configuration
+////////////////////////////////////////////////////////////////////////////////
+
+struct Config
+{
+    uint16_t port = 8080;
+    string key = "mock-access-key";
+    string secret = "mock-secret-key";
+    string fixtures = BENCH_FIXTURES_PATH;
+    double latencyMs = 0;   // added to every response
+    double jitterMs = 0;    // uniform [0, jitter] on top of latency
+    double errorRate = 0;   // fraction of requests answered with HTTP 500
+    double dropRate = 0;    // fraction of connections closed without reply
+    bool strictNonce = false;
+};
+
+struct Stats
+{
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> authFailures{0};
+    std::atomic<uint64_t> injectedErrors{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> notFound{0};
+};
+
+static Config config;
+static Stats stats;
+static map<string, string> fixtures; // schema name -> response body
+static std::atomic<bool> running{true};
+static std::atomic<long long> lastNonce{0};
+
+////////////////////////////////////////////////////////////////////////////////
+///  Utilities
+////////////////////////////////////////////////////////////////////////////////
+
+static void loadFixtures(const string &dir)
+{
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+    {
+        cerr << "Cannot open fixtures directory " << dir << endl;
+        exit(1);
+    }
+    while (dirent *entry = readdir(d))
+    {
+        const string name = entry->d_name;
+        if (name.size() < 6 || name.compare(name.size() - 5, 5, ".json"))
+            continue;
+        std::ifstream ifs(dir + "/" + name);
+        std::stringstream ss;
+        ss << ifs.rdbuf();
+        string body = ss.str();
+        while (!body.empty() && (body.back() == '\n' || body.back() == '\r'))
+            body.pop_back();
+        fixtures[name.substr(0, name.size() - 5)] = body;
+    }
+    closedir(d);
+}
+
+// Same names as BfxSchemaValidator uses, e.g. "/order/cancel/multi/" ->
+// "order_cancel_multi", "/book/btcusd" -> "book"
+static string schemaOf(const string &path)
+{
+    static const char *withSymbol[] =
+    {"pubticker", "stats", "book", "trades", "lendbook", "lends"};
+
+    string name;
+    for (const char c : path)
+        name += c == '/' ? '_' : c;
+    while (!name.empty() && name.front() == '_')
+        name.erase(0, 1);
+    while (!name.empty() && name.back() == '_')
+        name.pop_back();
+
+    const string first = name.substr(0, name.find('_'));
+    for (const char *prefix : withSymbol)
+        if (first == prefix && name != first)
+            return first;
+    return name;
+}
+
+static string base64Decode(const string &in)
+{
+    static const string chars =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    string out;
+    int value = 0, bits = -8;
+    for (const char c : in)
+    {
+        const auto pos = chars.find(c);
+        if (pos == string::npos)
+            break;
+        value = (value << 6) + static_cast<int>(pos);
+        bits += 6;
+        if (bits >= 0)
+        {
+            out += static_cast<char>((value >> bits) & 0xFF);
+            bits -= 8;
+        }
+    }
+    return out;
+}
+
+static string message(const string &text)
+{
+    return "{\"message\":\"" + text + "\"}";
+}
+
+static bool sendAll(const int &fd, const string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        const ssize_t n = send(fd, data.data() + sent, data.size() - sent,
+                               MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///  Request handling
+////////////////////////////////////////////////////////////////////////////////
+
+struct Request
+{
+    string method;
+    string path;
+    map<string, string> headers; // lower case names
+};
+
+// Verifies authenticated request like Bitfinex does, returns error message
+// or empty string
+static string authenticate(const Request &request)
+{
+    auto header = [&request](const string &name)
+    {
+        auto it = request.headers.find(name);
+        return it == request.headers.end() ? string() : it->second;
+    };
+
+    if (header("x-bfx-apikey") != config.key)
+        return "Could not find a key matching the given X-BFX-APIKEY.";
+
+    const string payload = header("x-bfx-payload");
+    string signature;
+    BfxAPI::HTTPRequest::getHmacSha384(config.secret, payload, signature);
+    if (payload.empty() || header("x-bfx-signature") != signature)
+        return "Invalid X-BFX-SIGNATURE.";
+
+    rapidjson::Document d;
+    const string json = base64Decode(payload);
+    if (d.Parse(json.c_str()).HasParseError() || !d.IsObject() ||
+        !d.HasMember("request") || !d["request"].IsString() ||
+        !d.HasMember("nonce") || !d["nonce"].IsString())
+        return "Invalid X-BFX-PAYLOAD.";
+
+    string expected = "/v1" + request.path;
+    if (expected.back() == '/')
+        expected.pop_back();
+    if (expected != d["request"].GetString())
+        return "Request path does not match payload request.";
+
+    if (config.strictNonce)
+    {
+        const long long nonce = atoll(d["nonce"].GetString());
+        long long last = lastNonce.load();
+        do
+        {
+            if (nonce <= last)
+                return "Nonce is too small.";
+        }
+        while (!lastNonce.compare_exchange_weak(last, nonce));
+    }
+    return string();
+}
+
+// Returns false if connection should be closed without response
+static bool handle(const Request &request, int &status, string &body)
+{
+    stats.requests.fetch_add(1, std::memory_order_relaxed);
+
+    thread_local std::minstd_rand rng(std::random_device{}());
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    const double delayMs = config.latencyMs + config.jitterMs * uniform(rng);
+    if (delayMs > 0)
+        std::this_thread::sleep_for(
+            std::chrono::microseconds(static_cast<int64_t>(delayMs * 1000)));
+
+    if (config.dropRate > 0 && uniform(rng) < config.dropRate)
+    {
+        stats.dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (config.errorRate > 0 && uniform(rng) < config.errorRate)
+    {
+        stats.injectedErrors.fetch_add(1, std::memory_order_relaxed);
+        status = 500;
+        body = message("Internal server error.");
+        return true;
+    }
+
+    auto it = fixtures.find(schemaOf(request.path));
+    if (it == fixtures.end())
+    {
+        stats.notFound.fetch_add(1, std::memory_order_relaxed);
+        status = 404;
+        body = message("Unknown endpoint.");
+        return true;
+    }
+
+    if (request.method == "POST")
+    {
+        const string error = authenticate(request);
+        if (!error.empty())
+        {
+            stats.authFailures.fetch_add(1, std::memory_order_relaxed);
+            status = 400;
+            body = message(error);
+            return true;
+        }
+    }
+
+    status = 200;
+    body = it->second;
+    return true;
+}
+
+static void serveConnection(const int fd)
+{
+    string buffer;
+    char chunk[16384];
+
+    for (;;)
+    {
+        // Read request head
+        size_t headEnd;
+        while ((headEnd = buffer.find("\r\n\r\n")) == string::npos)
+        {
+            const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0)
+            { close(fd); return; }
+            buffer.append(chunk, n);
+        }
+
+        Request request;
+        std::istringstream head(buffer.substr(0, headEnd));
+        string line, target;
+        std::getline(head, line);
+        std::istringstream(line) >> request.method >> target;
+        while (std::getline(head, line))
+        {
+            const auto colon = line.find(':');
+            if (colon == string::npos)
+                continue;
+            string name = line.substr(0, colon);
+            for (auto &c : name)
+                c = tolower(c);
+            string value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(' '));
+            while (!value.empty() && (value.back() == '\r' || value.back() == ' '))
+                value.pop_back();
+            request.headers[name] = value;
+        }
+
+        // Skip request body
+        size_t bodySize = 0;
+        auto length = request.headers.find("content-length");
+        if (length != request.headers.end())
+            bodySize = strtoul(length->second.c_str(), nullptr, 10);
+        while (buffer.size() < headEnd + 4 + bodySize)
+        {
+            const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0)
+            { close(fd); return; }
+            buffer.append(chunk, n);
+        }
+        buffer.erase(0, headEnd + 4 + bodySize);
+
+        request.path = target.substr(0, target.find('?'));
+        if (request.path.compare(0, 3, "/v1") == 0)
+            request.path.erase(0, 3);
+
+        int status;
+        string body;
+        if (!handle(request, status, body))
+        { close(fd); return; }
+
+        const char *reason = status == 200 ? "OK"
+        : status == 404 ? "Not Found"
+        : status == 500 ? "Internal Server Error" : "Bad Request";
+        const string response =
+        "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n"
+        "Content-Type: application/json; charset=utf-8\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: keep-alive\r\n\r\n" + body;
+        if (!sendAll(fd, response))
+        { close(fd); return; }
+    }
+}
+
+static void usage(const char *name)
+{
+    cerr << "Usage: " << name << " [--port N] [--key KEY] [--secret SECRET]"
+    " [--fixtures DIR] [--latency-ms MS] [--jitter-ms MS] [--error-rate P]"
+    " [--drop-rate P] [--strict-nonce]" << endl;
+}
+
+
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--strict-nonce")
+            config.strictNonce = true;
+        else if (arg == "--port" && hasValue)
+            config.port = static_cast<uint16_t>(atoi(argv[++i]));
+        else if (arg == "--key" && hasValue)
+            config.key = argv[++i];
+        else if (arg == "--secret" && hasValue)
+            config.secret = argv[++i];
+        else if (arg == "--fixtures" && hasValue)
+            config.fixtures = argv[++i];
+        else if (arg == "--latency-ms" && hasValue)
+            config.latencyMs = atof(argv[++i]);
+        else if (arg == "--jitter-ms" && hasValue)
+            config.jitterMs = atof(argv[++i]);
+        else if (arg == "--error-rate" && hasValue)
+            config.errorRate = atof(argv[++i]);
+        else if (arg == "--drop-rate" && hasValue)
+            config.dropRate = atof(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    loadFixtures(config.fixtures);
+
+    const int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) ||
+        listen(listenFd, 1024))
+    {
+        cerr << "Cannot listen on 127.0.0.1:" << config.port << endl;
+        return 1;
+    }
+
+    signal(SIGINT, [](int) { running = false; });
+    signal(SIGTERM, [](int) { running = false; });
+    cout << "Mock Bitfinex API on http://127.0.0.1:" << config.port << "/v1 ("
+    << fixtures.size() << " endpoints)" << endl;
+
+    while (running)
+    {
+        pollfd pfd = {listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+        const int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        std::thread(serveConnection, fd).detach();
+    }
+    close(listenFd);
+
+    cout << "requests: " << stats.requests
+    << " auth failures: " << stats.authFailures
+    << " injected errors: " << stats.injectedErrors
+    << " dropped: " << stats.dropped
+    << " not found: " << stats.notFound << endl;
+    return 0;
+}
@@ -0,0 +1,1401 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  unittest.cpp
+//
+//
+//  Bitfinex REST API C++ client - offline unit tests
+//
+//
+//  Deterministic tests of client components, one section per component.
+//  Requests are served by FakeTransport from recorded responses in
+//  doc/fixtures, nothing is sent. Returns number of failed checks, run by
+//  ctest.
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// POSIX
+#include <unistd.h>
+
+// BitfinexAPI
+#include "bfx-api-cpp/BitfinexAPI.hpp"
+#include "bfx-api-cpp/MarketPoller.hpp"
+#include "bfx-api-cpp/OrderBatch.hpp"
+#include "bfx-api-cpp/OrderCache.hpp"
+#include "bfx-api-cpp/OrderTemplate.hpp"
+#include "bfx-api-cpp/RingBuffer.hpp"
+#include "bfx-api-cpp/TickStore.hpp"
+
+
+// namespaces
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using BfxAPI::BitfinexAPI;
+using BfxAPI::FakeTransport;
+
+#ifndef TEST_FIXTURES_PATH
+#define TEST_FIXTURES_PATH "doc/fixtures"
+#endif
+
+static int failures = 0;
+
+static void check(const string &name, bool ok)
+{
+    cout << "- " << name << ": " << (ok ? "✅" : "❌") << endl;
+    if (!ok)
+        ++failures;
+}
+
+static string readFixture(const string &name)
+{
+    std::ifstream ifs(string(TEST_FIXTURES_PATH) + "/" + name + ".json");
+    if (!ifs.is_open())
+    {
+        cerr << "Missing fixture " << name << endl;
+        exit(1);
+    }
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+// Client without network, symbols come from fixture
+static std::unique_ptr<BitfinexAPI>
+fakeClient(const std::shared_ptr<FakeTransport> &fake,
+           const string &apiUrl = "http://127.0.0.1/v1")
+{
+    fake->setResponse("/symbols/", readFixture("symbols"));
+    std::unique_ptr<BitfinexAPI> api(new BitfinexAPI("fake-access-key",
+                                                     "fake-secret-key",
+                                                     apiUrl,
+                                                     fake));
+    api->getRateLimiter().setMode(BfxAPI::RateLimiter::Mode::off);
+    // Failed requests are reported right away, without retry delays
+    api->getRetrier().setDefaultPolicy({0, std::chrono::milliseconds(0),
+                                        std::chrono::milliseconds(0), true});
+    return api;
+}
+
+// Completes submitted requests only from poll(), like a network transport
+class DeferredTransport: public FakeTransport
+{
+public:
+
+    void submit(const string &url,
+                const Header &header,
+                BfxAPI::HttpExchange exchange,
+                const Callback &callback) override
+    { queued_.push_back({url, header, exchange, callback}); }
+
+    size_t poll(const std::chrono::milliseconds &timeout =
+                std::chrono::milliseconds(0)) override
+    {
+        vector<Queued> queued;
+        queued.swap(queued_);
+        for (auto &q : queued)
+        {
+            if (q.exchange.post)
+                post(q.url, q.header, q.exchange);
+            else
+                get(q.url, q.header, q.exchange);
+            q.callback(q.exchange);
+        }
+        return queued.size();
+    }
+
+    size_t pending() const override
+    { return queued_.size(); }
+
+private:
+
+    struct Queued
+    {
+        string url;
+        Header header;
+        BfxAPI::HttpExchange exchange;
+        Callback callback;
+    };
+
+    vector<Queued> queued_;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+///  Ring buffers
+////////////////////////////////////////////////////////////////////////////////
+
+struct Item
+{
+    uint32_t producer;
+    uint32_t sequence;
+};
+
+template <typename Ring>
+static void testRing(const string &name)
+{
+    auto ring = BfxAPI::makeAligned<Ring>(5);
+    int value = 0;
+    check(name + " capacity rounded to power of 2", ring->capacity() == 8);
+    check(name + " empty", !ring->front() && !ring->pop(value));
+
+    bool filled = true;
+    for (int i = 0; i < 8; ++i)
+        filled = filled && ring->push(i);
+    check(name + " full", filled && !ring->push(8) && !ring->claim());
+
+    // Indices wrap around capacity many times, records stay in order
+    bool ordered = true;
+    int next = 8;
+    for (int expected = 0; expected < 100; ++expected)
+    {
+        ordered = ordered && ring->pop(value) && value == expected;
+        ordered = ordered && ring->push(next++);
+    }
+    for (int expected = 100; expected < next; ++expected)
+        ordered = ordered && ring->pop(value) && value == expected;
+    check(name + " wraparound", ordered && !ring->front());
+
+    int *slot = ring->claim();
+    *slot = 42;
+    const bool hidden = !ring->front();
+    ring->commit(slot);
+    check(name + " claimed slot visible after commit",
+          hidden && ring->front() && *ring->front() == 42);
+    ring->pop();
+    check(name + " empty after pop", !ring->front());
+}
+
+static void testMpscProducers()
+{
+    const uint32_t producers = 4;
+    const uint32_t perProducer = 50000;
+    auto ring = BfxAPI::makeAligned<BfxAPI::MpscRing<Item>>(64);
+
+    // Slot claimed first blocks consumer until committed
+    Item *first = ring->claim();
+    Item *second = ring->claim();
+    *second = Item{1, 1};
+    ring->commit(second);
+    const bool blocked = !ring->front();
+    *first = Item{0, 0};
+    ring->commit(first);
+    Item item;
+    const bool inOrder = ring->pop(item) && item.producer == 0 &&
+                         ring->pop(item) && item.producer == 1;
+    check("MpscRing uncommitted claim blocks consumer", blocked && inOrder);
+
+    std::atomic<bool> start{false};
+    vector<std::thread> threads;
+    for (uint32_t p = 0; p < producers; ++p)
+        threads.emplace_back([&, p]
+        {
+            while (!start.load())
+                std::this_thread::yield();
+            for (uint32_t i = 0; i < perProducer; ++i)
+                while (!ring->push(Item{p, i}))
+                    std::this_thread::yield();
+        });
+
+    // Records of every producer arrive complete and in its order
+    vector<uint32_t> next(producers, 0);
+    bool ordered = true;
+    start = true;
+    for (uint64_t received = 0; received < producers * perProducer; )
+    {
+        if (!ring->pop(item))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        ordered = ordered && item.producer < producers &&
+                  item.sequence == next[item.producer];
+        if (item.producer < producers)
+            ++next[item.producer];
+        ++received;
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    bool complete = !ring->front();
+    for (const uint32_t count : next)
+        complete = complete && count == perProducer;
+    check("MpscRing concurrent producers", ordered && complete);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///  Order book deltas
+////////////////////////////////////////////////////////////////////////////////
+
+static string bookLevel(const char *price, const char *amount)
+{
+    return string("{\"price\":\"") + price + "\",\"amount\":\"" + amount +
+           "\",\"timestamp\":\"1539949960.0\"}";
+}
+
+static void testBookDeltas()
+{
+    using jsonutils::Side;
+    using Ring = BfxAPI::SpscRing<BfxAPI::MarketEvent<jsonutils::BookDelta>>;
+
+    auto fake = std::make_shared<FakeTransport>();
+    auto api = fakeClient(fake);
+    auto ring = BfxAPI::makeAligned<Ring>(64);
+    BfxAPI::MarketPoller<BfxAPI::SpscRing> poller(*api, {"btcusd"});
+    poller.publishBookDeltas(ring.get(), 5);
+
+    struct Expected
+    {
+        Side side;
+        double price;
+        double amount;
+    };
+    auto matches = [&ring](const vector<Expected> &expected)
+    {
+        BfxAPI::MarketEvent<jsonutils::BookDelta> event;
+        for (const auto &e : expected)
+            if (!ring->pop(event) || event.symbol != 0 ||
+                event.record.side != e.side || event.record.price != e.price ||
+                event.record.amount != e.amount || !event.record.timestamp)
+                return false;
+        return !ring->front();
+    };
+
+    // First snapshot is published whole
+    fake->setResponse("/book/btcusd",
+        "{\"bids\":[" + bookLevel("100.0", "1.0") + "," +
+        bookLevel("99.0", "2.0") + "," + bookLevel("98.0", "3.0") +
+        "],\"asks\":[" + bookLevel("101.0", "1.0") + "," +
+        bookLevel("102.0", "2.0") + "]}");
+    poller.pollOnce();
+    check("book deltas of first snapshot",
+          matches({{Side::buy, 100, 1}, {Side::buy, 99, 2}, {Side::buy, 98, 3},
+                   {Side::sell, 101, 1}, {Side::sell, 102, 2}}));
+
+    // Changed, removed (zero amount) and added levels from the best price,
+    // unchanged levels are skipped
+    fake->setResponse("/book/btcusd",
+        "{\"bids\":[" + bookLevel("100.0", "1.0") + "," +
+        bookLevel("99.0", "5.0") + "," + bookLevel("97.0", "4.0") +
+        "],\"asks\":[" + bookLevel("101.5", "1.0") + "," +
+        bookLevel("102.0", "2.0") + "]}");
+    poller.pollOnce();
+    check("book deltas between snapshots",
+          matches({{Side::buy, 99, 5}, {Side::buy, 98, 0}, {Side::buy, 97, 4},
+                   {Side::sell, 101, 0}, {Side::sell, 101.5, 1}}));
+
+    poller.pollOnce();
+    check("no book deltas of unchanged snapshot",
+          matches({}) && poller.published() == 10 && !poller.errors());
+
+    fake->setResponse("/book/btcusd", "{\"message\":\"error\"}", 500);
+    poller.pollOnce();
+    check("failed book request counted", matches({}) && poller.errors() == 1);
+
+    // Deltas dropped by full ring are published again by next poll
+    auto small = BfxAPI::makeAligned<Ring>(8);
+    BfxAPI::MarketPoller<BfxAPI::SpscRing> dropping(*api, {"btcusd"});
+    dropping.publishBookDeltas(small.get(), 5);
+    for (int i = 0; i < 4; ++i)
+        small->push(BfxAPI::MarketEvent<jsonutils::BookDelta>());
+    fake->setResponse("/book/btcusd",
+        "{\"bids\":[" + bookLevel("100.0", "1.0") + "," +
+        bookLevel("99.0", "2.0") + "," + bookLevel("98.0", "3.0") +
+        "],\"asks\":[" + bookLevel("101.0", "1.0") + "," +
+        bookLevel("102.0", "2.0") + "]}");
+    dropping.pollOnce();
+    const bool dropped = dropping.dropped() == 1 && dropping.published() == 4;
+    while (small->front())
+        small->pop();
+    dropping.pollOnce();
+    BfxAPI::MarketEvent<jsonutils::BookDelta> event;
+    size_t republished = 0;
+    while (small->pop(event))
+        republished += event.record.amount != 0;
+    dropping.pollOnce();
+    check("dropped book deltas published again",
+          dropped && republished == 5 && !small->front());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///  Rate limiter
+////////////////////////////////////////////////////////////////////////////////
+
+static void testRateLimiter()
+{
+    using BfxAPI::EndpointGroup;
+    using BfxAPI::RateLimiter;
+
+    check("rate limiter endpoint groups",
+          RateLimiter::groupOf("/pubticker/btcusd") ==
+          EndpointGroup::publicTicker &&
+          RateLimiter::groupOf("/book/btcusd") ==
+          EndpointGroup::publicBookTrades &&
+          RateLimiter::groupOf("/order/new/") == EndpointGroup::orders &&
+          RateLimiter::groupOf("/order/cancel/replace/") ==
+          EndpointGroup::orders &&
+          RateLimiter::groupOf("/order/cancel/multi/") ==
+          EndpointGroup::cancels &&
+          RateLimiter::groupOf("/mytrades") == EndpointGroup::history &&
+          RateLimiter::groupOf("/balances/") == EndpointGroup::account);
+
+    // One token per minute: refills don't happen while the test runs
+    RateLimiter failFast(RateLimiter::Mode::failFast);
+    failFast.setLimit(EndpointGroup::orders, 1, 3);
+    bool burst = true;
+    for (int i = 0; i < 3; ++i)
+        burst = burst && failFast.acquire("/order/new/");
+    check("GCRA burst in fail-fast mode",
+          burst && !failFast.acquire("/order/new/") &&
+          failFast.reserve("/order/new/") < 0 && failFast.rejected() == 2);
+    check("GCRA groups have own buckets",
+          failFast.acquire("/order/cancel/") &&
+          failFast.reserve(EndpointGroup::account) == 0);
+
+    // Waiting mode reserves future tokens one interval apart
+    const int64_t minute = 60000000000LL;
+    RateLimiter wait(RateLimiter::Mode::wait);
+    wait.setLimit(EndpointGroup::history, 1, 2);
+    const int64_t first = wait.reserve("/history/");
+    const int64_t second = wait.reserve("/history/");
+    const int64_t third = wait.reserve("/history/");
+    const int64_t fourth = wait.reserve("/history/");
+    auto near = [](int64_t value, int64_t expected)
+    { return value > expected - 1000000000LL && value <= expected; };
+    check("GCRA reservations in wait mode",
+          first == 0 && second == 0 && near(third, minute) &&
+          near(fourth, 2 * minute) && wait.delayed() == 2);
+
+    RateLimiter idle(RateLimiter::Mode::wait);
+    idle.setLimit(EndpointGroup::history, 1, 1);
+    const bool took = idle.tryAcquire("/history/");
+    bool refused = true;
+    for (int i = 0; i < 10; ++i)
+        refused = refused && !idle.tryAcquire("/history/");
+    check("GCRA tryAcquire doesn't reserve future tokens",
+          took && refused && near(idle.reserve("/history/"), minute));
+
+    RateLimiter off(RateLimiter::Mode::off);
+    off.setLimit(EndpointGroup::orders, 1, 1);
+    bool unlimited = true;
+    for (int i = 0; i < 100; ++i)
+        unlimited = unlimited && off.reserve("/order/new/") == 0;
+    check("GCRA off mode", unlimited);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///  Order cache
+////////////////////////////////////////////////////////////////////////////////
+
+// Active orders fixture without order id
+static string ordersWithout(const int64_t &id)
+{
+    rj::Document d;
+    d.Parse(readFixture("orders").c_str());
+    rj::StringBuffer buffer;
+    rj::Writer<rj::StringBuffer> writer(buffer);
+    writer.StartArray();
+    for (const auto &order : d.GetArray())
+        if (order["id"].GetInt64() != id)
+            order.Accept(writer);
+    writer.EndArray();
+    return buffer.GetString();
+}
+
+static BfxAPI::HttpExchange exchange(const string &path,
+                                     const string &response,
+                                     const int64_t &start,
+                                     const long &httpCode = 200)
+{
+    return BfxAPI::HttpExchange{true, path, string(), string(), response,
+                                CURLE_OK, httpCode, BfxAPI::RequestTimings(),
+                                start};
+}
+
+static void testOrderCache()
+{
+    const int64_t first = 448364249;
+    const int64_t gone = 448364250;
+    const int64_t other = 448364251;
+
+    auto fake = std::make_shared<FakeTransport>();
+    auto api = fakeClient(fake);
+    BfxAPI::OrderCache cache(*api);
+
+    fake->setResponse("/orders/", readFixture("orders"));
+    cache.reconcile();
+    check("orders cached from active orders",
+          cache.size() == 5 && cache.live().size() == 5 &&
+          cache.live("ltcusd").empty() && cache.lastReconciled() > 0);
+
+    fake->setResponse("/order/new/", readFixture("order_new"));
+    api->newOrder("btcusd", 0.01, 983, "sell", "exchange limit");
+    jsonutils::Order order;
+    check("order cached from new order",
+          cache.find(first, order) && order.isLive &&
+          !strcmp(order.symbol, "btcusd"));
+
+    // Order missing in active orders is no longer live, it is dropped by
+    // the second reconciliation after that
+    fake->setResponse("/orders/", ordersWithout(gone));
+    cache.reconcile();
+    check("missing order not live after reconciliation",
+          cache.find(gone, order) && !order.isLive && !order.isCancelled &&
+          cache.isLive(other) && cache.live().size() == 4);
+    cache.reconcile();
+    check("not live order kept by next reconciliation",
+          cache.size() == 5 && !cache.isLive(gone));
+    cache.reconcile();
+    check("not live order dropped by second reconciliation",
+          cache.size() == 4 && !cache.find(gone, order));
+
+    fake->setResponse("/order/cancel/", readFixture("order_cancel"));
+    api->cancelOrder(first);
+    check("cancelled order not live",
+          cache.find(first, order) && !order.isLive && order.isCancelled);
+
+    // Responses of requests older than cached state are ignored
+    cache.update(exchange("/order/status/", readFixture("order_status"), 1));
+    check("older order status ignored", !cache.isLive(first));
+    const int64_t reconciled = cache.lastReconciled();
+    cache.update(exchange("/orders/", "[]", reconciled - 1));
+    check("older active orders ignored",
+          cache.isLive(other) && cache.lastReconciled() == reconciled);
+
+    // Failed requests are ignored
+    cache.update(exchange("/order/status/", readFixture("order_status"),
+                          BfxAPI::steadyNowNs(), 400));
+    check("failed request ignored", !cache.isLive(first));
+
+    cache.update(exchange("/order/status/", readFixture("order_status"),
+                          BfxAPI::steadyNowNs()));
+    check("newer order status applied", cache.isLive(first));
+
+    // Order updated after cancel all request started stays live
+    const int64_t cancelStart = BfxAPI::steadyNowNs();
+    cache.update(exchange("/order/status/", readFixture("order_status"),
+                          cancelStart + 1));
+    cache.update(exchange("/order/cancel/all/",
+                          readFixture("order_cancel_all"), cancelStart));
+    check("order newer than cancel all kept live",
+          cache.live().size() == 1 && cache.isLive(first));
+
+    fake->setResponse("/order/cancel/all/", readFixture("order_cancel_all"));
+    api->cancelAllOrders();
+    check("all orders cancelled", cache.live().empty() && cache.size() == 4);
+}
+
+// Observers removed while requests are pending or running
+static void testObserverRemoval()
+{
+    auto deferred = std::make_shared<DeferredTransport>();
+    auto api = fakeClient(deferred);
+    deferred->setResponse("/order/new/", readFixture("order_new"));
+
+    BitfinexAPI::PreparedRequest request;
+    BitfinexAPI::AsyncResult result;
+    api->prepare([](BitfinexAPI &a)
+                 { a.newOrder("btcusd", 0.01, 983, "sell", "exchange limit"); },
+                 request, result);
+    auto callback = [&result](BitfinexAPI::AsyncResult &r) { result = r; };
+
+    unsigned observed = 0;
+    const uint64_t id = api->addExchangeObserver(
+        [&observed](const BfxAPI::HttpExchange&) { ++observed; });
+    api->submit(request, callback);
+    api->removeExchangeObserver(id);
+    api->poll();
+    check("removed observer not called by pending request",
+          observed == 0 && !result.hasApiError());
+
+    {
+        BfxAPI::OrderCache cache(*api);
+        api->submit(request, callback);
+    }
+    api->poll();
+    check("pending request completes after cache destruction",
+          !result.hasApiError() && !api->pending());
+
+    // Observers change while other thread runs requests
+    const string ticker = readFixture("pubticker");
+    auto threaded = fakeClient(std::make_shared<FakeTransport>());
+    threaded->setThreadSafe(true, [&ticker]
+    {
+        auto fake = std::make_shared<FakeTransport>();
+        fake->setResponse("/pubticker/btcusd", ticker);
+        return fake;
+    });
+    std::atomic<unsigned> counted{0};
+    threaded->addExchangeObserver([&counted](const BfxAPI::HttpExchange&)
+                                  { ++counted; });
+    std::atomic<bool> done{false};
+    std::thread caller([&]
+    {
+        for (int i = 0; i < 2000; ++i)
+            threaded->getTicker("btcusd");
+        threaded->releaseContext();
+        done = true;
+    });
+    unsigned changes = 0;
+    while (!done)
+    {
+        BfxAPI::OrderCache cache(*threaded);
+        ++changes;
+        std::this_thread::yield();
+    }
+    caller.join();
+    check("observers changed while requests run",
+          counted == 2000 && changes > 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///  Tick store
+////////////////////////////////////////////////////////////////////////////////
+
+static void testTickStore()
+{
+    char root[] = "/tmp/bfx-unittest-XXXXXX";
+    if (!mkdtemp(root))
+    {
+        check("tick store temporary directory", false);
+        return;
+    }
+
+    const int64_t day = 86400000000000LL;
+    const int64_t t0 = 1539950000000000000LL; // 2018-10-19
+    const uint32_t day0 = BfxAPI::TickStore::dayOf(t0);
+    const uint32_t day1 = BfxAPI::TickStore::dayOf(t0 + day);
+
+    jsonutils::Ticker ticker = {};
+    jsonutils::decodeTicker(readFixture("pubticker"), ticker);
+    vector<jsonutils::Trade> trades;
+    jsonutils::decodeTrades(readFixture("trades"), trades);
+    jsonutils::OrderBook book;
+    jsonutils::decodeOrderBook(readFixture("book"), book);
+
+    // Trades on both sides of midnight go to two files
+    vector<jsonutils::Trade> split(trades.begin(), trades.begin() + 4);
+    for (size_t i = 0; i < split.size(); ++i)
+        split[i].timestamp = t0 + (i < 2 ? 0 : day);
+
+    {
+        // Small capacity makes files grow while appending
+        BfxAPI::TickStore store(root, 2);
+        bool ok = store.append("btcusd", ticker) == noError;
+        for (int i = 0; i < 3; ++i)
+            ok = ok && store.append("ethusd", trades) == noError;
+        ok = ok && store.append("btcusd", split) == noError;
+        ok = ok && store.append("btcusd", book, t0) == noError;
+        ok = ok && store.sync() == noError;
+        check("tick store append", ok);
+    }
+
+    BfxAPI::TickStore store(root);
+    auto tickers = store.reader<jsonutils::Ticker>("btcusd",
+                                                   BfxAPI::TickStore::dayOf(
+                                                   ticker.timestamp));
+    check("tick store ticker round-trip",
+          tickers.isOpen() && tickers.size() == 1 &&
+          !memcmp(&tickers[0], &ticker, sizeof(ticker)) &&
+          tickers.symbol() == "btcusd");
+
+    auto ethusd = store.reader<jsonutils::Trade>("ethusd",
+                                                 BfxAPI::TickStore::dayOf(
+                                                 trades[0].timestamp));
+    bool same = ethusd.size() == 3 * trades.size();
+    for (size_t i = 0; same && i < ethusd.size(); ++i)
+        same = !memcmp(&ethusd[i], &trades[i % trades.size()],
+                       sizeof(jsonutils::Trade));
+    check("tick store trades round-trip after growing", same);
+
+    auto before = store.reader<jsonutils::Trade>("btcusd", day0);
+    auto after = store.reader<jsonutils::Trade>("btcusd", day1);
+    check("tick store splits trades by day",
+          before.size() == 2 && after.size() == 2 &&
+          before.day() == day0 && after.day() == day1 &&
+          !memcmp(&after[0], &split[2], sizeof(jsonutils::Trade)));
+
+    auto books = store.reader<jsonutils::BookRecord>("btcusd", day0);
+    bool levels = books.size() == book.bids.size() + book.asks.size();
+    for (size_t i = 0; levels && i < books.size(); ++i)
+    {
+        const bool bid = i < book.bids.size();
+        const auto &level = bid ? book.bids[i]
+                                : book.asks[i - book.bids.size()];
+        levels = books[i].snapshot == t0 &&
+                 books[i].price == level.price &&
+                 books[i].amount == level.amount &&
+                 books[i].side == (bid ? jsonutils::Side::buy
+                                       : jsonutils::Side::sell) &&
+                 books[i].level == (bid ? i : i - book.bids.size());
+    }
+    check("tick store book round-trip", levels);
+
+    // Reopened file continues after the last record, reader picks up
+    // records appended since
+    store.append("btcusd", split);
+    check("tick store appends to existing file",
+          before.refresh() && before.size() == 4 &&
+          !memcmp(&before[2], &split[0], sizeof(jsonutils::Trade)));
+
+    system((string("rm -rf ") + root).c_str());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///  Request coalescing
+////////////////////////////////////////////////////////////////////////////////
+
+static void testCoalescing()
+{
+    using Coalescer = BitfinexAPI::PublicCoalescer;
+
+    auto fake = std::make_shared<FakeTransport>();
+    auto first = fakeClient(fake);
+    auto second = fakeClient(fake);
+    auto coalescer = std::make_shared<Coalescer>();
+    first->setCoalescer(coalescer);
+    second->setCoalescer(coalescer);
+
+    // Leader's response is held until follower waits for it
+    const string ticker = readFixture("pubticker");
+    fake->setHandler([&](BfxAPI::HttpExchange &exchange)
+    {
+        while (!coalescer->shared())
+            std::this_thread::yield();
+        exchange.response = ticker;
+        exchange.httpCode = 200;
+    });
+    const size_t before = fake->requests();
+    std::thread leader([&] { first->getTicker("btcusd"); });
+    while (!coalescer->fetched())
+        std::this_thread::yield();
+    second->getTicker("btcusd");
+    leader.join();
+    check("concurrent identical requests sent once",
+          fake->requests() == before + 1 && coalescer->shared() == 1 &&
+          second->strResponse() == ticker && !second->hasApiError() &&
+          !first->hasApiError());
+
+    // Successful results are reused for freshness window, failures and
+    // other API urls are not
+    coalescer->setFreshness(std::chrono::seconds(60));
+    fake->setResponse("/pubticker/ethusd", ticker);
+    first->getTicker("ethusd");
+    second->getTicker("ethusd");
+    check("fresh result reused",
+          fake->requests() == before + 2 && second->strResponse() == ticker);
+
+    fake->setResponse("/pubticker/ltcusd", "{\"message\":\"error\"}", 500);
+    first->getTicker("ltcusd");
+    second->getTicker("ltcusd");
+    check("failed result not reused",
+          fake->requests() == before + 4 && second->hasApiError());
+
+    auto mock = fakeClient(fake, "http://127.0.0.2/v1");
+    mock->setCoalescer(coalescer);
+    const size_t fetched = fake->requests();
+    mock->getTicker("ethusd");
+    check("result of other API url not reused",
+          fake->requests() == fetched + 1);
+}
+////////////////////////////////////////////////////////////////////////////////
+///  Response cache
+////////////////////////////////////////////////////////////////////////////////
+
+static void testResponseCache()
+{
+    auto fake = std::make_shared<FakeTransport>();
+    auto api = fakeClient(fake);
+    api->setCacheTTL("/account_fees/", std::chrono::seconds(60));
+    api->setCacheTTL("/symbols_details/", std::chrono::seconds(60));
+    const size_t before = fake->requests();
+
+    // Error body of authenticated endpoint passes validation, it must not
+    // be cached because of its HTTP status
+    fake->setResponse("/account_fees/", "{\"message\":\"error\"}", 500);
+    api->getAccountFees();
+    api->getAccountFees();
+    check("failed response not cached",
+          fake->requests() == before + 2 &&
+          api->getCache().getStats("/account_fees/").hits == 0);
+
+    const string fees = readFixture("account_fees");
+    fake->setResponse("/account_fees/", fees);
+    api->getAccountFees();
+    api->getAccountFees();
+    check("2xx response served from cache",
+          fake->requests() == before + 3 && api->strResponse() == fees &&
+          !api->hasApiError() &&
+          api->getCache().getStats("/account_fees/").hits == 1);
+
+    api->invalidateCache("/account_fees/");
+    api->getAccountFees();
+    check("invalidated response fetched again",
+          fake->requests() == before + 4);
+
+    fake->setResponse("/symbols_details/", "[]", 503);
+    api->getSymbolsDetails();
+    fake->setResponse("/symbols_details/", readFixture("symbols_details"));
+    api->getSymbolsDetails();
+    api->getSymbolsDetails();
+    check("public response cached after failure",
+          fake->requests() == before + 6 && !api->hasApiError());
+}
+////////////////////////////////////////////////////////////////////////////////
+///  Retries
+////////////////////////////////////////////////////////////////////////////////
+
+static void testRetries()
+{
+    using BfxAPI::EndpointGroup;
+    using BfxAPI::Retrier;
+    using std::chrono::milliseconds;
+
+    auto fake = std::make_shared<FakeTransport>();
+    auto api = fakeClient(fake);
+    api->getRetrier().setDefaultPolicy({3, milliseconds(0), milliseconds(0),
+                                        true});
+
+    // Every path fails failures[path] times with given error, then succeeds
+    std::map<string, unsigned> failures;
+    CURLcode curlCode = CURLE_OK;
+    long httpCode = 503;
+    fake->setHandler([&](BfxAPI::HttpExchange &exchange)
+    {
+        if (failures[exchange.path])
+        {
+            --failures[exchange.path];
+            exchange.curlCode = curlCode;
+            exchange.httpCode = curlCode == CURLE_OK ? httpCode : 0;
+            exchange.response = curlCode == CURLE_OK
+            ? "{\"message\":\"error\"}" : "";
+            return;
+        }
+        exchange.httpCode = 200;
+        exchange.response = exchange.path == "/order/new/"
+        ? readFixture("order_new") : readFixture("pubticker");
+    });
+
+    size_t before = fake->requests();
+    failures["/pubticker/btcusd"] = 2;
+    api->getTicker("btcusd");
+    check("idempotent request retried after 5xx",
+          fake->requests() == before + 3 && !api->hasApiError() &&
+          api->getRetrier().retries(EndpointGroup::publicTicker) == 2);
+
+    before = fake->requests();
+    failures["/pubticker/btcusd"] = 10;
+    api->getTicker("btcusd");
+    failures.clear();
+    check("retries limited by policy",
+          fake->requests() == before + 4 && api->hasApiError() &&
+          api->getRetrier().failures(EndpointGroup::publicTicker) == 1);
+
+    before = fake->requests();
+    httpCode = 400;
+    failures["/pubticker/btcusd"] = 1;
+    api->getTicker("btcusd");
+    check("4xx not retried", fake->requests() == before + 1);
+
+    // Order may have been placed unless request provably wasn't sent
+    before = fake->requests();
+    httpCode = 503;
+    failures["/order/new/"] = 1;
+    api->newOrder("btcusd", 0.01, 983, "sell", "exchange limit");
+    check("non-idempotent request not retried after 5xx",
+          fake->requests() == before + 1 && api->getHttpStatusCode() == 503);
+
+    before = fake->requests();
+    curlCode = CURLE_OPERATION_TIMEDOUT;
+    failures["/order/new/"] = 1;
+    api->newOrder("btcusd", 0.01, 983, "sell", "exchange limit");
+    check("non-idempotent request not retried after timeout",
+          fake->requests() == before + 1 &&
+          api->getCurlStatusCode() == CURLE_OPERATION_TIMEDOUT);
+
+    before = fake->requests();
+    curlCode = CURLE_COULDNT_CONNECT;
+    failures["/order/new/"] = 1;
+    api->newOrder("btcusd", 0.01, 983, "sell", "exchange limit");
+    check("non-idempotent request retried when not sent",
+          fake->requests() == before + 2 && !api->hasApiError());
+
+    // Full jitter stays below exponential ceiling and maxDelay
+    Retrier retrier;
+    retrier.setPolicy("/pubticker/btcusd", {8, milliseconds(10),
+                                            milliseconds(50), true});
+    bool bounded = true;
+    for (unsigned attempt = 0; attempt < 8; ++attempt)
+        for (int i = 0; i < 100; ++i)
+        {
+            std::chrono::nanoseconds delay(-1);
+            const int64_t ceiling = std::min<int64_t>(10 << attempt, 50);
+            bounded = bounded &&
+            retrier.shouldRetry("/pubticker/btcusd", attempt, CURLE_OK, 502,
+                                delay) &&
+            delay.count() >= 0 && delay <= milliseconds(ceiling);
+        }
+    std::chrono::nanoseconds delay(0);
+    check("backoff within jitter ceiling",
+          bounded && !retrier.shouldRetry("/pubticker/btcusd", 8, CURLE_OK,
+                                          502, delay) &&
+          !Retrier::isTransient(CURLE_OK, 501) &&
+          Retrier::neverSent(CURLE_COULDNT_RESOLVE_HOST));
+}
+////////////////////////////////////////////////////////////////////////////////
+///  Latency histograms
+////////////////////////////////////////////////////////////////////////////////
+
+static void testLatencies()
+{
+    using BfxAPI::EndpointLatencies;
+    using BfxAPI::LatencyHistogram;
+    using BfxAPI::Phase;
+
+    LatencyHistogram histogram;
+    for (int64_t ns = 1; ns <= 1000; ++ns)
+        histogram.record(ns);
+    histogram.record(-5);
+    const int64_t median = histogram.percentile(0.5);
+    const int64_t tail = histogram.percentile(0.99);
+    check("histogram count, sum and max",
+          histogram.count() == 1001 && histogram.sum() == 500500 &&
+          histogram.max() == 1000 && histogram.mean() == 500.0);
+    check("histogram percentiles",
+          median > 500 && median <= 532 && tail > 990 && tail <= 1056);
+
+    // Bucket upper bound stays within 1/16 of value
+    bool precise = true;
+    for (int64_t ns = 1; ns < (1LL << 40); ns = ns * 3 + 1)
+    {
+        const int64_t bound =
+        LatencyHistogram::upperBoundOf(LatencyHistogram::indexOf(ns));
+        precise = precise && bound > ns && bound - ns <= ns / 16 + 1;
+    }
+    check("histogram bucket precision", precise);
+    histogram.reset();
+    check("histogram reset", !histogram.count() && !histogram.percentile(0.5));
+
+    // Cumulative libcurl timings are split into single phases
+    EndpointLatencies latencies;
+    latencies.record("/book/btcusd", {10, 30, 0, 35, 100, 150, 5});
+    latencies.record("/book/ethusd", {10, 30, 40, 45, 100, 150, 0});
+    auto sum = [&latencies](const Phase &phase)
+    {
+        const LatencyHistogram *h = latencies.find("/book/", phase);
+        return h ? h->sum() : -1;
+    };
+    check("curl phases of one endpoint",
+          sum(Phase::nameLookup) == 20 && sum(Phase::connect) == 40 &&
+          sum(Phase::appConnect) == 10 && sum(Phase::preTransfer) == 10 &&
+          sum(Phase::startTransfer) == 120 && sum(Phase::transfer) == 100 &&
+          sum(Phase::total) == 300 && sum(Phase::signing) == 5 &&
+          latencies.find("/book/", Phase::signing)->count() == 1 &&
+          !latencies.find("/trades/", Phase::total));
+
+    // Client records transfer, parsing, validation and signing
+    auto fake = std::make_shared<FakeTransport>();
+    auto api = fakeClient(fake);
+    const string ticker = readFixture("pubticker");
+    const string status = readFixture("order_status");
+    fake->setHandler([&](BfxAPI::HttpExchange &exchange)
+    {
+        exchange.httpCode = 200;
+        exchange.response = exchange.post ? status : ticker;
+        exchange.timings.connect = 1000;
+        exchange.timings.preTransfer = 2000;
+        exchange.timings.startTransfer = 5000;
+        exchange.timings.total = 7000;
+    });
+    // response is validated lazily by error check
+    api->getTicker("btcusd").hasApiError();
+    api->getOrderStatus(448364249);
+    const EndpointLatencies &recorded = api->getLatencies();
+    const LatencyHistogram *total =
+    recorded.find("/pubticker/btcusd", Phase::total);
+    const LatencyHistogram *signing =
+    recorded.find("/order/status/", Phase::signing);
+    const LatencyHistogram *validation =
+    recorded.find("/pubticker/btcusd", Phase::validation);
+    check("client records request phases",
+          total && total->count() == 1 && total->sum() == 7000 &&
+          recorded.find("/pubticker/", Phase::startTransfer)->sum() == 3000 &&
+          signing && signing->count() == 1 &&
+          validation && validation->count() == 1);
+}
+////////////////////////////////////////////////////////////////////////////////
+///  Metrics exposition
+////////////////////////////////////////////////////////////////////////////////
+
+static bool contains(const string &text, const string &part)
+{ return text.find(part) != string::npos; }
+
+static size_t occurrences(const string &text, const string &part)
+{
+    size_t n = 0;
+    for (size_t pos = text.find(part); pos != string::npos;
+         pos = text.find(part, pos + 1))
+        ++n;
+    return n;
+}
+
+static void testMetrics()
+{
+    BfxAPI::MetricsWriter writer;
+    writer.family("b_metric", "gauge", "Second");
+    writer.family("a_metric", "counter", "First");
+    writer.family("b_metric", "counter", "Ignored");
+    writer.sample("a_metric", "_total", {{"label", "q\"b\\s\nn"}}, 2);
+    writer.sample("b_metric", "", {}, 0.25);
+    writer.sample("undeclared", "", {}, 1);
+    check("OpenMetrics families, escaping and EOF",
+          writer.str() ==
+          "# TYPE b_metric gauge\n"
+          "# HELP b_metric Second\n"
+          "b_metric 0.25\n"
+          "# TYPE a_metric counter\n"
+          "# HELP a_metric First\n"
+          "a_metric_total{label=\"q\\\"b\\\\s\\nn\"} 2\n"
+          "# EOF\n");
+
+    // Clients of one registry share metric families
+    BfxAPI::MetricsRegistry registry;
+    auto fake = std::make_shared<FakeTransport>();
+    auto first = fakeClient(fake);
+    auto second = fakeClient(fake);
+    first->registerMetrics(registry, "first");
+    second->registerMetrics(registry, "second");
+
+    fake->setResponse("/pubticker/btcusd", readFixture("pubticker"));
+    fake->setResponse("/pubticker/ethusd", "{}");
+    first->getTicker("btcusd").hasApiError();
+    first->getTicker("ethusd").hasApiError();
+    string text = registry.render();
+    check("client metrics rendered",
+          occurrences(text, "# TYPE bfx_requests counter\n") == 1 &&
+          contains(text, "bfx_requests_total{client=\"first\","
+                         "group=\"public_ticker\"} 2\n") &&
+          contains(text, "bfx_requests_total{client=\"second\","
+                         "group=\"public_ticker\"} 0\n") &&
+          contains(text, "bfx_client_errors_total{client=\"first\","
+                         "code=\"responseSchemaError\"} 1\n") &&
+          contains(text, "bfx_request_latency_seconds_count{client=\"first\","
+                         "endpoint=\"/pubticker/\",phase=\"total\"} 2\n") &&
+          contains(text, "quantile=\"0.99\"") &&
+          text.compare(text.size() - 6, 6, "# EOF\n") == 0);
+
+    second->unregisterMetrics();
+    text = registry.render();
+    check("unregistered client metrics removed",
+          !contains(text, "client=\"second\"") &&
+          contains(text, "client=\"first\""));
+}
+////////////////////////////////////////////////////////////////////////////////
+///  Tracing
+////////////////////////////////////////////////////////////////////////////////
+
+static void testTracing()
+{
+    using BfxAPI::Tracer;
+
+    auto fake = std::make_shared<FakeTransport>();
+    auto api = fakeClient(fake);
+    fake->setResponse("/order/status/", readFixture("order_status"));
+
+    Tracer::clear();
+    api->getOrderStatus(448364249).hasApiError();
+    check("no spans while tracing is disabled",
+          Tracer::toJson().find("\"name\"") == string::npos);
+
+    // Authenticated request lifecycle from nonce to validation
+    Tracer::enable(64);
+    api->getOrderStatus(448364249).hasApiError();
+    Tracer::disable();
+    const string json = Tracer::toJson();
+    bool spans = json.compare(0, 15, "{\"displayTimeUn") == 0;
+    for (const char *name : {"nonce", "payload_build", "authPost", "sign",
+                             "checkErrors"})
+        spans = spans && json.find(string("\"name\":\"") + name + "\"") !=
+                         string::npos;
+    check("spans of authenticated request", spans &&
+          json.find("\"detail\":\"/order/status/\"") != string::npos);
+    Tracer::clear();
+}
+////////////////////////////////////////////////////////////////////////////////
+///  Client moves
+////////////////////////////////////////////////////////////////////////////////
+
+static void testMoves()
+{
+    static_assert(std::is_nothrow_move_constructible<BitfinexAPI>::value &&
+                  std::is_nothrow_move_assignable<BitfinexAPI>::value,
+                  "BitfinexAPI moves must not throw");
+
+    auto deferred = std::make_shared<DeferredTransport>();
+    auto api = fakeClient(deferred);
+    deferred->setResponse("/pubticker/btcusd", readFixture("pubticker"));
+
+    BitfinexAPI::PreparedRequest request;
+    BitfinexAPI::AsyncResult result;
+    api->prepare([](BitfinexAPI &a) { a.getTicker("btcusd"); }, request,
+                 result);
+    unsigned completed = 0;
+    auto callback = [&](BitfinexAPI::AsyncResult &r)
+    {
+        result = r;
+        ++completed;
+    };
+
+    // Callback of request submitted before move completes on new client
+    api->submit(request, callback);
+    BitfinexAPI moved(std::move(*api));
+    moved.poll();
+    const BfxAPI::LatencyHistogram *total =
+    moved.getLatencies().find("/pubticker/", BfxAPI::Phase::total);
+    check("pending request completes on move-constructed client",
+          completed == 1 && !result.hasApiError() && total &&
+          total->count() == 1 && !moved.pending());
+
+    auto other = fakeClient(std::make_shared<FakeTransport>());
+    moved.submit(request, callback);
+    *other = std::move(moved);
+    other->poll();
+    check("pending request completes on move-assigned client",
+          completed == 2 && !result.hasApiError() &&
+          other->getLatencies().find("/pubticker/",
+                                     BfxAPI::Phase::total)->count() == 2);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///  Order batches
+////////////////////////////////////////////////////////////////////////////////
+
+// Answers /order/new/multi/ with an order per requested order, order id is
+// its price. Chunk with an order priced rejectedPrice gets HTTP 400, first
+// nonceRejections requests get "Nonce is too small".
+struct MultiOrderServer
+{
+    double rejectedPrice = -1;
+    unsigned nonceRejections = 0;
+    vector<size_t> chunkSizes;
+    vector<unsigned long long> nonces;
+
+    void operator () (BfxAPI::HttpExchange &exchange)
+    {
+        if (exchange.path != "/order/new/multi/")
+            return;
+
+        rj::Document request;
+        request.Parse(exchange.payload.c_str());
+        nonces.push_back(std::stoull(request["nonce"].GetString()));
+        exchange.httpCode = 400;
+        if (nonceRejections)
+        {
+            --nonceRejections;
+            exchange.response = "{\"message\":\"Nonce is too small.\"}";
+            return;
+        }
+
+        rj::Document order;
+        order.Parse(readFixture("order_new").c_str());
+        string response = "{\"order_ids\":[";
+        const auto &orders = request["payload"].GetArray();
+        chunkSizes.push_back(orders.Size());
+        for (const auto &requested : orders)
+        {
+            const double price = atof(requested["price"].GetString());
+            if (price == rejectedPrice)
+            {
+                exchange.response = "{\"message\":\"Invalid order\"}";
+                return;
+            }
+            order["id"].SetInt64(static_cast<int64_t>(price));
+            rj::StringBuffer buffer;
+            rj::Writer<rj::StringBuffer> writer(buffer);
+            order.Accept(writer);
+            if (&requested != orders.Begin())
+                response += ",";
+            response += buffer.GetString();
+        }
+        exchange.response = response + "],\"status\":\"success\"}";
+        exchange.httpCode = 200;
+    }
+};
+
+static void testOrderBatch()
+{
+    auto fake = std::make_shared<FakeTransport>();
+    auto api = fakeClient(fake);
+    auto server = std::make_shared<MultiOrderServer>();
+    fake->setHandler([server](BfxAPI::HttpExchange &e) { (*server)(e); });
+
+    // 25 valid orders priced 1..25, the 7th has unknown symbol
+    BitfinexAPI::vOrders orders;
+    for (int i = 1; i <= 26; ++i)
+        orders.push_back({i == 7 ? "xxxusd" : "btcusd", 0.01,
+                          static_cast<double>(i < 7 ? i : i - 1), "sell",
+                          "exchange limit"});
+
+    BfxAPI::OrderBatch batch(*api);
+    BfxAPI::BatchResult result = batch.place(orders);
+    bool placedInOrder = true;
+    for (size_t i = 0; i < orders.size(); ++i)
+        if (i != 6 && result.orders[i].order.id !=
+            static_cast<int64_t>(orders[i].price))
+            placedInOrder = false;
+    std::sort(server->chunkSizes.begin(), server->chunkSizes.end());
+    check("orders sent in chunks of max multi orders",
+          server->chunkSizes == vector<size_t>({5, 10, 10}));
+    check("placed orders match submitted orders",
+          !result.ok() && result.placed == 25 && result.failed == 1 &&
+          placedInOrder &&
+          result.orders[6].bfxApiStatusCode == BfxClientErrors::badSymbol);
+
+    server->chunkSizes.clear();
+    batch.setChunkSize(4);
+    result = batch.place(orders);
+    check("custom chunk size", server->chunkSizes.size() == 7 &&
+          result.placed == 25);
+    batch.setChunkSize(50);
+    check("chunk size clamped to max multi orders",
+          batch.getChunkSize() == BitfinexAPI::MAX_MULTI_ORDERS);
+
+    // Rejected chunk fails its orders only
+    batch.setChunkSize(10);
+    server->rejectedPrice = 12;
+    result = batch.place(orders);
+    bool rejectedChunkFailed = true;
+    for (size_t i = 11; i < 21; ++i)
+        if (result.orders[i].ok() || result.orders[i].httpStatusCode != 400)
+            rejectedChunkFailed = false;
+    check("rejected chunk fails its orders only",
+          result.placed == 15 && result.failed == 11 && rejectedChunkFailed &&
+          result.orders[0].ok() && result.orders[21].ok());
+
+    // Nonce rejected request is resent with fresh nonce
+    server->rejectedPrice = -1;
+    server->nonces.clear();
+    server->nonceRejections = 2;
+    result = batch.place({orders[0]});
+    check("nonce rejected request resent with fresh nonce",
+          result.ok() && server->nonces.size() == 3 &&
+          server->nonces[0] < server->nonces[1] &&
+          server->nonces[1] < server->nonces[2]);
+
+    server->nonces.clear();
+    server->nonceRejections = BitfinexAPI::NONCE_RETRIES + 1;
+    result = batch.place({orders[0]});
+    check("nonce resends limited",
+          result.failed == 1 && result.orders[0].httpStatusCode == 400 &&
+          server->nonces.size() == BitfinexAPI::NONCE_RETRIES + 1);
+}
+
+// Acknowledges /order/cancel/multi/, chunk with rejectedId gets HTTP 400
+struct CancelServer
+{
+    long long rejectedId = -1;
+    vector<size_t> chunkSizes;
+
+    void operator () (BfxAPI::HttpExchange &exchange)
+    {
+        if (exchange.path != "/order/cancel/multi/")
+            return;
+
+        rj::Document request;
+        request.Parse(exchange.payload.c_str());
+        const auto &ids = request["order_ids"].GetArray();
+        chunkSizes.push_back(ids.Size());
+        for (const auto &id : ids)
+            if (id.GetInt64() == rejectedId)
+            {
+                exchange.response = "{\"message\":\"Invalid order\"}";
+                exchange.httpCode = 400;
+                return;
+            }
+        exchange.response = readFixture("order_cancel_multi");
+        exchange.httpCode = 200;
+    }
+};
+
+static BitfinexAPI::vIds idRange(const long long &count)
+{
+    BitfinexAPI::vIds ids;
+    for (long long id = 1; id <= count; ++id)
+        ids.push_back(id);
+    return ids;
+}
+
+static void testCancelBatch()
+{
+    auto fake = std::make_shared<FakeTransport>();
+    auto api = fakeClient(fake);
+    auto server = std::make_shared<CancelServer>();
+    fake->setHandler([server](BfxAPI::HttpExchange &e) { (*server)(e); });
+
+    BfxAPI::CancelBatch batch(*api);
+    auto chunks = [&](const BitfinexAPI::vIds &ids)
+    {
+        server->chunkSizes.clear();
+        const BfxAPI::CancelResult result = batch.cancel(ids);
+        std::sort(server->chunkSizes.begin(), server->chunkSizes.end());
+        return result.ok() && result.acknowledged.size() == ids.size()
+               ? server->chunkSizes
+               : vector<size_t>();
+    };
+
+    check("few IDs sent in one request",
+          chunks(idRange(5)) == vector<size_t>({5}));
+    check("IDs spread evenly over chunks of min size",
+          chunks(idRange(25)) == vector<size_t>({7, 9, 9}));
+    check("IDs spread over max in flight requests",
+          chunks(idRange(200)) == vector<size_t>(8, 25));
+    check("more requests when chunks would exceed max size",
+          chunks(idRange(1000)) == vector<size_t>(10, 100));
+    batch.setMaxChunkSize(50);
+    check("custom max chunk size",
+          chunks(idRange(1000)) == vector<size_t>(20, 50));
+
+    server->chunkSizes.clear();
+    BfxAPI::CancelResult result = batch.cancel({3, 1, 3, 2, 1});
+    check("duplicate IDs cancelled once",
+          result.acknowledged.size() == 3 &&
+          server->chunkSizes == vector<size_t>({3}));
+    const size_t sent = fake->requests();
+    check("no request without IDs",
+          batch.cancel({}).ok() && fake->requests() == sent);
+
+    server->rejectedId = 13;
+    result = batch.cancel(idRange(25));
+    check("rejected chunk fails its IDs only",
+          result.failed.size() == 9 && result.acknowledged.size() == 16 &&
+          result.failed.front().httpStatusCode == 400 &&
+          std::any_of(result.failed.begin(), result.failed.end(),
+                      [](const BfxAPI::CancelFailure &f)
+                      { return f.id == 13; }));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+///  Order templates
+////////////////////////////////////////////////////////////////////////////////
+
+// Keeps header and payload of the last POST request
+class CapturingTransport: public FakeTransport
+{
+public:
+
+    Header header;
+    string payload;
+
+    void post(const string &url,
+              const Header &inHeader,
+              BfxAPI::HttpExchange &exchange) override
+    {
+        header = inHeader;
+        payload = exchange.payload;
+        FakeTransport::post(url, inHeader, exchange);
+    }
+};
+
+// Payload with nonce value removed
+static string withoutNonce(const string &payload)
+{
+    const string key = "\"nonce\":\"";
+    const size_t first = payload.find(key);
+    if (first == string::npos)
+        return payload;
+    const size_t value = first + key.size();
+    return payload.substr(0, value) +
+           payload.substr(payload.find('"', value));
+}
+
+static void testOrderTemplate()
+{
+    auto capturing = std::make_shared<CapturingTransport>();
+    auto api = fakeClient(capturing);
+    capturing->setResponse("/order/new/", readFixture("order_new"));
+    capturing->setResponse("/order/cancel/replace/",
+                           readFixture("order_cancel_replace"));
+
+    api->newOrder("btcusd", 0.0125, 983.5, "sell", "exchange limit", true,
+                  true, false, true, 1.5);
+    const string expected = capturing->payload;
+    auto order = BfxAPI::OrderTemplate::newOrder(*api, "btcusd", "sell",
+                                                 "exchange limit", true, true,
+                                                 false, true, 1.5);
+    const BfxClientErrors status = order.send(0.0125, 983.5);
+    check("template order payload equals newOrder() payload",
+          status == noError && !expected.empty() &&
+          withoutNonce(capturing->payload) == withoutNonce(expected) &&
+          capturing->payload != expected);
+
+    string encoded;
+    BfxAPI::HTTPRequest::appendBase64(capturing->payload.data(),
+                                      capturing->payload.size(), encoded);
+    check("template order header signs its payload",
+          capturing->header["X-BFX-APIKEY"] == "fake-access-key" &&
+          capturing->header["X-BFX-PAYLOAD"] == encoded &&
+          capturing->header["X-BFX-SIGNATURE"] ==
+          BfxAPI::HmacSigner("fake-secret-key").sign(encoded));
+
+    api->replaceOrder(448364249, "btcusd", 0.02, 990, "buy", "exchange limit",
+                      false, true);
+    const string replaced = capturing->payload;
+    auto replace = BfxAPI::OrderTemplate::replaceOrder(*api, "btcusd", "buy",
+                                                       "exchange limit",
+                                                       false, true);
+    replace.send(0.02, 990, 448364249);
+    check("template replace payload equals replaceOrder() payload",
+          !replaced.empty() &&
+          withoutNonce(capturing->payload) == withoutNonce(replaced));
+
+    auto invalid = BfxAPI::OrderTemplate::newOrder(*api, "xxxusd", "sell",
+                                                   "exchange limit");
+    const size_t sent = capturing->requests();
+    check("invalid template not sent",
+          invalid.send(1, 1) == BfxClientErrors::badSymbol &&
+          capturing->requests() == sent);
+}
+
+int main(int argc, char *argv[])
+{
+    cout << "Starting offline unit tests" << endl << endl;
+
+    testRing<BfxAPI::SpscRing<int>>("SpscRing");
+    testRing<BfxAPI::MpscRing<int>>("MpscRing");
+    testMpscProducers();
+    testBookDeltas();
+    testRateLimiter();
+    testOrderCache();
+    testObserverRemoval();
+    testTickStore();
+    testCoalescing();
+    testResponseCache();
+    testRetries();
+    testLatencies();
+    testMetrics();
+    testTracing();
+    testMoves();
+    testOrderBatch();
+    testCancelBatch();
+    testOrderTemplate();
+
+    cout << endl << failures << " failed" << endl;
+    return failures;
+}
@@ -0,0 +1,182 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  uringbench.cpp
+//
+//
+//  Bitfinex REST API C++ client - transport benchmark
+//
+//
+//  Compares CurlTransport and UringTransport on loopback against mockserver.
+//  Every transport runs the same number of public GET requests, blocking
+//  (one at a time) and asynchronous (N requests in flight), and reports
+//  throughput, CPU time and context switches per request.
+//
+//  ./mockserver --port 8080 &
+//  ./uringbench --url http://127.0.0.1:8080/v1 --requests 20000 --inflight 32
+//
+////////////////////////////////////////////////////////////////////////////////
+
+// std
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+
+// POSIX
+#include <sys/resource.h>
+
+// BitfinexAPI
+#include "bfx-api-cpp/HTTPRequest.hpp"
+#include "bfx-api-cpp/UringTransport.hpp"
+
+
+// namespaces
+using std::cerr;
+using std::endl;
+using std::function;
+using std::string;
+using BfxAPI::HTTPRequest;
+using BfxAPI::HttpExchange;
+using BfxAPI::Transport;
+
+struct Config
+{
+    string url = "http://127.0.0.1:8080/v1";
+    string path = "/pubticker/btcusd";
+    unsigned requests = 20000;
+    unsigned inflight = 32;
+};
+
+struct Usage
+{
+    double wall;    // s
+    double cpu;     // s, user + system
+    long switches;  // voluntary + involuntary
+    unsigned errors;
+};
+
+static void usage(const char *name)
+{
+    cerr << "Usage: " << name << " [--url URL] [--path PATH] [--requests N]"
+    " [--inflight N]" << endl;
+}
+
+static Usage measure(const function<unsigned()> &run)
+{
+    auto snapshot = [](double &cpu, long &switches)
+    {
+        rusage r;
+        getrusage(RUSAGE_SELF, &r);
+        cpu = r.ru_utime.tv_sec + r.ru_utime.tv_usec / 1e6 +
+        r.ru_stime.tv_sec + r.ru_stime.tv_usec / 1e6;
+        switches = r.ru_nvcsw + r.ru_nivcsw;
+    };
+
+    double cpu0, cpu1;
+    long switches0, switches1;
+    snapshot(cpu0, switches0);
+    const int64_t start = BfxAPI::steadyNowNs();
+    const unsigned errors = run();
+    const int64_t end = BfxAPI::steadyNowNs();
+    snapshot(cpu1, switches1);
+    return {(end - start) / 1e9, cpu1 - cpu0, switches1 - switches0, errors};
+}
+
+static unsigned runBlocking(HTTPRequest &request, const Config &config)
+{
+    unsigned errors = 0;
+    for (unsigned i = 0; i < config.requests; ++i)
+    {
+        request.get(config.path);
+        if (request.hasError() || request.getLastHttpCode() != 200)
+            ++errors;
+    }
+    return errors;
+}
+
+static unsigned runAsync(HTTPRequest &request, const Config &config)
+{
+    unsigned submitted = 0, completed = 0, errors = 0;
+    function<void(HttpExchange&)> done = [&](HttpExchange &exchange)
+    {
+        ++completed;
+        if (exchange.curlCode != CURLE_OK || exchange.httpCode != 200)
+            ++errors;
+    };
+
+    while (completed < config.requests)
+    {
+        while (submitted < config.requests &&
+               submitted - completed < config.inflight)
+        {
+            request.submitGet(config.path, {}, done);
+            ++submitted;
+        }
+        request.poll(std::chrono::milliseconds(100));
+    }
+    return errors;
+}
+
+static void report(const char *name, const char *mode, const Config &config,
+                   const Usage &u)
+{
+    printf("%-6s %-6s %10.0f %12.2f %12.3f %8u\n", name, mode,
+           config.requests / u.wall, u.cpu * 1e6 / config.requests,
+           static_cast<double>(u.switches) / config.requests, u.errors);
+}
+
+
+int main(int argc, char *argv[])
+{
+    Config config;
+    for (int i = 1; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if (i + 1 >= argc)
+        { usage(argv[0]); return 1; }
+        if (arg == "--url")
+            config.url = argv[++i];
+        else if (arg == "--path")
+            config.path = argv[++i];
+        else if (arg == "--requests")
+            config.requests = atoi(argv[++i]);
+        else if (arg == "--inflight")
+            config.inflight = atoi(argv[++i]);
+        else
+        { usage(argv[0]); return 1; }
+    }
+
+    printf("%u requests of %s%s, %u in flight in async mode\n\n",
+           config.requests, config.url.c_str(), config.path.c_str(),
+           config.inflight);
+    printf("%-6s %-6s %10s %12s %12s %8s\n", "transport", "", "req/s",
+           "cpu us/req", "ctxsw/req", "errors");
+
+    struct Candidate
+    {
+        const char *name;
+        function<std::shared_ptr<Transport>()> make;
+    };
+    const Candidate candidates[] =
+    {
+        {"curl", [] { return std::make_shared<BfxAPI::CurlTransport>(); }},
+        {"uring", [&config]
+         { return std::make_shared<BfxAPI::UringTransport>(config.inflight); }}
+    };
+
+    for (const auto &candidate : candidates)
+    {
+        HTTPRequest request(config.url, candidate.make());
+        // Warm up connections
+        request.get(config.path);
+
+        report(candidate.name, "block", config,
+               measure([&] { return runBlocking(request, config); }));
+        report(candidate.name, "async", config,
+               measure([&] { return runAsync(request, config); }));
+    }
+    return 0;
+}